@@ -6,6 +6,7 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/PortalFrustum.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -49,6 +50,9 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Bounding box of the geometry in local space.
+	BoundingBox Bounds;
 };
 
 enum class RenderLayer : int
@@ -87,6 +91,7 @@ private:
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateReflectedPassCB(const GameTimer& gt);
+	void UpdateMirrorPortal();
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -133,6 +138,11 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// Frustum through the visible part of the mirror and the reflected items
+	// that can be seen through it.
+	PortalFrustum mMirrorPortal;
+	std::vector<RenderItem*> mVisibleReflectedRitems;
+
     PassConstants mMainPassCB;
 	PassConstants mReflectedPassCB;
 
@@ -250,6 +260,7 @@ void StencilApp::Update(const GameTimer& gt)
 	UpdateMaterialCBs(gt);
 	UpdateMainPassCB(gt);
 	UpdateReflectedPassCB(gt);
+	UpdateMirrorPortal();
 }
 
 void StencilApp::Draw(const GameTimer& gt)
@@ -290,20 +301,29 @@ void StencilApp::Draw(const GameTimer& gt)
 	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
 	
-	// Mark the visible mirror pixels in the stencil buffer with the value 1
-	mCommandList->OMSetStencilRef(1);
-	mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Mirrors]);
-
-	// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
-	// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
-	mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Reflected]);
-
-	// Restore main pass constants and stencil ref.
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
-	mCommandList->OMSetStencilRef(0);
+	// The reflection pass is skipped entirely when the mirror is off screen, and
+	// otherwise limited to the part of the screen the mirror covers.
+	if(mMirrorPortal.IsVisible())
+	{
+		D3D12_RECT mirrorRect = mMirrorPortal.ScreenRect(mClientWidth, mClientHeight);
+		mCommandList->RSSetScissorRects(1, &mirrorRect);
+
+		// Mark the visible mirror pixels in the stencil buffer with the value 1
+		mCommandList->OMSetStencilRef(1);
+		mCommandList->SetPipelineState(mPSOs["markStencilMirrors"].Get());
+		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Mirrors]);
+
+		// Draw the reflection into the mirror only (only for pixels where the stencil buffer is 1).
+		// Note that we must supply a different per-pass constant buffer--one with the lights reflected.
+		mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress() + 1 * passCBByteSize);
+		mCommandList->SetPipelineState(mPSOs["drawStencilReflections"].Get());
+		DrawRenderItems(mCommandList.Get(), mVisibleReflectedRitems);
+
+		// Restore main pass constants, stencil ref and scissor rect.
+		mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+		mCommandList->OMSetStencilRef(0);
+		mCommandList->RSSetScissorRects(1, &mScissorRect);
+	}
 
 	// Draw mirror with transparency so reflection blends through.
 	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
@@ -554,6 +574,39 @@ void StencilApp::UpdateReflectedPassCB(const GameTimer& gt)
 	currPassCB->CopyData(1, mReflectedPassCB);
 }
 
+void StencilApp::UpdateMirrorPortal()
+{
+	// The mirror quad in world space, clockwise seen from the front (see BuildRoomGeometry).
+	const XMFLOAT3 mirrorQuad[4] =
+	{
+		XMFLOAT3(-2.5f, 0.0f, 0.0f),
+		XMFLOAT3(-2.5f, 4.0f, 0.0f),
+		XMFLOAT3(+2.5f, 4.0f, 0.0f),
+		XMFLOAT3(+2.5f, 0.0f, 0.0f)
+	};
+
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX proj = XMLoadFloat4x4(&mProj);
+	XMVECTOR eyePos = XMLoadFloat3(&mEyePos);
+
+	mMirrorPortal.Build(mirrorQuad, 4, XMMatrixMultiply(view, proj), eyePos);
+
+	// The reflected items are placed behind the mirror, so they are culled
+	// directly against the frustum through the mirror.
+	mVisibleReflectedRitems.clear();
+	if(mMirrorPortal.IsVisible())
+	{
+		for(auto ri : mRitemLayer[(int)RenderLayer::Reflected])
+		{
+			BoundingBox worldBounds;
+			ri->Bounds.Transform(worldBounds, XMLoadFloat4x4(&ri->World));
+
+			if(mMirrorPortal.Intersects(worldBounds))
+				mVisibleReflectedRitems.push_back(ri);
+		}
+	}
+}
+
 void StencilApp::LoadTextures()
 {
 	auto bricksTex = std::make_unique<Texture>();
@@ -890,6 +943,7 @@ void StencilApp::BuildSkullGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["skull"] = submesh;
 
@@ -1132,6 +1186,7 @@ void StencilApp::BuildRenderItems()
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
 	mSkullRitem = skullRitem.get();
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(skullRitem.get());
 
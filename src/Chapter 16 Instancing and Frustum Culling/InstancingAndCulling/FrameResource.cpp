@@ -1,6 +1,7 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT maxInstanceCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT maxInstanceCount, UINT materialCount,
+    UINT maxClusteredLightCount, UINT clusterCount, UINT maxClusterLightIndexCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -9,9 +10,39 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT maxInsta
     PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
     MaterialBuffer = std::make_unique<UploadBuffer<MaterialData>>(device, materialCount, false);
 	InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, maxInstanceCount, false);
+
+	if(maxClusteredLightCount > 0 && clusterCount > 0 && maxClusterLightIndexCount > 0)
+	{
+		ClusteredLightBuffer = std::make_unique<UploadBuffer<Light>>(device, maxClusteredLightCount, false);
+		ClusterRangeBuffer = std::make_unique<UploadBuffer<DirectX::XMUINT2>>(device, clusterCount, false);
+		ClusterLightIndexBuffer = std::make_unique<UploadBuffer<UINT>>(device, maxClusterLightIndexCount, false);
+	}
 }
 
 FrameResource::~FrameResource()
 {
 
+}
+
+InstanceData PackInstanceData(DirectX::FXMMATRIX world, DirectX::CXMMATRIX texTransform, UINT materialIndex)
+{
+	using namespace DirectX;
+
+	assert(materialIndex <= 0xffff);
+
+	InstanceData data;
+
+	XMMATRIX worldT = XMMatrixTranspose(world);
+	XMStoreFloat4(&data.World[0], worldT.r[0]);
+	XMStoreFloat4(&data.World[1], worldT.r[1]);
+	XMStoreFloat4(&data.World[2], worldT.r[2]);
+
+	XMFLOAT4X4 tex;
+	XMStoreFloat4x4(&tex, texTransform);
+	data.TexScaleOffset = PackedVector::XMHALF4(tex._11, tex._22, tex._41, tex._42);
+
+	data.MaterialIndex = materialIndex;
+	data.InstancePad0 = 0;
+
+	return data;
 }
\ No newline at end of file
@@ -4,16 +4,24 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 
+// Compact per instance data, 64 bytes instead of two full matrices.
 struct InstanceData
 {
-	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
-	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	// First three rows of the transposed world matrix.  The world matrix is
+	// affine, so the fourth row of the transpose is always (0, 0, 0, 1).
+	DirectX::XMFLOAT4 World[3];
+
+	// Texture transform reduced to scale (x, y) and offset (z, w), as half floats.
+	DirectX::PackedVector::XMHALF4 TexScaleOffset;
+
+	// Material index in the low 16 bits; the high 16 bits are free for flags.
 	UINT MaterialIndex;
 	UINT InstancePad0;
-	UINT InstancePad1;
-	UINT InstancePad2;
 };
 
+// Pack an instance.  Only the scale and translation of texTransform are kept.
+InstanceData PackInstanceData(DirectX::FXMMATRIX world, DirectX::CXMMATRIX texTransform, UINT materialIndex);
+
 struct PassConstants
 {
     DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
@@ -38,6 +46,12 @@ struct PassConstants
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light Lights[MaxLights];
+
+    // Clustered point and spot lights: the grid size in tiles and slices, and
+    // the slice of view depth z is log(z)*ClusterSliceScale + ClusterSliceBias.
+    DirectX::XMUINT3 ClusterCounts = { 1, 1, 1 };
+    float ClusterSliceScale = 0.0f;
+    float ClusterSliceBias = 0.0f;
 };
 
 struct MaterialData
@@ -68,7 +82,8 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT maxInstanceCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT maxInstanceCount, UINT materialCount,
+        UINT maxClusteredLightCount = 0, UINT clusterCount = 0, UINT maxClusterLightIndexCount = 0);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -93,6 +108,13 @@ public:
 	// create a structured buffer large enough to store the instance data for 1000 instances.  
     std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
 
+	// Clustered lights: the lights, one (offset, count) range per cluster, and
+	// the light index list the ranges point into.  Only created if the
+	// counts are nonzero.
+	std::unique_ptr<UploadBuffer<Light>> ClusteredLightBuffer = nullptr;
+	std::unique_ptr<UploadBuffer<DirectX::XMUINT2>> ClusterRangeBuffer = nullptr;
+	std::unique_ptr<UploadBuffer<UINT>> ClusterLightIndexBuffer = nullptr;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
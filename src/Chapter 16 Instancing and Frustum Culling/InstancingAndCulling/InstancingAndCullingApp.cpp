@@ -7,7 +7,15 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/Bvh.h"
+#include "../../Common/OcclusionCuller.h"
+#include "../../Common/VisibilityCache.h"
+#include "../../Common/LodGroup.h"
+#include "../../Common/LightClusters.h"
+#include "../../Common/Profiler.h"
 #include "FrameResource.h"
+#include <chrono>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -18,6 +26,40 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// The skull instances are laid out on an n x n x n grid.  With the BVH the
+// culling cost follows the number of visible instances, so the grid can be
+// set on the command line, e.g., "-grid 100" for one million instances, to
+// stress test the culling.  The caption shows the BVH build and cull times.
+const int gDefaultInstanceGridDim = 5;
+const int gMaxInstanceGridDim = 100;
+
+int ParseInstanceGridDim(const char* cmdLine)
+{
+	const char* arg = strstr(cmdLine, "-grid");
+	if(arg == nullptr)
+		return gDefaultInstanceGridDim;
+
+	return MathHelper::Clamp(atoi(arg + 5), 2, gMaxInstanceGridDim);
+}
+
+// Point and spot lights moving through the grid, culled into clusters of 16x9
+// tiles by 24 depth slices.  The light index buffer holds up to
+// gMaxClusterLightIndices (cluster, light) pairs.
+const UINT gClusteredLightCount = 1024;
+const UINT gClusterTilesX = 16;
+const UINT gClusterTilesY = 9;
+const UINT gClusterSlices = 24;
+const UINT gMaxClusterLightIndices = 256*1024;
+
+// An instance as authored.  It is packed into the compact InstanceData layout
+// for the GPU.
+struct Instance
+{
+	XMFLOAT4X4 World = MathHelper::Identity4x4();
+	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	UINT MaterialIndex = 0;
+};
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -48,7 +90,34 @@ struct RenderItem
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
 	BoundingBox Bounds;
-	std::vector<InstanceData> Instances;
+	std::vector<Instance> Instances;
+
+	// The instances in GPU layout.  The instances do not move, so they are packed
+	// (and their matrices transposed) once instead of every frame.
+	std::vector<InstanceData> PackedInstances;
+
+	// World space bounds of the instances, precomputed once since the instances
+	// do not move, and the indices of the instances that survived culling.
+	// The flat culler tests every instance, the BVH skips whole subtrees and
+	// the visibility cache reuses last frame's results while the camera is still.
+	std::vector<BoundingBox> InstanceWorldBounds;
+	FrustumCuller InstanceCuller;
+	Bvh InstanceBvh;
+	VisibilityCache InstanceVisibility;
+	std::vector<UINT> VisibleInstances;
+
+	// Detail levels, and per instance the world space bounding sphere that gives
+	// its screen size and its current level.  The visible instances are written
+	// to the instance buffer grouped by level and every level is drawn with its
+	// own instanced draw call.
+	LodGroup Lods;
+	std::vector<BoundingSphere> InstanceWorldSpheres;
+	std::vector<BYTE> InstanceLods;
+	std::vector<UINT> LodSortedInstances;
+	UINT LodInstanceCounts[LodGroup::MaxLevels] = { 0 };
+
+	// Offset of the render item's instances in the instance buffer.
+	UINT BaseInstance = 0;
 
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
@@ -57,10 +126,27 @@ struct RenderItem
     int BaseVertexLocation = 0;
 };
 
+// A clustered light circling around a fixed center.
+struct AnimatedLight
+{
+	Light Params;
+	XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+	float OrbitRadius = 0.0f;
+	float OrbitSpeed = 0.0f;
+	float OrbitPhase = 0.0f;
+};
+
+enum class CullingMethod : int
+{
+	Bvh = 0,
+	Simd,
+	TemporalCache
+};
+
 class InstancingAndCullingApp : public D3DApp
 {
 public:
-    InstancingAndCullingApp(HINSTANCE hInstance);
+    InstancingAndCullingApp(HINSTANCE hInstance, int instanceGridDim);
     InstancingAndCullingApp(const InstancingAndCullingApp& rhs) = delete;
     InstancingAndCullingApp& operator=(const InstancingAndCullingApp& rhs) = delete;
     ~InstancingAndCullingApp();
@@ -79,6 +165,8 @@ private:
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateInstanceData(const GameTimer& gt);
+	void RenderOccluders();
+	void UpdateClusteredLights(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 
@@ -91,6 +179,8 @@ private:
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
+	void BuildOccluders();
+	void BuildClusteredLights();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
@@ -121,11 +211,32 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mOpaqueRitems;
 
+	int mInstanceGridDim = gDefaultInstanceGridDim;
 	UINT mInstanceCount = 0;
+	float mBvhBuildMs = 0.0f;
 
 	bool mFrustumCullingEnabled = true;
+	CullingMethod mCullingMethod = CullingMethod::Bvh;
+	bool mOcclusionCullingEnabled = true;
+	bool mLodEnabled = true;
+
+	// The instances nearest to the camera occlude the others through a box
+	// proxy scaled down to fit inside the skull.
+	static const UINT MaxOccluders = 16;
+	const float OccluderProxyScale = 0.35f;
+
+	OcclusionCuller mOcclusionCuller;
+	UINT mOccluderProxyMesh = 0;
 
-	BoundingFrustum mCamFrustum;
+	// Reused every frame to pick the occluders among the visible instances.
+	std::vector<std::pair<float, UINT>> mOccluderCandidates;
+
+	// The lights are culled on the CPU into per cluster light lists the pixel
+	// shader reads; disabling leaves every cluster empty.
+	bool mClusteredLightsEnabled = true;
+	LightClusters mLightClusters;
+	std::vector<AnimatedLight> mAnimatedLights;
+	std::vector<LightClusters::LightBounds> mLightBounds;
 
     PassConstants mMainPassCB;
 
@@ -144,7 +255,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 
     try
     {
-        InstancingAndCullingApp theApp(hInstance);
+        InstancingAndCullingApp theApp(hInstance, ParseInstanceGridDim(cmdLine));
         if(!theApp.Initialize())
             return 0;
 
@@ -157,9 +268,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
     }
 }
 
-InstancingAndCullingApp::InstancingAndCullingApp(HINSTANCE hInstance)
-    : D3DApp(hInstance)
+InstancingAndCullingApp::InstancingAndCullingApp(HINSTANCE hInstance, int instanceGridDim)
+    : D3DApp(hInstance), mInstanceGridDim(instanceGridDim)
 {
+	// OnResize() sets the projection, so the grid must be sized before.
+	mLightClusters.SetGrid(gClusterTilesX, gClusterTilesY, gClusterSlices, gMaxClusterLightIndices);
 }
 
 InstancingAndCullingApp::~InstancingAndCullingApp()
@@ -189,6 +302,8 @@ bool InstancingAndCullingApp::Initialize()
 	BuildSkullGeometry();
 	BuildMaterials();
     BuildRenderItems();
+	BuildOccluders();
+	BuildClusteredLights();
     BuildFrameResources();
     BuildPSOs();
 
@@ -208,8 +323,10 @@ void InstancingAndCullingApp::OnResize()
     D3DApp::OnResize();
 
 	mCamera.SetLens(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+	mLightClusters.SetProjection(mCamera.GetFovY(), mCamera.GetAspect(), mCamera.GetNearZ(), mCamera.GetFarZ());
 
-	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
+	// Occlusion only needs a coarse depth buffer.
+	mOcclusionCuller.Resize(mClientWidth / 4, mClientHeight / 4);
 }
 
 void InstancingAndCullingApp::Update(const GameTimer& gt)
@@ -232,6 +349,7 @@ void InstancingAndCullingApp::Update(const GameTimer& gt)
 
 	AnimateMaterials(gt);
 	UpdateInstanceData(gt);
+	UpdateClusteredLights(gt);
 	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
 }
@@ -278,6 +396,14 @@ void InstancingAndCullingApp::Draw(const GameTimer& gt)
 	// Bind all the textures used in this scene.
 	mCommandList->SetGraphicsRootDescriptorTable(3, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
+	// Bind the clustered lights and their per cluster lists.
+	mCommandList->SetGraphicsRootShaderResourceView(4,
+		mCurrFrameResource->ClusteredLightBuffer->Resource()->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(5,
+		mCurrFrameResource->ClusterRangeBuffer->Resource()->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(6,
+		mCurrFrameResource->ClusterLightIndexBuffer->Resource()->GetGPUVirtualAddress());
+
     DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
 
     // Indicate a state transition on the resource usage.
@@ -355,6 +481,33 @@ void InstancingAndCullingApp::OnKeyboardInput(const GameTimer& gt)
 	if(GetAsyncKeyState('2') & 0x8000)
 		mFrustumCullingEnabled = false;
 
+	if(GetAsyncKeyState('3') & 0x8000)
+		mCullingMethod = CullingMethod::Bvh;
+
+	if(GetAsyncKeyState('4') & 0x8000)
+		mCullingMethod = CullingMethod::Simd;
+
+	if(GetAsyncKeyState('7') & 0x8000)
+		mCullingMethod = CullingMethod::TemporalCache;
+
+	if(GetAsyncKeyState('5') & 0x8000)
+		mOcclusionCullingEnabled = true;
+
+	if(GetAsyncKeyState('6') & 0x8000)
+		mOcclusionCullingEnabled = false;
+
+	if(GetAsyncKeyState('8') & 0x8000)
+		mLodEnabled = true;
+
+	if(GetAsyncKeyState('9') & 0x8000)
+		mLodEnabled = false;
+
+	if(GetAsyncKeyState('L') & 0x8000)
+		mClusteredLightsEnabled = true;
+
+	if(GetAsyncKeyState('K') & 0x8000)
+		mClusteredLightsEnabled = false;
+
 	mCamera.UpdateViewMatrix();
 }
  
@@ -365,54 +518,181 @@ void InstancingAndCullingApp::AnimateMaterials(const GameTimer& gt)
 
 void InstancingAndCullingApp::UpdateInstanceData(const GameTimer& gt)
 {
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	PROFILE_SCOPE("InstancingAndCullingApp::UpdateInstanceData");
 
-	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+	// World space planes are only re-extracted when the camera changed.
+	const auto& frustumPlanes = mCamera.GetFrustumPlanes();
+
+	auto cullStart = std::chrono::high_resolution_clock::now();
 	for(auto& e : mAllRitems)
 	{
-		const auto& instanceData = e->Instances;
-
-		int visibleInstanceCount = 0;
+		UINT visibleInstanceCount = 0;
 
-		for(UINT i = 0; i < (UINT)instanceData.size(); ++i)
+		if(mFrustumCullingEnabled && mCullingMethod == CullingMethod::Bvh)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
+			visibleInstanceCount = e->InstanceBvh.QueryFrustum(frustumPlanes, e->VisibleInstances.data());
+		}
+		else if(mFrustumCullingEnabled && mCullingMethod == CullingMethod::Simd)
+		{
+			visibleInstanceCount = e->InstanceCuller.Cull(frustumPlanes, e->VisibleInstances.data());
+		}
+		else if(mFrustumCullingEnabled && mCullingMethod == CullingMethod::TemporalCache)
+		{
+			visibleInstanceCount = e->InstanceVisibility.Cull(frustumPlanes, mCamera.GetPosition(),
+				e->VisibleInstances.data());
+		}
+		else
+		{
+			for(UINT i = 0; i < (UINT)e->Instances.size(); ++i)
+				e->VisibleInstances[i] = i;
 
-			XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+			visibleInstanceCount = (UINT)e->Instances.size();
+		}
 
-			// View space to the object's local space.
-			XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
- 
-			// Transform the camera frustum from view space to the object's local space.
-			BoundingFrustum localSpaceFrustum;
-			mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+		e->InstanceCount = visibleInstanceCount;
+	}
+	auto cullEnd = std::chrono::high_resolution_clock::now();
+	const float cullMs = std::chrono::duration<float, std::milli>(cullEnd - cullStart).count();
 
-			// Perform the box/frustum intersection test in local space.
-			if((localSpaceFrustum.Contains(e->Bounds) != DirectX::DISJOINT) || (mFrustumCullingEnabled==false))
-			{
-				InstanceData data;
-				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
-				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
-				data.MaterialIndex = instanceData[i].MaterialIndex;
+	// Occluders from every render item must be in the depth buffer before
+	// any render item is tested against it.
+	if(mFrustumCullingEnabled && mOcclusionCullingEnabled)
+	{
+		RenderOccluders();
 
-				// Write the instance data to structured buffer for the visible objects.
-				currInstanceBuffer->CopyData(visibleInstanceCount++, data);
-			}
+		for(auto& e : mAllRitems)
+		{
+			e->InstanceCount = mOcclusionCuller.CullBoxes(e->InstanceWorldBounds.data(),
+				e->VisibleInstances.data(), e->InstanceCount);
 		}
+	}
 
-		e->InstanceCount = visibleInstanceCount;
+	// Group the visible instances by detail level.
+	const float pixelScale = LodGroup::PixelScale(mCamera.GetProj(), (float)mClientHeight);
+	for(auto& e : mAllRitems)
+	{
+		if(mLodEnabled)
+		{
+			e->Lods.Select(e->VisibleInstances.data(), e->InstanceCount, e->InstanceWorldSpheres.data(),
+				mCamera.GetPosition(), pixelScale, e->InstanceLods.data(),
+				e->LodSortedInstances.data(), e->LodInstanceCounts);
+		}
+		else
+		{
+			std::copy(e->VisibleInstances.begin(), e->VisibleInstances.begin() + e->InstanceCount,
+				e->LodSortedInstances.begin());
+			std::fill(std::begin(e->LodInstanceCounts), std::end(e->LodInstanceCounts), 0);
+			e->LodInstanceCounts[0] = e->InstanceCount;
+		}
+	}
+
+	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+	for(auto& e : mAllRitems)
+	{
+		const auto& instanceData = e->PackedInstances;
+
+		// Write the instance data to structured buffer for the visible objects.
+		for(UINT v = 0; v < e->InstanceCount; ++v)
+			currInstanceBuffer->CopyData(e->BaseInstance + v, instanceData[e->LodSortedInstances[v]]);
+
+		const auto& occlusionStats = mOcclusionCuller.GetStats();
 
 		std::wostringstream outs;
 		outs.precision(6);
 		outs << L"Instancing and Culling Demo" <<
 			L"    " << e->InstanceCount <<
-			L" objects visible out of " << e->Instances.size();
+			L" objects visible out of " << e->Instances.size() <<
+			L"    frustum cull " << cullMs << L" ms (BVH build " << mBvhBuildMs << L" ms)" <<
+			L"    occlusion culled " << occlusionStats.CulledCount <<
+			L" of " << occlusionStats.TestedCount <<
+			L"    per LOD";
+		for(UINT l = 0; l < e->Lods.LevelCount(); ++l)
+			outs << L" " << e->LodInstanceCounts[l];
 		mMainWndCaption = outs.str();
 	}
 }
 
+void InstancingAndCullingApp::UpdateClusteredLights(const GameTimer& gt)
+{
+	const float t = gt.TotalTime();
+
+	auto currLightBuffer = mCurrFrameResource->ClusteredLightBuffer.get();
+	for(UINT i = 0; i < (UINT)mAnimatedLights.size(); ++i)
+	{
+		AnimatedLight& l = mAnimatedLights[i];
+
+		float angle = l.OrbitSpeed*t + l.OrbitPhase;
+		l.Params.Position.x = l.Center.x + l.OrbitRadius*cosf(angle);
+		l.Params.Position.y = l.Center.y + 0.5f*l.OrbitRadius*sinf(2.0f*angle);
+		l.Params.Position.z = l.Center.z + l.OrbitRadius*sinf(angle);
+
+		mLightBounds[i].Position = l.Params.Position;
+		currLightBuffer->CopyData(i, l.Params);
+	}
+
+	UINT lightCount = mClusteredLightsEnabled ? (UINT)mLightBounds.size() : 0;
+	mLightClusters.Build(mCamera.GetView(), mLightBounds.data(), lightCount);
+
+	const auto& ranges = mLightClusters.ClusterRanges();
+	const auto& indices = mLightClusters.LightIndices();
+	const auto& stats = mLightClusters.GetStats();
+
+	auto currRangeBuffer = mCurrFrameResource->ClusterRangeBuffer.get();
+	for(UINT c = 0; c < (UINT)ranges.size(); ++c)
+		currRangeBuffer->CopyData(c, ranges[c]);
+
+	auto currIndexBuffer = mCurrFrameResource->ClusterLightIndexBuffer.get();
+	for(UINT i = 0; i < stats.IndexCount; ++i)
+		currIndexBuffer->CopyData(i, indices[i]);
+
+	std::wostringstream outs;
+	outs.precision(3);
+	outs << L"    lights " << stats.VisibleLightCount << L" of " << stats.LightCount <<
+		L" in " << stats.IndexCount << L" cluster slots (max " << stats.MaxClusterLightCount <<
+		L") " << stats.BuildMs << L" ms";
+	mMainWndCaption += outs.str();
+}
+
+void InstancingAndCullingApp::RenderOccluders()
+{
+	XMVECTOR eyePos = mCamera.GetPosition();
+
+	mOcclusionCuller.BeginFrame(XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj()));
+
+	for(auto& e : mAllRitems)
+	{
+		// Use the visible instances nearest to the camera as occluders.
+		auto& candidates = mOccluderCandidates;
+		candidates.resize(e->InstanceCount);
+		for(UINT v = 0; v < e->InstanceCount; ++v)
+		{
+			UINT i = e->VisibleInstances[v];
+			XMVECTOR center = XMLoadFloat3(&e->InstanceWorldBounds[i].Center);
+			candidates[v] = { XMVectorGetX(XMVector3LengthSq(center - eyePos)), i };
+		}
+
+		UINT occluderCount = MathHelper::Min(MaxOccluders, e->InstanceCount);
+		std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end());
+
+		// The unit box proxy is scaled to a fraction of the local bounds so that
+		// it stays inside the mesh.
+		XMMATRIX proxyToLocal =
+			XMMatrixScaling(
+				2.0f*OccluderProxyScale*e->Bounds.Extents.x,
+				2.0f*OccluderProxyScale*e->Bounds.Extents.y,
+				2.0f*OccluderProxyScale*e->Bounds.Extents.z) *
+			XMMatrixTranslation(e->Bounds.Center.x, e->Bounds.Center.y, e->Bounds.Center.z);
+
+		for(UINT k = 0; k < occluderCount; ++k)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&e->Instances[candidates[k].second].World);
+			mOcclusionCuller.SubmitOccluder(mOccluderProxyMesh, proxyToLocal*world);
+		}
+	}
+
+	mOcclusionCuller.RenderOccluders();
+}
+
 void InstancingAndCullingApp::UpdateMaterialBuffer(const GameTimer& gt)
 {
 	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
@@ -471,6 +751,11 @@ void InstancingAndCullingApp::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
 	mMainPassCB.Lights[2].Strength = { 0.2f, 0.2f, 0.2f };
 
+	XMFLOAT2 sliceScaleBias = mLightClusters.SliceScaleBias();
+	mMainPassCB.ClusterCounts = XMUINT3(mLightClusters.TilesX(), mLightClusters.TilesY(), mLightClusters.SliceCount());
+	mMainPassCB.ClusterSliceScale = sliceScaleBias.x;
+	mMainPassCB.ClusterSliceBias = sliceScaleBias.y;
+
 	auto currPassCB = mCurrFrameResource->PassCB.get();
 	currPassCB->CopyData(0, mMainPassCB);
 }
@@ -541,18 +826,21 @@ void InstancingAndCullingApp::BuildRootSignature()
 	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 7, 0, 0);
 
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[7];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
     slotRootParameter[0].InitAsShaderResourceView(0, 1);
     slotRootParameter[1].InitAsShaderResourceView(1, 1);
     slotRootParameter[2].InitAsConstantBufferView(0);
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[4].InitAsShaderResourceView(2, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[5].InitAsShaderResourceView(3, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[6].InitAsShaderResourceView(4, 1, D3D12_SHADER_VISIBILITY_PIXEL);
 
 	auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(7, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -739,6 +1027,25 @@ void InstancingAndCullingApp::BuildSkullGeometry()
 
 	fin.close();
 
+	const UINT fullIndexCount = (UINT)indices.size();
+	const float boundsSize = 2.0f*MathHelper::Max(bounds.Extents.x, MathHelper::Max(bounds.Extents.y, bounds.Extents.z));
+	const float lodCellFractions[] = { 1.0f / 64.0f, 1.0f / 32.0f, 1.0f / 16.0f };
+
+	std::vector<std::pair<std::string, SubmeshGeometry>> lodSubmeshes;
+	for(int i = 0; i < _countof(lodCellFractions); ++i)
+	{
+		auto lodIndices = LodGroup::SimplifyByClustering(&vertices[0].Pos, sizeof(Vertex), vcount,
+			indices.data(), fullIndexCount, lodCellFractions[i]*boundsSize);
+
+		SubmeshGeometry lodSubmesh;
+		lodSubmesh.IndexCount = (UINT)lodIndices.size();
+		lodSubmesh.StartIndexLocation = (UINT)indices.size();
+		lodSubmesh.BaseVertexLocation = 0;
+		lodSubmeshes.push_back({ "skullLod" + std::to_string(i + 1), lodSubmesh });
+
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+
 	//
 	// Pack the indices of all the meshes into one index buffer.
 	//
@@ -768,13 +1075,21 @@ void InstancingAndCullingApp::BuildSkullGeometry()
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
+	submesh.IndexCount = fullIndexCount;
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 	submesh.Bounds = bounds;
 
 	geo->DrawArgs["skull"] = submesh;
 
+	// Coarser detail levels for distant instances, simplified on the full
+	// resolution vertex buffer with growing grid cells.
+	for(auto& lod : lodSubmeshes)
+	{
+		lod.second.Bounds = bounds;
+		geo->DrawArgs[lod.first] = lod.second;
+	}
+
 	mGeometries[geo->Name] = std::move(geo);
 }
 
@@ -816,7 +1131,8 @@ void InstancingAndCullingApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, mInstanceCount, (UINT)mMaterials.size()));
+            1, mInstanceCount, (UINT)mMaterials.size(), (UINT)mAnimatedLights.size(),
+            mLightClusters.ClusterCount(), gMaxClusterLightIndices));
     }
 }
 
@@ -902,15 +1218,26 @@ void InstancingAndCullingApp::BuildRenderItems()
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
 	skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
 
+	// Switch detail levels by the projected size of the bounding sphere in pixels.
+	const char* lodNames[] = { "skull", "skullLod1", "skullLod2", "skullLod3" };
+	const float lodMinScreenSizes[] = { 160.0f, 64.0f, 24.0f, 0.0f };
+	for(int i = 0; i < _countof(lodNames); ++i)
+	{
+		const auto& lodSubmesh = skullRitem->Geo->DrawArgs[lodNames[i]];
+		skullRitem->Lods.AddLevel(lodSubmesh.IndexCount, lodSubmesh.StartIndexLocation,
+			lodSubmesh.BaseVertexLocation, lodMinScreenSizes[i]);
+	}
+
 	// Generate instance data.
-	const int n = 5;
+	const int n = mInstanceGridDim;
 	mInstanceCount = n*n*n;
 	skullRitem->Instances.resize(mInstanceCount);
 
 
-	float width = 200.0f;
-	float height = 200.0f;
-	float depth = 200.0f;
+	// Keep the 50 unit spacing of the original 5x5x5 grid as the grid grows.
+	float width = 50.0f*(n - 1);
+	float height = 50.0f*(n - 1);
+	float depth = 50.0f*(n - 1);
 
 	float x = -0.5f*width;
 	float y = -0.5f*height;
@@ -938,6 +1265,40 @@ void InstancingAndCullingApp::BuildRenderItems()
 		}
 	}
 
+	// The instances are static, so transform their bounds to world space once
+	// instead of transforming the frustum into each instance's local space every frame.
+	auto& worldBounds = skullRitem->InstanceWorldBounds;
+	worldBounds.resize(mInstanceCount);
+	skullRitem->InstanceCuller.Reserve(mInstanceCount);
+	skullRitem->InstanceVisibility.Resize(mInstanceCount);
+	skullRitem->InstanceWorldSpheres.resize(mInstanceCount);
+	skullRitem->PackedInstances.resize(mInstanceCount);
+
+	// All the instances share the skull's local box, so transform it by all the
+	// world matrices in one batch.
+	skullRitem->InstanceCuller.AddBoxes(skullRitem->Bounds, &skullRitem->Instances[0].World,
+		sizeof(Instance), mInstanceCount);
+
+	for(UINT i = 0; i < mInstanceCount; ++i)
+	{
+		const Instance& instance = skullRitem->Instances[i];
+		skullRitem->PackedInstances[i] = PackInstanceData(XMLoadFloat4x4(&instance.World),
+			XMLoadFloat4x4(&instance.TexTransform), instance.MaterialIndex);
+
+		worldBounds[i] = skullRitem->InstanceCuller.GetBox(i);
+
+		BoundingSphere& worldSphere = skullRitem->InstanceWorldSpheres[i];
+		BoundingSphere::CreateFromBoundingBox(worldSphere, worldBounds[i]);
+		skullRitem->InstanceVisibility.SetBounds(i, worldSphere);
+	}
+	auto bvhStart = std::chrono::high_resolution_clock::now();
+	skullRitem->InstanceBvh.Build(worldBounds.data(), nullptr, mInstanceCount);
+	auto bvhEnd = std::chrono::high_resolution_clock::now();
+	mBvhBuildMs = std::chrono::duration<float, std::milli>(bvhEnd - bvhStart).count();
+	skullRitem->VisibleInstances.resize(mInstanceCount);
+	skullRitem->InstanceLods.assign(mInstanceCount, 0);
+	skullRitem->LodSortedInstances.resize(mInstanceCount);
+
 
 	mAllRitems.push_back(std::move(skullRitem));
 	
@@ -946,6 +1307,65 @@ void InstancingAndCullingApp::BuildRenderItems()
 		mOpaqueRitems.push_back(e.get());
 }
 
+void InstancingAndCullingApp::BuildOccluders()
+{
+	// Occluders are rasterized on the CPU, so use a low-poly proxy rather
+	// than the skull mesh itself.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+
+	mOccluderProxyMesh = mOcclusionCuller.AddOccluderMesh(
+		&box.Vertices[0].Position, sizeof(GeometryGenerator::Vertex), (UINT)box.Vertices.size(),
+		box.Indices32.data(), (UINT)box.Indices32.size());
+}
+
+void InstancingAndCullingApp::BuildClusteredLights()
+{
+	// The spot factor pow(cos, SpotPower) counts as zero below this, which
+	// gives the cone angle the lights are culled with.
+	const float minSpotFactor = 1.0f / 256.0f;
+
+	// Scatter the lights over the instance grid and a margin around it.
+	const float halfExtent = 0.5f*50.0f*(mInstanceGridDim - 1) + 25.0f;
+
+	RandomGenerator rng(16);
+
+	mAnimatedLights.resize(gClusteredLightCount);
+	mLightBounds.resize(gClusteredLightCount);
+	for(UINT i = 0; i < gClusteredLightCount; ++i)
+	{
+		AnimatedLight& l = mAnimatedLights[i];
+		l.Center = XMFLOAT3(rng.NextFloat(-halfExtent, halfExtent),
+			rng.NextFloat(-halfExtent, halfExtent), rng.NextFloat(-halfExtent, halfExtent));
+		l.OrbitRadius = rng.NextFloat(2.0f, 10.0f);
+		l.OrbitSpeed = rng.NextFloat(0.2f, 1.0f);
+		l.OrbitPhase = rng.NextFloat(0.0f, 2.0f*MathHelper::Pi);
+
+		l.Params.Strength = XMFLOAT3(rng.NextFloat(0.1f, 0.6f), rng.NextFloat(0.1f, 0.6f), rng.NextFloat(0.1f, 0.6f));
+		l.Params.FalloffStart = 2.0f;
+		l.Params.FalloffEnd = rng.NextFloat(10.0f, 25.0f);
+		l.Params.Position = l.Center;
+
+		LightClusters::LightBounds& bounds = mLightBounds[i];
+		bounds.Range = l.Params.FalloffEnd;
+
+		// Every fourth light is a spot light; the others are point lights
+		// (SpotPower = 0 in the shader).
+		if(i % 4 == 0)
+		{
+			XMStoreFloat3(&l.Params.Direction, rng.NextUnitVec3());
+			l.Params.SpotPower = rng.NextFloat(8.0f, 32.0f);
+
+			bounds.Direction = l.Params.Direction;
+			bounds.SpotCosAngle = powf(minSpotFactor, 1.0f / l.Params.SpotPower);
+		}
+		else
+		{
+			l.Params.SpotPower = 0.0f;
+		}
+	}
+}
+
 void InstancingAndCullingApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
     // For each render item...
@@ -960,9 +1380,25 @@ void InstancingAndCullingApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList
 		// Set the instance buffer to use for this render-item.  For structured buffers, we can bypass 
 		// the heap and set as a root descriptor.
 		auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
-		mCommandList->SetGraphicsRootShaderResourceView(0, instanceBuffer->GetGPUVirtualAddress());
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		// One instanced draw per detail level.  SV_InstanceID restarts at zero for
+		// every draw, so each level gets a view starting at its first instance.
+		UINT firstInstance = ri->BaseInstance;
+		for(UINT l = 0; l < ri->Lods.LevelCount(); ++l)
+		{
+			UINT instanceCount = ri->LodInstanceCounts[l];
+			if(instanceCount == 0)
+				continue;
+
+			D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->GetGPUVirtualAddress() +
+				firstInstance*sizeof(InstanceData);
+			mCommandList->SetGraphicsRootShaderResourceView(0, instanceAddress);
+
+			const auto& level = ri->Lods.GetLevel(l);
+			cmdList->DrawIndexedInstanced(level.IndexCount, instanceCount, level.StartIndexLocation, level.BaseVertexLocation, 0);
+
+			firstInstance += instanceCount;
+		}
     }
 }
 
@@ -20,12 +20,17 @@
 
 struct InstanceData
 {
-	float4x4 World;
-	float4x4 TexTransform;
+	// Rows of the transposed affine world matrix; the fourth row is (0, 0, 0, 1).
+	float4   World0;
+	float4   World1;
+	float4   World2;
+
+	// Texture scale and offset as half floats: (scale.x | scale.y << 16, offset.x | offset.y << 16).
+	uint2    TexScaleOffset;
+
+	// Material index in the low 16 bits.
 	uint     MaterialIndex;
 	uint     InstPad0;
-	uint     InstPad1;
-	uint     InstPad2;
 };
 
 struct MaterialData
@@ -49,6 +54,12 @@ Texture2D gDiffuseMap[7] : register(t0);
 StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
 StructuredBuffer<MaterialData> gMaterialData : register(t1, space1);
 
+// Clustered point and spot lights (spot lights have SpotPower > 0).  Every
+// cluster has an (offset, count) range into the light index list.
+StructuredBuffer<Light> gClusteredLights      : register(t2, space1);
+StructuredBuffer<uint2> gClusterRanges        : register(t3, space1);
+StructuredBuffer<uint>  gClusterLightIndices  : register(t4, space1);
+
 SamplerState gsamPointWrap        : register(s0);
 SamplerState gsamPointClamp       : register(s1);
 SamplerState gsamLinearWrap       : register(s2);
@@ -80,6 +91,12 @@ cbuffer cbPass : register(b0)
     // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
     // are spot lights for a maximum of MaxLights per object.
     Light gLights[MaxLights];
+
+    // Clustered light grid size, and the slice of view depth z is
+    // log(z)*gClusterSliceScale + gClusterSliceBias.
+    uint3 gClusterCounts;
+    float gClusterSliceScale;
+    float gClusterSliceBias;
 };
 
 struct VertexIn
@@ -107,27 +124,29 @@ VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 	
 	// Fetch the instance data.
 	InstanceData instData = gInstanceData[instanceID];
-	float4x4 world = instData.World;
-	float4x4 texTransform = instData.TexTransform;
-	uint matIndex = instData.MaterialIndex;
+	float3x4 world = float3x4(instData.World0, instData.World1, instData.World2);
+	float2 texScale = f16tof32(uint2(instData.TexScaleOffset.x, instData.TexScaleOffset.x >> 16));
+	float2 texOffset = f16tof32(uint2(instData.TexScaleOffset.y, instData.TexScaleOffset.y >> 16));
+	uint matIndex = instData.MaterialIndex & 0xffff;
 
 	vout.MatIndex = matIndex;
 	
 	// Fetch the material data.
 	MaterialData matData = gMaterialData[matIndex];
 	
-    // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), world);
+    // Transform to world space.  world holds the transposed matrix, so multiply
+    // from the left.
+    float4 posW = float4(mul(world, float4(vin.PosL, 1.0f)), 1.0f);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)world);
+    vout.NormalW = mul((float3x3)world, vin.NormalL);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
+	float4 texC = float4(vin.TexC*texScale + texOffset, 0.0f, 1.0f);
 	vout.TexC = mul(texC, matData.MatTransform).xy;
 	
     return vout;
@@ -160,6 +179,22 @@ float4 PS(VertexOut pin) : SV_Target
     float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
 
+    // Add the point and spot lights of the pixel's cluster.  SV_Position.w is
+    // the view space depth.
+    uint3 cluster;
+    cluster.xy = min(uint2(pin.PosH.xy*gInvRenderTargetSize*gClusterCounts.xy), gClusterCounts.xy - 1);
+    cluster.z = (uint)clamp(log(pin.PosH.w)*gClusterSliceScale + gClusterSliceBias, 0.0f, gClusterCounts.z - 1.0f);
+
+    uint2 lightRange = gClusterRanges[(cluster.z*gClusterCounts.y + cluster.y)*gClusterCounts.x + cluster.x];
+    for(uint i = 0; i < lightRange.y; ++i)
+    {
+        Light light = gClusteredLights[gClusterLightIndices[lightRange.x + i]];
+        if(light.SpotPower > 0.0f)
+            directLight.rgb += ComputeSpotLight(light, mat, pin.PosW, pin.NormalW, toEyeW);
+        else
+            directLight.rgb += ComputePointLight(light, mat, pin.PosW, pin.NormalW, toEyeW);
+    }
+
     float4 litColor = ambient + directLight;
 
     // Common convention to take alpha from diffuse albedo.
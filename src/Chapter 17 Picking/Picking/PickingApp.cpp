@@ -7,6 +7,7 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/TriangleBvh.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -28,6 +29,9 @@ struct RenderItem
 	bool Visible = true;
 
 	BoundingBox Bounds;
+
+	// Triangle hierarchy of the mesh used for picking; null if not pickable.
+	const TriangleBvh* PickBvh = nullptr;
  
     // World matrix of the shape that describes the object's local space
     // relative to the world space, which defines the position, orientation,
@@ -94,6 +98,7 @@ private:
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayout();
     void BuildCarGeometry();
+	void BuildPickBvhs();
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
@@ -121,6 +126,9 @@ private:
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
+	// Picking hierarchies of the submeshes, by draw argument name.
+	std::unordered_map<std::string, std::unique_ptr<TriangleBvh>> mPickBvhs;
+
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
  
 	// List of all the render items.
@@ -194,6 +202,7 @@ bool PickingApp::Initialize()
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayout();
     BuildCarGeometry();
+	BuildPickBvhs();
 	BuildMaterials();
     BuildRenderItems();
     BuildFrameResources();
@@ -654,6 +663,28 @@ void PickingApp::BuildCarGeometry()
 	mGeometries[geo->Name] = std::move(geo);
 }
 
+void PickingApp::BuildPickBvhs()
+{
+	// NOTE: For the demo, we know the vertex format and that the indices are 32-bit.
+	for(auto& g : mGeometries)
+	{
+		MeshGeometry* geo = g.second.get();
+		auto vertices = (const Vertex*)geo->VertexBufferCPU->GetBufferPointer();
+		auto indices = (const std::uint32_t*)geo->IndexBufferCPU->GetBufferPointer();
+
+		for(auto& d : geo->DrawArgs)
+		{
+			const SubmeshGeometry& submesh = d.second;
+
+			auto bvh = std::make_unique<TriangleBvh>();
+			bvh->Build(&vertices[0].Pos, geo->VertexByteStride, indices + submesh.StartIndexLocation,
+				submesh.IndexCount / 3, submesh.BaseVertexLocation);
+
+			mPickBvhs[d.first] = std::move(bvh);
+		}
+	}
+}
+
 void PickingApp::BuildPSOs()
 {
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
@@ -760,6 +791,7 @@ void PickingApp::BuildRenderItems()
 	carRitem->IndexCount = carRitem->Geo->DrawArgs["car"].IndexCount;
 	carRitem->StartIndexLocation = carRitem->Geo->DrawArgs["car"].StartIndexLocation;
 	carRitem->BaseVertexLocation = carRitem->Geo->DrawArgs["car"].BaseVertexLocation;
+	carRitem->PickBvh = mPickBvhs["car"].get();
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(carRitem.get());
 
 	auto pickedRitem = std::make_unique<RenderItem>();
@@ -883,82 +915,52 @@ void PickingApp::Pick(int sx, int sy)
 	XMMATRIX V = mCamera.GetView();
 	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(V), V);
 
+	// Transform the ray to world space once.  It is transformed from world space
+	// to the local space of each render item separately below.
+	XMVECTOR rayOriginW = XMVector3TransformCoord(rayOrigin, invView);
+	XMVECTOR rayDirW = XMVector3Normalize(XMVector3TransformNormal(rayDir, invView));
+
 	// Assume nothing is picked to start, so the picked render-item is invisible.
 	mPickedRitem->Visible = false;
 
+	// Nearest hit over all render items, in world units.
+	float tmin = MathHelper::Infinity;
+
 	// Check if we picked an opaque render item.  A real app might keep a separate "picking list"
 	// of objects that can be selected.   
 	for(auto ri : mRitemLayer[(int)RenderLayer::Opaque])
 	{
-		auto geo = ri->Geo;
-
-		// Skip invisible render-items.
-		if(ri->Visible == false)
+		// Skip invisible and non-pickable render-items.
+		if(ri->Visible == false || ri->PickBvh == nullptr)
 			continue;
 
 		XMMATRIX W = XMLoadFloat4x4(&ri->World);
 		XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
 
-		// Tranform ray to vi space of Mesh.
-		XMMATRIX toLocal = XMMatrixMultiply(invView, invWorld);
+		// Tranform ray to the local space of the mesh.  The direction is not
+		// renormalized, so distances along it stay in world units and can be
+		// compared between render items with different scales.
+		XMVECTOR rayOriginL = XMVector3TransformCoord(rayOriginW, invWorld);
+		XMVECTOR rayDirL = XMVector3TransformNormal(rayDirW, invWorld);
 
-		rayOrigin = XMVector3TransformCoord(rayOrigin, toLocal);
-		rayDir = XMVector3TransformNormal(rayDir, toLocal);
+		// The hierarchy rejects rays missing the mesh bounds at its root and
+		// only tests the triangles in the leaves the ray passes through.
+		TriangleBvh::Hit hit;
+		if(ri->PickBvh->RayCast(rayOriginL, rayDirL, tmin, hit))
+		{
+			// This is the new nearest picked triangle.
+			tmin = hit.Distance;
 
-		// Make the ray direction unit length for the intersection tests.
-		rayDir = XMVector3Normalize(rayDir);
+			mPickedRitem->Visible = true;
+			mPickedRitem->IndexCount = 3;
+			mPickedRitem->BaseVertexLocation = ri->BaseVertexLocation;
 
-		// If we hit the bounding box of the Mesh, then we might have picked a Mesh triangle,
-		// so do the ray/triangle tests.
-		//
-		// If we did not hit the bounding box, then it is impossible that we hit 
-		// the Mesh, so do not waste effort doing ray/triangle tests.
-		float tmin = 0.0f;
-		if(ri->Bounds.Intersects(rayOrigin, rayDir, tmin))
-		{
-			// NOTE: For the demo, we know what to cast the vertex/index data to.  If we were mixing
-			// formats, some metadata would be needed to figure out what to cast it to.
-			auto vertices = (Vertex*)geo->VertexBufferCPU->GetBufferPointer();
-			auto indices = (std::uint32_t*)geo->IndexBufferCPU->GetBufferPointer();
-			UINT triCount = ri->IndexCount / 3;
-
-			// Find the nearest ray/triangle intersection.
-			tmin = MathHelper::Infinity;
-			for(UINT i = 0; i < triCount; ++i)
-			{
-				// Indices for this triangle.
-				UINT i0 = indices[i * 3 + 0];
-				UINT i1 = indices[i * 3 + 1];
-				UINT i2 = indices[i * 3 + 2];
-
-				// Vertices for this triangle.
-				XMVECTOR v0 = XMLoadFloat3(&vertices[i0].Pos);
-				XMVECTOR v1 = XMLoadFloat3(&vertices[i1].Pos);
-				XMVECTOR v2 = XMLoadFloat3(&vertices[i2].Pos);
-
-				// We have to iterate over all the triangles in order to find the nearest intersection.
-				float t = 0.0f;
-				if(TriangleTests::Intersects(rayOrigin, rayDir, v0, v1, v2, t))
-				{
-					if(t < tmin)
-					{
-						// This is the new nearest picked triangle.
-						tmin = t;
-						UINT pickedTriangle = i;
-
-						mPickedRitem->Visible = true;
-						mPickedRitem->IndexCount = 3;
-						mPickedRitem->BaseVertexLocation = 0;
-
-						// Picked render item needs same world matrix as object picked.
-						mPickedRitem->World = ri->World;
-						mPickedRitem->NumFramesDirty = gNumFrameResources;
-
-						// Offset to the picked triangle in the mesh index buffer.
-						mPickedRitem->StartIndexLocation = 3 * pickedTriangle;
-					}
-				}
-			}
+			// Picked render item needs same world matrix as object picked.
+			mPickedRitem->World = ri->World;
+			mPickedRitem->NumFramesDirty = gNumFrameResources;
+
+			// Offset to the picked triangle in the mesh index buffer.
+			mPickedRitem->StartIndexLocation = ri->StartIndexLocation + 3 * hit.Triangle;
 		}
 	}
-}
\ No newline at end of file
+}
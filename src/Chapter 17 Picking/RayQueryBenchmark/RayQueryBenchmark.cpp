@@ -0,0 +1,300 @@
+//***************************************************************************************
+// RayQueryBenchmark.cpp - Headless throughput benchmark for RayQuery
+//
+// Builds a grid of skull and car instances and measures the rays per second of
+// three batches:
+//   -primary: camera rays through the pixels of a 1024x768 image (closest hit)
+//   -shadow:  rays from the primary hits toward a directional light (any hit)
+//   -diffuse: rays from the primary hits in random directions (closest hit)
+// Each batch is traced one ray at a time (single thread), in packets on one
+// thread, and in packets on all worker threads; the results are compared.
+//
+// Usage: RayQueryBenchmark [skull.txt] [car.txt]
+//***************************************************************************************
+
+#include <windows.h> // for XMVerifyCPUSupport
+#include "../../Common/RayQuery.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace DirectX;
+
+namespace
+{
+	const UINT ImageWidth = 1024;
+	const UINT ImageHeight = 768;
+	const UINT GridSize = 4;
+	const float GridSpacing = 15.0f;
+	const UINT Repeats = 3;
+
+	// Loads the positions and indices of the book's .txt model format.
+	bool LoadModel(const std::string& filename, std::vector<XMFLOAT3>& positions, std::vector<std::uint32_t>& indices)
+	{
+		std::ifstream fin(filename);
+		if(!fin)
+			return false;
+
+		UINT vcount = 0;
+		UINT tcount = 0;
+		std::string ignore;
+
+		fin >> ignore >> vcount;
+		fin >> ignore >> tcount;
+		fin >> ignore >> ignore >> ignore >> ignore;
+
+		positions.resize(vcount);
+		for(UINT i = 0; i < vcount; ++i)
+		{
+			XMFLOAT3 normal;
+			fin >> positions[i].x >> positions[i].y >> positions[i].z;
+			fin >> normal.x >> normal.y >> normal.z;
+		}
+
+		fin >> ignore;
+		fin >> ignore;
+		fin >> ignore;
+
+		indices.resize(3 * tcount);
+		for(UINT i = 0; i < tcount; ++i)
+			fin >> indices[i*3 + 0] >> indices[i*3 + 1] >> indices[i*3 + 2];
+
+		return !fin.fail();
+	}
+
+	struct SceneInstance
+	{
+		const TriangleBvh* Mesh;
+		XMFLOAT4X4 InvWorld;
+	};
+
+	// Reference: one ray at a time, Bvh::QueryRay over the instance boxes and
+	// TriangleBvh::RayCast in each instance hit.
+	void TraceSingle(const Bvh& instanceBvh, const std::vector<SceneInstance>& instances,
+		const std::vector<RayQuery::Ray>& rays, std::vector<RayQuery::Result>& results)
+	{
+		std::vector<UINT> candidates;
+		for(size_t i = 0; i < rays.size(); ++i)
+		{
+			const RayQuery::Ray& ray = rays[i];
+			XMVECTOR origin = XMLoadFloat3(&ray.Origin);
+			XMVECTOR dir = XMLoadFloat3(&ray.Direction);
+
+			RayQuery::Result& result = results[i];
+			result = RayQuery::Result();
+
+			float nearest = ray.MaxDist;
+			instanceBvh.QueryRay(origin, dir, nearest, candidates);
+			for(UINT c : candidates)
+			{
+				XMMATRIX invWorld = XMLoadFloat4x4(&instances[c].InvWorld);
+
+				TriangleBvh::Hit hit;
+				if(instances[c].Mesh->RayCast(XMVector3TransformCoord(origin, invWorld),
+					XMVector3TransformNormal(dir, invWorld), nearest, hit))
+				{
+					nearest = hit.Distance;
+					result.Distance = hit.Distance;
+					result.Instance = c;
+					result.Triangle = hit.Triangle;
+					result.U = hit.U;
+					result.V = hit.V;
+				}
+			}
+		}
+	}
+
+	template<typename F>
+	double BestSeconds(F f)
+	{
+		double best = 1e30;
+		for(UINT r = 0; r < Repeats; ++r)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			f();
+			auto stop = std::chrono::high_resolution_clock::now();
+			best = std::min<double>(best, std::chrono::duration<double>(stop - start).count());
+		}
+
+		return best;
+	}
+
+	// Rays whose hit/miss or distance disagree between two runs.
+	UINT CountMismatches(const std::vector<RayQuery::Result>& a, const std::vector<RayQuery::Result>& b, bool compareDistance)
+	{
+		UINT mismatches = 0;
+		for(size_t i = 0; i < a.size(); ++i)
+		{
+			const bool hitA = a[i].Instance != RayQuery::NoHit;
+			const bool hitB = b[i].Instance != RayQuery::NoHit;
+			if(hitA != hitB)
+				++mismatches;
+			else if(hitA && compareDistance && fabsf(a[i].Distance - b[i].Distance) > 1e-4f*(1.0f + a[i].Distance))
+				++mismatches;
+		}
+
+		return mismatches;
+	}
+
+	void RunBatch(const char* name, const std::vector<RayQuery::Ray>& rays, RayQuery::Mode mode,
+		const RayQuery& query, const Bvh& instanceBvh, const std::vector<SceneInstance>& instances)
+	{
+		const UINT count = (UINT)rays.size();
+		std::vector<RayQuery::Result> single(count);
+		std::vector<RayQuery::Result> packets(count);
+		std::vector<RayQuery::Result> threaded(count);
+
+		double singleSeconds = BestSeconds([&]() { TraceSingle(instanceBvh, instances, rays, single); });
+		double packetSeconds = BestSeconds([&]() { query.Trace(rays.data(), count, mode, packets.data(), false); });
+		UINT hits = 0;
+		double threadedSeconds = BestSeconds([&]() { hits = query.Trace(rays.data(), count, mode, threaded.data(), true); });
+
+		// Any hit rays may report a different (not the nearest) hit.
+		const bool compareDistance = mode == RayQuery::Mode::ClosestHit;
+		UINT mismatches = CountMismatches(single, packets, compareDistance) + CountMismatches(single, threaded, compareDistance);
+
+		std::cout << std::left << std::setw(9) << name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(9) << count << " rays"
+			<< std::setw(7) << 100.0*hits / count << "% hit"
+			<< std::setw(9) << count / singleSeconds * 1e-6 << " single"
+			<< std::setw(9) << count / packetSeconds * 1e-6 << " packets"
+			<< std::setw(9) << count / threadedSeconds * 1e-6 << " threaded Mrays/s"
+			<< "  mismatches " << mismatches << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if(!XMVerifyCPUSupport())
+	{
+		std::cout << "directx math not supported" << std::endl;
+		return 0;
+	}
+
+	const std::string skullFile = argc > 1 ? argv[1] : "../Picking/Models/skull.txt";
+	const std::string carFile = argc > 2 ? argv[2] : "../Picking/Models/car.txt";
+
+	std::vector<XMFLOAT3> positions;
+	std::vector<std::uint32_t> indices;
+
+	TriangleBvh meshes[2];
+	const std::string* files[2] = { &skullFile, &carFile };
+	for(UINT m = 0; m < 2; ++m)
+	{
+		if(!LoadModel(*files[m], positions, indices))
+		{
+			std::cout << *files[m] << " not found." << std::endl;
+			return 1;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		meshes[m].Build(positions.data(), sizeof(XMFLOAT3), indices.data(), (UINT)indices.size() / 3);
+		auto stop = std::chrono::high_resolution_clock::now();
+
+		std::cout << *files[m] << ": " << meshes[m].TriangleCount() << " triangles, "
+			<< meshes[m].NodeCount() << " nodes, built in "
+			<< std::chrono::duration<double, std::milli>(stop - start).count() << " ms" << std::endl;
+	}
+
+	// A grid of alternating skulls and cars, each turned a bit differently.
+	RayQuery query;
+	std::vector<SceneInstance> instances;
+	std::vector<BoundingBox> instanceBounds;
+	for(UINT z = 0; z < GridSize; ++z)
+	{
+		for(UINT x = 0; x < GridSize; ++x)
+		{
+			const TriangleBvh* mesh = &meshes[(x + z) % 2];
+			const float offset = 0.5f*(GridSize - 1)*GridSpacing;
+			XMMATRIX world = XMMatrixRotationY(0.7f*(x + GridSize*z)) *
+				XMMatrixTranslation(x*GridSpacing - offset, 0.0f, z*GridSpacing - offset);
+
+			query.AddInstance(mesh, world);
+
+			XMVECTOR det = XMMatrixDeterminant(world);
+			SceneInstance instance;
+			instance.Mesh = mesh;
+			XMStoreFloat4x4(&instance.InvWorld, XMMatrixInverse(&det, world));
+			instances.push_back(instance);
+
+			BoundingBox box;
+			mesh->Bounds().Transform(box, world);
+			instanceBounds.push_back(box);
+		}
+	}
+	query.Build();
+
+	Bvh instanceBvh;
+	instanceBvh.Build(instanceBounds.data(), nullptr, (UINT)instanceBounds.size(), 1);
+
+	// Primary rays of a camera looking down at the grid.
+	XMVECTOR eye = XMVectorSet(0.0f, 25.0f, -55.0f, 1.0f);
+	XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	XMVECTOR det = XMMatrixDeterminant(view);
+	XMMATRIX invView = XMMatrixInverse(&det, view);
+
+	const float tanHalfFov = tanf(0.125f*XM_PI);
+	const float aspect = (float)ImageWidth / ImageHeight;
+
+	std::vector<RayQuery::Ray> primary(ImageWidth*ImageHeight);
+	for(UINT y = 0; y < ImageHeight; ++y)
+	{
+		for(UINT x = 0; x < ImageWidth; ++x)
+		{
+			float vx = (2.0f*(x + 0.5f) / ImageWidth - 1.0f)*tanHalfFov*aspect;
+			float vy = (1.0f - 2.0f*(y + 0.5f) / ImageHeight)*tanHalfFov;
+
+			RayQuery::Ray& ray = primary[y*ImageWidth + x];
+			XMStoreFloat3(&ray.Origin, eye);
+			XMStoreFloat3(&ray.Direction, XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView)));
+		}
+	}
+
+	std::vector<RayQuery::Result> primaryHits(primary.size());
+	query.Trace(primary.data(), (UINT)primary.size(), RayQuery::Mode::ClosestHit, primaryHits.data());
+
+	// Secondary rays start slightly off the primary hit points.
+	const float bias = 1e-3f;
+	XMVECTOR toLight = XMVector3Normalize(XMVectorSet(-0.57735f, 0.57735f, -0.57735f, 0.0f));
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+	std::vector<RayQuery::Ray> shadow;
+	std::vector<RayQuery::Ray> diffuse;
+	for(size_t i = 0; i < primary.size(); ++i)
+	{
+		if(primaryHits[i].Instance == RayQuery::NoHit)
+			continue;
+
+		XMVECTOR p = XMLoadFloat3(&primary[i].Origin) + primaryHits[i].Distance*XMLoadFloat3(&primary[i].Direction);
+
+		RayQuery::Ray ray;
+		XMStoreFloat3(&ray.Origin, p + bias*toLight);
+		XMStoreFloat3(&ray.Direction, toLight);
+		shadow.push_back(ray);
+
+		XMVECTOR dir;
+		do
+		{
+			dir = XMVectorSet(uniform(rng), uniform(rng), uniform(rng), 0.0f);
+		} while(XMVectorGetX(XMVector3LengthSq(dir)) > 1.0f || XMVectorGetX(XMVector3LengthSq(dir)) < 1e-4f);
+
+		dir = XMVector3Normalize(dir);
+		XMStoreFloat3(&ray.Origin, p + bias*dir);
+		XMStoreFloat3(&ray.Direction, dir);
+		ray.MaxDist = 10.0f;
+		diffuse.push_back(ray);
+	}
+
+	std::cout << std::endl;
+	RunBatch("primary", primary, RayQuery::Mode::ClosestHit, query, instanceBvh, instances);
+	RunBatch("shadow", shadow, RayQuery::Mode::AnyHit, query, instanceBvh, instances);
+	RunBatch("diffuse", diffuse, RayQuery::Mode::ClosestHit, query, instanceBvh, instances);
+
+	return 0;
+}
@@ -0,0 +1,308 @@
+//***************************************************************************************
+// CubeMapScene.cpp - The CubeMap demo's scene and per frame CPU path, without D3D12
+//***************************************************************************************
+
+#include "CubeMapScene.h"
+#include "../../Common/GeometryGenerator.h"
+#include <algorithm>
+#include <fstream>
+
+using namespace DirectX;
+
+//
+// CubeMapScene
+//
+
+SceneGeometry CubeMapScene::BuildShapeGeometry()
+{
+    GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
+	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+
+	//
+	// We are concatenating all the geometry into one big vertex/index buffer.  So
+	// define the regions in the buffer each submesh covers.
+	//
+
+	SceneGeometry geometry;
+
+	GeometryGenerator::MeshData* meshes[] = { &box, &grid, &sphere, &cylinder };
+	const char* names[] = { "box", "grid", "sphere", "cylinder" };
+	for(int i = 0; i < 4; ++i)
+	{
+		GeometryGenerator::MeshData& mesh = *meshes[i];
+
+		SceneGeometry::Submesh submesh;
+		submesh.IndexCount = (std::uint32_t)mesh.Indices32.size();
+		submesh.StartIndexLocation = (std::uint32_t)geometry.Indices16.size();
+		submesh.BaseVertexLocation = (int)geometry.Vertices.size();
+		geometry.DrawArgs[names[i]] = submesh;
+
+		// Extract the vertex elements we are interested in.
+		for(const auto& v : mesh.Vertices)
+			geometry.Vertices.push_back({ v.Position, v.Normal, v.TexC });
+
+		auto& indices16 = mesh.GetIndices16();
+		geometry.Indices16.insert(geometry.Indices16.end(), indices16.begin(), indices16.end());
+	}
+
+	return geometry;
+}
+
+bool CubeMapScene::LoadSkullGeometry(const std::string& filename, SceneGeometry& geometry)
+{
+    std::ifstream fin(filename);
+    if(!fin)
+        return false;
+
+    std::uint32_t vcount = 0;
+    std::uint32_t tcount = 0;
+    std::string ignore;
+
+    fin >> ignore >> vcount;
+    fin >> ignore >> tcount;
+    fin >> ignore >> ignore >> ignore >> ignore;
+
+    XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+    XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+
+    XMVECTOR vMin = XMLoadFloat3(&vMinf3);
+    XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+
+    geometry = SceneGeometry();
+    geometry.Vertices.resize(vcount);
+    for(std::uint32_t i = 0; i < vcount; ++i)
+    {
+        Vertex& v = geometry.Vertices[i];
+        fin >> v.Pos.x >> v.Pos.y >> v.Pos.z;
+        fin >> v.Normal.x >> v.Normal.y >> v.Normal.z;
+
+        v.TexC = { 0.0f, 0.0f };
+
+        XMVECTOR P = XMLoadFloat3(&v.Pos);
+
+        vMin = XMVectorMin(vMin, P);
+        vMax = XMVectorMax(vMax, P);
+    }
+
+    fin >> ignore;
+    fin >> ignore;
+    fin >> ignore;
+
+    geometry.Indices32.resize(3*tcount);
+    for(std::uint32_t i = 0; i < tcount; ++i)
+    {
+        fin >> geometry.Indices32[i*3 + 0] >> geometry.Indices32[i*3 + 1] >> geometry.Indices32[i*3 + 2];
+    }
+
+    if(fin.fail())
+        return false;
+
+    SceneGeometry::Submesh submesh;
+    submesh.IndexCount = (std::uint32_t)geometry.Indices32.size();
+    submesh.StartIndexLocation = 0;
+    submesh.BaseVertexLocation = 0;
+    XMStoreFloat3(&submesh.Bounds.Center, 0.5f*(vMin + vMax));
+    XMStoreFloat3(&submesh.Bounds.Extents, 0.5f*(vMax - vMin));
+
+    geometry.DrawArgs["skull"] = submesh;
+
+    return true;
+}
+
+void CubeMapScene::AssignSortGeometryIds(const std::vector<DrawMesh*>& meshes)
+{
+	std::vector<GpuAddress> vertexBuffers;
+	std::vector<std::vector<std::uint32_t>> submeshes;
+	for(DrawMesh* mesh : meshes)
+	{
+		GpuAddress vb = mesh->VertexBuffer.Address;
+		std::uint32_t vbIndex = (std::uint32_t)(std::find(vertexBuffers.begin(), vertexBuffers.end(), vb) - vertexBuffers.begin());
+		if(vbIndex == vertexBuffers.size())
+		{
+			vertexBuffers.push_back(vb);
+			submeshes.emplace_back();
+		}
+
+		auto& starts = submeshes[vbIndex];
+		std::uint32_t submeshIndex = (std::uint32_t)(std::find(starts.begin(), starts.end(), mesh->StartIndexLocation) - starts.begin());
+		if(submeshIndex == starts.size())
+			starts.push_back(mesh->StartIndexLocation);
+
+		mesh->SortGeometryId = (vbIndex << 8) | submeshIndex;
+	}
+}
+
+void CubeMapScene::AddSkyItem(std::vector<RenderItem>& items, const Meshes& meshes)
+{
+	RenderItem sky;
+	XMStoreFloat4x4(&sky.World, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
+	sky.MaterialIndex = (std::uint32_t)SceneMaterial::Sky;
+	sky.Layer = RenderLayer::Sky;
+	sky.Mesh = meshes.Sphere;
+	items.push_back(sky);
+}
+
+void CubeMapScene::AddObjectItems(std::vector<RenderItem>& items, const Meshes& meshes, FXMMATRIX offset)
+{
+	auto addItem = [&](const DrawMesh* mesh, SceneMaterial material, FXMMATRIX world, CXMMATRIX texTransform)
+	{
+		RenderItem ri;
+		XMStoreFloat4x4(&ri.World, world*offset);
+		XMStoreFloat4x4(&ri.TexTransform, texTransform);
+		ri.MaterialIndex = (std::uint32_t)material;
+		ri.Layer = RenderLayer::Opaque;
+		ri.Mesh = mesh;
+		items.push_back(ri);
+	};
+
+	addItem(meshes.Box, SceneMaterial::Bricks0,
+		XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f), XMMatrixIdentity());
+	addItem(meshes.Skull, SceneMaterial::Skull,
+		XMMatrixScaling(0.4f, 0.4f, 0.4f)*XMMatrixTranslation(0.0f, 1.0f, 0.0f), XMMatrixIdentity());
+	addItem(meshes.Grid, SceneMaterial::Tile0, XMMatrixIdentity(), XMMatrixScaling(8.0f, 8.0f, 1.0f));
+
+	XMMATRIX brickTexTransform = XMMatrixScaling(1.5f, 2.0f, 1.0f);
+	for(int i = 0; i < 5; ++i)
+	{
+		XMMATRIX leftCylWorld = XMMatrixTranslation(-5.0f, 1.5f, -10.0f + i*5.0f);
+		XMMATRIX rightCylWorld = XMMatrixTranslation(+5.0f, 1.5f, -10.0f + i*5.0f);
+
+		XMMATRIX leftSphereWorld = XMMatrixTranslation(-5.0f, 3.5f, -10.0f + i*5.0f);
+		XMMATRIX rightSphereWorld = XMMatrixTranslation(+5.0f, 3.5f, -10.0f + i*5.0f);
+
+		addItem(meshes.Cylinder, SceneMaterial::Bricks0, rightCylWorld, brickTexTransform);
+		addItem(meshes.Cylinder, SceneMaterial::Bricks0, leftCylWorld, brickTexTransform);
+		addItem(meshes.Sphere, SceneMaterial::Mirror0, leftSphereWorld, XMMatrixIdentity());
+		addItem(meshes.Sphere, SceneMaterial::Mirror0, rightSphereWorld, XMMatrixIdentity());
+	}
+}
+
+void CubeMapScene::BuildPassConstants(PassConstants& passCB, FXMMATRIX view, CXMMATRIX proj,
+	const XMFLOAT3& eyePosW, float width, float height, float nearZ, float farZ,
+	float totalTime, float deltaTime)
+{
+	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+	XMVECTOR viewDet = XMMatrixDeterminant(view);
+	XMVECTOR projDet = XMMatrixDeterminant(proj);
+	XMVECTOR viewProjDet = XMMatrixDeterminant(viewProj);
+	XMMATRIX invView = XMMatrixInverse(&viewDet, view);
+	XMMATRIX invProj = XMMatrixInverse(&projDet, proj);
+	XMMATRIX invViewProj = XMMatrixInverse(&viewProjDet, viewProj);
+
+	XMStoreFloat4x4(&passCB.View, XMMatrixTranspose(view));
+	XMStoreFloat4x4(&passCB.InvView, XMMatrixTranspose(invView));
+	XMStoreFloat4x4(&passCB.Proj, XMMatrixTranspose(proj));
+	XMStoreFloat4x4(&passCB.InvProj, XMMatrixTranspose(invProj));
+	XMStoreFloat4x4(&passCB.ViewProj, XMMatrixTranspose(viewProj));
+	XMStoreFloat4x4(&passCB.InvViewProj, XMMatrixTranspose(invViewProj));
+	passCB.EyePosW = eyePosW;
+	passCB.RenderTargetSize = XMFLOAT2(width, height);
+	passCB.InvRenderTargetSize = XMFLOAT2(1.0f / width, 1.0f / height);
+	passCB.NearZ = nearZ;
+	passCB.FarZ = farZ;
+	passCB.TotalTime = totalTime;
+	passCB.DeltaTime = deltaTime;
+	passCB.AmbientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
+	passCB.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
+	passCB.Lights[0].Strength = { 0.6f, 0.6f, 0.6f };
+	passCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
+	passCB.Lights[1].Strength = { 0.3f, 0.3f, 0.3f };
+	passCB.Lights[2].Direction = { 0.0f, -0.707f, -0.707f };
+	passCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };
+}
+
+//
+// CubeMapFrame
+//
+
+void CubeMapFrame::BuildDrawQueue(const std::vector<RenderItem>& items, FXMMATRIX view, float nearZ, float farZ)
+{
+	mDrawQueue.Clear();
+	for(std::uint32_t i = 0; i < (std::uint32_t)items.size(); ++i)
+	{
+		const RenderItem& ri = items[i];
+
+		// Depth of the object's origin.  The layers are opaque, so draw front to back.
+		XMVECTOR posV = XMVector3TransformCoord(XMLoadFloat4x4(&ri.World).r[3], view);
+		std::uint32_t depth = DrawQueue::DepthBucket(XMVectorGetZ(posV), nearZ, farZ);
+
+		// Each layer has its own PSO.  The material index is part of the instance
+		// data, so it is left out of the key to not split instanced draws.
+		std::uint32_t layer = (std::uint32_t)ri.Layer;
+		mDrawQueue.Add(DrawQueue::MakeOpaqueKey(layer, layer, 0, ri.Mesh->SortGeometryId, depth), i);
+	}
+
+	mDrawQueue.Sort();
+}
+
+void CubeMapFrame::WriteInstances(const std::vector<RenderItem>& items, RenderBuffer* instanceBuffer)
+{
+	for(std::uint32_t i = 0; i < mDrawQueue.Size(); ++i)
+	{
+		const RenderItem& ri = items[mDrawQueue[i].Item];
+
+		XMMATRIX world = XMLoadFloat4x4(&ri.World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&ri.TexTransform);
+
+		InstanceData data;
+		XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+		data.MaterialIndex = ri.MaterialIndex;
+		data.InstancePad0 = data.InstancePad1 = data.InstancePad2 = 0;
+
+		instanceBuffer->Write((std::uint64_t)i*sizeof(InstanceData), &data, sizeof(InstanceData));
+	}
+}
+
+void CubeMapFrame::Draw(RenderCommandList* cmdList, const Bindings& bindings, const std::vector<RenderItem>& items,
+	const RenderBuffer* instanceBuffer)
+{
+	cmdList->SetGraphicsRootSignature(bindings.RootSignature);
+
+	mStateCache.Begin(cmdList);
+	mStateCache.SetGraphicsRootConstantBufferView(1, bindings.PassCB);
+
+	// Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and
+	// set as a root descriptor.
+	mStateCache.SetGraphicsRootShaderResourceView(2, bindings.MaterialBuffer);
+
+	// One "world" cube map for the whole scene, so it is only set once per frame.
+	mStateCache.SetGraphicsRootDescriptorTable(3, bindings.SkyCubeMap);
+	mStateCache.SetGraphicsRootDescriptorTable(4, bindings.Textures);
+
+	// Render items next to each other in the sorted queue that only differ in depth
+	// share layer, PSO and mesh, and are drawn with one instanced draw.
+	for(std::uint32_t first = 0; first < mDrawQueue.Size(); )
+	{
+		std::uint32_t last = mDrawQueue.RunEnd(first, DrawQueue::OpaqueStateMask);
+
+		const DrawMesh* mesh = items[mDrawQueue[first].Item].Mesh;
+		std::uint32_t layer = DrawQueue::KeyLayer(mDrawQueue[first].Key);
+
+		mStateCache.SetPipelineState(bindings.LayerPsos[layer]);
+		mStateCache.SetVertexBuffer(mesh->VertexBuffer);
+		mStateCache.SetIndexBuffer(mesh->IndexBuffer);
+		mStateCache.SetPrimitiveTopology(mesh->Topology);
+
+		// SV_InstanceID starts at 0 for every draw, so bind the instance buffer at
+		// the first instance of the draw.
+		mStateCache.SetGraphicsRootShaderResourceView(0, instanceBuffer->GetGpuAddress() + first*sizeof(InstanceData));
+
+		mStateCache.DrawIndexedInstanced(mesh->IndexCount, last - first, mesh->StartIndexLocation, mesh->BaseVertexLocation, 0);
+
+		first = last;
+	}
+}
+
+const DrawQueue& CubeMapFrame::Queue()const
+{
+	return mDrawQueue;
+}
+
+const DrawStateCache::Stats& CubeMapFrame::GetDrawStats()const
+{
+	return mStateCache.GetStats();
+}
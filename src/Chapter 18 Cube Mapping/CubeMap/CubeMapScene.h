@@ -0,0 +1,219 @@
+//***************************************************************************************
+// CubeMapScene.h - The CubeMap demo's scene and per frame CPU path, without D3D12
+//
+// CubeMapApp runs this code on the D3D12 backend, and FrameBenchmark runs the same
+// code headless on the null backend, so the benchmark measures (and its stream
+// hash guards) what the demo actually does:
+//   -CubeMapScene makes the meshes on the CPU, lays out the render items and fills
+//    the pass constants.
+//   -CubeMapFrame builds and sorts the draw queue, writes the instance buffer in
+//    draw order, and records the root parameters and instanced draws through
+//    DrawStateCache.
+// Only DirectXMath and the rendering interface are used, so it builds on any
+// platform.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/MathHelper.h"
+#include "../../Common/Light.h"
+#include "../../Common/DrawQueue.h"
+#include "../../Common/DrawStateCache.h"
+#include <DirectXCollision.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Vertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 TexC;
+};
+
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+	std::uint32_t MaterialIndex;
+	std::uint32_t InstancePad0;
+	std::uint32_t InstancePad1;
+	std::uint32_t InstancePad2;
+};
+
+struct PassConstants
+{
+    DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 InvView = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 Proj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 InvProj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 InvViewProj = MathHelper::Identity4x4();
+    DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
+    float cbPerObjectPad1 = 0.0f;
+    DirectX::XMFLOAT2 RenderTargetSize = { 0.0f, 0.0f };
+    DirectX::XMFLOAT2 InvRenderTargetSize = { 0.0f, 0.0f };
+    float NearZ = 0.0f;
+    float FarZ = 0.0f;
+    float TotalTime = 0.0f;
+    float DeltaTime = 0.0f;
+
+    DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
+    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
+    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
+    // are spot lights for a maximum of MaxLights per object.
+    Light Lights[MaxLights];
+};
+
+struct MaterialData
+{
+	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
+	float Roughness = 0.5f;
+
+	// Used in texture mapping.
+	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	std::uint32_t DiffuseMapIndex = 0;
+	std::uint32_t MaterialPad0;
+	std::uint32_t MaterialPad1;
+	std::uint32_t MaterialPad2;
+};
+
+enum class RenderLayer : int
+{
+	Opaque = 0,
+	Sky,
+	Count
+};
+
+// Indices of the demo's materials in the material buffer.
+enum class SceneMaterial : std::uint32_t
+{
+	Bricks0 = 0,
+	Tile0,
+	Mirror0,
+	Skull,
+	Sky,
+	Count
+};
+
+// Vertices and indices on the CPU, and the submeshes in them by name.
+struct SceneGeometry
+{
+	struct Submesh
+	{
+		std::uint32_t IndexCount = 0;
+		std::uint32_t StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+		DirectX::BoundingBox Bounds;
+	};
+
+	std::vector<Vertex> Vertices;
+
+	// One of the two is used.
+	std::vector<std::uint16_t> Indices16;
+	std::vector<std::uint32_t> Indices32;
+
+	std::unordered_map<std::string, Submesh> DrawArgs;
+};
+
+// A submesh as the rendering interface draws it.
+struct DrawMesh
+{
+	VertexBufferView VertexBuffer;
+	IndexBufferView IndexBuffer;
+	PrimitiveTopology Topology = PrimitiveTopology::TriangleList;
+
+	// DrawIndexedInstanced parameters.
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// Identifies the mesh in the draw sort keys; see AssignSortGeometryIds().
+	std::uint32_t SortGeometryId = 0;
+};
+
+// Lightweight structure stores parameters to draw a shape.
+struct RenderItem
+{
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	std::uint32_t MaterialIndex = 0;
+	RenderLayer Layer = RenderLayer::Opaque;
+	const DrawMesh* Mesh = nullptr;
+};
+
+class CubeMapScene
+{
+public:
+	struct Meshes
+	{
+		const DrawMesh* Box = nullptr;
+		const DrawMesh* Grid = nullptr;
+		const DrawMesh* Sphere = nullptr;
+		const DrawMesh* Cylinder = nullptr;
+		const DrawMesh* Skull = nullptr;
+	};
+
+	// The box, grid, sphere and cylinder in one vertex and 16-bit index buffer.
+	static SceneGeometry BuildShapeGeometry();
+
+	// The skull model, with 32-bit indices.  Returns false if the file cannot be read.
+	static bool LoadSkullGeometry(const std::string& filename, SceneGeometry& geometry);
+
+	// Number the meshes so that submeshes sharing a vertex buffer get neighboring
+	// ids: vertex buffer in the high byte and submesh in the low byte.
+	static void AssignSortGeometryIds(const std::vector<DrawMesh*>& meshes);
+
+	static void AddSkyItem(std::vector<RenderItem>& items, const Meshes& meshes);
+
+	// The box, skull, grid and columns with spheres, moved by offset.
+	static void AddObjectItems(std::vector<RenderItem>& items, const Meshes& meshes, DirectX::FXMMATRIX offset);
+
+	static void BuildPassConstants(PassConstants& passCB, DirectX::FXMMATRIX view, DirectX::CXMMATRIX proj,
+		const DirectX::XMFLOAT3& eyePosW, float width, float height, float nearZ, float farZ,
+		float totalTime, float deltaTime);
+};
+
+class CubeMapFrame
+{
+public:
+	// What the root signature binds besides the instances (root parameter 0).
+	struct Bindings
+	{
+		RenderRootSignature* RootSignature = nullptr;
+		RenderPipeline* LayerPsos[(int)RenderLayer::Count] = {};
+		GpuAddress PassCB = 0;                  // Root parameter 1.
+		GpuAddress MaterialBuffer = 0;          // 2.
+		GpuDescriptor SkyCubeMap = 0;           // 3.
+		GpuDescriptor Textures = 0;             // 4.
+	};
+
+	CubeMapFrame() = default;
+	CubeMapFrame(const CubeMapFrame& rhs) = delete;
+	CubeMapFrame& operator=(const CubeMapFrame& rhs) = delete;
+	~CubeMapFrame() = default;
+
+	// Queue the items sorted by layer, mesh and depth (front to back).
+	void BuildDrawQueue(const std::vector<RenderItem>& items, DirectX::FXMMATRIX view, float nearZ, float farZ);
+
+	// Write the instances in draw order, so the items drawn together by one
+	// instanced draw are contiguous in the instance buffer.
+	void WriteInstances(const std::vector<RenderItem>& items, RenderBuffer* instanceBuffer);
+
+	// Bind the root signature and parameters and draw the queue, one instanced
+	// draw per run of queued items with the same layer and mesh.
+	void Draw(RenderCommandList* cmdList, const Bindings& bindings, const std::vector<RenderItem>& items,
+		const RenderBuffer* instanceBuffer);
+
+	const DrawQueue& Queue()const;
+	const DrawStateCache::Stats& GetDrawStats()const;
+
+private:
+	DrawQueue mDrawQueue;
+	DrawStateCache mStateCache;
+};
@@ -7,6 +7,8 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/DrawQueue.h"
 #include "FrameResource.h"
 #include "CubeRenderTarget.h"
 
@@ -35,13 +37,13 @@ struct RenderItem
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	// The render item's instance data, rebuilt by UpdateInstanceData() when InstanceDirty
+	// is set.  DrawRenderItems() copies it next to the other instances of its draw.
+	InstanceData Instance;
+	bool InstanceDirty = true;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Index of this render item in mAllRitems.  The instance data is written as the
+	// items are drawn, so there is no per object constant buffer to index.
 	UINT ObjCBIndex = -1;
 
 	Material* Mat = nullptr;
@@ -54,6 +56,9 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Bounding box of the geometry in local space.
+	BoundingBox Bounds;
 };
 
 enum class RenderLayer : int
@@ -86,7 +91,7 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
-	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateCubeMapFacePassCBs();
@@ -104,6 +109,8 @@ private:
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 	void DrawSceneToCubeMap();
+	void BuildSceneCuller();
+	void UpdateSceneCulling();
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 	void BuildCubeFaceCamera(float x, float y, float z);
@@ -144,9 +151,24 @@ private:
 
     PassConstants mMainPassCB;
 
+    // Instances written to the current frame resource's instance buffer so far.
+    UINT mInstanceCount = 0;
+
 	Camera mCamera;
 	Camera mCubeMapCamera[6];
 
+	// The six cube map faces and the main camera are culled together in one
+	// pass.  Views 0-5 are the cube map faces.
+	static const UINT MainView = 6;
+	static const UINT ViewCount = 7;
+
+	// World space bounds of the render items, indexed by ObjCBIndex.
+	FrustumCuller mSceneCuller;
+	std::vector<UINT> mRitemViewMasks;
+
+	// Visible render items of each view, divided by PSO.
+	std::vector<RenderItem*> mVisibleRitems[ViewCount][(int)RenderLayer::Count];
+
     POINT mLastMousePos;
 };
 
@@ -208,6 +230,7 @@ bool DynamicCubeMapApp::Initialize()
     BuildShapeGeometry();
 	BuildMaterials();
     BuildRenderItems();
+	BuildSceneCuller();
     BuildFrameResources();
     BuildPSOs();
 
@@ -268,7 +291,7 @@ void DynamicCubeMapApp::Update(const GameTimer& gt)
 	XMMATRIX skullLocalRotate = XMMatrixRotationY(2.0f*gt.TotalTime());
 	XMMATRIX skullGlobalRotate = XMMatrixRotationY(0.5f*gt.TotalTime());
 	XMStoreFloat4x4(&mSkullRitem->World, skullScale*skullLocalRotate*skullOffset*skullGlobalRotate);
-	mSkullRitem->NumFramesDirty = gNumFrameResources;
+	mSkullRitem->InstanceDirty = true;
 
     // Cycle through the circular frame resource array.
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -285,9 +308,10 @@ void DynamicCubeMapApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+	UpdateInstanceData(gt);
 	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
+	UpdateSceneCulling();
 }
 
 void DynamicCubeMapApp::Draw(const GameTimer& gt)
@@ -298,6 +322,9 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt)
     // We can only reset when the associated command lists have finished execution on the GPU.
     ThrowIfFailed(cmdListAlloc->Reset());
 
+    // The GPU is done with this frame resource's instance buffer too.
+    mInstanceCount = 0;
+
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
@@ -351,15 +378,15 @@ void DynamicCubeMapApp::Draw(const GameTimer& gt)
 	dynamicTexDescriptor.Offset(mSkyTexHeapIndex + 1, mCbvSrvUavDescriptorSize);
 	mCommandList->SetGraphicsRootDescriptorTable(3, dynamicTexDescriptor);
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors]);
+	DrawRenderItems(mCommandList.Get(), mVisibleRitems[MainView][(int)RenderLayer::OpaqueDynamicReflectors]);
 
 	// Use the static "background" cube map for the other objects (including the sky)
 	mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	DrawRenderItems(mCommandList.Get(), mVisibleRitems[MainView][(int)RenderLayer::Opaque]);
 
 	mCommandList->SetPipelineState(mPSOs["sky"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+	DrawRenderItems(mCommandList.Get(), mVisibleRitems[MainView][(int)RenderLayer::Sky]);
 
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -438,28 +465,23 @@ void DynamicCubeMapApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
-void DynamicCubeMapApp::UpdateObjectCBs(const GameTimer& gt)
+void DynamicCubeMapApp::UpdateInstanceData(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 	for(auto& e : mAllRitems)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+		// Only rebuild the instance data if the render item changed.
+		if(!e->InstanceDirty)
+			continue;
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-			objConstants.MaterialIndex = e->Mat->MatCBIndex;
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		InstanceData& instance = e->Instance;
+		XMStoreFloat4x4(&instance.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&instance.TexTransform, XMMatrixTranspose(texTransform));
+		instance.MaterialIndex = e->Mat->MatCBIndex;
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+		e->InstanceDirty = false;
 	}
 }
 
@@ -601,7 +623,7 @@ void DynamicCubeMapApp::BuildRootSignature()
     CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
-    slotRootParameter[0].InitAsConstantBufferView(0);
+    slotRootParameter[0].InitAsShaderResourceView(1, 1);
     slotRootParameter[1].InitAsConstantBufferView(1);
     slotRootParameter[2].InitAsShaderResourceView(0, 1);
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -905,6 +927,13 @@ void DynamicCubeMapApp::BuildShapeGeometry()
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
 
+	// Local space bounds, used to cull the render items.
+	const size_t vertexStride = sizeof(GeometryGenerator::Vertex);
+	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(), &box.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(gridSubmesh.Bounds, grid.Vertices.size(), &grid.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(sphereSubmesh.Bounds, sphere.Vertices.size(), &sphere.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(cylinderSubmesh.Bounds, cylinder.Vertices.size(), &cylinder.Vertices[0].Position, vertexStride);
+
 	//
 	// Extract the vertex elements we are interested in and pack the
 	// vertices of all the meshes into one vertex buffer.
@@ -1048,7 +1077,7 @@ void DynamicCubeMapApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            7, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            7, ViewCount*(UINT)mAllRitems.size(), (UINT)mMaterials.size()));
     }
 }
 
@@ -1113,6 +1142,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	skyRitem->IndexCount = skyRitem->Geo->DrawArgs["sphere"].IndexCount;
 	skyRitem->StartIndexLocation = skyRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 	skyRitem->BaseVertexLocation = skyRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	skyRitem->Bounds = skyRitem->Geo->DrawArgs["sphere"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Sky].push_back(skyRitem.get());
 	mAllRitems.push_back(std::move(skyRitem));
@@ -1127,6 +1157,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
 	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
 	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
 
 	mSkullRitem = skullRitem.get();
 
@@ -1143,6 +1174,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
 	mAllRitems.push_back(std::move(boxRitem));
@@ -1157,6 +1189,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 	globeRitem->IndexCount = globeRitem->Geo->DrawArgs["sphere"].IndexCount;
 	globeRitem->StartIndexLocation = globeRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 	globeRitem->BaseVertexLocation = globeRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	globeRitem->Bounds = globeRitem->Geo->DrawArgs["sphere"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::OpaqueDynamicReflectors].push_back(globeRitem.get());
 	mAllRitems.push_back(std::move(globeRitem));
@@ -1171,6 +1204,7 @@ void DynamicCubeMapApp::BuildRenderItems()
     gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
     gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
     gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    gridRitem->Bounds = gridRitem->Geo->DrawArgs["grid"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 	mAllRitems.push_back(std::move(gridRitem));
@@ -1199,6 +1233,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		leftCylRitem->Bounds = leftCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
@@ -1209,6 +1244,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		rightCylRitem->Bounds = rightCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1219,6 +1255,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		leftSphereRitem->Bounds = leftSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1229,6 +1266,7 @@ void DynamicCubeMapApp::BuildRenderItems()
 		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		rightSphereRitem->Bounds = rightSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		mRitemLayer[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
 		mRitemLayer[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
@@ -1240,29 +1278,43 @@ void DynamicCubeMapApp::BuildRenderItems()
 		mAllRitems.push_back(std::move(leftSphereRitem));
 		mAllRitems.push_back(std::move(rightSphereRitem));
 	}
+
+	// The visible lists keep the layer order, so the repeated meshes are drawn together.
+	for(auto& layer : mRitemLayer)
+		DrawQueue::SortRuns(layer, d3dUtil::MeshKey<RenderItem>);
 }
 
 void DynamicCubeMapApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+    UINT instanceByteSize = sizeof(InstanceData);
  
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer.get();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    // Each run of render items with the same mesh is one instanced draw.
+    DrawQueue::ForEachRun(ritems, d3dUtil::MeshKey<RenderItem>, [&](UINT first, UINT last)
     {
-        auto ri = ritems[i];
+        auto ri = ritems[first];
+
+        UINT instanceCount = last - first;
+
+        // Copy the draw's instances after the ones already drawn this frame.
+        for(UINT i = 0; i < instanceCount; ++i)
+            instanceBuffer->CopyData(mInstanceCount + i, ritems[first + i]->Instance);
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+        // SV_InstanceID starts at 0 for every draw, so bind the instance buffer at
+        // the first instance of the draw.
+        D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->Resource()->GetGPUVirtualAddress() + mInstanceCount*instanceByteSize;
 
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+		cmdList->SetGraphicsRootShaderResourceView(0, instanceAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+        cmdList->DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+
+        mInstanceCount += instanceCount;
+    });
 }
 
 void DynamicCubeMapApp::DrawSceneToCubeMap()
@@ -1292,10 +1344,10 @@ void DynamicCubeMapApp::DrawSceneToCubeMap()
 		D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1+i)*passCBByteSize;
 		mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
 
-		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+		DrawRenderItems(mCommandList.Get(), mVisibleRitems[i][(int)RenderLayer::Opaque]);
 
 		mCommandList->SetPipelineState(mPSOs["sky"].Get());
-		DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+		DrawRenderItems(mCommandList.Get(), mVisibleRitems[i][(int)RenderLayer::Sky]);
 
 		mCommandList->SetPipelineState(mPSOs["opaque"].Get());
 	}
@@ -1305,6 +1357,52 @@ void DynamicCubeMapApp::DrawSceneToCubeMap()
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
 }
 
+void DynamicCubeMapApp::BuildSceneCuller()
+{
+	mSceneCuller.Clear();
+	mSceneCuller.Reserve((UINT)mAllRitems.size());
+
+	for(auto& ri : mAllRitems)
+	{
+		BoundingBox worldBounds;
+		ri->Bounds.Transform(worldBounds, XMLoadFloat4x4(&ri->World));
+
+		UINT index = mSceneCuller.AddBox(worldBounds);
+		assert(index == ri->ObjCBIndex);
+	}
+
+	mRitemViewMasks.resize(mAllRitems.size());
+}
+
+void DynamicCubeMapApp::UpdateSceneCulling()
+{
+	// The skull is the only render item that moves.
+	BoundingBox skullBounds;
+	mSkullRitem->Bounds.Transform(skullBounds, XMLoadFloat4x4(&mSkullRitem->World));
+	mSceneCuller.SetBox(mSkullRitem->ObjCBIndex, skullBounds);
+
+	std::array<XMFLOAT4, 6> viewPlanes[ViewCount];
+	for(int i = 0; i < 6; ++i)
+		viewPlanes[i] = mCubeMapCamera[i].GetFrustumPlanes();
+	viewPlanes[MainView] = mCamera.GetFrustumPlanes();
+
+	// Test each render item once against all the views.
+	mSceneCuller.CullViews(viewPlanes, ViewCount, mRitemViewMasks.data());
+
+	for(UINT v = 0; v < ViewCount; ++v)
+	{
+		for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+		{
+			mVisibleRitems[v][layer].clear();
+			for(auto ri : mRitemLayer[layer])
+			{
+				if(mRitemViewMasks[ri->ObjCBIndex] & (1u << v))
+					mVisibleRitems[v][layer].push_back(ri);
+			}
+		}
+	}
+}
+
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> DynamicCubeMapApp::GetStaticSamplers()
 {
 	// Applications usually only need a handful of samplers.  So just define them all up front
@@ -0,0 +1,264 @@
+//***************************************************************************************
+// FrameBenchmark.cpp - Headless benchmark of the CubeMap demo's CPU frame
+//
+// Runs the CubeMap demo's own per frame CPU path (CubeMapScene and CubeMapFrame,
+// which CubeMapApp also runs) on the null rendering backend, without a window or
+// GPU: building and sorting the draw queue, writing the instance buffer and pass
+// constants, and recording the instanced draws through DrawStateCache.  The demo's
+// meshes are built (and the skull loaded) on the CPU for their sizes, and its scene
+// (a sky sphere, and a box, skull, grid and ten columns with spheres) is repeated
+// on a grid.  The camera orbits the grid at a fixed step per frame, so every run
+// records the same commands.
+//
+// Reports the time per frame and the counts of the null command list, and a hash
+// of all recorded streams.  With --expect, the exit code is 1 if the hash differs,
+// for use as a regression test (hashes are only comparable within one build
+// configuration, as the depth sort depends on float rounding).
+//
+// Usage: FrameBenchmark [frames] [--expect hash] [--skull path/to/skull.txt]
+//***************************************************************************************
+
+#include "../../Common/NullRenderDevice.h"
+#include "../CubeMap/CubeMapScene.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t GridSize = 8;
+	const float GridSpacing = 40.0f;
+	const std::uint32_t DefaultFrameCount = 600;
+	const char* DefaultSkullFilename = "../CubeMap/Models/skull.txt";
+
+	// The upload buffers of CubeMap's FrameResource, created on the rendering
+	// interface directly so that no D3D12 header is included.
+	struct FrameResource
+	{
+		FrameResource(RenderDevice* device, std::uint32_t itemCount)
+		{
+			// Constant buffers are multiples of 256 bytes.
+			PassCB = device->CreateBuffer((sizeof(PassConstants) + 255) & ~255, RenderHeap::Upload);
+			InstanceBuffer = device->CreateBuffer((std::uint64_t)itemCount*sizeof(InstanceData), RenderHeap::Upload);
+			MaterialBuffer = device->CreateBuffer((std::uint64_t)SceneMaterial::Count*sizeof(MaterialData), RenderHeap::Upload);
+		}
+
+		std::unique_ptr<RenderBuffer> PassCB;
+		std::unique_ptr<RenderBuffer> InstanceBuffer;
+		std::unique_ptr<RenderBuffer> MaterialBuffer;
+	};
+
+	// Default heap buffers of the mesh's sizes; the null backend keeps no contents.
+	struct NullMeshBuffers
+	{
+		std::unique_ptr<RenderBuffer> VertexBuffer;
+		std::unique_ptr<RenderBuffer> IndexBuffer;
+	};
+
+	NullMeshBuffers CreateMeshBuffers(RenderDevice* device, const SceneGeometry& geometry,
+		std::unordered_map<std::string, DrawMesh>& meshes)
+	{
+		const bool use32BitIndices = !geometry.Indices32.empty();
+		const std::uint64_t vbByteSize = geometry.Vertices.size()*sizeof(Vertex);
+		const std::uint64_t ibByteSize = use32BitIndices ?
+			geometry.Indices32.size()*sizeof(std::uint32_t) :
+			geometry.Indices16.size()*sizeof(std::uint16_t);
+
+		NullMeshBuffers buffers;
+		buffers.VertexBuffer = device->CreateBuffer(vbByteSize, RenderHeap::Default);
+		buffers.IndexBuffer = device->CreateBuffer(ibByteSize, RenderHeap::Default);
+
+		for(const auto& e : geometry.DrawArgs)
+		{
+			DrawMesh mesh;
+			mesh.VertexBuffer.Address = buffers.VertexBuffer->GetGpuAddress();
+			mesh.VertexBuffer.SizeInBytes = (std::uint32_t)vbByteSize;
+			mesh.VertexBuffer.StrideInBytes = sizeof(Vertex);
+			mesh.IndexBuffer.Address = buffers.IndexBuffer->GetGpuAddress();
+			mesh.IndexBuffer.SizeInBytes = (std::uint32_t)ibByteSize;
+			mesh.IndexBuffer.Format = use32BitIndices ? IndexFormat::UInt32 : IndexFormat::UInt16;
+			mesh.IndexCount = e.second.IndexCount;
+			mesh.StartIndexLocation = e.second.StartIndexLocation;
+			mesh.BaseVertexLocation = e.second.BaseVertexLocation;
+
+			meshes[e.first] = mesh;
+		}
+
+		return buffers;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if(!XMVerifyCPUSupport())
+	{
+		std::cout << "directx math not supported" << std::endl;
+		return 0;
+	}
+
+	std::uint32_t frameCount = DefaultFrameCount;
+	bool checkHash = false;
+	std::uint64_t expectedHash = 0;
+	std::string skullFilename = DefaultSkullFilename;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strcmp(argv[i], "--expect") == 0 && i + 1 < argc)
+		{
+			checkHash = true;
+			expectedHash = std::stoull(argv[++i], nullptr, 16);
+		}
+		else if(strcmp(argv[i], "--skull") == 0 && i + 1 < argc)
+			skullFilename = argv[++i];
+		else
+			frameCount = std::max<int>(1, std::atoi(argv[i]));
+	}
+
+	NullRenderDevice device;
+
+	// The demo's meshes: the shapes share one vertex and index buffer, like its shapeGeo.
+	SceneGeometry skull;
+	if(!CubeMapScene::LoadSkullGeometry(skullFilename, skull))
+	{
+		std::cout << skullFilename << " not found" << std::endl;
+		return 1;
+	}
+
+	std::unordered_map<std::string, DrawMesh> drawMeshes;
+	NullMeshBuffers shapeBuffers = CreateMeshBuffers(&device, CubeMapScene::BuildShapeGeometry(), drawMeshes);
+	NullMeshBuffers skullBuffers = CreateMeshBuffers(&device, skull, drawMeshes);
+
+	CubeMapScene::Meshes meshes;
+	meshes.Box = &drawMeshes["box"];
+	meshes.Grid = &drawMeshes["grid"];
+	meshes.Sphere = &drawMeshes["sphere"];
+	meshes.Cylinder = &drawMeshes["cylinder"];
+	meshes.Skull = &drawMeshes["skull"];
+
+	CubeMapScene::AssignSortGeometryIds({ &drawMeshes["box"], &drawMeshes["grid"], &drawMeshes["sphere"],
+		&drawMeshes["cylinder"], &drawMeshes["skull"] });
+
+	// The demo's scene, with the objects repeated on the grid.
+	const float extent = GridSize*GridSpacing;
+
+	std::vector<RenderItem> items;
+	CubeMapScene::AddSkyItem(items, meshes);
+	for(std::uint32_t gz = 0; gz < GridSize; ++gz)
+	{
+		for(std::uint32_t gx = 0; gx < GridSize; ++gx)
+		{
+			XMMATRIX offset = XMMatrixTranslation(gx*GridSpacing - 0.5f*extent, 0.0f, gz*GridSpacing - 0.5f*extent);
+			CubeMapScene::AddObjectItems(items, meshes, offset);
+		}
+	}
+
+	const std::uint32_t itemCount = (std::uint32_t)items.size();
+
+	// Three frame resources, as in the demo.
+	std::vector<std::unique_ptr<FrameResource>> frameResources;
+	for(int i = 0; i < 3; ++i)
+		frameResources.push_back(std::make_unique<FrameResource>(&device, itemCount));
+
+	// Stand-ins for the demo's PSOs, root signature, descriptor heap and back
+	// buffer; the null backend only needs distinct objects.
+	static char opaquePso, skyPso, rootSignature;
+	const GpuDescriptor srvHeapStart = 0x100000;
+	const std::uint32_t skyTexHeapIndex = 3;
+	const std::uint32_t cbvSrvDescriptorSize = 32;
+	auto backBuffer = device.CreateBuffer(0, RenderHeap::Default);
+
+	CubeMapFrame::Bindings bindings;
+	bindings.RootSignature = reinterpret_cast<RenderRootSignature*>(&rootSignature);
+	bindings.LayerPsos[(int)RenderLayer::Opaque] = reinterpret_cast<RenderPipeline*>(&opaquePso);
+	bindings.LayerPsos[(int)RenderLayer::Sky] = reinterpret_cast<RenderPipeline*>(&skyPso);
+	bindings.SkyCubeMap = srvHeapStart + skyTexHeapIndex*cbvSrvDescriptorSize;
+	bindings.Textures = srvHeapStart;
+
+	const float width = 800.0f;
+	const float height = 600.0f;
+	const float nearZ = 1.0f;
+	const float farZ = 1000.0f;
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, width / height, nearZ, farZ);
+
+	CubeMapFrame cubeMapFrame;
+	NullCommandList cmdList;
+
+	double totalMs = 0.0;
+	double minMs = 1e30;
+	std::uint64_t streamHash = 14695981039346656037ull;
+	std::uint64_t uploadedBytes = 0;
+	std::uint64_t streamBytes = 0;
+	NullCommandList::Stats cmdStats;
+	DrawStateCache::Stats drawStats;
+
+	for(std::uint32_t frame = 0; frame < frameCount; ++frame)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		FrameResource* currFrame = frameResources[frame % frameResources.size()].get();
+		device.ResetUploadStats();
+		cmdList.Reset();
+
+		// Orbit the grid at a fixed step per frame.
+		float t = frame / 60.0f;
+		XMVECTOR eye = XMVectorSet(0.6f*extent*cosf(0.2f*t), 30.0f, 0.6f*extent*sinf(0.2f*t), 1.0f);
+		XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+		// CubeMapApp::Update
+		XMFLOAT3 eyePosW;
+		XMStoreFloat3(&eyePosW, eye);
+
+		PassConstants passConstants;
+		CubeMapScene::BuildPassConstants(passConstants, view, proj, eyePosW, width, height, nearZ, farZ,
+			t, 1.0f / 60.0f);
+		currFrame->PassCB->Write(0, &passConstants, sizeof(PassConstants));
+
+		cubeMapFrame.BuildDrawQueue(items, view, nearZ, farZ);
+		cubeMapFrame.WriteInstances(items, currFrame->InstanceBuffer.get());
+
+		// CubeMapApp::Draw
+		bindings.PassCB = currFrame->PassCB->GetGpuAddress();
+		bindings.MaterialBuffer = currFrame->MaterialBuffer->GetGpuAddress();
+
+		cmdList.ResourceBarrier(backBuffer.get(), ResourceState::Present, ResourceState::RenderTarget);
+		cubeMapFrame.Draw(&cmdList, bindings, items, currFrame->InstanceBuffer.get());
+		cmdList.ResourceBarrier(backBuffer.get(), ResourceState::RenderTarget, ResourceState::Present);
+
+		auto stop = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+		totalMs += ms;
+		minMs = std::min<double>(minMs, ms);
+
+		streamHash = (streamHash ^ cmdList.Hash())*1099511628211ull;
+		uploadedBytes += device.GetStats().UploadedBytes;
+		streamBytes += cmdList.Stream().size()*sizeof(std::uint32_t);
+		cmdStats = cmdList.GetStats();
+		drawStats = cubeMapFrame.GetDrawStats();
+	}
+
+	std::cout << "FrameBenchmark: " << itemCount << " render items, " << frameCount << " frames" << std::endl;
+	std::cout << std::fixed << std::setprecision(3)
+		<< "  CPU frame        avg " << totalMs / frameCount << " ms   min " << minMs << " ms" << std::endl;
+	std::cout << "  last frame       draws " << cmdStats.DrawCount
+		<< "   instances " << cmdStats.InstanceCount
+		<< "   barriers " << cmdStats.BarrierCount
+		<< "   state changes " << cmdStats.StateChangeCount
+		<< " (redundant avoided " << drawStats.RedundantStateChanges << ")" << std::endl;
+	std::cout << std::setprecision(1)
+		<< "  per frame        uploaded " << uploadedBytes / 1024.0 / frameCount << " KB"
+		<< "   command stream " << streamBytes / 1024.0 / frameCount << " KB" << std::endl;
+	std::cout << "  stream hash      " << std::hex << streamHash << std::dec << std::endl;
+
+	if(checkHash && streamHash != expectedHash)
+	{
+		std::cout << "stream hash differs from expected " << std::hex << expectedHash << std::dec << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -7,6 +7,7 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/DrawQueue.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -32,14 +33,10 @@ struct RenderItem
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
+	// The render item's instance data, rebuilt by UpdateInstanceData() when InstanceDirty
+	// is set.  DrawRenderItems() copies it next to the other instances of its draw.
+	InstanceData Instance;
+	bool InstanceDirty = true;
 
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
@@ -81,7 +78,7 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
-	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 
@@ -128,6 +125,9 @@ private:
 
     PassConstants mMainPassCB;
 
+    // Instances written to the current frame resource's instance buffer so far.
+    UINT mInstanceCount = 0;
+
 	Camera mCamera;
 
     POINT mLastMousePos;
@@ -228,7 +228,7 @@ void NormalMapApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+	UpdateInstanceData(gt);
 	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
 }
@@ -241,6 +241,9 @@ void NormalMapApp::Draw(const GameTimer& gt)
     // We can only reset when the associated command lists have finished execution on the GPU.
     ThrowIfFailed(cmdListAlloc->Reset());
 
+    // The GPU is done with this frame resource's instance buffer too.
+    mInstanceCount = 0;
+
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
@@ -368,28 +371,23 @@ void NormalMapApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
-void NormalMapApp::UpdateObjectCBs(const GameTimer& gt)
+void NormalMapApp::UpdateInstanceData(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 	for(auto& e : mAllRitems)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+		// Only rebuild the instance data if the render item changed.
+		if(!e->InstanceDirty)
+			continue;
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-			objConstants.MaterialIndex = e->Mat->MatCBIndex;
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		InstanceData& instance = e->Instance;
+		XMStoreFloat4x4(&instance.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&instance.TexTransform, XMMatrixTranspose(texTransform));
+		instance.MaterialIndex = e->Mat->MatCBIndex;
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+		e->InstanceDirty = false;
 	}
 }
 
@@ -505,7 +503,7 @@ void NormalMapApp::BuildRootSignature()
     CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
-    slotRootParameter[0].InitAsConstantBufferView(0);
+    slotRootParameter[0].InitAsShaderResourceView(1, 1);
     slotRootParameter[1].InitAsConstantBufferView(1);
     slotRootParameter[2].InitAsShaderResourceView(0, 1);
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -860,7 +858,6 @@ void NormalMapApp::BuildRenderItems()
 	auto skyRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&skyRitem->World, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
 	skyRitem->TexTransform = MathHelper::Identity4x4();
-	skyRitem->ObjCBIndex = 0;
 	skyRitem->Mat = mMaterials["sky"].get();
 	skyRitem->Geo = mGeometries["shapeGeo"].get();
 	skyRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -874,7 +871,6 @@ void NormalMapApp::BuildRenderItems()
 	auto boxRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
 	XMStoreFloat4x4(&boxRitem->TexTransform, XMMatrixScaling(1.0f, 0.5f, 1.0f));
-	boxRitem->ObjCBIndex = 1;
 	boxRitem->Mat = mMaterials["bricks0"].get();
 	boxRitem->Geo = mGeometries["shapeGeo"].get();
 	boxRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -888,7 +884,6 @@ void NormalMapApp::BuildRenderItems()
 	auto globeRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&globeRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f)*XMMatrixTranslation(0.0f, 2.0f, 0.0f));
 	XMStoreFloat4x4(&globeRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-	globeRitem->ObjCBIndex = 2;
 	globeRitem->Mat = mMaterials["mirror0"].get();
 	globeRitem->Geo = mGeometries["shapeGeo"].get();
 	globeRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -902,7 +897,6 @@ void NormalMapApp::BuildRenderItems()
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
 	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(8.0f, 8.0f, 1.0f));
-	gridRitem->ObjCBIndex = 3;
 	gridRitem->Mat = mMaterials["tile0"].get();
 	gridRitem->Geo = mGeometries["shapeGeo"].get();
 	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -914,7 +908,6 @@ void NormalMapApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(gridRitem));
 
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.5f, 2.0f, 1.0f);
-	UINT objCBIndex = 4;
 	for(int i = 0; i < 5; ++i)
 	{
 		auto leftCylRitem = std::make_unique<RenderItem>();
@@ -930,7 +923,6 @@ void NormalMapApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&leftCylRitem->World, rightCylWorld);
 		XMStoreFloat4x4(&leftCylRitem->TexTransform, brickTexTransform);
-		leftCylRitem->ObjCBIndex = objCBIndex++;
 		leftCylRitem->Mat = mMaterials["bricks0"].get();
 		leftCylRitem->Geo = mGeometries["shapeGeo"].get();
 		leftCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -940,7 +932,6 @@ void NormalMapApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
-		rightCylRitem->ObjCBIndex = objCBIndex++;
 		rightCylRitem->Mat = mMaterials["bricks0"].get();
 		rightCylRitem->Geo = mGeometries["shapeGeo"].get();
 		rightCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -950,7 +941,6 @@ void NormalMapApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
-		leftSphereRitem->ObjCBIndex = objCBIndex++;
 		leftSphereRitem->Mat = mMaterials["mirror0"].get();
 		leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		leftSphereRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -960,7 +950,6 @@ void NormalMapApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
-		rightSphereRitem->ObjCBIndex = objCBIndex++;
 		rightSphereRitem->Mat = mMaterials["mirror0"].get();
 		rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		rightSphereRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -978,29 +967,42 @@ void NormalMapApp::BuildRenderItems()
 		mAllRitems.push_back(std::move(leftSphereRitem));
 		mAllRitems.push_back(std::move(rightSphereRitem));
 	}
+
+	for(auto& layer : mRitemLayer)
+		DrawQueue::SortRuns(layer, d3dUtil::MeshKey<RenderItem>);
 }
 
 void NormalMapApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+    UINT instanceByteSize = sizeof(InstanceData);
  
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer.get();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    // Each run of render items with the same mesh is one instanced draw.
+    DrawQueue::ForEachRun(ritems, d3dUtil::MeshKey<RenderItem>, [&](UINT first, UINT last)
     {
-        auto ri = ritems[i];
+        auto ri = ritems[first];
+
+        UINT instanceCount = last - first;
+
+        // Copy the draw's instances after the ones already drawn this frame.
+        for(UINT i = 0; i < instanceCount; ++i)
+            instanceBuffer->CopyData(mInstanceCount + i, ritems[first + i]->Instance);
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+        // SV_InstanceID starts at 0 for every draw, so bind the instance buffer at
+        // the first instance of the draw.
+        D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->Resource()->GetGPUVirtualAddress() + mInstanceCount*instanceByteSize;
 
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+		cmdList->SetGraphicsRootShaderResourceView(0, instanceAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+        cmdList->DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+
+        mInstanceCount += instanceCount;
+    });
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> NormalMapApp::GetStaticSamplers()
@@ -48,17 +48,20 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
-// Constant data that varies per frame.
-cbuffer cbPerObject : register(b0)
+struct InstanceData
 {
-    float4x4 gWorld;
-	float4x4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+	float4x4 World;
+	float4x4 TexTransform;
+	uint     MaterialIndex;
+	uint     InstPad0;
+	uint     InstPad1;
+	uint     InstPad2;
 };
 
+// Instances of the current draw.  The application binds the buffer at the draw's
+// first instance, so SV_InstanceID indexes it directly.
+StructuredBuffer<InstanceData> gInstanceData : register(t1, space1);
+
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
 {
@@ -3,15 +3,16 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "../../Common/ShadowCascades.h"
 
-struct ObjectConstants
+struct InstanceData
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 	UINT     MaterialIndex;
-	UINT     ObjPad0;
-	UINT     ObjPad1;
-	UINT     ObjPad2;
+	UINT     InstancePad0;
+	UINT     InstancePad1;
+	UINT     InstancePad2;
 };
 
 struct PassConstants
@@ -22,7 +23,14 @@ struct PassConstants
     DirectX::XMFLOAT4X4 InvProj = MathHelper::Identity4x4();
     DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
     DirectX::XMFLOAT4X4 InvViewProj = MathHelper::Identity4x4();
-    DirectX::XMFLOAT4X4 ShadowTransform = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 ShadowTransforms[ShadowCascades::MaxCascades];
+
+    // View depth where each cascade ends; pixels past the last one are unshadowed.
+    DirectX::XMFLOAT4 CascadeSplits = { 0.0f, 0.0f, 0.0f, 0.0f };
+    UINT CascadeCount = 0;
+    UINT CascadePad0 = 0;
+    UINT CascadePad1 = 0;
+    UINT CascadePad2 = 0;
     DirectX::XMFLOAT3 EyePosW = { 0.0f, 0.0f, 0.0f };
     float cbPerObjectPad1 = 0.0f;
     DirectX::XMFLOAT2 RenderTargetSize = { 0.0f, 0.0f };
@@ -70,7 +78,7 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT instanceCount, UINT materialCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -82,7 +90,9 @@ public:
     // We cannot update a cbuffer until the GPU is done processing the commands
     // that reference it.  So each frame needs their own cbuffers.
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+
+    // Instances of the render items, written in draw order as they are drawn.
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
 
 	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
 
@@ -15,6 +15,9 @@
     #define NUM_SPOT_LIGHTS 0
 #endif
 
+// Must match ShadowCascades::MaxCascades.
+#define MAX_SHADOW_CASCADES 4
+
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
@@ -31,7 +34,7 @@ struct MaterialData
 };
 
 TextureCube gCubeMap : register(t0);
-Texture2D gShadowMap : register(t1);
+Texture2DArray gShadowMap : register(t1);
 
 // An array of textures, which is only supported in shader model 5.1+.  Unlike Texture2DArray, the textures
 // in this array can be different sizes and formats, making it more flexible than texture arrays.
@@ -50,17 +53,20 @@ SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 SamplerComparisonState gsamShadow : register(s6);
 
-// Constant data that varies per frame.
-cbuffer cbPerObject : register(b0)
+struct InstanceData
 {
-    float4x4 gWorld;
-	float4x4 gTexTransform;
-	uint gMaterialIndex;
-	uint gObjPad0;
-	uint gObjPad1;
-	uint gObjPad2;
+	float4x4 World;
+	float4x4 TexTransform;
+	uint     MaterialIndex;
+	uint     InstPad0;
+	uint     InstPad1;
+	uint     InstPad2;
 };
 
+// Instances of the current draw.  The application binds the buffer at the draw's
+// first instance, so SV_InstanceID indexes it directly.
+StructuredBuffer<InstanceData> gInstanceData : register(t1, space1);
+
 cbuffer cbPass : register(b1)
 {
     float4x4 gView;
@@ -69,7 +75,10 @@ cbuffer cbPass : register(b1)
     float4x4 gInvProj;
     float4x4 gViewProj;
     float4x4 gInvViewProj;
-    float4x4 gShadowTransform;
+    float4x4 gShadowTransforms[MAX_SHADOW_CASCADES];
+    float4 gCascadeSplits;
+    uint gCascadeCount;
+    uint3 gCascadePad;
     float3 gEyePosW;
     float cbPerObjectPad1;
     float2 gRenderTargetSize;
@@ -112,7 +121,7 @@ float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, floa
 // PCF for shadow mapping.
 //---------------------------------------------------------------------------------------
 
-float CalcShadowFactor(float4 shadowPosH)
+float CalcShadowFactor(float4 shadowPosH, uint cascade)
 {
     // Complete projection by doing division by w.
     shadowPosH.xyz /= shadowPosH.w;
@@ -120,8 +129,8 @@ float CalcShadowFactor(float4 shadowPosH)
     // Depth in NDC space.
     float depth = shadowPosH.z;
 
-    uint width, height, numMips;
-    gShadowMap.GetDimensions(0, width, height, numMips);
+    uint width, height, elements, numMips;
+    gShadowMap.GetDimensions(0, width, height, elements, numMips);
 
     // Texel size.
     float dx = 1.0f / (float)width;
@@ -138,9 +147,29 @@ float CalcShadowFactor(float4 shadowPosH)
     for(int i = 0; i < 9; ++i)
     {
         percentLit += gShadowMap.SampleCmpLevelZero(gsamShadow,
-            shadowPosH.xy + offsets[i], depth).r;
+            float3(shadowPosH.xy + offsets[i], cascade), depth).r;
     }
     
     return percentLit / 9.0f;
 }
 
+//---------------------------------------------------------------------------------------
+// Picks the shadow cascade by view depth; pixels past the last cascade are lit.
+//---------------------------------------------------------------------------------------
+
+float CalcCascadedShadowFactor(float3 posW)
+{
+    float depth = mul(float4(posW, 1.0f), gView).z;
+
+    uint cascade = 0;
+    [loop]
+    while(cascade < gCascadeCount && depth >= gCascadeSplits[cascade])
+        ++cascade;
+
+    if(cascade == gCascadeCount)
+        return 1.0f;
+
+    float4 shadowPosH = mul(float4(posW, 1.0f), gShadowTransforms[cascade]);
+    return CalcShadowFactor(shadowPosH, cascade);
+}
+
@@ -15,22 +15,31 @@ struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
 	float2 TexC    : TEXCOORD;
+
+	// nointerpolation is used so the index is not interpolated 
+	// across the triangle.
+	nointerpolation uint MatIndex  : MATINDEX;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
-	MaterialData matData = gMaterialData[gMaterialIndex];
+	// Fetch the instance data.
+	InstanceData instData = gInstanceData[instanceID];
+
+	vout.MatIndex = instData.MaterialIndex;
+
+	MaterialData matData = gMaterialData[instData.MaterialIndex];
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), instData.World);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), instData.TexTransform);
 	vout.TexC = mul(texC, matData.MatTransform).xy;
 	
     return vout;
@@ -42,7 +51,7 @@ VertexOut VS(VertexIn vin)
 void PS(VertexOut pin) 
 {
 	// Fetch the material data.
-	MaterialData matData = gMaterialData[gMaterialIndex];
+	MaterialData matData = gMaterialData[pin.MatIndex];
 	float4 diffuseAlbedo = matData.DiffuseAlbedo;
     uint diffuseMapIndex = matData.DiffuseMapIndex;
 	
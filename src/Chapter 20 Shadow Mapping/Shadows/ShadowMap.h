@@ -9,8 +9,9 @@
 class ShadowMap
 {
 public:
+	// arraySize > 1 makes a texture array, e.g., one slice per shadow cascade.
 	ShadowMap(ID3D12Device* device,
-		UINT width, UINT height);
+		UINT width, UINT height, UINT arraySize = 1);
 		
 	ShadowMap(const ShadowMap& rhs)=delete;
 	ShadowMap& operator=(const ShadowMap& rhs)=delete;
@@ -18,17 +19,21 @@ public:
 
     UINT Width()const;
     UINT Height()const;
+    UINT ArraySize()const;
 	ID3D12Resource* Resource();
 	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv()const;
-	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv()const;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv(UINT slice = 0)const;
 
 	D3D12_VIEWPORT Viewport()const;
 	D3D12_RECT ScissorRect()const;
 
+	// The shadow map needs ArraySize() consecutive DSVs starting at hCpuDsv,
+	// dsvDescriptorSize apart.
 	void BuildDescriptors(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
-		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv);
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+		UINT dsvDescriptorSize = 0);
 
 	void OnResize(UINT newWidth, UINT newHeight);
 
@@ -45,6 +50,8 @@ private:
 
 	UINT mWidth = 0;
 	UINT mHeight = 0;
+	UINT mArraySize = 1;
+	UINT mDsvDescriptorSize = 0;
 	DXGI_FORMAT mFormat = DXGI_FORMAT_R24G8_TYPELESS;
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
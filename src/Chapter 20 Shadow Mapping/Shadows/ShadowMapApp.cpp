@@ -7,6 +7,11 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/ShadowCascades.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/ShadowCache.h"
+#include "../../Common/Profiler.h"
+#include "../../Common/DrawQueue.h"
 #include "FrameResource.h"
 #include "ShadowMap.h"
 
@@ -16,6 +21,11 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Texels per side of every shadow cascade, and the cascades used at startup
+// (keys 1-4 change it).
+const UINT gShadowMapSize = 1024;
+const UINT gShadowCascadeCount = 4;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -30,13 +40,13 @@ struct RenderItem
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	// The render item's instance data, rebuilt by UpdateInstanceData() when InstanceDirty
+	// is set.  DrawRenderItems() copies it next to the other instances of its draw.
+	InstanceData Instance;
+	bool InstanceDirty = true;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Index of this render item in mAllRitems.  The instance data is written as the
+	// items are drawn, so there is no per object constant buffer to index.
 	UINT ObjCBIndex = -1;
 
 	Material* Mat = nullptr;
@@ -49,6 +59,9 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Bounding box of the geometry in local space.
+	BoundingBox Bounds;
 };
 
 enum class RenderLayer : int
@@ -81,9 +94,11 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
-	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
     void UpdateShadowTransform(const GameTimer& gt);
+    void UpdateShadowCasters(const GameTimer& gt);
+    void UpdateShadowCaches(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
     void UpdateShadowPassCB(const GameTimer& gt);
 
@@ -97,6 +112,7 @@ private:
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
+    void BuildCasterCuller();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
     void DrawSceneToShadowMap();
 
@@ -135,22 +151,37 @@ private:
     CD3DX12_GPU_DESCRIPTOR_HANDLE mNullSrv;
 
     PassConstants mMainPassCB;  // index 0 of pass cbuffer.
-    PassConstants mShadowPassCB;// index 1 of pass cbuffer.
+    PassConstants mShadowPassCB;// index 1 + cascade of pass cbuffer.
+
+    // Instances written to the current frame resource's instance buffer so far.
+    UINT mInstanceCount = 0;
 
 	Camera mCamera;
 
+    // One array slice per cascade.
     std::unique_ptr<ShadowMap> mShadowMap;
 
-    DirectX::BoundingSphere mSceneBounds;
+    ShadowCascades mShadowCascades;
 
-    float mLightNearZ = 0.0f;
-    float mLightFarZ = 0.0f;
-    XMFLOAT3 mLightPosW;
-    XMFLOAT4X4 mLightView = MathHelper::Identity4x4();
-    XMFLOAT4X4 mLightProj = MathHelper::Identity4x4();
-    XMFLOAT4X4 mShadowTransform = MathHelper::Identity4x4();
+    DirectX::BoundingBox mSceneBounds;
+
+    // Shadow caster culling.  Every render item is tested against both caster
+    // volumes of every cascade in one pass: views 2*i and 2*i + 1 are the
+    // LightPlanes and SlicePlanes of cascade i, and a caster must be in both.
+    FrustumCuller mCasterCuller;
+    std::vector<UINT> mCasterViewMasks;
+    std::vector<RenderItem*> mShadowCasters[ShadowCascades::MaxCascades];
+
+    // Every caster is static, so each slice keeps its depth until its cascade
+    // moves, and only the dirty texels are redrawn.  Since the casters are culled
+    // per cascade, bit i of a caster's mask tells whether it is complete in slice
+    // i; a needed caster without it invalidates the texels it covers.
+    ShadowCache mShadowCaches[ShadowCascades::MaxCascades];
+    std::vector<UINT> mCachedCasterMasks;
+    std::vector<RenderItem*> mRedrawCasters[ShadowCascades::MaxCascades];
 
     float mLightRotationAngle = 0.0f;
+    bool mLightAnimationEnabled = true;
     XMFLOAT3 mBaseLightDirections[3] = {
         XMFLOAT3(0.57735f, -0.57735f, 0.57735f),
         XMFLOAT3(-0.57735f, -0.57735f, 0.57735f),
@@ -187,12 +218,17 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 ShadowMapApp::ShadowMapApp(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {
-    // Estimate the scene bounding sphere manually since we know how the scene was constructed.
-    // The grid is the "widest object" with a width of 20 and depth of 30.0f, and centered at
-    // the world space origin.  In general, you need to loop over every world space vertex
-    // position and compute the bounding sphere.
-    mSceneBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
-    mSceneBounds.Radius = sqrtf(10.0f*10.0f + 15.0f*15.0f);
+    // Estimate the scene bounding box manually since we know how the scene was constructed.
+    // The grid is the "widest object" with a width of 20 and depth of 30.0f, centered at
+    // the world space origin, and the spheres on the columns reach up to y = 4.  In general,
+    // you need to loop over every world space vertex position and compute the bounding box.
+    mSceneBounds.Center = XMFLOAT3(0.0f, 2.0f, 0.0f);
+    mSceneBounds.Extents = XMFLOAT3(10.0f, 2.0f, 15.0f);
+
+    ShadowCascades::Settings cascadeSettings;
+    cascadeSettings.CascadeCount = gShadowCascadeCount;
+    cascadeSettings.Resolution = gShadowMapSize;
+    mShadowCascades.SetSettings(cascadeSettings);
 }
 
 ShadowMapApp::~ShadowMapApp()
@@ -212,7 +248,9 @@ bool ShadowMapApp::Initialize()
 	mCamera.SetPosition(0.0f, 2.0f, -15.0f);
  
     mShadowMap = std::make_unique<ShadowMap>(
-        md3dDevice.Get(), 2048, 2048);
+        md3dDevice.Get(), gShadowMapSize, gShadowMapSize, ShadowCascades::MaxCascades);
+    for(auto& cache : mShadowCaches)
+        cache.SetSize(gShadowMapSize, gShadowMapSize);
 
 	LoadTextures();
     BuildRootSignature();
@@ -222,6 +260,7 @@ bool ShadowMapApp::Initialize()
     BuildSkullGeometry();
 	BuildMaterials();
     BuildRenderItems();
+    BuildCasterCuller();
     BuildFrameResources();
     BuildPSOs();
 
@@ -247,9 +286,9 @@ void ShadowMapApp::CreateRtvAndDsvDescriptorHeaps()
     ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
         &rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
 
-    // Add +1 DSV for shadow map.
+    // Add a DSV for every shadow cascade.
     D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
-    dsvHeapDesc.NumDescriptors = 2;
+    dsvHeapDesc.NumDescriptors = 1 + ShadowCascades::MaxCascades;
     dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
     dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
     dsvHeapDesc.NodeMask = 0;
@@ -286,7 +325,8 @@ void ShadowMapApp::Update(const GameTimer& gt)
     // Animate the lights (and hence shadows).
     //
 
-    mLightRotationAngle += 0.1f*gt.DeltaTime();
+    if(mLightAnimationEnabled)
+        mLightRotationAngle += 0.1f*gt.DeltaTime();
 
     XMMATRIX R = XMMatrixRotationY(mLightRotationAngle);
     for(int i = 0; i < 3; ++i)
@@ -297,9 +337,11 @@ void ShadowMapApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+	UpdateInstanceData(gt);
 	UpdateMaterialBuffer(gt);
     UpdateShadowTransform(gt);
+    UpdateShadowCasters(gt);
+    UpdateShadowCaches(gt);
 	UpdateMainPassCB(gt);
     UpdateShadowPassCB(gt);
 }
@@ -312,6 +354,9 @@ void ShadowMapApp::Draw(const GameTimer& gt)
     // We can only reset when the associated command lists have finished execution on the GPU.
     ThrowIfFailed(cmdListAlloc->Reset());
 
+    // The GPU is done with this frame resource's instance buffer too.
+    mInstanceCount = 0;
+
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
@@ -440,6 +485,23 @@ void ShadowMapApp::OnKeyboardInput(const GameTimer& gt)
 	if(GetAsyncKeyState('D') & 0x8000)
 		mCamera.Strafe(10.0f*dt);
 
+	for(UINT i = 1; i <= ShadowCascades::MaxCascades; ++i)
+	{
+		if(GetAsyncKeyState('0' + i) & 0x8000)
+		{
+			ShadowCascades::Settings settings = mShadowCascades.GetSettings();
+			settings.CascadeCount = i;
+			mShadowCascades.SetSettings(settings);
+		}
+	}
+
+	// Pause the light with 'L'; a still light (and camera) keeps the slices cached.
+	static bool lKeyWasDown = false;
+	bool lKeyIsDown = (GetAsyncKeyState('L') & 0x8000) != 0;
+	if(lKeyIsDown && !lKeyWasDown)
+		mLightAnimationEnabled = !mLightAnimationEnabled;
+	lKeyWasDown = lKeyIsDown;
+
 	mCamera.UpdateViewMatrix();
 }
  
@@ -448,28 +510,23 @@ void ShadowMapApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
-void ShadowMapApp::UpdateObjectCBs(const GameTimer& gt)
+void ShadowMapApp::UpdateInstanceData(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 	for(auto& e : mAllRitems)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+		// Only rebuild the instance data if the render item changed.
+		if(!e->InstanceDirty)
+			continue;
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-			objConstants.MaterialIndex = e->Mat->MatCBIndex;
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		InstanceData& instance = e->Instance;
+		XMStoreFloat4x4(&instance.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&instance.TexTransform, XMMatrixTranspose(texTransform));
+		instance.MaterialIndex = e->Mat->MatCBIndex;
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+		e->InstanceDirty = false;
 	}
 }
 
@@ -503,42 +560,97 @@ void ShadowMapApp::UpdateMaterialBuffer(const GameTimer& gt)
 
 void ShadowMapApp::UpdateShadowTransform(const GameTimer& gt)
 {
-    // Only the first "main" light casts a shadow.
+    // Only the first "main" light casts a shadow.  The scene is both the
+    // casters and the receivers.
     XMVECTOR lightDir = XMLoadFloat3(&mRotatedLightDirections[0]);
-    XMVECTOR lightPos = -2.0f*mSceneBounds.Radius*lightDir;
-    XMVECTOR targetPos = XMLoadFloat3(&mSceneBounds.Center);
-    XMVECTOR lightUp = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-    XMMATRIX lightView = XMMatrixLookAtLH(lightPos, targetPos, lightUp);
-
-    XMStoreFloat3(&mLightPosW, lightPos);
-
-    // Transform bounding sphere to light space.
-    XMFLOAT3 sphereCenterLS;
-    XMStoreFloat3(&sphereCenterLS, XMVector3TransformCoord(targetPos, lightView));
-
-    // Ortho frustum in light space encloses scene.
-    float l = sphereCenterLS.x - mSceneBounds.Radius;
-    float b = sphereCenterLS.y - mSceneBounds.Radius;
-    float n = sphereCenterLS.z - mSceneBounds.Radius;
-    float r = sphereCenterLS.x + mSceneBounds.Radius;
-    float t = sphereCenterLS.y + mSceneBounds.Radius;
-    float f = sphereCenterLS.z + mSceneBounds.Radius;
-
-    mLightNearZ = n;
-    mLightFarZ = f;
-    XMMATRIX lightProj = XMMatrixOrthographicOffCenterLH(l, r, b, t, n, f);
-
-    // Transform NDC space [-1,+1]^2 to texture space [0,1]^2
-    XMMATRIX T(
-        0.5f, 0.0f, 0.0f, 0.0f,
-        0.0f, -0.5f, 0.0f, 0.0f,
-        0.0f, 0.0f, 1.0f, 0.0f,
-        0.5f, 0.5f, 0.0f, 1.0f);
-
-    XMMATRIX S = lightView*lightProj*T;
-    XMStoreFloat4x4(&mLightView, lightView);
-    XMStoreFloat4x4(&mLightProj, lightProj);
-    XMStoreFloat4x4(&mShadowTransform, S);
+
+    mShadowCascades.Update(mCamera.GetView(), mCamera.GetFovY(), mCamera.GetAspect(),
+        mCamera.GetNearZ(), mCamera.GetFarZ(), lightDir, mSceneBounds, mSceneBounds);
+}
+
+void ShadowMapApp::UpdateShadowCasters(const GameTimer& gt)
+{
+    PROFILE_SCOPE("ShadowMapApp::UpdateShadowCasters");
+
+    UINT cascadeCount = mShadowCascades.CascadeCount();
+
+    std::array<XMFLOAT4, 6> viewPlanes[2*ShadowCascades::MaxCascades];
+    for(UINT i = 0; i < cascadeCount; ++i)
+    {
+        const ShadowCascades::Cascade& cascade = mShadowCascades.GetCascade(i);
+        viewPlanes[2*i + 0] = cascade.LightPlanes;
+        viewPlanes[2*i + 1] = cascade.SlicePlanes;
+    }
+
+    mCasterCuller.CullViews(viewPlanes, 2*cascadeCount, mCasterViewMasks.data());
+
+    const auto& casters = mRitemLayer[(int)RenderLayer::Opaque];
+
+    std::wostringstream outs;
+    outs << L"Shadows Demo    shadow casters drawn/culled per cascade";
+    for(UINT i = 0; i < cascadeCount; ++i)
+    {
+        mShadowCasters[i].clear();
+        for(auto ri : casters)
+        {
+            if(((mCasterViewMasks[ri->ObjCBIndex] >> 2*i) & 3) == 3)
+                mShadowCasters[i].push_back(ri);
+        }
+
+        outs << L"  " << mShadowCasters[i].size() << L"/" << casters.size() - mShadowCasters[i].size();
+    }
+    mMainWndCaption = outs.str();
+}
+
+void ShadowMapApp::UpdateShadowCaches(const GameTimer& gt)
+{
+    PROFILE_SCOPE("ShadowMapApp::UpdateShadowCaches");
+
+    const auto& casters = mRitemLayer[(int)RenderLayer::Opaque];
+
+    std::wostringstream outs;
+    outs << L"    slice redraws";
+    for(UINT i = 0; i < mShadowCascades.CascadeCount(); ++i)
+    {
+        ShadowCache& cache = mShadowCaches[i];
+        UINT bit = 1u << i;
+
+        // A moved cascade invalidates the whole slice.
+        cache.SetLightViewProj(XMLoadFloat4x4(&mShadowCascades.GetCascade(i).ViewProj));
+
+        // A caster culled when the slice was drawn may be needed now.
+        if(!cache.IsFullyDirty())
+        {
+            for(auto ri : mShadowCasters[i])
+            {
+                if((mCachedCasterMasks[ri->ObjCBIndex] & bit) == 0)
+                    cache.Invalidate(mCasterCuller.GetBox(ri->ObjCBIndex));
+            }
+        }
+
+        mRedrawCasters[i].clear();
+        if(cache.IsDirty())
+        {
+            // The redraw clears the dirty texels, so a caster in them is only
+            // complete again if it is drawn.
+            bool full = cache.IsFullyDirty();
+            for(auto ri : casters)
+            {
+                if(!full && !cache.OverlapsDirtyRect(mCasterCuller.GetBox(ri->ObjCBIndex)))
+                    continue;
+
+                mCachedCasterMasks[ri->ObjCBIndex] &= ~bit;
+                if(((mCasterViewMasks[ri->ObjCBIndex] >> 2*i) & 3) == 3)
+                {
+                    mRedrawCasters[i].push_back(ri);
+                    mCachedCasterMasks[ri->ObjCBIndex] |= bit;
+                }
+            }
+        }
+
+        outs << L"  " << cache.GetStats().StaticRedrawCount;
+    }
+    mMainWndCaption += outs.str();
 }
 
 void ShadowMapApp::UpdateMainPassCB(const GameTimer& gt)
@@ -551,15 +663,24 @@ void ShadowMapApp::UpdateMainPassCB(const GameTimer& gt)
 	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
 	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
 
-    XMMATRIX shadowTransform = XMLoadFloat4x4(&mShadowTransform);
-
 	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
 	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
 	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
 	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
 	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
 	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-    XMStoreFloat4x4(&mMainPassCB.ShadowTransform, XMMatrixTranspose(shadowTransform));
+
+    UINT cascadeCount = mShadowCascades.CascadeCount();
+    float* splits = &mMainPassCB.CascadeSplits.x;
+    for(UINT i = 0; i < cascadeCount; ++i)
+    {
+        const ShadowCascades::Cascade& cascade = mShadowCascades.GetCascade(i);
+        XMMATRIX shadowTransform = XMLoadFloat4x4(&cascade.ShadowTransform);
+        XMStoreFloat4x4(&mMainPassCB.ShadowTransforms[i], XMMatrixTranspose(shadowTransform));
+        splits[i] = cascade.SplitFar;
+    }
+    mMainPassCB.CascadeCount = cascadeCount;
+
 	mMainPassCB.EyePosW = mCamera.GetPosition3f();
 	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
 	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
@@ -581,31 +702,36 @@ void ShadowMapApp::UpdateMainPassCB(const GameTimer& gt)
 
 void ShadowMapApp::UpdateShadowPassCB(const GameTimer& gt)
 {
-    XMMATRIX view = XMLoadFloat4x4(&mLightView);
-    XMMATRIX proj = XMLoadFloat4x4(&mLightProj);
-
-    XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+    XMMATRIX view = mShadowCascades.LightView();
     XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-    XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-    XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
 
     UINT w = mShadowMap->Width();
     UINT h = mShadowMap->Height();
 
-    XMStoreFloat4x4(&mShadowPassCB.View, XMMatrixTranspose(view));
-    XMStoreFloat4x4(&mShadowPassCB.InvView, XMMatrixTranspose(invView));
-    XMStoreFloat4x4(&mShadowPassCB.Proj, XMMatrixTranspose(proj));
-    XMStoreFloat4x4(&mShadowPassCB.InvProj, XMMatrixTranspose(invProj));
-    XMStoreFloat4x4(&mShadowPassCB.ViewProj, XMMatrixTranspose(viewProj));
-    XMStoreFloat4x4(&mShadowPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-    mShadowPassCB.EyePosW = mLightPosW;
-    mShadowPassCB.RenderTargetSize = XMFLOAT2((float)w, (float)h);
-    mShadowPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / w, 1.0f / h);
-    mShadowPassCB.NearZ = mLightNearZ;
-    mShadowPassCB.FarZ = mLightFarZ;
-
     auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(1, mShadowPassCB);
+    for(UINT i = 0; i < mShadowCascades.CascadeCount(); ++i)
+    {
+        const ShadowCascades::Cascade& cascade = mShadowCascades.GetCascade(i);
+
+        XMMATRIX proj = XMLoadFloat4x4(&cascade.Proj);
+        XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+        XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+        XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+        XMStoreFloat4x4(&mShadowPassCB.View, XMMatrixTranspose(view));
+        XMStoreFloat4x4(&mShadowPassCB.InvView, XMMatrixTranspose(invView));
+        XMStoreFloat4x4(&mShadowPassCB.Proj, XMMatrixTranspose(proj));
+        XMStoreFloat4x4(&mShadowPassCB.InvProj, XMMatrixTranspose(invProj));
+        XMStoreFloat4x4(&mShadowPassCB.ViewProj, XMMatrixTranspose(viewProj));
+        XMStoreFloat4x4(&mShadowPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+        XMStoreFloat3(&mShadowPassCB.EyePosW, invView.r[3]);
+        mShadowPassCB.RenderTargetSize = XMFLOAT2((float)w, (float)h);
+        mShadowPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / w, 1.0f / h);
+        mShadowPassCB.NearZ = cascade.NearZ;
+        mShadowPassCB.FarZ = cascade.FarZ;
+
+        currPassCB->CopyData(1 + i, mShadowPassCB);
+    }
 }
 
 void ShadowMapApp::LoadTextures()
@@ -657,7 +783,7 @@ void ShadowMapApp::BuildRootSignature()
     CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
-    slotRootParameter[0].InitAsConstantBufferView(0);
+    slotRootParameter[0].InitAsShaderResourceView(1, 1);
     slotRootParameter[1].InitAsConstantBufferView(1);
     slotRootParameter[2].InitAsShaderResourceView(0, 1);
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -758,17 +884,21 @@ void ShadowMapApp::BuildDescriptorHeaps()
     md3dDevice->CreateShaderResourceView(nullptr, &srvDesc, nullSrv);
     nullSrv.Offset(1, mCbvSrvUavDescriptorSize);
 
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    // The shadow map is a texture array, one slice per cascade.
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
     srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    srvDesc.Texture2D.MostDetailedMip = 0;
-    srvDesc.Texture2D.MipLevels = 1;
-    srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+    srvDesc.Texture2DArray.MostDetailedMip = 0;
+    srvDesc.Texture2DArray.MipLevels = 1;
+    srvDesc.Texture2DArray.FirstArraySlice = 0;
+    srvDesc.Texture2DArray.ArraySize = ShadowCascades::MaxCascades;
+    srvDesc.Texture2DArray.ResourceMinLODClamp = 0.0f;
     md3dDevice->CreateShaderResourceView(nullptr, &srvDesc, nullSrv);
     
     mShadowMap->BuildDescriptors(
         CD3DX12_CPU_DESCRIPTOR_HANDLE(srvCpuStart, mShadowMapHeapIndex, mCbvSrvUavDescriptorSize),
         CD3DX12_GPU_DESCRIPTOR_HANDLE(srvGpuStart, mShadowMapHeapIndex, mCbvSrvUavDescriptorSize),
-        CD3DX12_CPU_DESCRIPTOR_HANDLE(dsvCpuStart, 1, mDsvDescriptorSize));
+        CD3DX12_CPU_DESCRIPTOR_HANDLE(dsvCpuStart, 1, mDsvDescriptorSize),
+        mDsvDescriptorSize);
 }
 
 void ShadowMapApp::BuildShadersAndInputLayout()
@@ -854,6 +984,14 @@ void ShadowMapApp::BuildShapeGeometry()
     quadSubmesh.StartIndexLocation = quadIndexOffset;
     quadSubmesh.BaseVertexLocation = quadVertexOffset;
 
+	// Local space bounds, used to cull the shadow casters.
+	const size_t vertexStride = sizeof(GeometryGenerator::Vertex);
+	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(), &box.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(gridSubmesh.Bounds, grid.Vertices.size(), &grid.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(sphereSubmesh.Bounds, sphere.Vertices.size(), &sphere.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(cylinderSubmesh.Bounds, cylinder.Vertices.size(), &cylinder.Vertices[0].Position, vertexStride);
+	BoundingBox::CreateFromPoints(quadSubmesh.Bounds, quad.Vertices.size(), &quad.Vertices[0].Position, vertexStride);
+
 	//
 	// Extract the vertex elements we are interested in and pack the
 	// vertices of all the meshes into one vertex buffer.
@@ -1164,8 +1302,10 @@ void ShadowMapApp::BuildFrameResources()
 {
     for(int i = 0; i < gNumFrameResources; ++i)
     {
+        // The render items can be drawn in the main pass and in each cascade.
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            2, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            1 + ShadowCascades::MaxCascades, (1 + ShadowCascades::MaxCascades)*(UINT)mAllRitems.size(),
+            (UINT)mMaterials.size()));
     }
 }
 
@@ -1235,6 +1375,7 @@ void ShadowMapApp::BuildRenderItems()
 	skyRitem->IndexCount = skyRitem->Geo->DrawArgs["sphere"].IndexCount;
 	skyRitem->StartIndexLocation = skyRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 	skyRitem->BaseVertexLocation = skyRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	skyRitem->Bounds = skyRitem->Geo->DrawArgs["sphere"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Sky].push_back(skyRitem.get());
 	mAllRitems.push_back(std::move(skyRitem));
@@ -1249,6 +1390,7 @@ void ShadowMapApp::BuildRenderItems()
     quadRitem->IndexCount = quadRitem->Geo->DrawArgs["quad"].IndexCount;
     quadRitem->StartIndexLocation = quadRitem->Geo->DrawArgs["quad"].StartIndexLocation;
     quadRitem->BaseVertexLocation = quadRitem->Geo->DrawArgs["quad"].BaseVertexLocation;
+    quadRitem->Bounds = quadRitem->Geo->DrawArgs["quad"].Bounds;
 
     mRitemLayer[(int)RenderLayer::Debug].push_back(quadRitem.get());
     mAllRitems.push_back(std::move(quadRitem));
@@ -1263,6 +1405,7 @@ void ShadowMapApp::BuildRenderItems()
 	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(boxRitem.get());
 	mAllRitems.push_back(std::move(boxRitem));
@@ -1277,6 +1420,7 @@ void ShadowMapApp::BuildRenderItems()
     skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
     skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
     skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+    skullRitem->Bounds = skullRitem->Geo->DrawArgs["skull"].Bounds;
 
     mRitemLayer[(int)RenderLayer::Opaque].push_back(skullRitem.get());
     mAllRitems.push_back(std::move(skullRitem));
@@ -1291,6 +1435,7 @@ void ShadowMapApp::BuildRenderItems()
     gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
     gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
     gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    gridRitem->Bounds = gridRitem->Geo->DrawArgs["grid"].Bounds;
 
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
 	mAllRitems.push_back(std::move(gridRitem));
@@ -1319,6 +1464,7 @@ void ShadowMapApp::BuildRenderItems()
 		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		leftCylRitem->Bounds = leftCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
@@ -1329,6 +1475,7 @@ void ShadowMapApp::BuildRenderItems()
 		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		rightCylRitem->Bounds = rightCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1339,6 +1486,7 @@ void ShadowMapApp::BuildRenderItems()
 		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		leftSphereRitem->Bounds = leftSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -1349,6 +1497,7 @@ void ShadowMapApp::BuildRenderItems()
 		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		rightSphereRitem->Bounds = rightSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		mRitemLayer[(int)RenderLayer::Opaque].push_back(leftCylRitem.get());
 		mRitemLayer[(int)RenderLayer::Opaque].push_back(rightCylRitem.get());
@@ -1360,59 +1509,116 @@ void ShadowMapApp::BuildRenderItems()
 		mAllRitems.push_back(std::move(leftSphereRitem));
 		mAllRitems.push_back(std::move(rightSphereRitem));
 	}
+
+	// The casters redrawn in a cascade keep the layer order, so the repeated
+	// meshes are drawn together there too.
+	for(auto& layer : mRitemLayer)
+		DrawQueue::SortRuns(layer, d3dUtil::MeshKey<RenderItem>);
+}
+
+void ShadowMapApp::BuildCasterCuller()
+{
+    // The scene is static, so the world bounds are only computed once.
+    mCasterCuller.Clear();
+    mCasterCuller.Reserve((UINT)mAllRitems.size());
+
+    for(auto& ri : mAllRitems)
+    {
+        BoundingBox worldBounds;
+        ri->Bounds.Transform(worldBounds, XMLoadFloat4x4(&ri->World));
+
+        UINT index = mCasterCuller.AddBox(worldBounds);
+        assert(index == ri->ObjCBIndex);
+    }
+
+    mCasterViewMasks.resize(mAllRitems.size());
+    mCachedCasterMasks.assign(mAllRitems.size(), 0);
 }
 
 void ShadowMapApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+    UINT instanceByteSize = sizeof(InstanceData);
  
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer.get();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    // Each run of render items with the same mesh is one instanced draw.
+    DrawQueue::ForEachRun(ritems, d3dUtil::MeshKey<RenderItem>, [&](UINT first, UINT last)
     {
-        auto ri = ritems[i];
+        auto ri = ritems[first];
+
+        UINT instanceCount = last - first;
+
+        // Copy the draw's instances after the ones already drawn this frame.
+        for(UINT i = 0; i < instanceCount; ++i)
+            instanceBuffer->CopyData(mInstanceCount + i, ritems[first + i]->Instance);
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+        // SV_InstanceID starts at 0 for every draw, so bind the instance buffer at
+        // the first instance of the draw.
+        D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->Resource()->GetGPUVirtualAddress() + mInstanceCount*instanceByteSize;
 
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+		cmdList->SetGraphicsRootShaderResourceView(0, instanceAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+        cmdList->DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+
+        mInstanceCount += instanceCount;
+    });
 }
 
 void ShadowMapApp::DrawSceneToShadowMap()
 {
+    PROFILE_SCOPE("ShadowMapApp::DrawSceneToShadowMap");
+
+    bool dirty = false;
+    for(UINT i = 0; i < mShadowCascades.CascadeCount(); ++i)
+        dirty = dirty || mShadowCaches[i].IsDirty();
+
+    // Every slice still holds the depth of its casters.
+    if(!dirty)
+        return;
+
     mCommandList->RSSetViewports(1, &mShadowMap->Viewport());
-    mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
 
     // Change to DEPTH_WRITE.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
         D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
 
     UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+    auto passCB = mCurrFrameResource->PassCB->Resource();
 
-    // Clear the back buffer and depth buffer.
-    mCommandList->ClearDepthStencilView(mShadowMap->Dsv(), 
-        D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+    mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
 
-    // Set null render target because we are only going to draw to
-    // depth buffer.  Setting a null render target will disable color writes.
-    // Note the active PSO also must specify a render target count of 0.
-    mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+    // Redraw the dirty texels of every cascade in its own slice.
+    for(UINT i = 0; i < mShadowCascades.CascadeCount(); ++i)
+    {
+        ShadowCache& cache = mShadowCaches[i];
+        if(!cache.IsDirty())
+            continue;
 
-    // Bind the pass constant buffer for the shadow map pass.
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + 1*passCBByteSize;
-    mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+        CD3DX12_CPU_DESCRIPTOR_HANDLE dsv = mShadowMap->Dsv(i);
+        D3D12_RECT dirtyRect = cache.DirtyRect();
+        mCommandList->RSSetScissorRects(1, &dirtyRect);
 
-    mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+        // Clear the depth buffer.
+        mCommandList->ClearDepthStencilView(dsv, 
+            D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 1, &dirtyRect);
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+        // Set null render target because we are only going to draw to
+        // depth buffer.  Setting a null render target will disable color writes.
+        // Note the active PSO also must specify a render target count of 0.
+        mCommandList->OMSetRenderTargets(0, nullptr, false, &dsv);
+
+        // Bind the pass constant buffer for the shadow map pass of this cascade.
+        D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + (1 + i)*passCBByteSize;
+        mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+
+        DrawRenderItems(mCommandList.Get(), mRedrawCasters[i]);
+
+        cache.MarkClean();
+    }
 
     // Change back to GENERIC_READ so we can read the texture in a shader.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
@@ -2,17 +2,16 @@
 
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
-#include "../../Common/UploadBuffer.h"
 
-struct ObjectConstants
+struct InstanceData
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
     DirectX::XMFLOAT4X4 PrevWorld = MathHelper::Identity4x4();  // For velocity buffer
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 	UINT     MaterialIndex;
-	UINT     ObjPad0;
-	UINT     ObjPad1;
-	UINT     ObjPad2;
+	UINT     InstancePad0;
+	UINT     InstancePad1;
+	UINT     InstancePad2;
 };
 
 struct PassConstants
@@ -98,6 +97,9 @@ struct Vertex
     DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT2 TexC;
 	DirectX::XMFLOAT3 TangentU;
+
+	// Baked ambient accessibility (see AoBaker); 1 = unoccluded.
+	float AmbientAccess = 1.0f;
 };
 
 // Stores the resources needed for the CPU to build the command lists
@@ -106,7 +108,7 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -115,17 +117,15 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
-    // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
-    std::unique_ptr<UploadBuffer<SsaoConstants>> SsaoCB = nullptr;
-    std::unique_ptr<UploadBuffer<TaaConstants>> TaaCB = nullptr;
-
-	std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
-
-    
+    // The frame's constants and materials live in the app's UploadRing, which keeps
+    // them until the GPU is done with the frame.  These are their addresses, set by
+    // the Update*() calls that write them; the object constants are per RenderItem.
+    D3D12_GPU_VIRTUAL_ADDRESS MainPassCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS ShadowPassCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS SsaoCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS TaaCB = 0;
 
+	D3D12_GPU_VIRTUAL_ADDRESS MaterialBuffer = 0;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
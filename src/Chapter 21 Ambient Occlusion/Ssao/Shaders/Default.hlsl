@@ -24,6 +24,7 @@ struct VertexIn
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
 	float3 TangentU : TANGENT;
+    float AmbientAccess : AMBIENT;
 };
 
 struct VertexOut
@@ -35,23 +36,33 @@ struct VertexOut
     float3 NormalW : NORMAL;
 	float3 TangentW : TANGENT;
 	float2 TexC    : TEXCOORD;
+    float AmbientAccess : AMBIENT;
+
+	// nointerpolation is used so the index is not interpolated 
+	// across the triangle.
+	nointerpolation uint MatIndex  : MATINDEX;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
 
+	// Fetch the instance data.
+	InstanceData instData = gInstanceData[instanceID];
+
+	vout.MatIndex = instData.MaterialIndex;
+
 	// Fetch the material data.
-	MaterialData matData = gMaterialData[gMaterialIndex];
+	MaterialData matData = gMaterialData[instData.MaterialIndex];
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), instData.World);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)instData.World);
 	
-	vout.TangentW = mul(vin.TangentU, (float3x3)gWorld);
+	vout.TangentW = mul(vin.TangentU, (float3x3)instData.World);
 
     // Transform to homogeneous clip space using jittered ViewProj for TAA
     vout.PosH = mul(posW, gJitteredViewProj);
@@ -60,11 +71,14 @@ VertexOut VS(VertexIn vin)
     vout.SsaoPosH = mul(posW, gViewProjTex);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), instData.TexTransform);
 	vout.TexC = mul(texC, matData.MatTransform).xy;
 
     // Generate projective tex-coords to project shadow map onto scene.
     vout.ShadowPosH = mul(posW, gShadowTransform);
+
+    // Ambient accessibility baked per vertex (1 for meshes without a bake).
+    vout.AmbientAccess = vin.AmbientAccess;
 	
     return vout;
 }
@@ -72,7 +86,7 @@ VertexOut VS(VertexIn vin)
 float4 PS(VertexOut pin) : SV_Target
 {
 	// Fetch the material data.
-	MaterialData matData = gMaterialData[gMaterialIndex];
+	MaterialData matData = gMaterialData[pin.MatIndex];
 	float4 diffuseAlbedo = matData.DiffuseAlbedo;
 	float3 fresnelR0 = matData.FresnelR0;
 	float  roughness = matData.Roughness;
@@ -105,6 +119,11 @@ float4 PS(VertexOut pin) : SV_Target
     pin.SsaoPosH /= pin.SsaoPosH.w;
     float ambientAccess = gSsaoMap.Sample(gsamLinearClamp, pin.SsaoPosH.xy, 0.0f).r;
 
+    // The baked term holds the self occlusion of static meshes at full quality;
+    // SSAO adds the occlusion by other objects.  Take the darker of the two
+    // rather than the product, which would count the self occlusion twice.
+    ambientAccess = min(ambientAccess, pin.AmbientAccess);
+
     // Light terms.
     float4 ambient = ambientAccess*gAmbientLight*diffuseAlbedo;
 
@@ -23,17 +23,20 @@ struct VertexOut
     float4 PrevPosH  : POSITION1;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout;
+
+    // Fetch the instance data.
+    InstanceData instData = gInstanceData[instanceID];
     
     // Current frame: world position -> clip space with current ViewProj
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), instData.World);
     vout.PosH = mul(posW, gViewProj);
     vout.CurrPosH = vout.PosH;
     
     // Previous frame: world position (with previous world matrix) -> clip space with previous ViewProj
-    float4 prevPosW = mul(float4(vin.PosL, 1.0f), gPrevWorld);
+    float4 prevPosW = mul(float4(vin.PosL, 1.0f), instData.PrevWorld);
     vout.PrevPosH = mul(prevPosW, gPrevViewProj);
     
     return vout;
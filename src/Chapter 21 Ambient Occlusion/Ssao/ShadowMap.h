@@ -32,13 +32,19 @@ public:
 	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv()const;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE Dsv()const;
 
+	// Depth of the static casters only, kept from frame to frame and copied into
+	// Resource() before the dynamic casters are drawn (see ShadowCache).
+	ID3D12Resource* StaticResource();
+	CD3DX12_CPU_DESCRIPTOR_HANDLE StaticDsv()const;
+
 	D3D12_VIEWPORT Viewport()const;
 	D3D12_RECT ScissorRect()const;
 
 	void BuildDescriptors(
 		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuSrv,
 		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuSrv,
-		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv);
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDsv,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuStaticDsv);
 
 	void OnResize(UINT newWidth, UINT newHeight);
 
@@ -60,8 +66,10 @@ private:
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuSrv;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuSrv;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDsv;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuStaticDsv;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> mShadowMap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mStaticShadowMap = nullptr;
 };
 
  
\ No newline at end of file
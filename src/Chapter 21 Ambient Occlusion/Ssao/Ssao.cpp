@@ -71,14 +71,14 @@ std::vector<float> Ssao::CalcGaussWeights(float sigma)
     return weights;
 }
 
-ID3D12Resource* Ssao::NormalMap()
+RenderGraph::Texture Ssao::NormalMap()const
 {
-    return mNormalMap.Get();
+    return mNormalMap;
 }
 
-ID3D12Resource* Ssao::AmbientMap()
+RenderGraph::Texture Ssao::AmbientMap()const
 {
-    return mAmbientMap0.Get();
+    return mAmbientMap0;
 }
 
 CD3DX12_CPU_DESCRIPTOR_HANDLE Ssao::NormalMapRtv()const
@@ -123,7 +123,8 @@ void Ssao::BuildDescriptors(
     mhAmbientMap0CpuRtv = hCpuRtv.Offset(1, rtvDescriptorSize);
     mhAmbientMap1CpuRtv = hCpuRtv.Offset(1, rtvDescriptorSize);
 
-    //  Create the descriptors
+    //  Create the descriptors; the render graph creates the views of the
+    //  normal and ambient maps.
     RebuildDescriptors(depthStencilBuffer);
 }
 
@@ -132,31 +133,14 @@ void Ssao::RebuildDescriptors(ID3D12Resource* depthStencilBuffer)
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Format = NormalMapFormat;
     srvDesc.Texture2D.MostDetailedMip = 0;
     srvDesc.Texture2D.MipLevels = 1;
-    md3dDevice->CreateShaderResourceView(mNormalMap.Get(), &srvDesc, mhNormalMapCpuSrv);
 
     srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
     md3dDevice->CreateShaderResourceView(depthStencilBuffer, &srvDesc, mhDepthMapCpuSrv);
 
     srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
     md3dDevice->CreateShaderResourceView(mRandomVectorMap.Get(), &srvDesc, mhRandomVectorMapCpuSrv);
-
-    srvDesc.Format = AmbientMapFormat;
-    md3dDevice->CreateShaderResourceView(mAmbientMap0.Get(), &srvDesc, mhAmbientMap0CpuSrv);
-    md3dDevice->CreateShaderResourceView(mAmbientMap1.Get(), &srvDesc, mhAmbientMap1CpuSrv);
-
-    D3D12_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-    rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-    rtvDesc.Format = NormalMapFormat;
-    rtvDesc.Texture2D.MipSlice = 0;
-    rtvDesc.Texture2D.PlaneSlice = 0;
-    md3dDevice->CreateRenderTargetView(mNormalMap.Get(), &rtvDesc, mhNormalMapCpuRtv);
-
-    rtvDesc.Format = AmbientMapFormat;
-    md3dDevice->CreateRenderTargetView(mAmbientMap0.Get(), &rtvDesc, mhAmbientMap0CpuRtv);
-    md3dDevice->CreateRenderTargetView(mAmbientMap1.Get(), &rtvDesc, mhAmbientMap1CpuRtv);
 }
 
 void Ssao::SetPSOs(ID3D12PipelineState* ssaoPso, ID3D12PipelineState* ssaoBlurPso)
@@ -181,104 +165,140 @@ void Ssao::OnResize(UINT newWidth, UINT newHeight)
         mViewport.MaxDepth = 1.0f;
 
         mScissorRect = { 0, 0, (int)mRenderTargetWidth / 2, (int)mRenderTargetHeight / 2 };
-
-        BuildResources();
     }
 }
 
+void Ssao::CreateTextures(RenderGraph& graph)
+{
+    RenderGraph::TextureDesc desc;
+    desc.Width = mRenderTargetWidth;
+    desc.Height = mRenderTargetHeight;
+    desc.Format = NormalMapFormat;
+    float normalClearColor[] = { 0.0f, 0.0f, 1.0f, 0.0f };
+    desc.ClearValue = CD3DX12_CLEAR_VALUE(NormalMapFormat, normalClearColor);
+    desc.Srv = mhNormalMapCpuSrv;
+    desc.Rtv = mhNormalMapCpuRtv;
+    mNormalMap = graph.Create("SSAO Normal Map", desc);
+
+	// Ambient occlusion maps are at half resolution.
+    desc.Width = mRenderTargetWidth / 2;
+    desc.Height = mRenderTargetHeight / 2;
+    desc.Format = AmbientMapFormat;
+    float ambientClearColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    desc.ClearValue = CD3DX12_CLEAR_VALUE(AmbientMapFormat, ambientClearColor);
+
+    desc.Srv = mhAmbientMap0CpuSrv;
+    desc.Rtv = mhAmbientMap0CpuRtv;
+    mAmbientMap0 = graph.Create("SSAO Ambient Map 0", desc);
+
+    desc.Srv = mhAmbientMap1CpuSrv;
+    desc.Rtv = mhAmbientMap1CpuRtv;
+    mAmbientMap1 = graph.Create("SSAO Ambient Map 1", desc);
+}
+
 void Ssao::ComputeSsao(
-    ID3D12GraphicsCommandList* cmdList,
+    RenderGraph& graph,
+    ID3D12RootSignature* rootSig,
     FrameResource* currFrame, 
+    RenderGraph::Texture depthMap,
     int blurCount)
 {
-	cmdList->RSSetViewports(1, &mViewport);
-    cmdList->RSSetScissorRects(1, &mScissorRect);
-
 	// We compute the initial SSAO to AmbientMap0.
+    graph.AddPass("SSAO", [=](ID3D12GraphicsCommandList* cmdList)
+    {
+        cmdList->SetGraphicsRootSignature(rootSig);
 
-    // Change to RENDER_TARGET.
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mAmbientMap0.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
-  
-	float clearValue[] = {1.0f, 1.0f, 1.0f, 1.0f};
-    cmdList->ClearRenderTargetView(mhAmbientMap0CpuRtv, clearValue, 0, nullptr);
-     
-	// Specify the buffers we are going to render to.
-    cmdList->OMSetRenderTargets(1, &mhAmbientMap0CpuRtv, true, nullptr);
+	    cmdList->RSSetViewports(1, &mViewport);
+        cmdList->RSSetScissorRects(1, &mScissorRect);
 
-    // Bind the constant buffer for this pass.
-    auto ssaoCBAddress = currFrame->SsaoCB->Resource()->GetGPUVirtualAddress();
-    cmdList->SetGraphicsRootConstantBufferView(0, ssaoCBAddress);
-    cmdList->SetGraphicsRoot32BitConstant(1, 0, 0);
+	    float clearValue[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        cmdList->ClearRenderTargetView(mhAmbientMap0CpuRtv, clearValue, 0, nullptr);
+     
+	    // Specify the buffers we are going to render to.
+        cmdList->OMSetRenderTargets(1, &mhAmbientMap0CpuRtv, true, nullptr);
 
-	// Bind the normal and depth maps.
-    cmdList->SetGraphicsRootDescriptorTable(2, mhNormalMapGpuSrv);
+        // Bind the constant buffer for this pass.
+        auto ssaoCBAddress = currFrame->SsaoCB;
+        cmdList->SetGraphicsRootConstantBufferView(0, ssaoCBAddress);
+        cmdList->SetGraphicsRoot32BitConstant(1, 0, 0);
 
-    // Bind the random vector map.
-    cmdList->SetGraphicsRootDescriptorTable(3, mhRandomVectorMapGpuSrv);
+	    // Bind the normal and depth maps.
+        cmdList->SetGraphicsRootDescriptorTable(2, mhNormalMapGpuSrv);
 
-    cmdList->SetPipelineState(mSsaoPso);
+        // Bind the random vector map.
+        cmdList->SetGraphicsRootDescriptorTable(3, mhRandomVectorMapGpuSrv);
 
-	// Draw fullscreen quad.
-	cmdList->IASetVertexBuffers(0, 0, nullptr);
-    cmdList->IASetIndexBuffer(nullptr);
-    cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	cmdList->DrawInstanced(6, 1, 0, 0);
-   
-	// Change back to GENERIC_READ so we can read the texture in a shader.
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mAmbientMap0.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
+        cmdList->SetPipelineState(mSsaoPso);
 
-    BlurAmbientMap(cmdList, currFrame, blurCount);
-}
- 
-void Ssao::BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, int blurCount)
-{
-    cmdList->SetPipelineState(mBlurPso);
+	    // Draw fullscreen quad.
+	    cmdList->IASetVertexBuffers(0, 0, nullptr);
+        cmdList->IASetIndexBuffer(nullptr);
+        cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	    cmdList->DrawInstanced(6, 1, 0, 0);
+    })
+    .Read(mNormalMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+    .Read(depthMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+    .Write(mAmbientMap0, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
-    auto ssaoCBAddress = currFrame->SsaoCB->Resource()->GetGPUVirtualAddress();
-    cmdList->SetGraphicsRootConstantBufferView(0, ssaoCBAddress);
- 
+    // Ping-pong the two ambient map textures as we apply
+    // horizontal and vertical blur passes.
     for(int i = 0; i < blurCount; ++i)
     {
-        BlurAmbientMap(cmdList, true);
-        BlurAmbientMap(cmdList, false);
+        graph.AddPass("SSAO Horizontal Blur", [=](ID3D12GraphicsCommandList* cmdList)
+        {
+            BlurAmbientMap(cmdList, rootSig, currFrame, true);
+        })
+        .Read(mAmbientMap0, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Read(mNormalMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Read(depthMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Write(mAmbientMap1, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+        graph.AddPass("SSAO Vertical Blur", [=](ID3D12GraphicsCommandList* cmdList)
+        {
+            BlurAmbientMap(cmdList, rootSig, currFrame, false);
+        })
+        .Read(mAmbientMap1, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Read(mNormalMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Read(depthMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Write(mAmbientMap0, D3D12_RESOURCE_STATE_RENDER_TARGET);
     }
 }
 
-void Ssao::BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, bool horzBlur)
+void Ssao::BlurAmbientMap(
+    ID3D12GraphicsCommandList* cmdList,
+    ID3D12RootSignature* rootSig,
+    FrameResource* currFrame,
+    bool horzBlur)
 {
-	ID3D12Resource* output = nullptr;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE inputSrv;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE outputRtv;
+
+    cmdList->SetGraphicsRootSignature(rootSig);
+    cmdList->SetPipelineState(mBlurPso);
+
+	cmdList->RSSetViewports(1, &mViewport);
+    cmdList->RSSetScissorRects(1, &mScissorRect);
+
+    auto ssaoCBAddress = currFrame->SsaoCB;
+    cmdList->SetGraphicsRootConstantBufferView(0, ssaoCBAddress);
 	
-	// Ping-pong the two ambient map textures as we apply
-	// horizontal and vertical blur passes.
 	if(horzBlur == true)
 	{
-		output = mAmbientMap1.Get();
 		inputSrv = mhAmbientMap0GpuSrv;
 		outputRtv = mhAmbientMap1CpuRtv;
         cmdList->SetGraphicsRoot32BitConstant(1, 1, 0);
 	}
 	else
 	{
-		output = mAmbientMap0.Get();
 		inputSrv = mhAmbientMap1GpuSrv;
 		outputRtv = mhAmbientMap0CpuRtv;
         cmdList->SetGraphicsRoot32BitConstant(1, 0, 0);
 	}
- 
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(output,
-        D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
 	float clearValue[] = { 1.0f, 1.0f, 1.0f, 1.0f };
     cmdList->ClearRenderTargetView(outputRtv, clearValue, 0, nullptr);
  
     cmdList->OMSetRenderTargets(1, &outputRtv, true, nullptr);
-	
-    // Normal/depth map still bound.
-
 
     // Bind the normal and depth maps.
     cmdList->SetGraphicsRootDescriptorTable(2, mhNormalMapGpuSrv);
@@ -291,68 +311,8 @@ void Ssao::BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, bool horzBlur)
     cmdList->IASetIndexBuffer(nullptr);
     cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	cmdList->DrawInstanced(6, 1, 0, 0);
-   
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(output,
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
 }
  
-void Ssao::BuildResources()
-{
-	// Free the old resources if they exist.
-    mNormalMap = nullptr;
-    mAmbientMap0 = nullptr;
-    mAmbientMap1 = nullptr;
-
-    D3D12_RESOURCE_DESC texDesc;
-    ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
-    texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-    texDesc.Alignment = 0;
-    texDesc.Width = mRenderTargetWidth;
-    texDesc.Height = mRenderTargetHeight;
-    texDesc.DepthOrArraySize = 1;
-    texDesc.MipLevels = 1;
-    texDesc.Format = Ssao::NormalMapFormat;
-    texDesc.SampleDesc.Count = 1;
-    texDesc.SampleDesc.Quality = 0;
-    texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-    texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
-
-
-    float normalClearColor[] = { 0.0f, 0.0f, 1.0f, 0.0f };
-    CD3DX12_CLEAR_VALUE optClear(NormalMapFormat, normalClearColor);
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-        &optClear,
-        IID_PPV_ARGS(&mNormalMap)));
-
-	// Ambient occlusion maps are at half resolution.
-    texDesc.Width = mRenderTargetWidth / 2;
-    texDesc.Height = mRenderTargetHeight / 2;
-    texDesc.Format = Ssao::AmbientMapFormat;
-
-    float ambientClearColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    optClear = CD3DX12_CLEAR_VALUE(AmbientMapFormat, ambientClearColor);
-
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        &optClear,
-        IID_PPV_ARGS(&mAmbientMap0)));
-
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        &optClear,
-        IID_PPV_ARGS(&mAmbientMap1)));
-}
-
 void Ssao::BuildRandomVectorTexture(ID3D12GraphicsCommandList* cmdList)
 {
     D3D12_RESOURCE_DESC texDesc;
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "../../Common/d3dUtil.h"
+#include "../../Common/RenderGraph.h"
 #include "FrameResource.h"
  
  
@@ -34,8 +35,10 @@ public:
     std::vector<float> CalcGaussWeights(float sigma);
 
 
-	ID3D12Resource* NormalMap();
-	ID3D12Resource* AmbientMap();
+	// The normal and ambient maps are transient textures of the frame's render graph,
+	// valid after CreateTextures().
+	RenderGraph::Texture NormalMap()const;
+	RenderGraph::Texture AmbientMap()const;
 	
     CD3DX12_CPU_DESCRIPTOR_HANDLE NormalMapRtv()const;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE NormalMapSrv()const;
@@ -57,16 +60,22 @@ public:
 	/// Call when the backbuffer is resized.  
 	///</summary>
 	void OnResize(UINT newWidth, UINT newHeight);
+
+    ///<summary>
+    /// Declares this frame's normal and ambient maps in the render graph.
+    ///</summary>
+    void CreateTextures(RenderGraph& graph);
   
     ///<summary>
-    /// Changes the render target to the Ambient render target and draws a fullscreen
-    /// quad to kick off the pixel shader to compute the AmbientMap.  We still keep the
-    /// main depth buffer binded to the pipeline, but depth buffer read/writes
-    /// are disabled, as we do not need the depth buffer computing the Ambient map.
+    /// Adds the passes that render to the Ambient render target, drawing a fullscreen
+    /// quad to kick off the pixel shader to compute the AmbientMap, and blur it.
+    /// The depth map is read as a shader resource, so no depth buffer is bound.
     ///</summary>
 	void ComputeSsao(
-        ID3D12GraphicsCommandList* cmdList, 
+        RenderGraph& graph,
+        ID3D12RootSignature* rootSig,
         FrameResource* currFrame, 
+        RenderGraph::Texture depthMap,
         int blurCount);
  
 
@@ -77,10 +86,12 @@ private:
     /// few random samples per pixel.  We use an edge preserving blur so that 
     /// we do not blur across discontinuities--we want edges to remain edges.
     ///</summary>
-    void BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, FrameResource* currFrame, int blurCount);
-	void BlurAmbientMap(ID3D12GraphicsCommandList* cmdList, bool horzBlur);
+    void BlurAmbientMap(
+        ID3D12GraphicsCommandList* cmdList,
+        ID3D12RootSignature* rootSig,
+        FrameResource* currFrame,
+        bool horzBlur);
 
-    void BuildResources();
     void BuildRandomVectorTexture(ID3D12GraphicsCommandList* cmdList);
  
 	void BuildOffsetVectors();
@@ -96,9 +107,9 @@ private:
 	 
     Microsoft::WRL::ComPtr<ID3D12Resource> mRandomVectorMap;
 	Microsoft::WRL::ComPtr<ID3D12Resource> mRandomVectorMapUploadBuffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mNormalMap;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mAmbientMap0;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mAmbientMap1;
+    RenderGraph::Texture mNormalMap;
+    RenderGraph::Texture mAmbientMap0;
+    RenderGraph::Texture mAmbientMap1;
 
     CD3DX12_CPU_DESCRIPTOR_HANDLE mhNormalMapCpuSrv;
     CD3DX12_GPU_DESCRIPTOR_HANDLE mhNormalMapGpuSrv;
@@ -4,9 +4,14 @@
 
 #include "../../Common/d3dApp.h"
 #include "../../Common/MathHelper.h"
-#include "../../Common/UploadBuffer.h"
+#include "../../Common/D3D12RenderDevice.h"
+#include "../../Common/UploadRing.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/AoBaker.h"
+#include "../../Common/ShadowCache.h"
+#include "../../Common/RenderGraph.h"
+#include "../../Common/DrawQueue.h"
 #include "FrameResource.h"
 #include "ShadowMap.h"
 #include "Ssao.h"
@@ -35,14 +40,9 @@ struct RenderItem
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
+	// This frame's instance data, written by UpdateInstanceData().  DrawRenderItems()
+	// copies it to the upload ring next to the other instances of its draw.
+	InstanceData Instance;
 
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
@@ -86,7 +86,7 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
-	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
     void UpdateShadowTransform(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
@@ -107,8 +107,8 @@ private:
     void BuildMaterials();
     void BuildRenderItems();
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
-    void DrawSceneToShadowMap();
-	void DrawNormalsAndDepth();
+    void DrawSceneToShadowMap(RenderGraph::Texture shadowMap, RenderGraph::Texture staticShadowMap);
+	void DrawNormalsAndDepth(RenderGraph::Texture normalMap, RenderGraph::Texture depthBuffer);
 
     CD3DX12_CPU_DESCRIPTOR_HANDLE GetCpuSrv(int index)const;
     CD3DX12_GPU_DESCRIPTOR_HANDLE GetGpuSrv(int index)const;
@@ -120,6 +120,8 @@ private:
 private:
 
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
+    std::unique_ptr<D3D12RenderDevice> mRenderDevice;
+    std::unique_ptr<UploadRing> mUploadRing;
     FrameResource* mCurrFrameResource = nullptr;
     int mCurrFrameResourceIndex = 0;
 
@@ -153,15 +155,24 @@ private:
 
     CD3DX12_GPU_DESCRIPTOR_HANDLE mNullSrv;
 
-    PassConstants mMainPassCB;  // index 0 of pass cbuffer.
-    PassConstants mShadowPassCB;// index 1 of pass cbuffer.
+    PassConstants mMainPassCB;
+    PassConstants mShadowPassCB;
 
 	Camera mCamera;
 
     std::unique_ptr<ShadowMap> mShadowMap;
 
+    // The skull is the only caster that moves; the rest of the opaque layer is
+    // cached in the static shadow map.
+    ShadowCache mShadowCache;
+    std::vector<RenderItem*> mStaticShadowCasters;
+    std::vector<RenderItem*> mDynamicShadowCasters;
+
     std::unique_ptr<Ssao> mSsao;
 
+    // Rebuilt every frame; keeps the transient textures' heap between frames.
+    std::unique_ptr<RenderGraph> mRenderGraph;
+
     // TAA (Temporal Anti-Aliasing)
     std::unique_ptr<Taa> mTaa;
     ComPtr<ID3D12RootSignature> mTaaRootSignature = nullptr;
@@ -181,6 +192,7 @@ private:
     XMFLOAT4X4 mShadowTransform = MathHelper::Identity4x4();
 
     float mLightRotationAngle = 0.0f;
+    bool mLightAnimationEnabled = true;
     XMFLOAT3 mBaseLightDirections[3] = {
         XMFLOAT3(0.57735f, -0.57735f, 0.57735f),
         XMFLOAT3(-0.57735f, -0.57735f, 0.57735f),
@@ -247,6 +259,9 @@ bool SsaoApp::Initialize()
  
     mShadowMap = std::make_unique<ShadowMap>(md3dDevice.Get(),
         2048, 2048);
+    mShadowCache.SetSize(mShadowMap->Width(), mShadowMap->Height());
+
+    mRenderGraph = std::make_unique<RenderGraph>(md3dDevice.Get(), mFence.Get());
 
     mSsao = std::make_unique<Ssao>(
         md3dDevice.Get(),
@@ -296,9 +311,9 @@ void SsaoApp::CreateRtvAndDsvDescriptorHeaps()
     ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
         &rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
 
-    // Add +1 DSV for shadow map.
+    // Add +2 DSV for shadow map and its static copy, +1 for a read-only view of the depth buffer.
     D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
-    dsvHeapDesc.NumDescriptors = 2;
+    dsvHeapDesc.NumDescriptors = 4;
     dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
     dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
     dsvHeapDesc.NodeMask = 0;
@@ -312,6 +327,15 @@ void SsaoApp::OnResize()
 
 	mCamera.SetLens(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
 
+    // Read-only view of the new depth buffer, for passes that depth test against it
+    // while it is in the DEPTH_READ state.
+    D3D12_DEPTH_STENCIL_VIEW_DESC readOnlyDsvDesc;
+    readOnlyDsvDesc.Flags = D3D12_DSV_FLAG_READ_ONLY_DEPTH | D3D12_DSV_FLAG_READ_ONLY_STENCIL;
+    readOnlyDsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+    readOnlyDsvDesc.Format = mDepthStencilFormat;
+    readOnlyDsvDesc.Texture2D.MipSlice = 0;
+    md3dDevice->CreateDepthStencilView(mDepthStencilBuffer.Get(), &readOnlyDsvDesc, GetDsv(3));
+
     if(mSsao != nullptr)
     {
         mSsao->OnResize(mClientWidth, mClientHeight);
@@ -345,11 +369,15 @@ void SsaoApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+    // Free the upload ring space of the frames the GPU has finished.
+    mUploadRing->BeginFrame(mFence->GetCompletedValue());
+
     //
     // Animate the lights (and hence shadows).
     //
 
-    mLightRotationAngle += 0.1f*gt.DeltaTime();
+    if(mLightAnimationEnabled)
+        mLightRotationAngle += 0.1f*gt.DeltaTime();
 
     XMMATRIX R = XMMatrixRotationY(mLightRotationAngle);
     for(int i = 0; i < 3; ++i)
@@ -360,7 +388,7 @@ void SsaoApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+	UpdateInstanceData(gt);
 	UpdateMaterialBuffer(gt);
     UpdateShadowTransform(gt);
 	UpdateMainPassCB(gt);
@@ -386,14 +414,11 @@ void SsaoApp::Draw(const GameTimer& gt)
 
     mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
 
-	//
-	// Shadow map pass.
-	//
+    // State the shadow map and normal/depth passes share.
 
     // Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
     // set as a root descriptor.
-    auto matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
-    mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+    mCommandList->SetGraphicsRootShaderResourceView(2, mCurrFrameResource->MaterialBuffer);
 	
     // Bind null SRV for shadow map pass.
     mCommandList->SetGraphicsRootDescriptorTable(3, mNullSrv);	 
@@ -403,140 +428,173 @@ void SsaoApp::Draw(const GameTimer& gt)
     // The root signature knows how many descriptors are expected in the table.
     mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 
-    DrawSceneToShadowMap();
+    //
+    // Declare the frame's passes.  The render graph works out and batches the
+    // barriers between them, and places the transient textures.
+    //
+
+    mRenderGraph->Reset();
+
+    auto backBuffer = mRenderGraph->Import(CurrentBackBuffer(), D3D12_RESOURCE_STATE_PRESENT);
+    auto depthBuffer = mRenderGraph->Import(mDepthStencilBuffer.Get(), D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    auto shadowMap = mRenderGraph->Import(mShadowMap->Resource(), D3D12_RESOURCE_STATE_GENERIC_READ);
+    auto staticShadowMap = mRenderGraph->Import(mShadowMap->StaticResource(), D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+    bool taaEnabled = mTaaEnabled && mTaa != nullptr;
+
+    mSsao->CreateTextures(*mRenderGraph);
+    if(taaEnabled)
+        mTaa->CreateTextures(*mRenderGraph);
+
+    DrawSceneToShadowMap(shadowMap, staticShadowMap);
 
 	//
 	// Normal/depth pass.
 	//
 	
-	DrawNormalsAndDepth();
+	DrawNormalsAndDepth(mSsao->NormalMap(), depthBuffer);
 	
 	//
 	// Compute SSAO.
 	// 
 	
-    mCommandList->SetGraphicsRootSignature(mSsaoRootSignature.Get());
-    mSsao->ComputeSsao(mCommandList.Get(), mCurrFrameResource, 3);
+    mSsao->ComputeSsao(*mRenderGraph, mSsaoRootSignature.Get(), mCurrFrameResource, depthBuffer, 3);
 	
 	//
 	// Main rendering pass.
 	//
-	
-    mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-
-    // Rebind state whenever graphics root signature changes.
 
-    // Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
-    // set as a root descriptor.
-    matBuffer = mCurrFrameResource->MaterialBuffer->Resource();
-    mCommandList->SetGraphicsRootShaderResourceView(2, matBuffer->GetGPUVirtualAddress());
+    mRenderGraph->AddPass("Main", [this](ID3D12GraphicsCommandList* cmdList)
+    {
+        cmdList->SetGraphicsRootSignature(mRootSignature.Get());
 
+        // Rebind state whenever graphics root signature changes.
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+        // Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
+        // set as a root descriptor.
+        cmdList->SetGraphicsRootShaderResourceView(2, mCurrFrameResource->MaterialBuffer);
 
-    // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+        cmdList->RSSetViewports(1, &mScreenViewport);
+        cmdList->RSSetScissorRects(1, &mScissorRect);
 
-    // Clear the back buffer.
-    mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
+        // Clear the back buffer.
+        cmdList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
 
-    // WE ALREADY WROTE THE DEPTH INFO TO THE DEPTH BUFFER IN DrawNormalsAndDepth,
-    // SO DO NOT CLEAR DEPTH.
+        // WE ALREADY WROTE THE DEPTH INFO TO THE DEPTH BUFFER IN DrawNormalsAndDepth,
+        // SO DO NOT CLEAR DEPTH.
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+        // Specify the buffers we are going to render to.
+        cmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	// Bind all the textures used in this scene.  Observe
-    // that we only have to specify the first descriptor in the table.  
-    // The root signature knows how many descriptors are expected in the table.
-    mCommandList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	    // Bind all the textures used in this scene.  Observe
+        // that we only have to specify the first descriptor in the table.  
+        // The root signature knows how many descriptors are expected in the table.
+        cmdList->SetGraphicsRootDescriptorTable(4, mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 	
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+	    cmdList->SetGraphicsRootConstantBufferView(1, mCurrFrameResource->MainPassCB);
 
-    // Bind the sky cube map.  For our demos, we just use one "world" cube map representing the environment
-    // from far away, so all objects will use the same cube map and we only need to set it once per-frame.  
-    // If we wanted to use "local" cube maps, we would have to change them per-object, or dynamically
-    // index into an array of cube maps.
+        // Bind the sky cube map.  For our demos, we just use one "world" cube map representing the environment
+        // from far away, so all objects will use the same cube map and we only need to set it once per-frame.  
+        // If we wanted to use "local" cube maps, we would have to change them per-object, or dynamically
+        // index into an array of cube maps.
 
-    CD3DX12_GPU_DESCRIPTOR_HANDLE skyTexDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-    skyTexDescriptor.Offset(mSkyTexHeapIndex, mCbvSrvUavDescriptorSize);
-    mCommandList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
+        CD3DX12_GPU_DESCRIPTOR_HANDLE skyTexDescriptor(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+        skyTexDescriptor.Offset(mSkyTexHeapIndex, mCbvSrvUavDescriptorSize);
+        cmdList->SetGraphicsRootDescriptorTable(3, skyTexDescriptor);
 
-    mCommandList->SetPipelineState(mPSOs["opaque"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+        cmdList->SetPipelineState(mPSOs["opaque"].Get());
+        DrawRenderItems(cmdList, mRitemLayer[(int)RenderLayer::Opaque]);
 
-    // Debug quad disabled - uncomment to show shadow map debug view
-    // mCommandList->SetPipelineState(mPSOs["debug"].Get());
-    // DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Debug]);
+        // Debug quad disabled - uncomment to show shadow map debug view
+        // cmdList->SetPipelineState(mPSOs["debug"].Get());
+        // DrawRenderItems(cmdList, mRitemLayer[(int)RenderLayer::Debug]);
 
-	mCommandList->SetPipelineState(mPSOs["sky"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Sky]);
+	    cmdList->SetPipelineState(mPSOs["sky"].Get());
+	    DrawRenderItems(cmdList, mRitemLayer[(int)RenderLayer::Sky]);
+    })
+    .Read(mSsao->AmbientMap(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+    .Read(shadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+    .Write(backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET)
+    .Write(depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 
     //
     // TAA Pass - Temporal Anti-Aliasing
     //
-    if(mTaaEnabled && mTaa != nullptr)
+    if(taaEnabled)
     {
+        auto history = mRenderGraph->Import(mTaa->HistoryBuffer(), D3D12_RESOURCE_STATE_GENERIC_READ);
+        auto currentColor = mTaa->CurrentColorBuffer();
+        auto velocity = mTaa->VelocityBuffer();
+        auto output = mTaa->OutputBuffer();
+
         // Step 0: Render velocity buffer
-        mTaa->TransitionVelocityForWrite(mCommandList.Get());
-        
-        float velocityClear[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-        mCommandList->ClearRenderTargetView(mTaa->VelocityRtv(), velocityClear, 0, nullptr);
-        
-        mCommandList->OMSetRenderTargets(1, &mTaa->VelocityRtv(), true, &DepthStencilView());
+        mRenderGraph->AddPass("TAA Velocity", [this](ID3D12GraphicsCommandList* cmdList)
+        {
+            float velocityClear[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            cmdList->ClearRenderTargetView(mTaa->VelocityRtv(), velocityClear, 0, nullptr);
         
-        mCommandList->SetPipelineState(mPSOs["velocity"].Get());
-        DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+            // The depth buffer is in DEPTH_READ here, so bind its read-only view.
+            auto readOnlyDsv = GetDsv(3);
+            cmdList->OMSetRenderTargets(1, &mTaa->VelocityRtv(), true, &readOnlyDsv);
         
-        mTaa->TransitionVelocityForRead(mCommandList.Get());
+            cmdList->SetPipelineState(mPSOs["velocity"].Get());
+            DrawRenderItems(cmdList, mRitemLayer[(int)RenderLayer::Opaque]);
+        })
+        .Read(depthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ)
+        .Write(velocity, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
         // Step 1: Copy current back buffer to TAA current color buffer
-        CD3DX12_RESOURCE_BARRIER barriers[2];
-        barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
-        barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(mTaa->CurrentColorBuffer(),
-            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST);
-        mCommandList->ResourceBarrier(2, barriers);
-
-        mCommandList->CopyResource(mTaa->CurrentColorBuffer(), CurrentBackBuffer());
-
-        // Step 2: Transition for TAA resolve
-        barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(mTaa->CurrentColorBuffer(),
-            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
-        barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-            D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COPY_DEST);
-        mCommandList->ResourceBarrier(2, barriers);
-
-        // Step 3: Execute TAA resolve (renders to OutputBuffer)
-        mCommandList->SetGraphicsRootSignature(mTaaRootSignature.Get());
-        mTaa->Execute(mCommandList.Get(), mTaaRootSignature.Get(), mCurrFrameResource);
-
-        // Step 4: Copy TAA output to back buffer
-        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mTaa->OutputBuffer(),
-            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE));
-
-        mCommandList->CopyResource(CurrentBackBuffer(), mTaa->OutputBuffer());
-
-        // Step 5: Transition to present
-        barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(mTaa->OutputBuffer(),
-            D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_GENERIC_READ);
-        barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
-        mCommandList->ResourceBarrier(2, barriers);
-
-        // Step 6: Copy output to history for next frame
-        mTaa->CopyToHistory(mCommandList.Get());
-    }
-    else
-    {
-        // No TAA - just transition to present
-        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+        mRenderGraph->AddPass("TAA Copy Color", [this, currentColor, backBuffer](ID3D12GraphicsCommandList* cmdList)
+        {
+            cmdList->CopyResource(mRenderGraph->Resource(currentColor), mRenderGraph->Resource(backBuffer));
+        })
+        .Read(backBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE)
+        .Write(currentColor, D3D12_RESOURCE_STATE_COPY_DEST);
+
+        // Step 2: Execute TAA resolve (renders to OutputBuffer)
+        mRenderGraph->AddPass("TAA Resolve", [this](ID3D12GraphicsCommandList* cmdList)
+        {
+            cmdList->SetGraphicsRootSignature(mTaaRootSignature.Get());
+            mTaa->Execute(cmdList, mTaaRootSignature.Get(), mCurrFrameResource);
+        })
+        .Read(history, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Read(currentColor, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Read(velocity, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+        .Write(output, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+        // Step 3: Copy TAA output to back buffer
+        mRenderGraph->AddPass("TAA Copy Output", [this, output, backBuffer](ID3D12GraphicsCommandList* cmdList)
+        {
+            cmdList->CopyResource(mRenderGraph->Resource(backBuffer), mRenderGraph->Resource(output));
+        })
+        .Read(output, D3D12_RESOURCE_STATE_COPY_SOURCE)
+        .Write(backBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
+
+        // Step 4: Copy output to history for next frame
+        mRenderGraph->AddPass("TAA History", [this, output, history](ID3D12GraphicsCommandList* cmdList)
+        {
+            cmdList->CopyResource(mRenderGraph->Resource(history), mRenderGraph->Resource(output));
+        })
+        .Read(output, D3D12_RESOURCE_STATE_COPY_SOURCE)
+        .Write(history, D3D12_RESOURCE_STATE_COPY_DEST);
     }
 
+    // The back buffer leaves the graph in the PRESENT state it was imported in.
+    mRenderGraph->Compile(mCurrentFence + 1);
+    mRenderGraph->Execute(mCommandList.Get());
+
+    const auto& graphStats = mRenderGraph->GetStats();
+
+    std::wostringstream outs;
+    outs << L"Ssao Demo" <<
+        L"    passes " << graphStats.PassCount <<
+        L"    barriers " << graphStats.BarrierCount <<
+        L" (split " << graphStats.SplitBarrierCount << L")" <<
+        L" in " << graphStats.BarrierBatchCount << L" calls" <<
+        L"    transients " << graphStats.TransientBytes / 1024 << L" KB" <<
+        L" in " << graphStats.HeapBytes / 1024 << L" KB heap";
+    mMainWndCaption = outs.str();
+
     // Increment frame counter for TAA jitter
     mFrameCount++;
 
@@ -558,6 +616,8 @@ void SsaoApp::Draw(const GameTimer& gt)
     // Because we are on the GPU timeline, the new fence point won't be 
     // set until the GPU finishes processing all the commands prior to this Signal().
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+    mUploadRing->EndFrame(mCurrentFence);
 }
 
 void SsaoApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -614,6 +674,15 @@ void SsaoApp::OnKeyboardInput(const GameTimer& gt)
     }
     tKeyWasDown = tKeyIsDown;
 
+    // Pause the light with 'L' key; a still light keeps the static shadow map cached.
+    static bool lKeyWasDown = false;
+    bool lKeyIsDown = (GetAsyncKeyState('L') & 0x8000) != 0;
+    if(lKeyIsDown && !lKeyWasDown)
+    {
+        mLightAnimationEnabled = !mLightAnimationEnabled;
+    }
+    lKeyWasDown = lKeyIsDown;
+
 	mCamera.UpdateViewMatrix();
 }
  
@@ -633,14 +702,11 @@ void SsaoApp::AnimateMaterials(const GameTimer& gt)
         XMMATRIX skullScale = XMMatrixScaling(0.4f, 0.4f, 0.4f);
         XMMATRIX skullTranslation = XMMatrixTranslation(0.0f, y, 0.0f);
         XMStoreFloat4x4(&mSkullRitem->World, skullScale * skullTranslation);
-        
-        mSkullRitem->NumFramesDirty = gNumFrameResources;
     }
 }
 
-void SsaoApp::UpdateObjectCBs(const GameTimer& gt)
+void SsaoApp::UpdateInstanceData(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 	for(auto& e : mAllRitems)
 	{
 		// Always update for velocity buffer (need current and previous world matrices)
@@ -648,48 +714,38 @@ void SsaoApp::UpdateObjectCBs(const GameTimer& gt)
 		XMMATRIX prevWorld = XMLoadFloat4x4(&e->PrevWorld);
 		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
 
-		ObjectConstants objConstants;
-		XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-		XMStoreFloat4x4(&objConstants.PrevWorld, XMMatrixTranspose(prevWorld));
-		XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-		objConstants.MaterialIndex = e->Mat->MatCBIndex;
-
-		currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+		InstanceData& instance = e->Instance;
+		XMStoreFloat4x4(&instance.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&instance.PrevWorld, XMMatrixTranspose(prevWorld));
+		XMStoreFloat4x4(&instance.TexTransform, XMMatrixTranspose(texTransform));
+		instance.MaterialIndex = e->Mat->MatCBIndex;
 
 		// Store current world as previous for next frame
 		e->PrevWorld = e->World;
-
-		if(e->NumFramesDirty > 0)
-			e->NumFramesDirty--;
 	}
 }
 
 void SsaoApp::UpdateMaterialBuffer(const GameTimer& gt)
 {
-	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
+	// The ring holds a new copy of the buffer every frame, so all the materials are
+	// written, not only the changed ones.
+	auto matBuffer = mUploadRing->Allocate(mMaterials.size()*sizeof(MaterialData), alignof(MaterialData));
+	auto matData = reinterpret_cast<MaterialData*>(matBuffer.CpuAddress);
 	for(auto& e : mMaterials)
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
 		Material* mat = e.second.get();
-		if(mat->NumFramesDirty > 0)
-		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
-
-			MaterialData matData;
-			matData.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matData.FresnelR0 = mat->FresnelR0;
-			matData.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
-			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
-			matData.NormalMapIndex = mat->NormalSrvHeapIndex;
-
-			currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
-
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
-		}
+		XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+
+		MaterialData& d = matData[mat->MatCBIndex];
+		d.DiffuseAlbedo = mat->DiffuseAlbedo;
+		d.FresnelR0 = mat->FresnelR0;
+		d.Roughness = mat->Roughness;
+		XMStoreFloat4x4(&d.MatTransform, XMMatrixTranspose(matTransform));
+		d.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
+		d.NormalMapIndex = mat->NormalSrvHeapIndex;
 	}
+
+	mCurrFrameResource->MaterialBuffer = matBuffer.Address;
 }
 
 void SsaoApp::UpdateShadowTransform(const GameTimer& gt)
@@ -727,6 +783,7 @@ void SsaoApp::UpdateShadowTransform(const GameTimer& gt)
         0.5f, 0.5f, 0.0f, 1.0f);
 
     XMMATRIX S = lightView*lightProj*T;
+    mShadowCache.SetLightViewProj(lightView*lightProj);
     XMStoreFloat4x4(&mLightView, lightView);
     XMStoreFloat4x4(&mLightProj, lightProj);
     XMStoreFloat4x4(&mShadowTransform, S);
@@ -801,8 +858,7 @@ void SsaoApp::UpdateMainPassCB(const GameTimer& gt)
 	mMainPassCB.Lights[2].Direction = mRotatedLightDirections[2];
 	mMainPassCB.Lights[2].Strength = { 0.0f, 0.0f, 0.0f };
  
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	mCurrFrameResource->MainPassCB = mUploadRing->PushConstants(mMainPassCB);
 }
 
 void SsaoApp::UpdateShadowPassCB(const GameTimer& gt)
@@ -830,8 +886,7 @@ void SsaoApp::UpdateShadowPassCB(const GameTimer& gt)
     mShadowPassCB.NearZ = mLightNearZ;
     mShadowPassCB.FarZ = mLightFarZ;
 
-    auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(1, mShadowPassCB);
+    mCurrFrameResource->ShadowPassCB = mUploadRing->PushConstants(mShadowPassCB);
 }
 
 void SsaoApp::UpdateSsaoCB(const GameTimer& gt)
@@ -866,8 +921,7 @@ void SsaoApp::UpdateSsaoCB(const GameTimer& gt)
     ssaoCB.OcclusionFadeEnd = 1.0f;
     ssaoCB.SurfaceEpsilon = 0.05f;
  
-    auto currSsaoCB = mCurrFrameResource->SsaoCB.get();
-    currSsaoCB->CopyData(0, ssaoCB);
+    mCurrFrameResource->SsaoCB = mUploadRing->PushConstants(ssaoCB);
 }
 
 void SsaoApp::UpdateTaaCB(const GameTimer& gt)
@@ -894,8 +948,7 @@ void SsaoApp::UpdateTaaCB(const GameTimer& gt)
     taaCB.MotionScale = 60.0f;  // Adjusted for better motion handling
     taaCB.FrameCount = mFrameCount;
 
-    auto currTaaCB = mCurrFrameResource->TaaCB.get();
-    currTaaCB->CopyData(0, taaCB);
+    mCurrFrameResource->TaaCB = mUploadRing->PushConstants(taaCB);
 
     mPrevJitterOffset = jitter;
 }
@@ -949,7 +1002,7 @@ void SsaoApp::BuildRootSignature()
     CD3DX12_ROOT_PARAMETER slotRootParameter[5];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
-    slotRootParameter[0].InitAsConstantBufferView(0);
+    slotRootParameter[0].InitAsShaderResourceView(1, 1);
     slotRootParameter[1].InitAsConstantBufferView(1);
     slotRootParameter[2].InitAsShaderResourceView(0, 1);
 	slotRootParameter[3].InitAsDescriptorTable(1, &texTable0, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -1184,7 +1237,8 @@ void SsaoApp::BuildDescriptorHeaps()
     mShadowMap->BuildDescriptors(
         GetCpuSrv(mShadowMapHeapIndex),
         GetGpuSrv(mShadowMapHeapIndex),
-        GetDsv(1));
+        GetDsv(1),
+        GetDsv(2));
 
     mSsao->BuildDescriptors(
         mDepthStencilBuffer.Get(),
@@ -1248,6 +1302,7 @@ void SsaoApp::BuildShadersAndInputLayout()
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "AMBIENT", 0, DXGI_FORMAT_R32_FLOAT, 0, 44, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
 }
 
@@ -1471,6 +1526,24 @@ void SsaoApp::BuildSkullGeometry()
 
     fin.close();
 
+    //
+    // Bake the self occlusion of the skull into the vertices.  The bake takes a
+    // moment, so it is cached next to the model and redone only when the model
+    // or the settings change.
+    //
+
+    AoBaker::Settings aoSettings;
+    aoSettings.RayCount = 64;
+    aoSettings.MaxDistance = 0.25f*XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+    aoSettings.Bias = 1e-4f*aoSettings.MaxDistance;
+
+    std::vector<float> ambientAccess = AoBaker::BakeCached("Models/skull.ao",
+        &vertices[0].Pos, &vertices[0].Normal, sizeof(Vertex), vcount,
+        reinterpret_cast<const std::uint32_t*>(indices.data()), tcount, aoSettings);
+
+    for (UINT i = 0; i < vcount; ++i)
+        vertices[i].AmbientAccess = ambientAccess[i];
+
     //
     // Pack the indices of all the meshes into one index buffer.
     //
@@ -1734,9 +1807,13 @@ void SsaoApp::BuildFrameResources()
 {
     for(int i = 0; i < gNumFrameResources; ++i)
     {
-        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            2, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get()));
     }
+
+    // The constants and materials of all frames in flight come from one ring.  It
+    // grows if a frame ever needs more.
+    mRenderDevice = std::make_unique<D3D12RenderDevice>(md3dDevice.Get());
+    mUploadRing = std::make_unique<UploadRing>(mRenderDevice.get(), 256*1024);
 }
 
 void SsaoApp::BuildMaterials()
@@ -1798,7 +1875,6 @@ void SsaoApp::BuildRenderItems()
 	auto skyRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&skyRitem->World, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
 	skyRitem->TexTransform = MathHelper::Identity4x4();
-	skyRitem->ObjCBIndex = 0;
 	skyRitem->Mat = mMaterials["sky"].get();
 	skyRitem->Geo = mGeometries["shapeGeo"].get();
 	skyRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1812,7 +1888,6 @@ void SsaoApp::BuildRenderItems()
     auto quadRitem = std::make_unique<RenderItem>();
     quadRitem->World = MathHelper::Identity4x4();
     quadRitem->TexTransform = MathHelper::Identity4x4();
-    quadRitem->ObjCBIndex = 1;
     quadRitem->Mat = mMaterials["bricks0"].get();
     quadRitem->Geo = mGeometries["shapeGeo"].get();
     quadRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1826,7 +1901,6 @@ void SsaoApp::BuildRenderItems()
 	auto boxRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
 	XMStoreFloat4x4(&boxRitem->TexTransform, XMMatrixScaling(1.0f, 0.5f, 1.0f));
-	boxRitem->ObjCBIndex = 2;
 	boxRitem->Mat = mMaterials["bricks0"].get();
 	boxRitem->Geo = mGeometries["shapeGeo"].get();
 	boxRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1840,7 +1914,6 @@ void SsaoApp::BuildRenderItems()
     auto skullRitem = std::make_unique<RenderItem>();
     XMStoreFloat4x4(&skullRitem->World, XMMatrixScaling(0.4f, 0.4f, 0.4f)*XMMatrixTranslation(0.0f, 1.0f, 0.0f));
     skullRitem->TexTransform = MathHelper::Identity4x4();
-    skullRitem->ObjCBIndex = 3;
     skullRitem->Mat = mMaterials["skullMat"].get();
     skullRitem->Geo = mGeometries["skullGeo"].get();
     skullRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1855,7 +1928,6 @@ void SsaoApp::BuildRenderItems()
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
 	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(8.0f, 8.0f, 1.0f));
-	gridRitem->ObjCBIndex = 4;
 	gridRitem->Mat = mMaterials["tile0"].get();
 	gridRitem->Geo = mGeometries["shapeGeo"].get();
 	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1867,7 +1939,6 @@ void SsaoApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(gridRitem));
 
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.5f, 2.0f, 1.0f);
-	UINT objCBIndex = 5;
 	for(int i = 0; i < 5; ++i)
 	{
 		auto leftCylRitem = std::make_unique<RenderItem>();
@@ -1883,7 +1954,6 @@ void SsaoApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&leftCylRitem->World, rightCylWorld);
 		XMStoreFloat4x4(&leftCylRitem->TexTransform, brickTexTransform);
-		leftCylRitem->ObjCBIndex = objCBIndex++;
 		leftCylRitem->Mat = mMaterials["bricks0"].get();
 		leftCylRitem->Geo = mGeometries["shapeGeo"].get();
 		leftCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1893,7 +1963,6 @@ void SsaoApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
-		rightCylRitem->ObjCBIndex = objCBIndex++;
 		rightCylRitem->Mat = mMaterials["bricks0"].get();
 		rightCylRitem->Geo = mGeometries["shapeGeo"].get();
 		rightCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1903,7 +1972,6 @@ void SsaoApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
-		leftSphereRitem->ObjCBIndex = objCBIndex++;
 		leftSphereRitem->Mat = mMaterials["mirror0"].get();
 		leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		leftSphereRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1913,7 +1981,6 @@ void SsaoApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
-		rightSphereRitem->ObjCBIndex = objCBIndex++;
 		rightSphereRitem->Mat = mMaterials["mirror0"].get();
 		rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		rightSphereRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1931,93 +1998,154 @@ void SsaoApp::BuildRenderItems()
 		mAllRitems.push_back(std::move(leftSphereRitem));
 		mAllRitems.push_back(std::move(rightSphereRitem));
 	}
+
+	// The shadow caster lists keep the layer order, so the repeated meshes are
+	// drawn together there too.
+	for(auto& layer : mRitemLayer)
+		DrawQueue::SortRuns(layer, d3dUtil::MeshKey<RenderItem>);
+
+    for(auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+    {
+        if(ri == mSkullRitem)
+            mDynamicShadowCasters.push_back(ri);
+        else
+            mStaticShadowCasters.push_back(ri);
+    }
 }
 
 void SsaoApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
- 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    // Each run of render items with the same mesh is one instanced draw.
+    DrawQueue::ForEachRun(ritems, d3dUtil::MeshKey<RenderItem>, [&](UINT first, UINT last)
     {
-        auto ri = ritems[i];
+        auto ri = ritems[first];
+
+        UINT instanceCount = last - first;
+
+        // The instances of a draw are contiguous in the ring, so SV_InstanceID,
+        // which starts at 0 for every draw, indexes them from the bound address.
+        auto instances = mUploadRing->Allocate(instanceCount*sizeof(InstanceData), alignof(InstanceData));
+        auto instanceData = reinterpret_cast<InstanceData*>(instances.CpuAddress);
+        for(UINT i = 0; i < instanceCount; ++i)
+            instanceData[i] = ritems[first + i]->Instance;
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+		cmdList->SetGraphicsRootShaderResourceView(0, instances.Address);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+        cmdList->DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+    });
 }
 
-void SsaoApp::DrawSceneToShadowMap()
+void SsaoApp::DrawSceneToShadowMap(RenderGraph::Texture shadowMap, RenderGraph::Texture staticShadowMap)
 {
-    mCommandList->RSSetViewports(1, &mShadowMap->Viewport());
-    mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
+    auto setShadowPassState = [this](ID3D12GraphicsCommandList* cmdList)
+    {
+        cmdList->RSSetViewports(1, &mShadowMap->Viewport());
 
-    // Change to DEPTH_WRITE.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-        D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+        // Bind the pass constant buffer for the shadow map pass.
+        cmdList->SetGraphicsRootConstantBufferView(1, mCurrFrameResource->ShadowPassCB);
 
-    // Clear the back buffer and depth buffer.
-    mCommandList->ClearDepthStencilView(mShadowMap->Dsv(), 
-        D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+        cmdList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+    };
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+    // While the light moves the static map would be redrawn every frame, so draw
+    // all casters straight into the shadow map instead.
+    if(mShadowCache.BypassCache())
+    {
+        mRenderGraph->AddPass("Shadow Map", [this, setShadowPassState](ID3D12GraphicsCommandList* cmdList)
+        {
+            setShadowPassState(cmdList);
+            cmdList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
+
+            cmdList->ClearDepthStencilView(mShadowMap->Dsv(),
+                D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+
+            cmdList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+
+            DrawRenderItems(cmdList, mStaticShadowCasters);
+            DrawRenderItems(cmdList, mDynamicShadowCasters);
+        })
+        .Write(shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+        mShadowCache.MarkBypassed();
+        return;
+    }
+
+    // Redraw the invalidated texels of the static shadow map, if any.
+    if(mShadowCache.IsDirty())
+    {
+        D3D12_RECT dirtyRect = mShadowCache.DirtyRect();
 
-    // Bind the pass constant buffer for the shadow map pass.
-    UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + 1*passCBByteSize;
-    mCommandList->SetGraphicsRootConstantBufferView(1, passCBAddress);
+        mRenderGraph->AddPass("Static Shadow Map", [this, setShadowPassState, dirtyRect](ID3D12GraphicsCommandList* cmdList)
+        {
+            setShadowPassState(cmdList);
+            cmdList->RSSetScissorRects(1, &dirtyRect);
+
+            cmdList->ClearDepthStencilView(mShadowMap->StaticDsv(),
+                D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 1, &dirtyRect);
 
-    mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+            cmdList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->StaticDsv());
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+            DrawRenderItems(cmdList, mStaticShadowCasters);
+        })
+        .Write(staticShadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 
-    // Change back to GENERIC_READ so we can read the texture in a shader.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+        mShadowCache.MarkClean();
+    }
+
+    // Restore the static casters, then draw the dynamic ones on top.
+    if(mShadowCache.BeginFrame(!mDynamicShadowCasters.empty()))
+    {
+        mRenderGraph->AddPass("Restore Shadow Map", [this](ID3D12GraphicsCommandList* cmdList)
+        {
+            cmdList->CopyResource(mShadowMap->Resource(), mShadowMap->StaticResource());
+        })
+        .Read(staticShadowMap, D3D12_RESOURCE_STATE_COPY_SOURCE)
+        .Write(shadowMap, D3D12_RESOURCE_STATE_COPY_DEST);
+
+        mRenderGraph->AddPass("Dynamic Shadow Casters", [this, setShadowPassState](ID3D12GraphicsCommandList* cmdList)
+        {
+            setShadowPassState(cmdList);
+            cmdList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
+
+            // Specify the buffers we are going to render to.
+            cmdList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+
+            DrawRenderItems(cmdList, mDynamicShadowCasters);
+        })
+        .Write(shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    }
 }
  
-void SsaoApp::DrawNormalsAndDepth()
+void SsaoApp::DrawNormalsAndDepth(RenderGraph::Texture normalMap, RenderGraph::Texture depthBuffer)
 {
-	mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
-
-	auto normalMap = mSsao->NormalMap();
-	auto normalMapRtv = mSsao->NormalMapRtv();
-	
-    // Change to RENDER_TARGET.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
-        D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_RENDER_TARGET));
+    mRenderGraph->AddPass("Normals and Depth", [this](ID3D12GraphicsCommandList* cmdList)
+    {
+	    cmdList->RSSetViewports(1, &mScreenViewport);
+        cmdList->RSSetScissorRects(1, &mScissorRect);
 
-	// Clear the screen normal map and depth buffer.
-	float clearValue[] = {0.0f, 0.0f, 1.0f, 0.0f};
-    mCommandList->ClearRenderTargetView(normalMapRtv, clearValue, 0, nullptr);
-    mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+	    auto normalMapRtv = mSsao->NormalMapRtv();
 
-	// Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &normalMapRtv, true, &DepthStencilView());
+	    // Clear the screen normal map and depth buffer.
+	    float clearValue[] = {0.0f, 0.0f, 1.0f, 0.0f};
+        cmdList->ClearRenderTargetView(normalMapRtv, clearValue, 0, nullptr);
+        cmdList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-    // Bind the constant buffer for this pass.
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    mCommandList->SetGraphicsRootConstantBufferView(1, passCB->GetGPUVirtualAddress());
+	    // Specify the buffers we are going to render to.
+        cmdList->OMSetRenderTargets(1, &normalMapRtv, true, &DepthStencilView());
 
-    mCommandList->SetPipelineState(mPSOs["drawNormals"].Get());
+        // Bind the constant buffer for this pass.
+        cmdList->SetGraphicsRootConstantBufferView(1, mCurrFrameResource->MainPassCB);
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+        cmdList->SetPipelineState(mPSOs["drawNormals"].Get());
 
-    // Change back to GENERIC_READ so we can read the texture in a shader.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
+        DrawRenderItems(cmdList, mRitemLayer[(int)RenderLayer::Opaque]);
+    })
+    .Write(normalMap, D3D12_RESOURCE_STATE_RENDER_TARGET)
+    .Write(depthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
 }
 
 CD3DX12_CPU_DESCRIPTOR_HANDLE SsaoApp::GetCpuSrv(int index)const
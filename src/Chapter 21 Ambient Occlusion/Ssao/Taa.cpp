@@ -17,27 +17,7 @@ Taa::Taa(ID3D12Device* device,
 
 void Taa::BuildHaltonSequence()
 {
-    for (int i = 0; i < JitterSampleCount; ++i)
-    {
-        mJitterSequence[i].x = Halton(i + 1, 2);
-        mJitterSequence[i].y = Halton(i + 1, 3);
-    }
-}
-
-float Taa::Halton(int index, int base)
-{
-    float result = 0.0f;
-    float f = 1.0f / base;
-    int i = index;
-
-    while (i > 0)
-    {
-        result += f * (i % base);
-        i = i / base;
-        f = f / base;
-    }
-
-    return result;
+    MathHelper::HaltonSequence(mJitterSequence, JitterSampleCount, 1);
 }
 
 XMFLOAT2 Taa::GetJitterOffset(UINT frameIndex) const
@@ -89,31 +69,14 @@ void Taa::BuildDescriptors(
 
 void Taa::RebuildDescriptors()
 {
+    // The render graph creates the views of the transient buffers.
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Format = ColorFormat;
     srvDesc.Texture2D.MostDetailedMip = 0;
     srvDesc.Texture2D.MipLevels = 1;
-
-    srvDesc.Format = ColorFormat;
     md3dDevice->CreateShaderResourceView(mHistoryBuffer.Get(), &srvDesc, mhHistoryBufferCpuSrv);
-    md3dDevice->CreateShaderResourceView(mCurrentColorBuffer.Get(), &srvDesc, mhCurrentColorCpuSrv);
-    md3dDevice->CreateShaderResourceView(mOutputBuffer.Get(), &srvDesc, mhOutputCpuSrv);
-
-    srvDesc.Format = VelocityFormat;
-    md3dDevice->CreateShaderResourceView(mVelocityBuffer.Get(), &srvDesc, mhVelocityCpuSrv);
-
-    D3D12_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-    rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
-    rtvDesc.Texture2D.MipSlice = 0;
-    rtvDesc.Texture2D.PlaneSlice = 0;
-
-    rtvDesc.Format = ColorFormat;
-    md3dDevice->CreateRenderTargetView(mCurrentColorBuffer.Get(), &rtvDesc, mhCurrentColorCpuRtv);
-    md3dDevice->CreateRenderTargetView(mOutputBuffer.Get(), &rtvDesc, mhOutputCpuRtv);
-
-    rtvDesc.Format = VelocityFormat;
-    md3dDevice->CreateRenderTargetView(mVelocityBuffer.Get(), &rtvDesc, mhVelocityCpuRtv);
 }
 
 void Taa::SetPSOs(ID3D12PipelineState* taaPso, ID3D12PipelineState* velocityPso)
@@ -145,11 +108,7 @@ void Taa::OnResize(UINT newWidth, UINT newHeight)
 void Taa::BuildResources()
 {
     mHistoryBuffer = nullptr;
-    mCurrentColorBuffer = nullptr;
-    mVelocityBuffer = nullptr;
-    mOutputBuffer = nullptr;
 
-    // Color buffers
     D3D12_RESOURCE_DESC texDesc = {};
     texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
     texDesc.Alignment = 0;
@@ -174,54 +133,32 @@ void Taa::BuildResources()
         &colorOptClear,
         IID_PPV_ARGS(&mHistoryBuffer)));
     mHistoryBuffer->SetName(L"TAA History Buffer");
+}
 
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        &colorOptClear,
-        IID_PPV_ARGS(&mCurrentColorBuffer)));
-    mCurrentColorBuffer->SetName(L"TAA Current Color Buffer");
+void Taa::CreateTextures(RenderGraph& graph)
+{
+    RenderGraph::TextureDesc desc;
+    desc.Width = mWidth;
+    desc.Height = mHeight;
+    desc.Format = ColorFormat;
+    float colorClearValue[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    desc.ClearValue = CD3DX12_CLEAR_VALUE(ColorFormat, colorClearValue);
 
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        &colorOptClear,
-        IID_PPV_ARGS(&mOutputBuffer)));
-    mOutputBuffer->SetName(L"TAA Output Buffer");
+    desc.Srv = mhCurrentColorCpuSrv;
+    desc.Rtv = mhCurrentColorCpuRtv;
+    mCurrentColorBuffer = graph.Create("TAA Current Color Buffer", desc);
+
+    desc.Srv = mhOutputCpuSrv;
+    desc.Rtv = mhOutputCpuRtv;
+    mOutputBuffer = graph.Create("TAA Output Buffer", desc);
 
     // Velocity buffer (R16G16_FLOAT)
-    texDesc.Format = VelocityFormat;
+    desc.Format = VelocityFormat;
     float velocityClearValue[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-    CD3DX12_CLEAR_VALUE velocityOptClear(VelocityFormat, velocityClearValue);
-
-    ThrowIfFailed(md3dDevice->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &texDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        &velocityOptClear,
-        IID_PPV_ARGS(&mVelocityBuffer)));
-    mVelocityBuffer->SetName(L"TAA Velocity Buffer");
-}
-
-void Taa::TransitionVelocityForWrite(ID3D12GraphicsCommandList* cmdList)
-{
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        mVelocityBuffer.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_RESOURCE_STATE_RENDER_TARGET));
-}
-
-void Taa::TransitionVelocityForRead(ID3D12GraphicsCommandList* cmdList)
-{
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        mVelocityBuffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET,
-        D3D12_RESOURCE_STATE_GENERIC_READ));
+    desc.ClearValue = CD3DX12_CLEAR_VALUE(VelocityFormat, velocityClearValue);
+    desc.Srv = mhVelocityCpuSrv;
+    desc.Rtv = mhVelocityCpuRtv;
+    mVelocityBuffer = graph.Create("TAA Velocity Buffer", desc);
 }
 
 void Taa::Execute(
@@ -232,17 +169,12 @@ void Taa::Execute(
     cmdList->RSSetViewports(1, &mViewport);
     cmdList->RSSetScissorRects(1, &mScissorRect);
 
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        mOutputBuffer.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_RESOURCE_STATE_RENDER_TARGET));
-
     float clearValue[] = { 0.0f, 0.0f, 0.0f, 1.0f };
     cmdList->ClearRenderTargetView(mhOutputCpuRtv, clearValue, 0, nullptr);
 
     cmdList->OMSetRenderTargets(1, &mhOutputCpuRtv, true, nullptr);
 
-    auto taaCBAddress = currFrame->TaaCB->Resource()->GetGPUVirtualAddress();
+    auto taaCBAddress = currFrame->TaaCB;
     cmdList->SetGraphicsRootConstantBufferView(0, taaCBAddress);
 
     cmdList->SetGraphicsRootDescriptorTable(1, mhHistoryBufferGpuSrv);
@@ -253,35 +185,4 @@ void Taa::Execute(
     cmdList->IASetIndexBuffer(nullptr);
     cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     cmdList->DrawInstanced(6, 1, 0, 0);
-
-    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-        mOutputBuffer.Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET,
-        D3D12_RESOURCE_STATE_GENERIC_READ));
-}
-
-void Taa::CopyToHistory(ID3D12GraphicsCommandList* cmdList)
-{
-    CD3DX12_RESOURCE_BARRIER barriers[2];
-    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
-        mHistoryBuffer.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_RESOURCE_STATE_COPY_DEST);
-    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
-        mOutputBuffer.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_RESOURCE_STATE_COPY_SOURCE);
-    cmdList->ResourceBarrier(2, barriers);
-
-    cmdList->CopyResource(mHistoryBuffer.Get(), mOutputBuffer.Get());
-
-    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(
-        mHistoryBuffer.Get(),
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        D3D12_RESOURCE_STATE_GENERIC_READ);
-    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(
-        mOutputBuffer.Get(),
-        D3D12_RESOURCE_STATE_COPY_SOURCE,
-        D3D12_RESOURCE_STATE_GENERIC_READ);
-    cmdList->ResourceBarrier(2, barriers);
 }
@@ -12,6 +12,7 @@
 #pragma once
 
 #include "../../Common/d3dUtil.h"
+#include "../../Common/RenderGraph.h"
 #include "FrameResource.h"
 
 class Taa
@@ -37,11 +38,12 @@ public:
     // Get jitter offset in NDC space [-1, 1]
     DirectX::XMFLOAT2 GetJitterOffsetNDC(UINT frameIndex) const;
 
-    // Resources
+    // Resources; only the history lives across frames, the others are transient
+    // textures of the frame's render graph, valid after CreateTextures().
     ID3D12Resource* HistoryBuffer() { return mHistoryBuffer.Get(); }
-    ID3D12Resource* CurrentColorBuffer() { return mCurrentColorBuffer.Get(); }
-    ID3D12Resource* VelocityBuffer() { return mVelocityBuffer.Get(); }
-    ID3D12Resource* OutputBuffer() { return mOutputBuffer.Get(); }
+    RenderGraph::Texture CurrentColorBuffer() const { return mCurrentColorBuffer; }
+    RenderGraph::Texture VelocityBuffer() const { return mVelocityBuffer; }
+    RenderGraph::Texture OutputBuffer() const { return mOutputBuffer; }
 
     // Descriptor handles
     CD3DX12_GPU_DESCRIPTOR_HANDLE HistoryBufferSrvGpu() const { return mhHistoryBufferGpuSrv; }
@@ -61,26 +63,21 @@ public:
 
     void OnResize(UINT newWidth, UINT newHeight);
 
-    // Execute TAA resolve pass
+    // Declare this frame's current color, velocity and output buffers
+    void CreateTextures(RenderGraph& graph);
+
+    // Execute TAA resolve pass; the render graph transitions the buffers
     void Execute(
         ID3D12GraphicsCommandList* cmdList,
         ID3D12RootSignature* rootSig,
         FrameResource* currFrame);
 
-    // Copy output to history for next frame
-    void CopyToHistory(ID3D12GraphicsCommandList* cmdList);
-
-    // Velocity buffer state transitions
-    void TransitionVelocityForWrite(ID3D12GraphicsCommandList* cmdList);
-    void TransitionVelocityForRead(ID3D12GraphicsCommandList* cmdList);
-
     D3D12_VIEWPORT Viewport() const { return mViewport; }
     D3D12_RECT ScissorRect() const { return mScissorRect; }
 
 private:
     void BuildResources();
     void BuildHaltonSequence();
-    float Halton(int index, int base);
 
 private:
     ID3D12Device* md3dDevice;
@@ -89,9 +86,9 @@ private:
     ID3D12PipelineState* mVelocityPso = nullptr;
 
     Microsoft::WRL::ComPtr<ID3D12Resource> mHistoryBuffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mCurrentColorBuffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mVelocityBuffer;
-    Microsoft::WRL::ComPtr<ID3D12Resource> mOutputBuffer;
+    RenderGraph::Texture mCurrentColorBuffer;
+    RenderGraph::Texture mVelocityBuffer;
+    RenderGraph::Texture mOutputBuffer;
 
     // SRV handles
     CD3DX12_CPU_DESCRIPTOR_HANDLE mhHistoryBufferCpuSrv;
@@ -7,11 +7,15 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/ShadowCache.h"
+#include "../../Common/DrawQueue.h"
 #include "FrameResource.h"
 #include "ShadowMap.h"
 #include "Ssao.h"
 #include "SkinnedData.h"
 #include "LoadM3d.h"
+#include "SkinnedMeshPicker.h"
+#include <chrono>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -57,15 +61,11 @@ struct RenderItem
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	// The render item's instance data, rebuilt by UpdateInstanceData() when InstanceDirty
+	// is set.  DrawRenderItems() copies it next to the other instances of its draw.
+	InstanceData Instance;
+	bool InstanceDirty = true;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
- 
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 
@@ -82,12 +82,23 @@ struct RenderItem
 	
     // nullptr if this render-item is not animated by skinned mesh.
     SkinnedModelInstance* SkinnedModelInst = nullptr;
+
+	bool Visible = true;
 };
 
+// Render items with equal keys are drawn with one instanced draw (see
+// DrawQueue::ForEachRun()).  Skinned render items also need the same bone
+// transforms, and hidden render items are not drawn.
+auto SkinnedDrawKey(const RenderItem* ri)
+{
+	return std::tuple_cat(d3dUtil::MeshKey(ri), std::make_tuple(ri->Visible, (std::uintptr_t)ri->SkinnedModelInst, ri->SkinnedCBIndex));
+}
+
 enum class RenderLayer : int
 {
 	Opaque = 0,
     SkinnedOpaque,
+    SkinnedHighlight,
     Debug,
 	Sky,
 	Count
@@ -115,7 +126,7 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
-	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData(const GameTimer& gt);
     void UpdateSkinnedCBs(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
     void UpdateShadowTransform(const GameTimer& gt);
@@ -138,6 +149,8 @@ private:
     void DrawSceneToShadowMap();
 	void DrawNormalsAndDepth();
 
+	void Pick(int sx, int sy);
+
     CD3DX12_CPU_DESCRIPTOR_HANDLE GetCpuSrv(int index)const;
     CD3DX12_GPU_DESCRIPTOR_HANDLE GetGpuSrv(int index)const;
     CD3DX12_CPU_DESCRIPTOR_HANDLE GetDsv(int index)const;
@@ -185,6 +198,9 @@ private:
     PassConstants mMainPassCB;  // index 0 of pass cbuffer.
     PassConstants mShadowPassCB;// index 1 of pass cbuffer.
 
+    // Instances written to the current frame resource's instance buffer so far.
+    UINT mInstanceCount = 0;
+
     UINT mSkinnedSrvHeapStart = 0;
     std::string mSkinnedModelFilename = "Models\\soldier.m3d";
     std::unique_ptr<SkinnedModelInstance> mSkinnedModelInst; 
@@ -193,10 +209,21 @@ private:
     std::vector<M3DLoader::M3dMaterial> mSkinnedMats;
     std::vector<std::string> mSkinnedTextureNames;
 
+    // Picking against the animated soldier; the picked triangle is redrawn
+    // with the skinned highlight PSO so it follows the animation.
+    SkinnedMeshPicker mSkinnedPicker;
+    RenderItem* mSkinnedRitem = nullptr;
+    RenderItem* mPickedRitem = nullptr;
+    bool mPickWithRefit = false;
+
 	Camera mCamera;
 
     std::unique_ptr<ShadowMap> mShadowMap;
 
+    // The animated soldier is drawn into the shadow map every frame; the static
+    // opaque layer is cached in the static shadow map.
+    ShadowCache mShadowCache;
+
     std::unique_ptr<Ssao> mSsao;
 
     DirectX::BoundingSphere mSceneBounds;
@@ -209,6 +236,7 @@ private:
     XMFLOAT4X4 mShadowTransform = MathHelper::Identity4x4();
 
     float mLightRotationAngle = 0.0f;
+    bool mLightAnimationEnabled = true;
     XMFLOAT3 mBaseLightDirections[3] = {
         XMFLOAT3(0.57735f, -0.57735f, 0.57735f),
         XMFLOAT3(-0.57735f, -0.57735f, 0.57735f),
@@ -271,6 +299,7 @@ bool SkinnedMeshApp::Initialize()
  
     mShadowMap = std::make_unique<ShadowMap>(md3dDevice.Get(),
         2048, 2048);
+    mShadowCache.SetSize(mShadowMap->Width(), mShadowMap->Height());
 
     mSsao = std::make_unique<Ssao>(
         md3dDevice.Get(),
@@ -313,9 +342,9 @@ void SkinnedMeshApp::CreateRtvAndDsvDescriptorHeaps()
     ThrowIfFailed(md3dDevice->CreateDescriptorHeap(
         &rtvHeapDesc, IID_PPV_ARGS(mRtvHeap.GetAddressOf())));
 
-    // Add +1 DSV for shadow map.
+    // Add +2 DSV for shadow map and its static copy.
     D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc;
-    dsvHeapDesc.NumDescriptors = 2;
+    dsvHeapDesc.NumDescriptors = 3;
     dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
     dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
     dsvHeapDesc.NodeMask = 0;
@@ -360,7 +389,8 @@ void SkinnedMeshApp::Update(const GameTimer& gt)
     // Animate the lights (and hence shadows).
     //
 
-    mLightRotationAngle += 0.1f*gt.DeltaTime();
+    if(mLightAnimationEnabled)
+        mLightRotationAngle += 0.1f*gt.DeltaTime();
 
     XMMATRIX R = XMMatrixRotationY(mLightRotationAngle);
     for(int i = 0; i < 3; ++i)
@@ -371,7 +401,7 @@ void SkinnedMeshApp::Update(const GameTimer& gt)
     }
  
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+	UpdateInstanceData(gt);
     UpdateSkinnedCBs(gt);
 	UpdateMaterialBuffer(gt);
     UpdateShadowTransform(gt);
@@ -388,6 +418,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt)
     // We can only reset when the associated command lists have finished execution on the GPU.
     ThrowIfFailed(cmdListAlloc->Reset());
 
+    // The GPU is done with this frame resource's instance buffer too.
+    mInstanceCount = 0;
+
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
     ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
@@ -480,6 +513,9 @@ void SkinnedMeshApp::Draw(const GameTimer& gt)
     mCommandList->SetPipelineState(mPSOs["skinnedOpaque"].Get());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
 
+    mCommandList->SetPipelineState(mPSOs["skinnedHighlight"].Get());
+    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::SkinnedHighlight]);
+
     mCommandList->SetPipelineState(mPSOs["debug"].Get());
     DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Debug]);
 
@@ -512,10 +548,17 @@ void SkinnedMeshApp::Draw(const GameTimer& gt)
 
 void SkinnedMeshApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
-    mLastMousePos.x = x;
-    mLastMousePos.y = y;
+    if((btnState & MK_LBUTTON) != 0)
+    {
+        mLastMousePos.x = x;
+        mLastMousePos.y = y;
 
-    SetCapture(mhMainWnd);
+        SetCapture(mhMainWnd);
+    }
+    else if((btnState & MK_RBUTTON) != 0)
+    {
+        Pick(x, y);
+    }
 }
 
 void SkinnedMeshApp::OnMouseUp(WPARAM btnState, int x, int y)
@@ -555,6 +598,20 @@ void SkinnedMeshApp::OnKeyboardInput(const GameTimer& gt)
 	if(GetAsyncKeyState('D') & 0x8000)
 		mCamera.Strafe(10.0f*dt);
 
+	// Pick with the bone proxies (1) or by refitting the triangle tree (2).
+	if(GetAsyncKeyState('1') & 0x8000)
+		mPickWithRefit = false;
+
+	if(GetAsyncKeyState('2') & 0x8000)
+		mPickWithRefit = true;
+
+	// Pause the light with 'L'; a still light keeps the static shadow map cached.
+	static bool lKeyWasDown = false;
+	bool lKeyIsDown = (GetAsyncKeyState('L') & 0x8000) != 0;
+	if(lKeyIsDown && !lKeyWasDown)
+		mLightAnimationEnabled = !mLightAnimationEnabled;
+	lKeyWasDown = lKeyIsDown;
+
 	mCamera.UpdateViewMatrix();
 }
  
@@ -563,31 +620,6 @@ void SkinnedMeshApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
-void SkinnedMeshApp::UpdateObjectCBs(const GameTimer& gt)
-{
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
-	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
-		{
-            XMMATRIX world = XMLoadFloat4x4(&e->World);
-            XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
-
-            ObjectConstants objConstants;
-            XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-            XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
-            objConstants.MaterialIndex = e->Mat->MatCBIndex;
-
-            currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
-	}
-}
-
 void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
 {
     auto currSkinnedCB = mCurrFrameResource->SkinnedCB.get();
@@ -604,6 +636,26 @@ void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
     currSkinnedCB->CopyData(0, skinnedConstants);
 }
  
+void SkinnedMeshApp::UpdateInstanceData(const GameTimer& gt)
+{
+	for(auto& e : mAllRitems)
+	{
+		// Only rebuild the instance data if the render item changed.
+		if(!e->InstanceDirty)
+			continue;
+
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+
+		InstanceData& instance = e->Instance;
+		XMStoreFloat4x4(&instance.World, XMMatrixTranspose(world));
+		XMStoreFloat4x4(&instance.TexTransform, XMMatrixTranspose(texTransform));
+		instance.MaterialIndex = e->Mat->MatCBIndex;
+
+		e->InstanceDirty = false;
+	}
+}
+
 void SkinnedMeshApp::UpdateMaterialBuffer(const GameTimer& gt)
 {
 	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
@@ -667,6 +719,7 @@ void SkinnedMeshApp::UpdateShadowTransform(const GameTimer& gt)
         0.5f, 0.5f, 0.0f, 1.0f);
 
     XMMATRIX S = lightView*lightProj*T;
+    mShadowCache.SetLightViewProj(lightView*lightProj);
     XMStoreFloat4x4(&mLightView, lightView);
     XMStoreFloat4x4(&mLightProj, lightProj);
     XMStoreFloat4x4(&mShadowTransform, S);
@@ -859,7 +912,7 @@ void SkinnedMeshApp::BuildRootSignature()
     CD3DX12_ROOT_PARAMETER slotRootParameter[6];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
-    slotRootParameter[0].InitAsConstantBufferView(0);
+    slotRootParameter[0].InitAsShaderResourceView(1, 1);
     slotRootParameter[1].InitAsConstantBufferView(1);
     slotRootParameter[2].InitAsConstantBufferView(2);
     slotRootParameter[3].InitAsShaderResourceView(0, 1);
@@ -1058,7 +1111,8 @@ void SkinnedMeshApp::BuildDescriptorHeaps()
     mShadowMap->BuildDescriptors(
         GetCpuSrv(mShadowMapHeapIndex),
         GetGpuSrv(mShadowMapHeapIndex),
-        GetDsv(1));
+        GetDsv(1),
+        GetDsv(2));
 
     mSsao->BuildDescriptors(
         mDepthStencilBuffer.Get(),
@@ -1288,6 +1342,8 @@ void SkinnedMeshApp::LoadSkinnedModel()
     mSkinnedModelInst->FinalTransforms.resize(mSkinnedInfo.BoneCount());
     mSkinnedModelInst->ClipName = "Take1";
     mSkinnedModelInst->TimePos = 0.0f;
+
+    mSkinnedPicker.Build(vertices, indices, mSkinnedInfo.BoneCount());
  
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(SkinnedVertex);
     const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
@@ -1376,6 +1432,30 @@ void SkinnedMeshApp::BuildPSOs()
     };
     ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&skinnedOpaquePsoDesc, IID_PPV_ARGS(&mPSOs["skinnedOpaque"])));
 
+    //
+    // PSO for the picked skinned triangle.
+    //
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC skinnedHighlightPsoDesc = skinnedOpaquePsoDesc;
+
+    // The picked triangle is drawn a second time on top of itself, so it must
+    // pass the depth test with <=.
+    skinnedHighlightPsoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+
+    D3D12_RENDER_TARGET_BLEND_DESC transparencyBlendDesc;
+    transparencyBlendDesc.BlendEnable = true;
+    transparencyBlendDesc.LogicOpEnable = false;
+    transparencyBlendDesc.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+    transparencyBlendDesc.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+    transparencyBlendDesc.BlendOp = D3D12_BLEND_OP_ADD;
+    transparencyBlendDesc.SrcBlendAlpha = D3D12_BLEND_ONE;
+    transparencyBlendDesc.DestBlendAlpha = D3D12_BLEND_ZERO;
+    transparencyBlendDesc.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+    transparencyBlendDesc.LogicOp = D3D12_LOGIC_OP_NOOP;
+    transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+
+    skinnedHighlightPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&skinnedHighlightPsoDesc, IID_PPV_ARGS(&mPSOs["skinnedHighlight"])));
+
     //
     // PSO for shadow map pass.
     //
@@ -1538,8 +1618,9 @@ void SkinnedMeshApp::BuildFrameResources()
 {
     for(int i = 0; i < gNumFrameResources; ++i)
     {
+        // The render items can be drawn in the shadow, normal and main passes.
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            2, (UINT)mAllRitems.size(), 
+            2, 3*(UINT)mAllRitems.size(), 
             1,
             (UINT)mMaterials.size()));
     }
@@ -1603,6 +1684,17 @@ void SkinnedMeshApp::BuildMaterials()
 
         mMaterials[mat->Name] = std::move(mat);
     }
+
+    auto highlight0 = std::make_unique<Material>();
+    highlight0->Name = "highlight0";
+    highlight0->MatCBIndex = matCBIndex++;
+    highlight0->DiffuseSrvHeapIndex = 0;
+    highlight0->NormalSrvHeapIndex = 1;
+    highlight0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 0.0f, 0.6f);
+    highlight0->FresnelR0 = XMFLOAT3(0.06f, 0.06f, 0.06f);
+    highlight0->Roughness = 0.0f;
+
+    mMaterials["highlight0"] = std::move(highlight0);
 }
 
 void SkinnedMeshApp::BuildRenderItems()
@@ -1610,7 +1702,6 @@ void SkinnedMeshApp::BuildRenderItems()
 	auto skyRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&skyRitem->World, XMMatrixScaling(5000.0f, 5000.0f, 5000.0f));
 	skyRitem->TexTransform = MathHelper::Identity4x4();
-	skyRitem->ObjCBIndex = 0;
 	skyRitem->Mat = mMaterials["sky"].get();
 	skyRitem->Geo = mGeometries["shapeGeo"].get();
 	skyRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1624,7 +1715,6 @@ void SkinnedMeshApp::BuildRenderItems()
     auto quadRitem = std::make_unique<RenderItem>();
     quadRitem->World = MathHelper::Identity4x4();
     quadRitem->TexTransform = MathHelper::Identity4x4();
-    quadRitem->ObjCBIndex = 1;
     quadRitem->Mat = mMaterials["bricks0"].get();
     quadRitem->Geo = mGeometries["shapeGeo"].get();
     quadRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1638,7 +1728,6 @@ void SkinnedMeshApp::BuildRenderItems()
 	auto boxRitem = std::make_unique<RenderItem>();
 	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 1.0f, 2.0f)*XMMatrixTranslation(0.0f, 0.5f, 0.0f));
 	XMStoreFloat4x4(&boxRitem->TexTransform, XMMatrixScaling(1.0f, 1.0f, 1.0f));
-	boxRitem->ObjCBIndex = 2;
 	boxRitem->Mat = mMaterials["bricks0"].get();
 	boxRitem->Geo = mGeometries["shapeGeo"].get();
 	boxRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1652,7 +1741,6 @@ void SkinnedMeshApp::BuildRenderItems()
     auto gridRitem = std::make_unique<RenderItem>();
     gridRitem->World = MathHelper::Identity4x4();
 	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(8.0f, 8.0f, 1.0f));
-	gridRitem->ObjCBIndex = 3;
 	gridRitem->Mat = mMaterials["tile0"].get();
 	gridRitem->Geo = mGeometries["shapeGeo"].get();
 	gridRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1664,7 +1752,6 @@ void SkinnedMeshApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(gridRitem));
 
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.5f, 2.0f, 1.0f);
-	UINT objCBIndex = 4;
 	for(int i = 0; i < 5; ++i)
 	{
 		auto leftCylRitem = std::make_unique<RenderItem>();
@@ -1680,7 +1767,6 @@ void SkinnedMeshApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&leftCylRitem->World, rightCylWorld);
 		XMStoreFloat4x4(&leftCylRitem->TexTransform, brickTexTransform);
-		leftCylRitem->ObjCBIndex = objCBIndex++;
 		leftCylRitem->Mat = mMaterials["bricks0"].get();
 		leftCylRitem->Geo = mGeometries["shapeGeo"].get();
 		leftCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1690,7 +1776,6 @@ void SkinnedMeshApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
-		rightCylRitem->ObjCBIndex = objCBIndex++;
 		rightCylRitem->Mat = mMaterials["bricks0"].get();
 		rightCylRitem->Geo = mGeometries["shapeGeo"].get();
 		rightCylRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1700,7 +1785,6 @@ void SkinnedMeshApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
-		leftSphereRitem->ObjCBIndex = objCBIndex++;
 		leftSphereRitem->Mat = mMaterials["mirror0"].get();
 		leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		leftSphereRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1710,7 +1794,6 @@ void SkinnedMeshApp::BuildRenderItems()
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
-		rightSphereRitem->ObjCBIndex = objCBIndex++;
 		rightSphereRitem->Mat = mMaterials["mirror0"].get();
 		rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
 		rightSphereRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1742,7 +1825,6 @@ void SkinnedMeshApp::BuildRenderItems()
         XMStoreFloat4x4(&ritem->World, modelScale*modelRot*modelOffset);
 
         ritem->TexTransform = MathHelper::Identity4x4();
-        ritem->ObjCBIndex = objCBIndex++;
         ritem->Mat = mMaterials[mSkinnedMats[i].Name].get();
         ritem->Geo = mGeometries[mSkinnedModelFilename].get();
         ritem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -1755,31 +1837,65 @@ void SkinnedMeshApp::BuildRenderItems()
         ritem->SkinnedCBIndex = 0;
         ritem->SkinnedModelInst = mSkinnedModelInst.get();
 
+        mSkinnedRitem = ritem.get();
         mRitemLayer[(int)RenderLayer::SkinnedOpaque].push_back(ritem.get());
         mAllRitems.push_back(std::move(ritem));
     }
+
+    auto pickedRitem = std::make_unique<RenderItem>();
+    pickedRitem->World = mSkinnedRitem->World;
+    pickedRitem->TexTransform = MathHelper::Identity4x4();
+    pickedRitem->Mat = mMaterials["highlight0"].get();
+    pickedRitem->Geo = mGeometries[mSkinnedModelFilename].get();
+    pickedRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+    pickedRitem->SkinnedCBIndex = 0;
+    pickedRitem->SkinnedModelInst = mSkinnedModelInst.get();
+
+    // Picked triangle is not visible until one is picked.  The draw parameters
+    // are filled out when a triangle is picked.
+    pickedRitem->Visible = false;
+    pickedRitem->IndexCount = 0;
+    pickedRitem->StartIndexLocation = 0;
+    pickedRitem->BaseVertexLocation = 0;
+    mPickedRitem = pickedRitem.get();
+    mRitemLayer[(int)RenderLayer::SkinnedHighlight].push_back(pickedRitem.get());
+    mAllRitems.push_back(std::move(pickedRitem));
+
+	for(auto& layer : mRitemLayer)
+		DrawQueue::SortRuns(layer, SkinnedDrawKey);
 }
 
 void SkinnedMeshApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+    UINT instanceByteSize = sizeof(InstanceData);
     UINT skinnedCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(SkinnedConstants));
 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer.get();
     auto skinnedCB = mCurrFrameResource->SkinnedCB->Resource();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    // Each run of render items with the same mesh is one instanced draw.
+    DrawQueue::ForEachRun(ritems, SkinnedDrawKey, [&](UINT first, UINT last)
     {
-        auto ri = ritems[i];
+        auto ri = ritems[first];
+
+        if(ri->Visible == false)
+            return;
+
+        UINT instanceCount = last - first;
+
+        // Copy the draw's instances after the ones already drawn this frame.
+        for(UINT i = 0; i < instanceCount; ++i)
+            instanceBuffer->CopyData(mInstanceCount + i, ritems[first + i]->Instance);
 
         cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
         cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
         cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
+        // SV_InstanceID starts at 0 for every draw, so bind the instance buffer at
+        // the first instance of the draw.
+        D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBuffer->Resource()->GetGPUVirtualAddress() + mInstanceCount*instanceByteSize;
 
-		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
+		cmdList->SetGraphicsRootShaderResourceView(0, instanceAddress);
 
         if(ri->SkinnedModelInst != nullptr)
         {
@@ -1791,25 +1907,15 @@ void SkinnedMeshApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const s
             cmdList->SetGraphicsRootConstantBufferView(1, 0);
         }
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+        cmdList->DrawIndexedInstanced(ri->IndexCount, instanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+
+        mInstanceCount += instanceCount;
+    });
 }
 
 void SkinnedMeshApp::DrawSceneToShadowMap()
 {
     mCommandList->RSSetViewports(1, &mShadowMap->Viewport());
-    mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
-
-    // Change to DEPTH_WRITE.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-        D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
-
-    // Clear the back buffer and depth buffer.
-    mCommandList->ClearDepthStencilView(mShadowMap->Dsv(), 
-        D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
 
     // Bind the pass constant buffer for the shadow map pass.
     UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
@@ -1817,15 +1923,80 @@ void SkinnedMeshApp::DrawSceneToShadowMap()
     D3D12_GPU_VIRTUAL_ADDRESS passCBAddress = passCB->GetGPUVirtualAddress() + 1*passCBByteSize;
     mCommandList->SetGraphicsRootConstantBufferView(2, passCBAddress);
 
-    mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+    // While the light moves the static map would be redrawn every frame, so draw
+    // all casters straight into the shadow map instead.
+    if(mShadowCache.BypassCache())
+    {
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
 
-    mCommandList->SetPipelineState(mPSOs["skinnedShadow_opaque"].Get());
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+        mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
 
-    // Change back to GENERIC_READ so we can read the texture in a shader.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
-        D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+        mCommandList->ClearDepthStencilView(mShadowMap->Dsv(),
+            D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+
+        mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+
+        mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+        DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+
+        mCommandList->SetPipelineState(mPSOs["skinnedShadow_opaque"].Get());
+        DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+
+        // Change back to GENERIC_READ so we can read the texture in a shader.
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+            D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+        mShadowCache.MarkBypassed();
+        return;
+    }
+
+    // Redraw the invalidated texels of the static shadow map, if any.
+    if(mShadowCache.IsDirty())
+    {
+        D3D12_RECT dirtyRect = mShadowCache.DirtyRect();
+        mCommandList->RSSetScissorRects(1, &dirtyRect);
+
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->StaticResource(),
+            D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+
+        mCommandList->ClearDepthStencilView(mShadowMap->StaticDsv(),
+            D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 1, &dirtyRect);
+
+        mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->StaticDsv());
+
+        mCommandList->SetPipelineState(mPSOs["shadow_opaque"].Get());
+        DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->StaticResource(),
+            D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+
+        mShadowCache.MarkClean();
+    }
+
+    // Restore the static casters, then draw the skinned ones on top.
+    if(mShadowCache.BeginFrame(!mRitemLayer[(int)RenderLayer::SkinnedOpaque].empty()))
+    {
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST));
+
+        mCommandList->CopyResource(mShadowMap->Resource(), mShadowMap->StaticResource());
+
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+
+        mCommandList->RSSetScissorRects(1, &mShadowMap->ScissorRect());
+
+        // Specify the buffers we are going to render to.
+        mCommandList->OMSetRenderTargets(0, nullptr, false, &mShadowMap->Dsv());
+
+        mCommandList->SetPipelineState(mPSOs["skinnedShadow_opaque"].Get());
+        DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::SkinnedOpaque]);
+
+        // Change back to GENERIC_READ so we can read the texture in a shader.
+        mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mShadowMap->Resource(),
+            D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_GENERIC_READ));
+    }
 }
  
 void SkinnedMeshApp::DrawNormalsAndDepth()
@@ -1862,6 +2033,70 @@ void SkinnedMeshApp::DrawNormalsAndDepth()
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap,
         D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_GENERIC_READ));
 }
+
+void SkinnedMeshApp::Pick(int sx, int sy)
+{
+    XMFLOAT4X4 P = mCamera.GetProj4x4f();
+
+    // Compute picking ray in view space.
+    float vx = (+2.0f*sx / mClientWidth - 1.0f) / P(0, 0);
+    float vy = (-2.0f*sy / mClientHeight + 1.0f) / P(1, 1);
+
+    XMVECTOR rayOrigin = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+    XMVECTOR rayDir = XMVectorSet(vx, vy, 1.0f, 0.0f);
+
+    XMMATRIX V = mCamera.GetView();
+    XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(V), V);
+
+    XMMATRIX W = XMLoadFloat4x4(&mSkinnedRitem->World);
+    XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
+
+    // Tranform ray to the local space of the soldier, where it is skinned.
+    XMMATRIX toLocal = XMMatrixMultiply(invView, invWorld);
+    rayOrigin = XMVector3TransformCoord(rayOrigin, toLocal);
+    rayDir = XMVector3TransformNormal(rayDir, toLocal);
+
+    // Pick against the pose drawn this frame.
+    const auto& finalTransforms = mSkinnedModelInst->FinalTransforms;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    TriangleBvh::Hit hit;
+    bool picked = false;
+    if(mPickWithRefit)
+    {
+        mSkinnedPicker.RefitPose(finalTransforms);
+        picked = mSkinnedPicker.PickRefitted(rayOrigin, rayDir, MathHelper::Infinity, hit);
+    }
+    else
+    {
+        picked = mSkinnedPicker.Pick(finalTransforms, rayOrigin, rayDir, MathHelper::Infinity, hit);
+    }
+
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    mPickedRitem->Visible = picked;
+    if(picked)
+    {
+        // Hit triangles index the whole index buffer (the subsets have no base vertex).
+        mPickedRitem->IndexCount = 3;
+        mPickedRitem->StartIndexLocation = 3 * hit.Triangle;
+        mPickedRitem->BaseVertexLocation = 0;
+    }
+
+    std::wostringstream outs;
+    outs.precision(3);
+    outs << L"Skinned Mesh Demo" <<
+        L"    pick " << (mPickWithRefit ? L"(refit)" : L"(proxies)") <<
+        L" " << std::chrono::duration<float, std::milli>(stop - start).count() << L" ms";
+    if(!mPickWithRefit)
+    {
+        outs << L"    bones tested " << mSkinnedPicker.LastCandidateBoneCount() <<
+            L"    triangles tested " << mSkinnedPicker.LastTestedTriangleCount();
+    }
+    mMainWndCaption = outs.str();
+}
+
 CD3DX12_CPU_DESCRIPTOR_HANDLE SkinnedMeshApp::GetCpuSrv(int index)const
 {
     auto srv = CD3DX12_CPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
@@ -0,0 +1,317 @@
+//***************************************************************************************
+// SkinnedMeshPicker.cpp - Ray picking against an animated skinned mesh
+//***************************************************************************************
+
+#include "SkinnedMeshPicker.h"
+#include "../../Common/JobSystem.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+const float SkinnedMeshPicker::ProxyMargin = 0.1f;
+
+namespace
+{
+	// Slab test of a ray against a box; dir need not be normalized.
+	bool RayBox(const BoundingBox& box, const XMFLOAT3& origin, const XMFLOAT3& dir, float maxDist, float& tEnter)
+	{
+		float tNear = 0.0f;
+		float tFar = maxDist;
+		for(UINT axis = 0; axis < 3; ++axis)
+		{
+			const float c = (&box.Center.x)[axis];
+			const float e = (&box.Extents.x)[axis];
+			const float o = (&origin.x)[axis];
+			const float d = (&dir.x)[axis];
+
+			if(fabsf(d) < 1e-20f)
+			{
+				if(o < c - e || o > c + e)
+					return false;
+				continue;
+			}
+
+			float t0 = (c - e - o) / d;
+			float t1 = (c + e - o) / d;
+			if(t0 > t1)
+				std::swap(t0, t1);
+
+			tNear = MathHelper::Max(tNear, t0);
+			tFar = MathHelper::Min(tFar, t1);
+			if(tNear > tFar)
+				return false;
+		}
+
+		tEnter = tNear;
+		return true;
+	}
+
+	// Two sided Moller-Trumbore; t is in units of |dir|.
+	bool RayTriangle(FXMVECTOR origin, FXMVECTOR dir, FXMVECTOR v0, GXMVECTOR v1, HXMVECTOR v2,
+		float& t, float& u, float& v)
+	{
+		XMVECTOR e1 = v1 - v0;
+		XMVECTOR e2 = v2 - v0;
+		XMVECTOR p = XMVector3Cross(dir, e2);
+
+		float det = XMVectorGetX(XMVector3Dot(e1, p));
+		if(det == 0.0f)
+			return false;
+
+		float invDet = 1.0f / det;
+		XMVECTOR s = origin - v0;
+		u = XMVectorGetX(XMVector3Dot(s, p))*invDet;
+		if(u < 0.0f || u > 1.0f)
+			return false;
+
+		XMVECTOR q = XMVector3Cross(s, e1);
+		v = XMVectorGetX(XMVector3Dot(dir, q))*invDet;
+		if(v < 0.0f || u + v > 1.0f)
+			return false;
+
+		t = XMVectorGetX(XMVector3Dot(e2, q))*invDet;
+		return t >= 0.0f;
+	}
+}
+
+void SkinnedMeshPicker::Build(const std::vector<M3DLoader::SkinnedVertex>& vertices,
+	const std::vector<std::uint16_t>& indices, UINT boneCount)
+{
+	const UINT vertexCount = (UINT)vertices.size();
+	const UINT triangleCount = (UINT)indices.size() / 3;
+
+	mBoneCount = boneCount;
+	mBindPositions.resize(vertexCount);
+	mWeights.resize(vertexCount);
+	mBoneIndices.resize(vertexCount);
+	mIndices.assign(indices.begin(), indices.end());
+
+	// Bind pose bounds of the vertices each bone influences.
+	std::vector<XMFLOAT3> boneMin(boneCount, XMFLOAT3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity));
+	std::vector<XMFLOAT3> boneMax(boneCount, XMFLOAT3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity));
+
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const M3DLoader::SkinnedVertex& vertex = vertices[i];
+
+		// The vertex shader derives the fourth weight from the other three.
+		const XMFLOAT3& w = vertex.BoneWeights;
+		mBindPositions[i] = vertex.Pos;
+		mWeights[i] = XMFLOAT4(w.x, w.y, w.z, 1.0f - w.x - w.y - w.z);
+		mBoneIndices[i] = *(const UINT*)vertex.BoneIndices;
+
+		for(UINT k = 0; k < 4; ++k)
+		{
+			const UINT bone = vertex.BoneIndices[k];
+			if((&mWeights[i].x)[k] <= 0.0f || bone >= boneCount)
+				continue;
+
+			boneMin[bone].x = MathHelper::Min(boneMin[bone].x, vertex.Pos.x);
+			boneMin[bone].y = MathHelper::Min(boneMin[bone].y, vertex.Pos.y);
+			boneMin[bone].z = MathHelper::Min(boneMin[bone].z, vertex.Pos.z);
+			boneMax[bone].x = MathHelper::Max(boneMax[bone].x, vertex.Pos.x);
+			boneMax[bone].y = MathHelper::Max(boneMax[bone].y, vertex.Pos.y);
+			boneMax[bone].z = MathHelper::Max(boneMax[bone].z, vertex.Pos.z);
+		}
+	}
+
+	mBoneProxies.resize(boneCount);
+	for(UINT b = 0; b < boneCount; ++b)
+	{
+		BoundingBox& proxy = mBoneProxies[b];
+		if(boneMin[b].x > boneMax[b].x)
+		{
+			proxy.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			proxy.Extents = XMFLOAT3(-1.0f, -1.0f, -1.0f);
+			continue;
+		}
+
+		XMVECTOR vMin = XMLoadFloat3(&boneMin[b]);
+		XMVECTOR vMax = XMLoadFloat3(&boneMax[b]);
+		XMStoreFloat3(&proxy.Center, 0.5f*(vMin + vMax));
+		XMStoreFloat3(&proxy.Extents, (0.5f + ProxyMargin)*(vMax - vMin));
+	}
+
+	// Bucket the triangles by the bones influencing any of their vertices.
+	auto forEachBone = [&](UINT t, auto f)
+	{
+		UINT seen[12];
+		UINT seenCount = 0;
+		for(UINT c = 0; c < 3; ++c)
+		{
+			const UINT v = mIndices[3*t + c];
+			for(UINT k = 0; k < 4; ++k)
+			{
+				const UINT bone = vertices[v].BoneIndices[k];
+				if((&mWeights[v].x)[k] <= 0.0f || bone >= boneCount ||
+					std::find(seen, seen + seenCount, bone) != seen + seenCount)
+					continue;
+
+				seen[seenCount++] = bone;
+				f(bone);
+			}
+		}
+	};
+
+	mBoneTriangleStart.assign(boneCount + 1, 0);
+	for(UINT t = 0; t < triangleCount; ++t)
+		forEachBone(t, [&](UINT bone) { mBoneTriangleStart[bone + 1]++; });
+	for(UINT b = 0; b < boneCount; ++b)
+		mBoneTriangleStart[b + 1] += mBoneTriangleStart[b];
+
+	std::vector<UINT> next(mBoneTriangleStart.begin(), mBoneTriangleStart.end() - 1);
+	mBoneTriangles.resize(mBoneTriangleStart[boneCount]);
+	for(UINT t = 0; t < triangleCount; ++t)
+		forEachBone(t, [&](UINT bone) { mBoneTriangles[next[bone]++] = t; });
+
+	mPalette.resize(boneCount);
+	mSkinnedPositions.resize(vertexCount);
+	mVertexStamps.assign(vertexCount, 0);
+	mTriangleStamps.assign(triangleCount, 0);
+	mStamp = 0;
+
+	mBvh.Build(mBindPositions.data(), sizeof(XMFLOAT3), mIndices.data(), triangleCount);
+}
+
+bool SkinnedMeshPicker::Pick(const std::vector<XMFLOAT4X4>& finalTransforms,
+	FXMVECTOR origin, FXMVECTOR dir, float maxDist, TriangleBvh::Hit& outHit)
+{
+	mLastCandidateBoneCount = 0;
+	mLastTestedTriangleCount = 0;
+
+	LoadPalette(finalTransforms);
+
+	XMFLOAT3 o, d;
+	XMStoreFloat3(&o, origin);
+	XMStoreFloat3(&d, dir);
+
+	// First level: the proxies in the current pose.
+	mCandidateBones.clear();
+	for(UINT b = 0; b < mBoneCount; ++b)
+	{
+		if(mBoneProxies[b].Extents.x < 0.0f)
+			continue;
+
+		BoundingBox proxy;
+		mBoneProxies[b].Transform(proxy, XMLoadFloat4x4(&mPalette[b]));
+
+		float dist = 0.0f;
+		if(RayBox(proxy, o, d, maxDist, dist))
+			mCandidateBones.push_back(b);
+	}
+
+	// A new stamp invalidates the skinned vertices and tested triangles of the
+	// previous pick.
+	if(++mStamp == 0)
+	{
+		std::fill(mVertexStamps.begin(), mVertexStamps.end(), 0);
+		std::fill(mTriangleStamps.begin(), mTriangleStamps.end(), 0);
+		mStamp = 1;
+	}
+
+	// Second level: skin and test the triangles of all bones hit.  A blended
+	// triangle may lie outside the proxy it is met in first, so the loop cannot
+	// stop once a hit is in front of the remaining proxies.
+	float nearest = maxDist;
+	bool hit = false;
+	for(UINT bone : mCandidateBones)
+	{
+		++mLastCandidateBoneCount;
+
+		for(UINT i = mBoneTriangleStart[bone]; i < mBoneTriangleStart[bone + 1]; ++i)
+		{
+			const UINT t = mBoneTriangles[i];
+			if(mTriangleStamps[t] == mStamp)
+				continue;
+
+			mTriangleStamps[t] = mStamp;
+			++mLastTestedTriangleCount;
+
+			XMVECTOR v[3];
+			for(UINT c = 0; c < 3; ++c)
+			{
+				const UINT index = mIndices[3*t + c];
+				if(mVertexStamps[index] != mStamp)
+				{
+					XMStoreFloat3(&mSkinnedPositions[index], SkinVertex(index));
+					mVertexStamps[index] = mStamp;
+				}
+
+				v[c] = XMLoadFloat3(&mSkinnedPositions[index]);
+			}
+
+			float tHit, u, w;
+			if(RayTriangle(origin, dir, v[0], v[1], v[2], tHit, u, w) && tHit < nearest)
+			{
+				nearest = tHit;
+				outHit.Distance = tHit;
+				outHit.Triangle = t;
+				outHit.U = u;
+				outHit.V = w;
+				hit = true;
+			}
+		}
+	}
+
+	return hit;
+}
+
+void SkinnedMeshPicker::RefitPose(const std::vector<XMFLOAT4X4>& finalTransforms)
+{
+	LoadPalette(finalTransforms);
+
+	// The skinned positions are overwritten, so the per pick cache is stale.
+	std::fill(mVertexStamps.begin(), mVertexStamps.end(), 0);
+
+	const UINT vertexCount = (UINT)mBindPositions.size();
+	const UINT chunkSize = 1024;
+	JobSystem::Default().ParallelFor(0u, (vertexCount + chunkSize - 1) / chunkSize, [&](UINT chunk)
+	{
+		const UINT last = MathHelper::Min(vertexCount, (chunk + 1)*chunkSize);
+		for(UINT v = chunk*chunkSize; v < last; ++v)
+			XMStoreFloat3(&mSkinnedPositions[v], SkinVertex(v));
+	});
+
+	mBvh.Refit(mSkinnedPositions.data(), sizeof(XMFLOAT3));
+}
+
+bool SkinnedMeshPicker::PickRefitted(FXMVECTOR origin, FXMVECTOR dir, float maxDist, TriangleBvh::Hit& outHit)const
+{
+	return mBvh.RayCast(origin, dir, maxDist, outHit);
+}
+
+UINT SkinnedMeshPicker::LastCandidateBoneCount()const
+{
+	return mLastCandidateBoneCount;
+}
+
+UINT SkinnedMeshPicker::LastTestedTriangleCount()const
+{
+	return mLastTestedTriangleCount;
+}
+
+XMVECTOR SkinnedMeshPicker::SkinVertex(UINT v)const
+{
+	// Same blend as the skinned vertex shader.
+	const BYTE* bones = (const BYTE*)&mBoneIndices[v];
+	const float* weights = &mWeights[v].x;
+	XMVECTOR bindPos = XMLoadFloat3(&mBindPositions[v]);
+
+	XMVECTOR pos = XMVectorZero();
+	for(UINT k = 0; k < 4; ++k)
+	{
+		if(weights[k] == 0.0f || bones[k] >= mBoneCount)
+			continue;
+
+		pos += weights[k]*XMVector3TransformCoord(bindPos, XMLoadFloat4x4(&mPalette[bones[k]]));
+	}
+
+	return pos;
+}
+
+void SkinnedMeshPicker::LoadPalette(const std::vector<XMFLOAT4X4>& finalTransforms)
+{
+	// The final transforms are transposed for the shader constants.
+	for(UINT b = 0; b < mBoneCount; ++b)
+		XMStoreFloat4x4(&mPalette[b], XMMatrixTranspose(XMLoadFloat4x4(&finalTransforms[b])));
+}
@@ -0,0 +1,92 @@
+//***************************************************************************************
+// SkinnedMeshPicker.h - Ray picking against an animated skinned mesh
+//
+// The vertex shader skins the mesh, so the CPU copy only holds the bind pose.
+// Picking the current pose works in two ways:
+//   -Pick(): every bone has a proxy box around the bind pose vertices it
+//    influences.  The ray is tested against the proxies moved by the bone
+//    transforms, and only the triangles of the bones it hits are skinned on the
+//    CPU and tested.  The pick is approximate: the proxies are grown by a margin,
+//    but a strongly blended triangle can still leave the proxies of all its
+//    bones and be missed.
+//   -RefitPose() + PickRefitted(): all vertices are skinned and a TriangleBvh
+//    built over the bind pose is refitted to them, which pays off when many
+//    rays are cast against the same pose.
+// Rays are given in the mesh's local space (before the world matrix) and the
+// bone transforms as produced by SkinnedData::GetFinalTransforms().
+//***************************************************************************************
+
+#pragma once
+
+#include "LoadM3d.h"
+#include "../../Common/TriangleBvh.h"
+
+class SkinnedMeshPicker
+{
+public:
+	SkinnedMeshPicker() = default;
+	SkinnedMeshPicker(const SkinnedMeshPicker& rhs) = delete;
+	SkinnedMeshPicker& operator=(const SkinnedMeshPicker& rhs) = delete;
+	~SkinnedMeshPicker() = default;
+
+	void Build(const std::vector<M3DLoader::SkinnedVertex>& vertices,
+		const std::vector<std::uint16_t>& indices, UINT boneCount);
+
+	// Nearest triangle of the skinned mesh the ray hits within [0, maxDist];
+	// hit.Triangle indexes the index list given to Build().  dir need not be
+	// normalized.  Returns false on a miss.
+	bool Pick(const std::vector<DirectX::XMFLOAT4X4>& finalTransforms,
+		DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist, TriangleBvh::Hit& outHit);
+
+	// Skin all vertices and refit the triangle tree to them.
+	void RefitPose(const std::vector<DirectX::XMFLOAT4X4>& finalTransforms);
+
+	// Same as Pick(), but against the pose of the last RefitPose().  Exact, as
+	// every triangle is skinned.
+	bool PickRefitted(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist, TriangleBvh::Hit& outHit)const;
+
+	// Stats of the last Pick(); handy for profiling.
+	UINT LastCandidateBoneCount()const;
+	UINT LastTestedTriangleCount()const;
+
+private:
+	DirectX::XMVECTOR SkinVertex(UINT v)const;
+	void LoadPalette(const std::vector<DirectX::XMFLOAT4X4>& finalTransforms);
+
+private:
+	// Proxy boxes are grown by this fraction of their size, since a vertex
+	// blended between bones may leave the box of each of its bones.
+	static const float ProxyMargin;
+
+	UINT mBoneCount = 0;
+
+	std::vector<DirectX::XMFLOAT3> mBindPositions;
+	std::vector<DirectX::XMFLOAT4> mWeights;
+	std::vector<UINT> mBoneIndices;  // Four bytes per vertex as in SkinnedVertex.
+	std::vector<std::uint32_t> mIndices;
+
+	// Bind pose proxy box per bone; an empty box (negative extents) if the bone
+	// influences no vertices.
+	std::vector<DirectX::BoundingBox> mBoneProxies;
+
+	// Triangles influenced by bone b: mBoneTriangles[mBoneTriangleStart[b]..mBoneTriangleStart[b+1]).
+	std::vector<UINT> mBoneTriangleStart;
+	std::vector<UINT> mBoneTriangles;
+
+	// Bones whose proxy the current pick's ray hits; kept to reuse the memory.
+	std::vector<UINT> mCandidateBones;
+
+	// Bone transforms of the current pick, in row vector form.
+	std::vector<DirectX::XMFLOAT4X4> mPalette;
+
+	// Per pick caches: a vertex or triangle is done if its stamp equals mStamp.
+	std::vector<DirectX::XMFLOAT3> mSkinnedPositions;
+	std::vector<UINT> mVertexStamps;
+	std::vector<UINT> mTriangleStamps;
+	UINT mStamp = 0;
+
+	TriangleBvh mBvh;
+
+	UINT mLastCandidateBoneCount = 0;
+	UINT mLastTestedTriangleCount = 0;
+};
@@ -4,11 +4,15 @@
 // Transforms and colors geometry.
 //***************************************************************************************
  
-cbuffer cbPerObject : register(b0)
+struct InstanceData
 {
-	float4x4 gWorld; 
+	float4x4 World;
 };
 
+// Instances of the current draw.  The application binds the buffer at the draw's
+// first instance, so SV_InstanceID indexes it directly.
+StructuredBuffer<InstanceData> gInstanceData : register(t0);
+
 cbuffer cbPass : register(b1)
 {
     float4x4 gView;
@@ -39,12 +43,12 @@ struct VertexOut
     float4 Color : COLOR;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout;
 	
 	// Transform to homogeneous clip space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), gInstanceData[instanceID].World);
     vout.PosH = mul(posW, gViewProj);
 	
 	// Just pass vertex color into the pixel shader.
@@ -3,7 +3,8 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "../../Common/JobSystem.h"
+#include "../../Common/Profiler.h"
 #include <algorithm>
 #include <vector>
 #include <cassert>
@@ -87,6 +88,8 @@ float Waves::Depth()const
 
 void Waves::Update(float dt)
 {
+	PROFILE_SCOPE("Waves::Update");
+
 	static float t = 0;
 
 	// Accumulate time.
@@ -96,7 +99,7 @@ void Waves::Update(float dt)
 	if( t >= mTimeStep )
 	{
 		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+		JobSystem::Default().ParallelFor(1, mNumRows - 1, [this](int i)
 		//for(int i = 1; i < mNumRows-1; ++i)
 		{
 			for(int j = 1; j < mNumCols-1; ++j)
@@ -130,7 +133,7 @@ void Waves::Update(float dt)
 		//
 		// Compute normals using finite difference scheme.
 		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+		JobSystem::Default().ParallelFor(1, mNumRows - 1, [this](int i)
 		//for(int i = 1; i < mNumRows - 1; ++i)
 		{
 			for(int j = 1; j < mNumCols-1; ++j)
@@ -0,0 +1,199 @@
+//***************************************************************************************
+// AoBaker.cpp - Per-vertex ambient occlusion baking for static meshes
+//***************************************************************************************
+
+#include "AoBaker.h"
+#include "RayQuery.h"
+#include "JobSystem.h"
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+	// Vertices whose rays are traced in one RayQuery::Trace() call; bounds the
+	// memory of the ray and result arrays for large meshes.
+	const UINT BatchVertexCount = 4096;
+
+	const std::uint32_t CacheMagic = 0x32424f41; // "AOB2"
+
+	struct CacheHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t VertexCount;
+		std::uint64_t Key;
+	};
+
+	const XMFLOAT3& VertexAt(const void* base, UINT stride, UINT i)
+	{
+		return *reinterpret_cast<const XMFLOAT3*>(static_cast<const char*>(base) + std::size_t(i)*stride);
+	}
+}
+
+std::vector<float> AoBaker::Bake(const void* positions, const void* normals, UINT vertexStride,
+	UINT vertexCount, const std::uint32_t* indices, UINT triangleCount, const Settings& settings)
+{
+	std::vector<float> access(vertexCount, 1.0f);
+	if(vertexCount == 0 || triangleCount == 0 || settings.RayCount == 0)
+		return access;
+
+	TriangleBvh mesh;
+	mesh.Build(positions, vertexStride, indices, triangleCount);
+
+	RayQuery scene;
+	scene.AddInstance(&mesh, XMMatrixIdentity());
+	scene.Build();
+
+	const UINT rayCount = settings.RayCount;
+	const UINT batchSize = MathHelper::Min(vertexCount, BatchVertexCount);
+
+	std::vector<RayQuery::Ray> rays(std::size_t(batchSize)*rayCount);
+	std::vector<RayQuery::Result> results(rays.size());
+
+	for(UINT first = 0; first < vertexCount; first += batchSize)
+	{
+		const UINT count = MathHelper::Min(batchSize, vertexCount - first);
+
+		JobSystem::Default().ParallelFor(0u, count, [&](UINT i)
+		{
+			const UINT v = first + i;
+			RayQuery::Ray* vertexRays = &rays[std::size_t(i)*rayCount];
+
+			XMVECTOR N = XMLoadFloat3(&VertexAt(normals, vertexStride, v));
+			float length = XMVectorGetX(XMVector3Length(N));
+			if(length < 1e-6f)
+			{
+				// No usable normal: disable the rays, the vertex stays fully open.
+				for(UINT r = 0; r < rayCount; ++r)
+					vertexRays[r].MaxDist = -1.0f;
+				return;
+			}
+
+			N /= length;
+
+			XMFLOAT3 origin;
+			XMStoreFloat3(&origin, XMLoadFloat3(&VertexAt(positions, vertexStride, v)) + settings.Bias*N);
+
+			// Scrambled Sobol points cover the hemisphere more evenly than
+			// independent samples; the scramble decorrelates the vertices.
+			RandomGenerator rng(settings.Seed, v);
+			const UINT scramble = rng.NextUInt();
+
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				XMFLOAT2 u = MathHelper::Sobol2D(r, scramble);
+
+				vertexRays[r].Origin = origin;
+				XMStoreFloat3(&vertexRays[r].Direction, MathHelper::CosineHemisphereUnitVec3(N, u.x, u.y));
+				vertexRays[r].MaxDist = settings.MaxDistance;
+			}
+		});
+
+		scene.Trace(rays.data(), count*rayCount, RayQuery::Mode::AnyHit, results.data());
+
+		JobSystem::Default().ParallelFor(0u, count, [&](UINT i)
+		{
+			if(rays[std::size_t(i)*rayCount].MaxDist < 0.0f)
+				return;
+
+			const RayQuery::Result* vertexResults = &results[std::size_t(i)*rayCount];
+
+			UINT open = 0;
+			for(UINT r = 0; r < rayCount; ++r)
+			{
+				if(vertexResults[r].Instance == RayQuery::NoHit)
+					++open;
+			}
+
+			access[first + i] = (float)open / rayCount;
+		});
+	}
+
+	return access;
+}
+
+bool AoBaker::SaveCache(const std::string& filename, const void* positions, UINT vertexStride,
+	UINT vertexCount, const Settings& settings, const std::vector<float>& access)
+{
+	if(access.size() != vertexCount)
+		return false;
+
+	std::ofstream fout(filename, std::ios::binary);
+	if(!fout)
+		return false;
+
+	CacheHeader header;
+	header.Magic = CacheMagic;
+	header.VertexCount = vertexCount;
+	header.Key = CacheKey(positions, vertexStride, vertexCount, settings);
+
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(access.data()), access.size()*sizeof(float));
+
+	return (bool)fout;
+}
+
+bool AoBaker::LoadCache(const std::string& filename, const void* positions, UINT vertexStride,
+	UINT vertexCount, const Settings& settings, std::vector<float>& outAccess)
+{
+	std::ifstream fin(filename, std::ios::binary);
+	if(!fin)
+		return false;
+
+	CacheHeader header;
+	if(!fin.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	if(header.Magic != CacheMagic || header.VertexCount != vertexCount ||
+		header.Key != CacheKey(positions, vertexStride, vertexCount, settings))
+		return false;
+
+	std::vector<float> access(vertexCount);
+	if(!fin.read(reinterpret_cast<char*>(access.data()), access.size()*sizeof(float)))
+		return false;
+
+	outAccess = std::move(access);
+	return true;
+}
+
+std::vector<float> AoBaker::BakeCached(const std::string& filename, const void* positions,
+	const void* normals, UINT vertexStride, UINT vertexCount, const std::uint32_t* indices,
+	UINT triangleCount, const Settings& settings)
+{
+	std::vector<float> access;
+	if(LoadCache(filename, positions, vertexStride, vertexCount, settings, access))
+		return access;
+
+	access = Bake(positions, normals, vertexStride, vertexCount, indices, triangleCount, settings);
+
+	// A failed save (e.g., read-only folder) only costs another bake next time.
+	SaveCache(filename, positions, vertexStride, vertexCount, settings, access);
+
+	return access;
+}
+
+std::uint64_t AoBaker::CacheKey(const void* positions, UINT vertexStride, UINT vertexCount,
+	const Settings& settings)
+{
+	// FNV-1a over the positions and settings.
+	std::uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash](const void* data, std::size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for(std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	for(UINT i = 0; i < vertexCount; ++i)
+		add(&VertexAt(positions, vertexStride, i), sizeof(XMFLOAT3));
+
+	add(&settings.RayCount, sizeof(settings.RayCount));
+	add(&settings.MaxDistance, sizeof(settings.MaxDistance));
+	add(&settings.Bias, sizeof(settings.Bias));
+	add(&settings.Seed, sizeof(settings.Seed));
+
+	return hash;
+}
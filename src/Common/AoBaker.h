@@ -0,0 +1,64 @@
+//***************************************************************************************
+// AoBaker.h - Per-vertex ambient occlusion baking for static meshes
+//
+// Computes the ambient accessibility (1 = fully open, 0 = fully occluded) of every
+// vertex of a mesh by casting rays into the hemisphere around the vertex normal.
+//   -Directions are cosine weighted, so the fraction of unoccluded rays is the
+//    cosine weighted accessibility the lighting wants, with no extra weights.
+//   -Rays are any-hit occlusion rays traced by RayQuery against a TriangleBvh of
+//    the mesh itself, in packets and on the worker threads.
+//   -Every vertex takes its own scrambled Sobol points (the scramble seeded from
+//    the vertex index), so the result does not depend on the thread scheduling.
+//   -Bakes are slow next to a frame, so the result can be saved to a cache file
+//    that is only reused if the mesh and bake settings match.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <string>
+#include <vector>
+
+class AoBaker
+{
+public:
+	struct Settings
+	{
+		// Rays cast per vertex.
+		UINT RayCount = 64;
+
+		// Occluders further away than this do not count; in mesh units.
+		float MaxDistance = 1.0f;
+
+		// Ray origins are pushed off the surface along the normal by this much to
+		// keep the rays from hitting the triangles around the vertex.
+		float Bias = 1e-3f;
+
+		UINT Seed = 0;
+	};
+
+	// Bake the accessibility of vertexCount vertices.  positions and normals point to
+	// the first position and normal and consecutive vertices are vertexStride bytes
+	// apart (e.g., both inside an interleaved vertex array).  The mesh is the
+	// triangle list of triangleCount*3 indices.  Returns one value per vertex.
+	static std::vector<float> Bake(const void* positions, const void* normals, UINT vertexStride,
+		UINT vertexCount, const std::uint32_t* indices, UINT triangleCount, const Settings& settings);
+
+	// Save a bake to filename, keyed on the mesh positions and the settings.
+	static bool SaveCache(const std::string& filename, const void* positions, UINT vertexStride,
+		UINT vertexCount, const Settings& settings, const std::vector<float>& access);
+
+	// Load a bake saved by SaveCache().  Fails (returns false) if the file is
+	// missing or was baked from other positions or settings.
+	static bool LoadCache(const std::string& filename, const void* positions, UINT vertexStride,
+		UINT vertexCount, const Settings& settings, std::vector<float>& outAccess);
+
+	// Bake, or load the bake from filename if it is up to date and save it otherwise.
+	static std::vector<float> BakeCached(const std::string& filename, const void* positions,
+		const void* normals, UINT vertexStride, UINT vertexCount, const std::uint32_t* indices,
+		UINT triangleCount, const Settings& settings);
+
+private:
+	static std::uint64_t CacheKey(const void* positions, UINT vertexStride, UINT vertexCount,
+		const Settings& settings);
+};
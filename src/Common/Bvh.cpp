@@ -0,0 +1,531 @@
+//***************************************************************************************
+// Bvh.cpp - Static bounding volume hierarchy for scene queries
+//***************************************************************************************
+
+#include "Bvh.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	float SurfaceArea(FXMVECTOR boxMin, FXMVECTOR boxMax)
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, XMVectorMax(XMVectorSubtract(boxMax, boxMin), XMVectorZero()));
+
+		return 2.0f*(d.x*d.y + d.y*d.z + d.z*d.x);
+	}
+
+	float Component(const XMFLOAT3& v, UINT axis)
+	{
+		return (&v.x)[axis];
+	}
+
+	// A zero direction component gives a large finite reciprocal instead of inf, so
+	// an origin on that slab's plane gives 0 rather than 0*inf = NaN in RayBox().
+	float SafeReciprocal(float d)
+	{
+		const float tiny = 1e-20f;
+		if(fabsf(d) < tiny)
+			d = d < 0.0f ? -tiny : tiny;
+
+		return 1.0f / d;
+	}
+
+	XMFLOAT3 SafeInverseDirection(FXMVECTOR dir)
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, dir);
+
+		return XMFLOAT3(SafeReciprocal(d.x), SafeReciprocal(d.y), SafeReciprocal(d.z));
+	}
+}
+
+void Bvh::Build(const BoundingBox* bounds, const UINT* itemIds, UINT count, UINT maxLeafSize)
+{
+	PROFILE_SCOPE("Bvh::Build");
+
+	Clear();
+
+	mMaxLeafSize = MathHelper::Max(1u, maxLeafSize);
+
+	mItems.resize(count);
+	mItemBounds.assign(bounds, bounds + count);
+	mCentroids.resize(count);
+	for(UINT i = 0; i < count; ++i)
+	{
+		mItems[i] = itemIds ? itemIds[i] : i;
+		mCentroids[i] = bounds[i].Center;
+	}
+
+	if(count == 0)
+		return;
+
+	// A binary tree with leaves of at least one item has fewer than 2n nodes.
+	mNodes.reserve(2 * count / mMaxLeafSize + 1);
+
+	BuildRecursive(0, count, 1);
+
+	mCentroids.clear();
+	mCentroids.shrink_to_fit();
+}
+
+void Bvh::Clear()
+{
+	mDepth = 0;
+	mNodes.clear();
+	mItems.clear();
+	mItemBounds.clear();
+	mCentroids.clear();
+}
+
+UINT Bvh::ItemCount()const
+{
+	return (UINT)mItems.size();
+}
+
+UINT Bvh::NodeCount()const
+{
+	return (UINT)mNodes.size();
+}
+
+UINT Bvh::Depth()const
+{
+	return mDepth;
+}
+
+const std::vector<Bvh::Node>& Bvh::Nodes()const
+{
+	return mNodes;
+}
+
+const std::vector<UINT>& Bvh::Items()const
+{
+	return mItems;
+}
+
+BoundingBox Bvh::Bounds()const
+{
+	if(mNodes.empty())
+		return BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+
+	return BoundingBox(mNodes[0].Center, mNodes[0].Extents);
+}
+
+UINT Bvh::LastVisitedNodeCount()const
+{
+	return mLastVisitedNodeCount;
+}
+
+UINT Bvh::BuildRecursive(UINT first, UINT count, UINT depth)
+{
+	mDepth = MathHelper::Max(mDepth, depth);
+
+	const UINT nodeIndex = (UINT)mNodes.size();
+	mNodes.emplace_back();
+
+	//
+	// Compute the bounds of the items and of their centroids.
+	//
+
+	XMVECTOR boundsMin = XMVectorReplicate(+MathHelper::Infinity);
+	XMVECTOR boundsMax = XMVectorReplicate(-MathHelper::Infinity);
+	XMVECTOR centroidMin = boundsMin;
+	XMVECTOR centroidMax = boundsMax;
+	for(UINT i = first; i < first + count; ++i)
+	{
+		XMVECTOR c = XMLoadFloat3(&mItemBounds[i].Center);
+		XMVECTOR e = XMLoadFloat3(&mItemBounds[i].Extents);
+
+		boundsMin = XMVectorMin(boundsMin, XMVectorSubtract(c, e));
+		boundsMax = XMVectorMax(boundsMax, XMVectorAdd(c, e));
+
+		XMVECTOR centroid = XMLoadFloat3(&mCentroids[i]);
+		centroidMin = XMVectorMin(centroidMin, centroid);
+		centroidMax = XMVectorMax(centroidMax, centroid);
+	}
+
+	Node& node = mNodes[nodeIndex];
+	XMStoreFloat3(&node.Center, XMVectorScale(XMVectorAdd(boundsMin, boundsMax), 0.5f));
+	XMStoreFloat3(&node.Extents, XMVectorScale(XMVectorSubtract(boundsMax, boundsMin), 0.5f));
+	node.First = first;
+	node.Count = count;
+	node.Skip = nodeIndex + 1;
+
+	if(count <= mMaxLeafSize)
+		return nodeIndex;
+
+	//
+	// Find the cheapest split plane with the surface area heuristic, evaluated
+	// at the boundaries of BinCount equally sized bins along each axis.
+	//
+
+	XMFLOAT3 cMin, cMax;
+	XMStoreFloat3(&cMin, centroidMin);
+	XMStoreFloat3(&cMax, centroidMax);
+
+	float bestCost = MathHelper::Infinity;
+	UINT bestAxis = 3;
+	UINT bestBin = 0;
+
+	for(UINT axis = 0; axis < 3; ++axis)
+	{
+		const float lo = Component(cMin, axis);
+		const float hi = Component(cMax, axis);
+		if(hi - lo <= 1e-6f)
+			continue;
+
+		const float scale = BinCount / (hi - lo);
+
+		XMVECTOR binMin[BinCount];
+		XMVECTOR binMax[BinCount];
+		UINT binCount[BinCount] = { 0 };
+		for(UINT b = 0; b < BinCount; ++b)
+		{
+			binMin[b] = XMVectorReplicate(+MathHelper::Infinity);
+			binMax[b] = XMVectorReplicate(-MathHelper::Infinity);
+		}
+
+		for(UINT i = first; i < first + count; ++i)
+		{
+			UINT b = MathHelper::Min(BinCount - 1, (UINT)((Component(mCentroids[i], axis) - lo)*scale));
+
+			XMVECTOR c = XMLoadFloat3(&mItemBounds[i].Center);
+			XMVECTOR e = XMLoadFloat3(&mItemBounds[i].Extents);
+			binMin[b] = XMVectorMin(binMin[b], XMVectorSubtract(c, e));
+			binMax[b] = XMVectorMax(binMax[b], XMVectorAdd(c, e));
+			binCount[b]++;
+		}
+
+		// Sweep from the right to get the cost of everything right of each boundary...
+		float rightArea[BinCount];
+		UINT rightCount[BinCount];
+		XMVECTOR accumMin = XMVectorReplicate(+MathHelper::Infinity);
+		XMVECTOR accumMax = XMVectorReplicate(-MathHelper::Infinity);
+		UINT accumCount = 0;
+		for(UINT b = BinCount - 1; b > 0; --b)
+		{
+			accumMin = XMVectorMin(accumMin, binMin[b]);
+			accumMax = XMVectorMax(accumMax, binMax[b]);
+			accumCount += binCount[b];
+			rightArea[b] = SurfaceArea(accumMin, accumMax);
+			rightCount[b] = accumCount;
+		}
+
+		// ...then from the left to combine it with the left side.
+		accumMin = XMVectorReplicate(+MathHelper::Infinity);
+		accumMax = XMVectorReplicate(-MathHelper::Infinity);
+		accumCount = 0;
+		for(UINT b = 1; b < BinCount; ++b)
+		{
+			accumMin = XMVectorMin(accumMin, binMin[b - 1]);
+			accumMax = XMVectorMax(accumMax, binMax[b - 1]);
+			accumCount += binCount[b - 1];
+
+			if(accumCount == 0 || rightCount[b] == 0)
+				continue;
+
+			float cost = accumCount*SurfaceArea(accumMin, accumMax) + rightCount[b]*rightArea[b];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	//
+	// Partition the items.
+	//
+
+	UINT leftCount = 0;
+	if(bestAxis == 3)
+	{
+		// All centroids coincide; no plane separates them, so split in the middle.
+		leftCount = count / 2;
+	}
+	else
+	{
+		// Splitting costs one extra box test relative to keeping a (large) leaf.
+		const float leafCost = count*SurfaceArea(boundsMin, boundsMax);
+		if(bestCost >= leafCost - SurfaceArea(boundsMin, boundsMax) && count <= 4*mMaxLeafSize)
+			return nodeIndex;
+
+		const float lo = Component(cMin, bestAxis);
+		const float scale = BinCount / (Component(cMax, bestAxis) - lo);
+
+		UINT i = first;
+		UINT j = first + count;
+		while(i < j)
+		{
+			UINT b = MathHelper::Min(BinCount - 1, (UINT)((Component(mCentroids[i], bestAxis) - lo)*scale));
+			if(b < bestBin)
+			{
+				++i;
+			}
+			else
+			{
+				--j;
+				std::swap(mItems[i], mItems[j]);
+				std::swap(mItemBounds[i], mItemBounds[j]);
+				std::swap(mCentroids[i], mCentroids[j]);
+			}
+		}
+
+		leftCount = i - first;
+	}
+
+	assert(leftCount > 0 && leftCount < count);
+
+	BuildRecursive(first, leftCount, depth + 1);
+	BuildRecursive(first + leftCount, count - leftCount, depth + 1);
+
+	// Note: mNodes may have been reallocated by the recursion.
+	mNodes[nodeIndex].Skip = (UINT)mNodes.size();
+
+	return nodeIndex;
+}
+
+Bvh::PlaneResult Bvh::ClassifyBox(const XMFLOAT3& center, const XMFLOAT3& extents,
+	const XMFLOAT4* planes, UINT planeCount)
+{
+	PlaneResult result = PlaneResult::Inside;
+	for(UINT p = 0; p < planeCount; ++p)
+	{
+		const XMFLOAT4& n = planes[p];
+
+		float dist = n.x*center.x + n.y*center.y + n.z*center.z + n.w;
+		float radius = fabsf(n.x)*extents.x + fabsf(n.y)*extents.y + fabsf(n.z)*extents.z;
+
+		if(dist + radius < 0.0f)
+			return PlaneResult::Outside;
+
+		if(dist - radius < 0.0f)
+			result = PlaneResult::Intersecting;
+	}
+
+	return result;
+}
+
+bool Bvh::RayBox(const XMFLOAT3& center, const XMFLOAT3& extents,
+	const XMFLOAT3& origin, const XMFLOAT3& invDir, float maxDist, float& tEnter)
+{
+	float tMin = 0.0f;
+	float tMax = maxDist;
+	for(UINT axis = 0; axis < 3; ++axis)
+	{
+		const float c = Component(center, axis);
+		const float e = Component(extents, axis);
+		const float o = Component(origin, axis);
+		const float inv = Component(invDir, axis);
+
+		float t0 = (c - e - o)*inv;
+		float t1 = (c + e - o)*inv;
+		if(t0 > t1)
+			std::swap(t0, t1);
+
+		tMin = MathHelper::Max(tMin, t0);
+		tMax = MathHelper::Min(tMax, t1);
+		if(tMin > tMax)
+			return false;
+	}
+
+	tEnter = tMin;
+	return true;
+}
+
+UINT Bvh::QueryFrustum(const std::array<XMFLOAT4, 6>& planes, UINT* outItems)const
+{
+	return QueryFrustum(planes.data(), (UINT)planes.size(), outItems);
+}
+
+UINT Bvh::QueryFrustum(const XMFLOAT4* planes, UINT planeCount, UINT* outItems)const
+{
+	UINT outCount = 0;
+	UINT visited = 0;
+
+	const UINT nodeCount = (UINT)mNodes.size();
+	UINT i = 0;
+	while(i < nodeCount)
+	{
+		const Node& node = mNodes[i];
+		++visited;
+
+		PlaneResult result = ClassifyBox(node.Center, node.Extents, planes, planeCount);
+		if(result == PlaneResult::Outside)
+		{
+			i = node.Skip;
+			continue;
+		}
+
+		if(result == PlaneResult::Inside)
+		{
+			// The whole subtree is visible.
+			std::copy(mItems.begin() + node.First, mItems.begin() + node.First + node.Count, outItems + outCount);
+			outCount += node.Count;
+			i = node.Skip;
+			continue;
+		}
+
+		if(node.Skip == i + 1)
+		{
+			// Leaf straddling a plane: test its items individually.
+			for(UINT k = node.First; k < node.First + node.Count; ++k)
+			{
+				if(ClassifyBox(mItemBounds[k].Center, mItemBounds[k].Extents, planes, planeCount) != PlaneResult::Outside)
+					outItems[outCount++] = mItems[k];
+			}
+		}
+
+		++i;
+	}
+
+	mLastVisitedNodeCount = visited;
+
+	return outCount;
+}
+
+UINT Bvh::QuerySphere(const BoundingSphere& sphere, UINT* outItems)const
+{
+	XMVECTOR s = XMLoadFloat3(&sphere.Center);
+	const float r2 = sphere.Radius*sphere.Radius;
+
+	UINT outCount = 0;
+	UINT visited = 0;
+
+	const UINT nodeCount = (UINT)mNodes.size();
+	UINT i = 0;
+	while(i < nodeCount)
+	{
+		const Node& node = mNodes[i];
+		++visited;
+
+		// Distance from the sphere center to the nearest and furthest point of the box.
+		XMVECTOR d = XMVectorAbs(XMVectorSubtract(s, XMLoadFloat3(&node.Center)));
+		XMVECTOR e = XMLoadFloat3(&node.Extents);
+		float nearDist2 = XMVectorGetX(XMVector3LengthSq(XMVectorMax(XMVectorSubtract(d, e), XMVectorZero())));
+		float farDist2 = XMVectorGetX(XMVector3LengthSq(XMVectorAdd(d, e)));
+
+		if(nearDist2 > r2)
+		{
+			i = node.Skip;
+			continue;
+		}
+
+		if(farDist2 <= r2)
+		{
+			std::copy(mItems.begin() + node.First, mItems.begin() + node.First + node.Count, outItems + outCount);
+			outCount += node.Count;
+			i = node.Skip;
+			continue;
+		}
+
+		if(node.Skip == i + 1)
+		{
+			for(UINT k = node.First; k < node.First + node.Count; ++k)
+			{
+				if(mItemBounds[k].Intersects(sphere))
+					outItems[outCount++] = mItems[k];
+			}
+		}
+
+		++i;
+	}
+
+	mLastVisitedNodeCount = visited;
+
+	return outCount;
+}
+
+void Bvh::QueryRay(FXMVECTOR origin, FXMVECTOR dir, float maxDist, std::vector<UINT>& outItems)const
+{
+	outItems.clear();
+
+	XMFLOAT3 o;
+	XMStoreFloat3(&o, origin);
+	const XMFLOAT3 invDir = SafeInverseDirection(dir);
+
+	UINT visited = 0;
+
+	const UINT nodeCount = (UINT)mNodes.size();
+	UINT i = 0;
+	while(i < nodeCount)
+	{
+		const Node& node = mNodes[i];
+		++visited;
+
+		float t;
+		if(!RayBox(node.Center, node.Extents, o, invDir, maxDist, t))
+		{
+			i = node.Skip;
+			continue;
+		}
+
+		if(node.Skip == i + 1)
+		{
+			for(UINT k = node.First; k < node.First + node.Count; ++k)
+			{
+				if(RayBox(mItemBounds[k].Center, mItemBounds[k].Extents, o, invDir, maxDist, t))
+					outItems.push_back(mItems[k]);
+			}
+		}
+
+		++i;
+	}
+
+	mLastVisitedNodeCount = visited;
+}
+
+bool Bvh::RayCast(FXMVECTOR origin, FXMVECTOR dir, float maxDist, UINT& outItem, float& outDist)const
+{
+	XMFLOAT3 o;
+	XMStoreFloat3(&o, origin);
+	const XMFLOAT3 invDir = SafeInverseDirection(dir);
+
+	bool hit = false;
+	float nearest = maxDist;
+	UINT visited = 0;
+
+	const UINT nodeCount = (UINT)mNodes.size();
+	UINT i = 0;
+	while(i < nodeCount)
+	{
+		const Node& node = mNodes[i];
+		++visited;
+
+		// Shrinking the search distance as hits are found prunes everything behind them.
+		float t;
+		if(!RayBox(node.Center, node.Extents, o, invDir, nearest, t))
+		{
+			i = node.Skip;
+			continue;
+		}
+
+		if(node.Skip == i + 1)
+		{
+			for(UINT k = node.First; k < node.First + node.Count; ++k)
+			{
+				if(RayBox(mItemBounds[k].Center, mItemBounds[k].Extents, o, invDir, nearest, t))
+				{
+					hit = true;
+					nearest = t;
+					outItem = mItems[k];
+				}
+			}
+		}
+
+		++i;
+	}
+
+	mLastVisitedNodeCount = visited;
+
+	if(hit)
+		outDist = nearest;
+
+	return hit;
+}
@@ -0,0 +1,98 @@
+//***************************************************************************************
+// Bvh.h - Static bounding volume hierarchy for scene queries
+//
+// Builds a binned SAH bounding volume hierarchy over a set of world space boxes
+// (render items, instances, ...) identified by a user supplied item id.
+//   -The nodes are flattened in depth first order.  The left child of an interior
+//    node is the next node and every node stores the index of the node following
+//    its subtree ("skip" index), so the queries traverse without a stack.
+//   -The items of a subtree are contiguous, so subtrees completely inside a
+//    query volume are accepted without visiting their children.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <array>
+#include <vector>
+
+class Bvh
+{
+public:
+	struct Node
+	{
+		DirectX::XMFLOAT3 Center;
+		UINT First = 0;  // First item of the subtree in Items().
+		DirectX::XMFLOAT3 Extents;
+		UINT Count = 0;  // Number of items in the subtree.
+		UINT Skip = 0;   // Node following the subtree; equals index+1 for leaves.
+	};
+
+	Bvh() = default;
+	Bvh(const Bvh& rhs) = delete;
+	Bvh& operator=(const Bvh& rhs) = delete;
+	~Bvh() = default;
+
+	// Build the hierarchy over bounds[i] with item id itemIds[i] (or i if itemIds
+	// is null).  Any previous hierarchy is discarded.
+	void Build(const DirectX::BoundingBox* bounds, const UINT* itemIds, UINT count, UINT maxLeafSize = 4);
+
+	void Clear();
+
+	UINT ItemCount()const;
+	UINT NodeCount()const;
+	UINT Depth()const;
+	const std::vector<Node>& Nodes()const;
+	const std::vector<UINT>& Items()const;
+	DirectX::BoundingBox Bounds()const;
+
+	// Write the ids of the items whose boxes are not completely outside the
+	// planes (inward facing, normalized; see Camera::GetFrustumPlanes()) to
+	// outItems, which must have room for ItemCount() ids.  Returns the count.
+	UINT QueryFrustum(const std::array<DirectX::XMFLOAT4, 6>& planes, UINT* outItems)const;
+	UINT QueryFrustum(const DirectX::XMFLOAT4* planes, UINT planeCount, UINT* outItems)const;
+
+	// Same as QueryFrustum, but for the items whose boxes intersect the sphere.
+	UINT QuerySphere(const DirectX::BoundingSphere& sphere, UINT* outItems)const;
+
+	// Collect the items whose boxes the ray hits in [0, maxDist].  dir need not
+	// be normalized; distances are in units of |dir|.
+	void QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist,
+		std::vector<UINT>& outItems)const;
+
+	// Find the item whose box the ray enters first.  Returns false on a miss.
+	bool RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist,
+		UINT& outItem, float& outDist)const;
+
+	// Number of nodes visited by the last query; handy for profiling.
+	UINT LastVisitedNodeCount()const;
+
+private:
+	UINT BuildRecursive(UINT first, UINT count, UINT depth);
+
+	enum class PlaneResult { Outside, Intersecting, Inside };
+	static PlaneResult ClassifyBox(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents,
+		const DirectX::XMFLOAT4* planes, UINT planeCount);
+
+	static bool RayBox(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents,
+		const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& invDir, float maxDist, float& tEnter);
+
+private:
+	static const UINT BinCount = 16;
+
+	UINT mMaxLeafSize = 4;
+	UINT mDepth = 0;
+
+	mutable UINT mLastVisitedNodeCount = 0;
+
+	std::vector<Node> mNodes;
+
+	// Item ids and their boxes, reordered during the build so that the items of
+	// every subtree are contiguous.
+	std::vector<UINT> mItems;
+	std::vector<DirectX::BoundingBox> mItemBounds;
+
+	// Scratch memory used only during the build.
+	std::vector<DirectX::XMFLOAT3> mCentroids;
+};
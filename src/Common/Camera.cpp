@@ -126,6 +126,8 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFovY, mAspect, mNearZ, mFarZ);
 	XMStoreFloat4x4(&mProj, P);
+
+	mFrustumDirty = true;
 }
 
 void Camera::LookAt(FXMVECTOR pos, FXMVECTOR target, FXMVECTOR worldUp)
@@ -176,6 +178,20 @@ XMFLOAT4X4 Camera::GetProj4x4f()const
 	return mProj;
 }
 
+const std::array<XMFLOAT4, 6>& Camera::GetFrustumPlanes()const
+{
+	assert(!mViewDirty);
+
+	if(mFrustumDirty)
+	{
+		MathHelper::ExtractFrustumPlanes(XMMatrixMultiply(GetView(), GetProj()), mFrustumPlanes.data());
+
+		mFrustumDirty = false;
+	}
+
+	return mFrustumPlanes;
+}
+
 void Camera::Strafe(float d)
 {
 	// mPosition += d*mRight
@@ -269,6 +285,7 @@ void Camera::UpdateViewMatrix()
 		mView(3, 3) = 1.0f;
 
 		mViewDirty = false;
+		mFrustumDirty = true;
 	}
 }
 
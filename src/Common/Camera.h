@@ -46,6 +46,11 @@ public:
 	float GetNearWindowHeight()const;
 	float GetFarWindowWidth()const;
 	float GetFarWindowHeight()const;
+
+	// Get the six world space frustum planes (left, right, bottom, top, near, far)
+	// with inward facing unit normals.  The planes are extracted from the 
+	// view-projection matrix and cached until the view or lens changes.
+	const std::array<DirectX::XMFLOAT4, 6>& GetFrustumPlanes()const;
 	
 	// Set frustum.
 	void SetLens(float fovY, float aspect, float zn, float zf);
@@ -90,6 +95,10 @@ private:
 
 	bool mViewDirty = true;
 
+	// Cache world space frustum planes.
+	mutable bool mFrustumDirty = true;
+	mutable std::array<DirectX::XMFLOAT4, 6> mFrustumPlanes;
+
 	// Cache View/Proj matrices.
 	DirectX::XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 mProj = MathHelper::Identity4x4();
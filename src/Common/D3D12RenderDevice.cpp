@@ -0,0 +1,232 @@
+//***************************************************************************************
+// D3D12RenderDevice.cpp - D3D12 backend of the rendering interface
+//***************************************************************************************
+
+#include "D3D12RenderDevice.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	class D3D12Resource : public RenderBuffer
+	{
+	public:
+		D3D12Resource(ComPtr<ID3D12Resource> resource, bool map) :
+			mResource(std::move(resource))
+		{
+			// Upload buffers stay mapped until they are destroyed.
+			if(map)
+				ThrowIfFailed(mResource->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+		}
+
+		~D3D12Resource()
+		{
+			if(mMappedData != nullptr)
+				mResource->Unmap(0, nullptr);
+		}
+
+		std::uint64_t Size()const override
+		{
+			return mResource->GetDesc().Width;
+		}
+
+		GpuAddress GetGpuAddress()const override
+		{
+			return mResource->GetGPUVirtualAddress();
+		}
+
+		void Write(std::uint64_t offset, const void* data, std::uint64_t byteSize) override
+		{
+			assert(mMappedData != nullptr);
+			memcpy(mMappedData + offset, data, (size_t)byteSize);
+		}
+
+		std::uint8_t* MappedData()const override
+		{
+			return mMappedData;
+		}
+
+		ID3D12Resource* Get()const
+		{
+			return mResource.Get();
+		}
+
+	private:
+		ComPtr<ID3D12Resource> mResource;
+		BYTE* mMappedData = nullptr;
+	};
+
+	D3D12_RESOURCE_STATES ToD3D12State(ResourceState state)
+	{
+		switch(state)
+		{
+		case ResourceState::VertexAndConstantBuffer: return D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+		case ResourceState::IndexBuffer:             return D3D12_RESOURCE_STATE_INDEX_BUFFER;
+		case ResourceState::RenderTarget:            return D3D12_RESOURCE_STATE_RENDER_TARGET;
+		case ResourceState::UnorderedAccess:         return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		case ResourceState::DepthWrite:              return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+		case ResourceState::DepthRead:               return D3D12_RESOURCE_STATE_DEPTH_READ;
+		case ResourceState::NonPixelShaderResource:  return D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		case ResourceState::PixelShaderResource:     return D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+		case ResourceState::CopyDest:                return D3D12_RESOURCE_STATE_COPY_DEST;
+		case ResourceState::CopySource:              return D3D12_RESOURCE_STATE_COPY_SOURCE;
+		case ResourceState::GenericRead:             return D3D12_RESOURCE_STATE_GENERIC_READ;
+		case ResourceState::Present:                 return D3D12_RESOURCE_STATE_PRESENT;
+		default:                                     return D3D12_RESOURCE_STATE_COMMON;
+		}
+	}
+
+	D3D12_PRIMITIVE_TOPOLOGY ToD3D12Topology(PrimitiveTopology topology)
+	{
+		switch(topology)
+		{
+		case PrimitiveTopology::PointList:     return D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+		case PrimitiveTopology::LineList:      return D3D_PRIMITIVE_TOPOLOGY_LINELIST;
+		case PrimitiveTopology::LineStrip:     return D3D_PRIMITIVE_TOPOLOGY_LINESTRIP;
+		case PrimitiveTopology::TriangleList:  return D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		case PrimitiveTopology::TriangleStrip: return D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
+		default:                               return D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		}
+	}
+}
+
+PrimitiveTopology ToPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+{
+	switch(topology)
+	{
+	case D3D_PRIMITIVE_TOPOLOGY_POINTLIST:     return PrimitiveTopology::PointList;
+	case D3D_PRIMITIVE_TOPOLOGY_LINELIST:      return PrimitiveTopology::LineList;
+	case D3D_PRIMITIVE_TOPOLOGY_LINESTRIP:     return PrimitiveTopology::LineStrip;
+	case D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST:  return PrimitiveTopology::TriangleList;
+	case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP: return PrimitiveTopology::TriangleStrip;
+	default:                                   return PrimitiveTopology::Undefined;
+	}
+}
+
+//
+// D3D12RenderDevice
+//
+
+D3D12RenderDevice::D3D12RenderDevice(ID3D12Device* device) :
+	mDevice(device)
+{
+}
+
+std::unique_ptr<RenderBuffer> D3D12RenderDevice::CreateBuffer(std::uint64_t byteSize, RenderHeap heap)
+{
+	bool upload = heap == RenderHeap::Upload;
+
+	ComPtr<ID3D12Resource> resource;
+	ThrowIfFailed(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(upload ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+		upload ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&resource)));
+
+	return std::make_unique<D3D12Resource>(std::move(resource), upload);
+}
+
+std::unique_ptr<RenderResource> D3D12RenderDevice::WrapResource(ID3D12Resource* resource)
+{
+	return std::make_unique<D3D12Resource>(resource, false);
+}
+
+ID3D12Resource* D3D12RenderDevice::GetResource(const RenderResource* resource)
+{
+	auto r = dynamic_cast<const D3D12Resource*>(resource);
+	return r != nullptr ? r->Get() : nullptr;
+}
+
+//
+// D3D12CommandList
+//
+
+D3D12CommandList::D3D12CommandList(ID3D12GraphicsCommandList* cmdList) :
+	mCmdList(cmdList)
+{
+}
+
+ID3D12GraphicsCommandList* D3D12CommandList::Get()const
+{
+	return mCmdList;
+}
+
+void D3D12CommandList::SetPipelineState(RenderPipeline* pso)
+{
+	mCmdList->SetPipelineState(reinterpret_cast<ID3D12PipelineState*>(pso));
+}
+
+void D3D12CommandList::SetGraphicsRootSignature(RenderRootSignature* rootSignature)
+{
+	mCmdList->SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(rootSignature));
+}
+
+void D3D12CommandList::SetVertexBuffer(const VertexBufferView& vbv)
+{
+	D3D12_VERTEX_BUFFER_VIEW v;
+	v.BufferLocation = vbv.Address;
+	v.SizeInBytes = vbv.SizeInBytes;
+	v.StrideInBytes = vbv.StrideInBytes;
+
+	mCmdList->IASetVertexBuffers(0, 1, &v);
+}
+
+void D3D12CommandList::SetIndexBuffer(const IndexBufferView& ibv)
+{
+	D3D12_INDEX_BUFFER_VIEW v;
+	v.BufferLocation = ibv.Address;
+	v.SizeInBytes = ibv.SizeInBytes;
+	v.Format = ibv.Format == IndexFormat::UInt32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+
+	mCmdList->IASetIndexBuffer(&v);
+}
+
+void D3D12CommandList::SetPrimitiveTopology(PrimitiveTopology topology)
+{
+	mCmdList->IASetPrimitiveTopology(ToD3D12Topology(topology));
+}
+
+void D3D12CommandList::SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address)
+{
+	mCmdList->SetGraphicsRootConstantBufferView(rootParameterIndex, address);
+}
+
+void D3D12CommandList::SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address)
+{
+	mCmdList->SetGraphicsRootShaderResourceView(rootParameterIndex, address);
+}
+
+void D3D12CommandList::SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor)
+{
+	D3D12_GPU_DESCRIPTOR_HANDLE handle;
+	handle.ptr = baseDescriptor;
+
+	mCmdList->SetGraphicsRootDescriptorTable(rootParameterIndex, handle);
+}
+
+void D3D12CommandList::DrawInstanced(std::uint32_t vertexCountPerInstance, std::uint32_t instanceCount,
+	std::uint32_t startVertexLocation, std::uint32_t startInstanceLocation)
+{
+	mCmdList->DrawInstanced(vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation);
+}
+
+void D3D12CommandList::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+	std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+{
+	mCmdList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+void D3D12CommandList::ResourceBarrier(RenderResource* resource, ResourceState before, ResourceState after)
+{
+	mCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(D3D12RenderDevice::GetResource(resource),
+		ToD3D12State(before), ToD3D12State(after)));
+}
+
+void D3D12CommandList::CopyBufferRegion(RenderBuffer* dst, std::uint64_t dstOffset,
+	RenderBuffer* src, std::uint64_t srcOffset, std::uint64_t byteSize)
+{
+	mCmdList->CopyBufferRegion(D3D12RenderDevice::GetResource(dst), dstOffset,
+		D3D12RenderDevice::GetResource(src), srcOffset, byteSize);
+}
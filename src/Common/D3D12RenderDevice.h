@@ -0,0 +1,92 @@
+//***************************************************************************************
+// D3D12RenderDevice.h - D3D12 backend of the rendering interface
+//
+// Forwards every RenderDevice/RenderCommandList call to D3D12.  The To*() helpers
+// convert the D3D12 types the demos already hold (MeshGeometry views, PSOs) to the
+// interface types.
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderDevice.h"
+#include "d3dUtil.h"
+
+class D3D12RenderDevice : public RenderDevice
+{
+public:
+	explicit D3D12RenderDevice(ID3D12Device* device);
+	D3D12RenderDevice(const D3D12RenderDevice& rhs) = delete;
+	D3D12RenderDevice& operator=(const D3D12RenderDevice& rhs) = delete;
+	~D3D12RenderDevice() = default;
+
+	std::unique_ptr<RenderBuffer> CreateBuffer(std::uint64_t byteSize, RenderHeap heap) override;
+
+	// A resource created elsewhere, e.g., a swap chain buffer, for barriers.
+	static std::unique_ptr<RenderResource> WrapResource(ID3D12Resource* resource);
+
+	// The D3D12 resource behind resource; nullptr if it is from another backend.
+	static ID3D12Resource* GetResource(const RenderResource* resource);
+
+private:
+	ID3D12Device* mDevice;
+};
+
+class D3D12CommandList : public RenderCommandList
+{
+public:
+	explicit D3D12CommandList(ID3D12GraphicsCommandList* cmdList);
+	D3D12CommandList(const D3D12CommandList& rhs) = delete;
+	D3D12CommandList& operator=(const D3D12CommandList& rhs) = delete;
+	~D3D12CommandList() = default;
+
+	ID3D12GraphicsCommandList* Get()const;
+
+	void SetPipelineState(RenderPipeline* pso) override;
+	void SetGraphicsRootSignature(RenderRootSignature* rootSignature) override;
+	void SetVertexBuffer(const VertexBufferView& vbv) override;
+	void SetIndexBuffer(const IndexBufferView& ibv) override;
+	void SetPrimitiveTopology(PrimitiveTopology topology) override;
+	void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address) override;
+	void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address) override;
+	void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor) override;
+	void DrawInstanced(std::uint32_t vertexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startVertexLocation, std::uint32_t startInstanceLocation) override;
+	void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) override;
+	void ResourceBarrier(RenderResource* resource, ResourceState before, ResourceState after) override;
+	void CopyBufferRegion(RenderBuffer* dst, std::uint64_t dstOffset,
+		RenderBuffer* src, std::uint64_t srcOffset, std::uint64_t byteSize) override;
+
+private:
+	ID3D12GraphicsCommandList* mCmdList;
+};
+
+inline RenderPipeline* ToRenderPipeline(ID3D12PipelineState* pso)
+{
+	return reinterpret_cast<RenderPipeline*>(pso);
+}
+
+inline RenderRootSignature* ToRenderRootSignature(ID3D12RootSignature* rootSignature)
+{
+	return reinterpret_cast<RenderRootSignature*>(rootSignature);
+}
+
+inline VertexBufferView ToVertexBufferView(const D3D12_VERTEX_BUFFER_VIEW& vbv)
+{
+	VertexBufferView v;
+	v.Address = vbv.BufferLocation;
+	v.SizeInBytes = vbv.SizeInBytes;
+	v.StrideInBytes = vbv.StrideInBytes;
+	return v;
+}
+
+inline IndexBufferView ToIndexBufferView(const D3D12_INDEX_BUFFER_VIEW& ibv)
+{
+	IndexBufferView v;
+	v.Address = ibv.BufferLocation;
+	v.SizeInBytes = ibv.SizeInBytes;
+	v.Format = ibv.Format == DXGI_FORMAT_R32_UINT ? IndexFormat::UInt32 : IndexFormat::UInt16;
+	return v;
+}
+
+PrimitiveTopology ToPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology);
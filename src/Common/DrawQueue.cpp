@@ -0,0 +1,205 @@
+//***************************************************************************************
+// DrawQueue.cpp - Sorting of draw submissions by 64-bit keys
+//***************************************************************************************
+
+#include "DrawQueue.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	const std::uint32_t RadixBits = 8;
+	const std::uint32_t RadixSize = 1 << RadixBits;
+	const std::uint32_t RadixPasses = 64 / RadixBits;
+
+	// Below this many entries per chunk the threading overhead is not worth it.
+	const std::uint32_t MinChunkSize = 4096;
+	const std::uint32_t MaxChunks = 16;
+
+	std::uint64_t Field(std::uint32_t value, std::uint32_t bits, std::uint32_t shift)
+	{
+		return (std::uint64_t(value) & ((std::uint64_t(1) << bits) - 1)) << shift;
+	}
+}
+
+void DrawQueue::Clear()
+{
+	mEntries.clear();
+}
+
+void DrawQueue::Reserve(std::uint32_t count)
+{
+	mEntries.reserve(count);
+	mScratch.reserve(count);
+}
+
+void DrawQueue::Add(std::uint64_t key, std::uint32_t item)
+{
+	mEntries.push_back({ key, item });
+}
+
+std::uint32_t DrawQueue::Size()const
+{
+	return (std::uint32_t)mEntries.size();
+}
+
+const DrawQueue::Entry& DrawQueue::operator[](std::uint32_t index)const
+{
+	assert(index < mEntries.size());
+
+	return mEntries[index];
+}
+
+std::uint32_t DrawQueue::RunEnd(std::uint32_t first, std::uint64_t mask)const
+{
+	assert(first < mEntries.size());
+
+	const std::uint64_t state = mEntries[first].Key & mask;
+
+	std::uint32_t last = first + 1;
+	while(last < mEntries.size() && (mEntries[last].Key & mask) == state)
+		++last;
+
+	return last;
+}
+
+void DrawQueue::Sort()
+{
+	PROFILE_SCOPE("DrawQueue::Sort");
+
+	const std::uint32_t count = (std::uint32_t)mEntries.size();
+	if(count < 2)
+		return;
+
+	mScratch.resize(count);
+
+	const std::uint32_t chunkCount = MathHelper::Clamp(count / MinChunkSize, 1u, MaxChunks);
+	const std::uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+	// Find the passes that actually reorder anything.  A pass is skipped if every
+	// key has the same digit, e.g., unused key bits.  The digit counts of the
+	// whole queue do not depend on the order, so one read of the keys does.
+	std::vector<std::uint32_t> counts(chunkCount*RadixPasses*RadixSize, 0);
+
+	JobSystem::Default().ParallelFor(0u, chunkCount, [&](std::uint32_t chunk)
+	{
+		std::uint32_t* chunkCounts = &counts[chunk*RadixPasses*RadixSize];
+
+		const std::uint32_t first = chunk*chunkSize;
+		const std::uint32_t last = MathHelper::Min(first + chunkSize, count);
+		for(std::uint32_t i = first; i < last; ++i)
+		{
+			std::uint64_t key = mEntries[i].Key;
+			for(std::uint32_t pass = 0; pass < RadixPasses; ++pass)
+				chunkCounts[pass*RadixSize + (std::uint32_t)((key >> (pass*RadixBits)) & (RadixSize - 1))]++;
+		}
+	});
+
+	bool sortPass[RadixPasses];
+	for(std::uint32_t pass = 0; pass < RadixPasses; ++pass)
+	{
+		const std::uint32_t firstDigit = (std::uint32_t)((mEntries[0].Key >> (pass*RadixBits)) & (RadixSize - 1));
+		std::uint32_t total = 0;
+		for(std::uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+			total += counts[(chunk*RadixPasses + pass)*RadixSize + firstDigit];
+
+		sortPass[pass] = total != count;
+	}
+
+	std::vector<std::uint32_t> offsets(chunkCount*RadixSize);
+
+	Entry* src = mEntries.data();
+	Entry* dst = mScratch.data();
+	bool firstSortedPass = true;
+	for(std::uint32_t pass = 0; pass < RadixPasses; ++pass)
+	{
+		if(!sortPass[pass])
+			continue;
+
+		// Each pass moves entries between chunks, so apart from the first sorted
+		// pass the per chunk counts have to be redone.
+		if(!firstSortedPass && chunkCount > 1)
+		{
+			JobSystem::Default().ParallelFor(0u, chunkCount, [&](std::uint32_t chunk)
+			{
+				std::uint32_t* chunkCounts = &counts[(chunk*RadixPasses + pass)*RadixSize];
+				std::fill(chunkCounts, chunkCounts + RadixSize, 0u);
+
+				const std::uint32_t first = chunk*chunkSize;
+				const std::uint32_t last = MathHelper::Min(first + chunkSize, count);
+				for(std::uint32_t i = first; i < last; ++i)
+					chunkCounts[(std::uint32_t)((src[i].Key >> (pass*RadixBits)) & (RadixSize - 1))]++;
+			});
+		}
+		firstSortedPass = false;
+
+		// Chunk c writes digit d after all smaller digits and after digit d of
+		// the chunks before it, which keeps the sort stable.
+		std::uint32_t offset = 0;
+		for(std::uint32_t digit = 0; digit < RadixSize; ++digit)
+		{
+			for(std::uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+			{
+				offsets[chunk*RadixSize + digit] = offset;
+				offset += counts[(chunk*RadixPasses + pass)*RadixSize + digit];
+			}
+		}
+
+		JobSystem::Default().ParallelFor(0u, chunkCount, [&](std::uint32_t chunk)
+		{
+			std::uint32_t* chunkOffsets = &offsets[chunk*RadixSize];
+
+			const std::uint32_t first = chunk*chunkSize;
+			const std::uint32_t last = MathHelper::Min(first + chunkSize, count);
+			for(std::uint32_t i = first; i < last; ++i)
+			{
+				std::uint32_t digit = (std::uint32_t)((src[i].Key >> (pass*RadixBits)) & (RadixSize - 1));
+				dst[chunkOffsets[digit]++] = src[i];
+			}
+		});
+
+		std::swap(src, dst);
+	}
+
+	if(src != mEntries.data())
+		std::copy(src, src + count, mEntries.data());
+}
+
+std::uint32_t DrawQueue::DepthBucket(float viewZ, float nearZ, float farZ)
+{
+	const std::uint32_t maxBucket = (1u << DepthBits) - 1;
+
+	float t = MathHelper::Clamp((viewZ - nearZ) / (farZ - nearZ), 0.0f, 1.0f);
+
+	return (std::uint32_t)(t*maxBucket);
+}
+
+std::uint64_t DrawQueue::MakeOpaqueKey(std::uint32_t layer, std::uint32_t pso, std::uint32_t material, std::uint32_t geometry, std::uint32_t depthBucket)
+{
+	return
+		Field(layer, LayerBits, 60) |
+		Field(pso, PsoBits, 52) |
+		Field(material, MaterialBits, 40) |
+		Field(geometry, GeometryBits, 24) |
+		Field(depthBucket, DepthBits, 0);
+}
+
+std::uint64_t DrawQueue::MakeBlendedKey(std::uint32_t layer, std::uint32_t pso, std::uint32_t material, std::uint32_t geometry, std::uint32_t depthBucket)
+{
+	// Invert the depth so that the furthest draws come first.
+	const std::uint32_t maxBucket = (1u << DepthBits) - 1;
+
+	return
+		Field(layer, LayerBits, 60) |
+		Field(maxBucket - MathHelper::Min(depthBucket, maxBucket), DepthBits, 36) |
+		Field(pso, PsoBits, 28) |
+		Field(material, MaterialBits, 16) |
+		Field(geometry, GeometryBits, 0);
+}
+
+std::uint32_t DrawQueue::KeyLayer(std::uint64_t key)
+{
+	return (std::uint32_t)(key >> 60);
+}
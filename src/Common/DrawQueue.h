@@ -0,0 +1,115 @@
+//***************************************************************************************
+// DrawQueue.h - Sorting of draw submissions by 64-bit keys
+//
+// Every visible draw is added with a 64-bit key and an item index.  Sorting the
+// keys groups draws sharing state so redundant state changes can be skipped
+// (see DrawStateCache), lets draws of the same state be merged into instanced
+// draws (see RunEnd()), and orders draws within a layer by depth.
+//   -Opaque keys, most significant first: layer (4 bits), PSO (8), material (12),
+//    geometry (16), depth bucket (24).  Depth is the least significant so state
+//    wins, and within the same state draws go front to back.
+//   -Blended keys: layer (4 bits), inverted depth bucket (24), PSO (8), material
+//    (12), geometry (16), so blended draws go strictly back to front.
+//   -Keys are sorted with an LSD radix sort, 8 bits per pass.  Each pass counts
+//    digits per chunk of the queue in parallel, and passes in which all keys have
+//    the same digit are skipped, so only the bits that vary are sorted.
+//   -Short lists drawn in a fixed order, e.g., the render item layers of the chapter
+//    demos, are grouped by SortRuns() and ForEachRun() instead of a queue.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <algorithm>
+#include <vector>
+
+class DrawQueue
+{
+public:
+	static const std::uint32_t LayerBits = 4;
+	static const std::uint32_t PsoBits = 8;
+	static const std::uint32_t MaterialBits = 12;
+	static const std::uint32_t GeometryBits = 16;
+	static const std::uint32_t DepthBits = 24;
+
+	// Bits of an opaque key that hold state, i.e., everything but the depth bucket.
+	static const std::uint64_t OpaqueStateMask = ~((std::uint64_t(1) << DepthBits) - 1);
+
+	struct Entry
+	{
+		std::uint64_t Key;
+		std::uint32_t Item;
+	};
+
+	DrawQueue() = default;
+	DrawQueue(const DrawQueue& rhs) = delete;
+	DrawQueue& operator=(const DrawQueue& rhs) = delete;
+	~DrawQueue() = default;
+
+	void Clear();
+	void Reserve(std::uint32_t count);
+
+	void Add(std::uint64_t key, std::uint32_t item);
+
+	// Sort the entries by key.  Entries with equal keys keep their order.
+	void Sort();
+
+	std::uint32_t Size()const;
+	const Entry& operator[](std::uint32_t index)const;
+
+	// Returns one past the last entry of the run starting at first whose keys
+	// agree in the bits of mask.  After sorting, a run of equal state, e.g., with
+	// OpaqueStateMask, can be drawn as a single instanced draw.
+	std::uint32_t RunEnd(std::uint32_t first, std::uint64_t mask)const;
+
+	// Quantize a view space depth in [nearZ, farZ] to a depth bucket.
+	static std::uint32_t DepthBucket(float viewZ, float nearZ, float farZ);
+
+	// The fields are truncated to their number of bits.
+	static std::uint64_t MakeOpaqueKey(std::uint32_t layer, std::uint32_t pso, std::uint32_t material, std::uint32_t geometry, std::uint32_t depthBucket);
+	static std::uint64_t MakeBlendedKey(std::uint32_t layer, std::uint32_t pso, std::uint32_t material, std::uint32_t geometry, std::uint32_t depthBucket);
+
+	// The layer is in the same place in both kinds of keys.
+	static std::uint32_t KeyLayer(std::uint64_t key);
+
+	// Grouping of item lists by a key function: key(item) returns the state the
+	// items of one instanced draw must share, as any value with < and ==, e.g.,
+	// d3dUtil::MeshKey().  SortRuns() puts the items with equal keys next to each
+	// other and otherwise keeps their order.  ForEachRun() calls body(first, last)
+	// for every run [first, last) of adjacent items with equal keys.
+	template<typename Item, typename Key>
+	static void SortRuns(std::vector<Item>& items, Key key);
+
+	template<typename Item, typename Key, typename Body>
+	static void ForEachRun(const std::vector<Item>& items, Key key, Body body);
+
+private:
+	std::vector<Entry> mEntries;
+	std::vector<Entry> mScratch;
+};
+
+template<typename Item, typename Key>
+void DrawQueue::SortRuns(std::vector<Item>& items, Key key)
+{
+	std::stable_sort(items.begin(), items.end(), [&key](const Item& a, const Item& b)
+	{
+		return key(a) < key(b);
+	});
+}
+
+template<typename Item, typename Key, typename Body>
+void DrawQueue::ForEachRun(const std::vector<Item>& items, Key key, Body body)
+{
+	const std::uint32_t count = (std::uint32_t)items.size();
+	for(std::uint32_t first = 0; first < count; )
+	{
+		const auto state = key(items[first]);
+
+		std::uint32_t last = first + 1;
+		while(last < count && key(items[last]) == state)
+			++last;
+
+		body(first, last);
+		first = last;
+	}
+}
@@ -0,0 +1,129 @@
+//***************************************************************************************
+// DrawStateCache.cpp - Filters redundant pipeline state changes
+//***************************************************************************************
+
+#include "DrawStateCache.h"
+#include <cassert>
+
+void DrawStateCache::Begin(RenderCommandList* cmdList)
+{
+	mCmdList = cmdList;
+	mStats = Stats();
+
+	Invalidate();
+}
+
+void DrawStateCache::Invalidate()
+{
+	mPso = nullptr;
+	mVertexBuffer = VertexBufferView();
+	mIndexBuffer = IndexBufferView();
+	mTopology = PrimitiveTopology::Undefined;
+
+	for(std::uint32_t i = 0; i < MaxRootParameters; ++i)
+		mRootParameters[i] = 0;
+}
+
+void DrawStateCache::SetPipelineState(RenderPipeline* pso)
+{
+	if(pso == mPso)
+	{
+		mStats.RedundantStateChanges++;
+		return;
+	}
+
+	mPso = pso;
+	mCmdList->SetPipelineState(pso);
+	mStats.StateChanges++;
+}
+
+void DrawStateCache::SetVertexBuffer(const VertexBufferView& vbv)
+{
+	if(vbv.Address == mVertexBuffer.Address &&
+		vbv.SizeInBytes == mVertexBuffer.SizeInBytes &&
+		vbv.StrideInBytes == mVertexBuffer.StrideInBytes)
+	{
+		mStats.RedundantStateChanges++;
+		return;
+	}
+
+	mVertexBuffer = vbv;
+	mCmdList->SetVertexBuffer(vbv);
+	mStats.StateChanges++;
+}
+
+void DrawStateCache::SetIndexBuffer(const IndexBufferView& ibv)
+{
+	if(ibv.Address == mIndexBuffer.Address &&
+		ibv.SizeInBytes == mIndexBuffer.SizeInBytes &&
+		ibv.Format == mIndexBuffer.Format)
+	{
+		mStats.RedundantStateChanges++;
+		return;
+	}
+
+	mIndexBuffer = ibv;
+	mCmdList->SetIndexBuffer(ibv);
+	mStats.StateChanges++;
+}
+
+void DrawStateCache::SetPrimitiveTopology(PrimitiveTopology topology)
+{
+	if(topology == mTopology)
+	{
+		mStats.RedundantStateChanges++;
+		return;
+	}
+
+	mTopology = topology;
+	mCmdList->SetPrimitiveTopology(topology);
+	mStats.StateChanges++;
+}
+
+void DrawStateCache::SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address)
+{
+	if(SetRootParameter(rootParameterIndex, address))
+		mCmdList->SetGraphicsRootConstantBufferView(rootParameterIndex, address);
+}
+
+void DrawStateCache::SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address)
+{
+	if(SetRootParameter(rootParameterIndex, address))
+		mCmdList->SetGraphicsRootShaderResourceView(rootParameterIndex, address);
+}
+
+void DrawStateCache::SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor)
+{
+	if(SetRootParameter(rootParameterIndex, baseDescriptor))
+		mCmdList->SetGraphicsRootDescriptorTable(rootParameterIndex, baseDescriptor);
+}
+
+void DrawStateCache::DrawIndexedInstanced(std::uint32_t indexCount, std::uint32_t instanceCount, std::uint32_t startIndexLocation,
+	std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+{
+	mCmdList->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+	mStats.DrawCount++;
+}
+
+const DrawStateCache::Stats& DrawStateCache::GetStats()const
+{
+	return mStats;
+}
+
+bool DrawStateCache::SetRootParameter(std::uint32_t rootParameterIndex, std::uint64_t value)
+{
+	assert(rootParameterIndex < MaxRootParameters);
+
+	// Setting the root signature clears the root arguments, so it must not be
+	// changed between Begin() and the end of the recording.
+	if(value == mRootParameters[rootParameterIndex])
+	{
+		mStats.RedundantStateChanges++;
+		return false;
+	}
+
+	mRootParameters[rootParameterIndex] = value;
+	mStats.StateChanges++;
+
+	return true;
+}
@@ -0,0 +1,68 @@
+//***************************************************************************************
+// DrawStateCache.h - Filters redundant pipeline state changes
+//
+// Sits between the draw loop and a RenderCommandList and remembers the pipeline
+// state, input assembler state and root parameters last set.  Setting the same
+// state again is dropped instead of being recorded.  Together with draws sorted
+// by state (see DrawQueue) most per draw state changes disappear; the stats
+// report how many were recorded and how many were avoided.
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderDevice.h"
+#include <cstdint>
+
+class DrawStateCache
+{
+public:
+	static const std::uint32_t MaxRootParameters = 16;
+
+	struct Stats
+	{
+		std::uint32_t DrawCount = 0;
+		std::uint32_t StateChanges = 0;
+		std::uint32_t RedundantStateChanges = 0;
+	};
+
+	DrawStateCache() = default;
+	DrawStateCache(const DrawStateCache& rhs) = delete;
+	DrawStateCache& operator=(const DrawStateCache& rhs) = delete;
+	~DrawStateCache() = default;
+
+	// Start recording to cmdList.  Nothing is assumed to be set, and the stats
+	// are reset.
+	void Begin(RenderCommandList* cmdList);
+
+	// Forget the state, e.g., after the command list was used directly.
+	void Invalidate();
+
+	void SetPipelineState(RenderPipeline* pso);
+	void SetVertexBuffer(const VertexBufferView& vbv);
+	void SetIndexBuffer(const IndexBufferView& ibv);
+	void SetPrimitiveTopology(PrimitiveTopology topology);
+	void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address);
+	void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address);
+	void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor);
+
+	void DrawIndexedInstanced(std::uint32_t indexCount, std::uint32_t instanceCount, std::uint32_t startIndexLocation,
+		std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation);
+
+	const Stats& GetStats()const;
+
+private:
+	bool SetRootParameter(std::uint32_t rootParameterIndex, std::uint64_t value);
+
+private:
+	RenderCommandList* mCmdList = nullptr;
+
+	RenderPipeline* mPso = nullptr;
+	VertexBufferView mVertexBuffer;
+	IndexBufferView mIndexBuffer;
+	PrimitiveTopology mTopology = PrimitiveTopology::Undefined;
+
+	// GPU address or descriptor handle bound to each root parameter; 0 if unknown.
+	std::uint64_t mRootParameters[MaxRootParameters] = {};
+
+	Stats mStats;
+};
@@ -0,0 +1,508 @@
+//***************************************************************************************
+// FrustumCuller.cpp - Batched SIMD frustum culling over world space bounds
+//***************************************************************************************
+
+#include "FrustumCuller.h"
+#include "TransformKernels.h"
+#include "Profiler.h"
+#include <intrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+UINT FrustumCuller::BoundsCount()const
+{
+	return mCount;
+}
+
+void FrustumCuller::Clear()
+{
+	mCount = 0;
+
+	mCenterX.clear();
+	mCenterY.clear();
+	mCenterZ.clear();
+	mExtentX.clear();
+	mExtentY.clear();
+	mExtentZ.clear();
+}
+
+void FrustumCuller::Reserve(UINT count)
+{
+	UINT padded = (count + 7) & ~7;
+
+	mCenterX.reserve(padded);
+	mCenterY.reserve(padded);
+	mCenterZ.reserve(padded);
+	mExtentX.reserve(padded);
+	mExtentY.reserve(padded);
+	mExtentZ.reserve(padded);
+}
+
+UINT FrustumCuller::AddBox(const BoundingBox& box)
+{
+	// Grow by a whole SIMD block of always-culled boxes when we run out of room.
+	if(mCount == (UINT)mCenterX.size())
+	{
+		UINT padded = mCount + 8;
+
+		mCenterX.resize(padded, 0.0f);
+		mCenterY.resize(padded, 0.0f);
+		mCenterZ.resize(padded, 0.0f);
+		mExtentX.resize(padded, -MathHelper::Infinity);
+		mExtentY.resize(padded, -MathHelper::Infinity);
+		mExtentZ.resize(padded, -MathHelper::Infinity);
+	}
+
+	UINT index = mCount++;
+	SetBox(index, box);
+
+	return index;
+}
+
+UINT FrustumCuller::AddSphere(const BoundingSphere& sphere)
+{
+	BoundingBox box;
+	BoundingBox::CreateFromSphere(box, sphere);
+
+	return AddBox(box);
+}
+
+void FrustumCuller::SetBox(UINT index, const BoundingBox& box)
+{
+	assert(index < mCount);
+
+	mCenterX[index] = box.Center.x;
+	mCenterY[index] = box.Center.y;
+	mCenterZ[index] = box.Center.z;
+	mExtentX[index] = box.Extents.x;
+	mExtentY[index] = box.Extents.y;
+	mExtentZ[index] = box.Extents.z;
+}
+
+void FrustumCuller::SetSphere(UINT index, const BoundingSphere& sphere)
+{
+	BoundingBox box;
+	BoundingBox::CreateFromSphere(box, sphere);
+
+	SetBox(index, box);
+}
+
+BoundingBox FrustumCuller::GetBox(UINT index)const
+{
+	assert(index < mCount);
+
+	return BoundingBox(
+		XMFLOAT3(mCenterX[index], mCenterY[index], mCenterZ[index]),
+		XMFLOAT3(mExtentX[index], mExtentY[index], mExtentZ[index]));
+}
+
+UINT FrustumCuller::AddBoxes(const BoundingBox& localBox, const XMFLOAT4X4* worlds, UINT worldStride, UINT count)
+{
+	const UINT first = mCount;
+
+	// Keep the arrays a whole number of SIMD blocks long, padded with always-culled boxes.
+	UINT padded = (first + count + 7) & ~7;
+	if(padded > (UINT)mCenterX.size())
+	{
+		mCenterX.resize(padded, 0.0f);
+		mCenterY.resize(padded, 0.0f);
+		mCenterZ.resize(padded, 0.0f);
+		mExtentX.resize(padded, -MathHelper::Infinity);
+		mExtentY.resize(padded, -MathHelper::Infinity);
+		mExtentZ.resize(padded, -MathHelper::Infinity);
+	}
+
+	mCount += count;
+	SetBoxes(first, localBox, worlds, worldStride, count);
+
+	return first;
+}
+
+void FrustumCuller::SetBoxes(UINT first, const BoundingBox& localBox, const XMFLOAT4X4* worlds, UINT worldStride, UINT count)
+{
+	assert(first + count <= mCount);
+
+	if(count == 0)
+		return;
+
+	TransformKernels::BoxArrays boxes;
+	boxes.CenterX = &mCenterX[first];
+	boxes.CenterY = &mCenterY[first];
+	boxes.CenterZ = &mCenterZ[first];
+	boxes.ExtentX = &mExtentX[first];
+	boxes.ExtentY = &mExtentY[first];
+	boxes.ExtentZ = &mExtentZ[first];
+
+	TransformKernels::TransformBox(localBox, count, worlds, worldStride, boxes);
+}
+
+UINT FrustumCuller::Cull(const std::array<XMFLOAT4, 6>& planes, UINT* outVisible)const
+{
+	return Cull(planes.data(), (UINT)planes.size(), outVisible);
+}
+
+UINT FrustumCuller::Cull(const XMFLOAT4* planes, UINT planeCount, UINT* outVisible)const
+{
+	PROFILE_SCOPE("FrustumCuller::Cull");
+
+	if(mCount == 0)
+		return 0;
+
+	if(AvxSupported())
+		return CullAvx(planes, planeCount, outVisible);
+
+	return CullSse(planes, planeCount, outVisible);
+}
+
+bool FrustumCuller::AvxSupported()
+{
+	static const bool supported = []()
+	{
+		int info[4];
+		__cpuid(info, 1);
+
+		// The CPU must support AVX and the OS must use XSAVE/XRSTOR...
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+		if(!osxsave || !avx)
+			return false;
+
+		// ...and preserve the YMM registers across context switches.
+		return (_xgetbv(0) & 0x6) == 0x6;
+	}();
+
+	return supported;
+}
+
+//
+// For a box with center c and extents e, the signed distance of the point of
+// the box furthest along the plane normal n is
+//
+//    dot(n, c) + d + (|n.x|*e.x + |n.y|*e.y + |n.z|*e.z)
+//
+// If it is negative the whole box is behind the plane and therefore outside
+// of the frustum.  The kernels below evaluate this for eight (AVX) or four (SSE)
+// boxes at once and then compact the survivors' indices using the sign mask.
+//
+
+UINT FrustumCuller::CullSse(const XMFLOAT4* planes, UINT planeCount, UINT* outVisible)const
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 zero = _mm_setzero_ps();
+
+	UINT visibleCount = 0;
+	const UINT paddedCount = (UINT)mCenterX.size();
+	for(UINT i = 0; i < paddedCount; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&mCenterX[i]);
+		__m128 cy = _mm_loadu_ps(&mCenterY[i]);
+		__m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+		__m128 ex = _mm_loadu_ps(&mExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&mExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+
+		int mask = 0xf;
+		for(UINT p = 0; p < planeCount && mask != 0; ++p)
+		{
+			__m128 nx = _mm_set1_ps(planes[p].x);
+			__m128 ny = _mm_set1_ps(planes[p].y);
+			__m128 nz = _mm_set1_ps(planes[p].z);
+			__m128 nd = _mm_set1_ps(planes[p].w);
+
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), nd));
+			__m128 radius = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_and_ps(nx, signMask), ex),
+				_mm_mul_ps(_mm_and_ps(ny, signMask), ey)),
+				_mm_mul_ps(_mm_and_ps(nz, signMask), ez));
+
+			mask &= _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+		}
+
+		unsigned long bit;
+		while(_BitScanForward(&bit, (unsigned long)mask))
+		{
+			outVisible[visibleCount++] = i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	return visibleCount;
+}
+
+UINT FrustumCuller::CullAvx(const XMFLOAT4* planes, UINT planeCount, UINT* outVisible)const
+{
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 zero = _mm256_setzero_ps();
+
+	// Broadcast the coefficients of the first planes once rather than once per
+	// block.  Frusta have six planes and portal volumes a few more; any planes
+	// beyond MaxBroadcastPlanes are broadcast inside the block loop instead.
+	const UINT MaxBroadcastPlanes = 16;
+	const UINT broadcastCount = MathHelper::Min(planeCount, MaxBroadcastPlanes);
+	__m256 nx[MaxBroadcastPlanes], ny[MaxBroadcastPlanes], nz[MaxBroadcastPlanes], nd[MaxBroadcastPlanes];
+	__m256 ax[MaxBroadcastPlanes], ay[MaxBroadcastPlanes], az[MaxBroadcastPlanes];
+	for(UINT p = 0; p < broadcastCount; ++p)
+	{
+		nx[p] = _mm256_set1_ps(planes[p].x);
+		ny[p] = _mm256_set1_ps(planes[p].y);
+		nz[p] = _mm256_set1_ps(planes[p].z);
+		nd[p] = _mm256_set1_ps(planes[p].w);
+		ax[p] = _mm256_and_ps(nx[p], signMask);
+		ay[p] = _mm256_and_ps(ny[p], signMask);
+		az[p] = _mm256_and_ps(nz[p], signMask);
+	}
+
+	UINT visibleCount = 0;
+	const UINT paddedCount = (UINT)mCenterX.size();
+	for(UINT i = 0; i < paddedCount; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+		__m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+		__m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+		__m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		__m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		__m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+
+		int mask = 0xff;
+		for(UINT p = 0; p < broadcastCount && mask != 0; ++p)
+		{
+			__m256 dist = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+				_mm256_add_ps(_mm256_mul_ps(nz[p], cz), nd[p]));
+			__m256 radius = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+				_mm256_mul_ps(az[p], ez));
+
+			mask &= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_GE_OQ));
+		}
+
+		for(UINT p = broadcastCount; p < planeCount && mask != 0; ++p)
+		{
+			__m256 px = _mm256_set1_ps(planes[p].x);
+			__m256 py = _mm256_set1_ps(planes[p].y);
+			__m256 pz = _mm256_set1_ps(planes[p].z);
+			__m256 pd = _mm256_set1_ps(planes[p].w);
+
+			__m256 dist = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(px, cx), _mm256_mul_ps(py, cy)),
+				_mm256_add_ps(_mm256_mul_ps(pz, cz), pd));
+			__m256 radius = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(px, signMask), ex), _mm256_mul_ps(_mm256_and_ps(py, signMask), ey)),
+				_mm256_mul_ps(_mm256_and_ps(pz, signMask), ez));
+
+			mask &= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_GE_OQ));
+		}
+
+		unsigned long bit;
+		while(_BitScanForward(&bit, (unsigned long)mask))
+		{
+			outVisible[visibleCount++] = i + bit;
+			mask &= mask - 1;
+		}
+	}
+
+	return visibleCount;
+}
+
+UINT FrustumCuller::CullViews(const std::array<XMFLOAT4, 6>* viewPlanes, UINT viewCount,
+	UINT* outViewMasks, std::vector<UINT>* outViewLists)const
+{
+	PROFILE_SCOPE("FrustumCuller::CullViews");
+
+	assert(viewCount <= MaxViews);
+
+	if(outViewLists != nullptr)
+	{
+		for(UINT v = 0; v < viewCount; ++v)
+			outViewLists[v].clear();
+	}
+
+	if(mCount == 0 || viewCount == 0)
+	{
+		std::fill(outViewMasks, outViewMasks + mCount, 0u);
+		return 0;
+	}
+
+	ViewSetup setup;
+	SetupViews(viewPlanes, viewCount, setup);
+
+	if(AvxSupported())
+		return CullViewsAvx(setup, viewCount, outViewMasks, outViewLists);
+
+	return CullViewsSse(setup, viewCount, outViewMasks, outViewLists);
+}
+
+//
+// Views rendered from the same point share planes: the right plane of the +X cube
+// face is the left plane of the -Z face with the normal flipped.  A box is outside
+// of the plane (n, d) when dot(n, c) + d + r < 0 and outside of the flipped plane
+// when -(dot(n, c) + d) + r < 0, so both follow from one distance and radius.  The
+// planes of all views are therefore reduced to a table of unique planes, each of
+// which is evaluated once per block of bounds.
+//
+
+void FrustumCuller::SetupViews(const std::array<XMFLOAT4, 6>* viewPlanes, UINT viewCount, ViewSetup& setup)
+{
+	const float epsilon = 1e-5f;
+
+	setup.UniqueCount = 0;
+	for(UINT v = 0; v < viewCount; ++v)
+	{
+		for(UINT p = 0; p < 6; ++p)
+		{
+			const XMFLOAT4& plane = viewPlanes[v][p];
+
+			UINT u = 0;
+			BYTE flipped = 0;
+			for(; u < setup.UniqueCount; ++u)
+			{
+				if(fabsf(setup.Nx[u] - plane.x) < epsilon && fabsf(setup.Ny[u] - plane.y) < epsilon &&
+					fabsf(setup.Nz[u] - plane.z) < epsilon && fabsf(setup.Nd[u] - plane.w) < epsilon)
+				{
+					break;
+				}
+
+				if(fabsf(setup.Nx[u] + plane.x) < epsilon && fabsf(setup.Ny[u] + plane.y) < epsilon &&
+					fabsf(setup.Nz[u] + plane.z) < epsilon && fabsf(setup.Nd[u] + plane.w) < epsilon)
+				{
+					flipped = 1;
+					break;
+				}
+			}
+
+			if(u == setup.UniqueCount)
+			{
+				setup.Nx[u] = plane.x;
+				setup.Ny[u] = plane.y;
+				setup.Nz[u] = plane.z;
+				setup.Nd[u] = plane.w;
+				setup.UniqueCount++;
+			}
+
+			setup.Planes[v][p].Index = (BYTE)u;
+			setup.Planes[v][p].Flipped = flipped;
+		}
+	}
+}
+
+// planeMasks holds, for every unique plane u, the lanes in front of the plane at
+// [2*u] and the lanes in front of the flipped plane at [2*u+1].
+UINT FrustumCuller::ScatterViewMasks(UINT first, UINT laneCount, const int* planeMasks, const ViewSetup& setup,
+	UINT viewCount, UINT* outViewMasks, std::vector<UINT>* outViewLists)const
+{
+	UINT laneViewMasks[8] = { 0 };
+
+	for(UINT v = 0; v < viewCount; ++v)
+	{
+		int mask = (1 << laneCount) - 1;
+		for(UINT p = 0; p < 6; ++p)
+		{
+			const ViewPlane& vp = setup.Planes[v][p];
+			mask &= planeMasks[2*vp.Index + vp.Flipped];
+		}
+
+		unsigned long bit;
+		while(_BitScanForward(&bit, (unsigned long)mask))
+		{
+			laneViewMasks[bit] |= 1u << v;
+			if(outViewLists != nullptr)
+				outViewLists[v].push_back(first + bit);
+			mask &= mask - 1;
+		}
+	}
+
+	// Padding bounds are rejected by every plane, so only real bounds have bits set.
+	UINT visibleCount = 0;
+	const UINT realCount = MathHelper::Min(laneCount, mCount - first);
+	for(UINT lane = 0; lane < realCount; ++lane)
+	{
+		outViewMasks[first + lane] = laneViewMasks[lane];
+		visibleCount += laneViewMasks[lane] != 0 ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+UINT FrustumCuller::CullViewsSse(const ViewSetup& setup, UINT viewCount, UINT* outViewMasks, std::vector<UINT>* outViewLists)const
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 zero = _mm_setzero_ps();
+
+	int planeMasks[2*MaxViews*6];
+
+	UINT visibleCount = 0;
+	for(UINT i = 0; i < mCount; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&mCenterX[i]);
+		__m128 cy = _mm_loadu_ps(&mCenterY[i]);
+		__m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+		__m128 ex = _mm_loadu_ps(&mExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&mExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+
+		for(UINT u = 0; u < setup.UniqueCount; ++u)
+		{
+			__m128 nx = _mm_set1_ps(setup.Nx[u]);
+			__m128 ny = _mm_set1_ps(setup.Ny[u]);
+			__m128 nz = _mm_set1_ps(setup.Nz[u]);
+			__m128 nd = _mm_set1_ps(setup.Nd[u]);
+
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), nd));
+			__m128 radius = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_and_ps(nx, signMask), ex),
+				_mm_mul_ps(_mm_and_ps(ny, signMask), ey)),
+				_mm_mul_ps(_mm_and_ps(nz, signMask), ez));
+
+			planeMasks[2*u + 0] = _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(radius, dist), zero));
+			planeMasks[2*u + 1] = _mm_movemask_ps(_mm_cmpge_ps(_mm_sub_ps(radius, dist), zero));
+		}
+
+		visibleCount += ScatterViewMasks(i, 4, planeMasks, setup, viewCount, outViewMasks, outViewLists);
+	}
+
+	return visibleCount;
+}
+
+UINT FrustumCuller::CullViewsAvx(const ViewSetup& setup, UINT viewCount, UINT* outViewMasks, std::vector<UINT>* outViewLists)const
+{
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 zero = _mm256_setzero_ps();
+
+	int planeMasks[2*MaxViews*6];
+
+	UINT visibleCount = 0;
+	for(UINT i = 0; i < mCount; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+		__m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+		__m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+		__m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		__m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		__m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+
+		for(UINT u = 0; u < setup.UniqueCount; ++u)
+		{
+			__m256 nx = _mm256_broadcast_ss(&setup.Nx[u]);
+			__m256 ny = _mm256_broadcast_ss(&setup.Ny[u]);
+			__m256 nz = _mm256_broadcast_ss(&setup.Nz[u]);
+			__m256 nd = _mm256_broadcast_ss(&setup.Nd[u]);
+
+			__m256 dist = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+				_mm256_add_ps(_mm256_mul_ps(nz, cz), nd));
+			__m256 radius = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(_mm256_and_ps(nx, signMask), ex), _mm256_mul_ps(_mm256_and_ps(ny, signMask), ey)),
+				_mm256_mul_ps(_mm256_and_ps(nz, signMask), ez));
+
+			planeMasks[2*u + 0] = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(radius, dist), zero, _CMP_GE_OQ));
+			planeMasks[2*u + 1] = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_sub_ps(radius, dist), zero, _CMP_GE_OQ));
+		}
+
+		visibleCount += ScatterViewMasks(i, 8, planeMasks, setup, viewCount, outViewMasks, outViewLists);
+	}
+
+	return visibleCount;
+}
@@ -0,0 +1,114 @@
+//***************************************************************************************
+// FrustumCuller.h - Batched SIMD frustum culling over world space bounds
+//
+// Culls large numbers of world space bounding volumes against a view frustum.
+//   -The bounds are kept in structure-of-arrays form (one array per component) so
+//    that one AVX instruction processes eight bounds at a time (four on the SSE path).
+//   -The frustum is given as world space planes (see Camera::GetFrustumPlanes()), so
+//    no per-object matrix inverse or frustum transform is needed.
+//   -The result is a compacted list of the indices of the visible bounds.
+//   -CullViews() tests every bound against up to 32 frusta (cube map faces, shadow
+//    cascades, the main camera) in one pass and returns a view bitmask per bound.
+//    Planes shared by several views, e.g., the side planes of adjacent cube faces,
+//    are evaluated only once per bound.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <array>
+#include <vector>
+
+class FrustumCuller
+{
+public:
+	FrustumCuller() = default;
+	FrustumCuller(const FrustumCuller& rhs) = delete;
+	FrustumCuller& operator=(const FrustumCuller& rhs) = delete;
+	~FrustumCuller() = default;
+
+	UINT BoundsCount()const;
+
+	void Clear();
+	void Reserve(UINT count);
+
+	// Append a world space bound and return its index.  Spheres are stored as
+	// their enclosing boxes.
+	UINT AddBox(const DirectX::BoundingBox& box);
+	UINT AddSphere(const DirectX::BoundingSphere& sphere);
+
+	// Replace the bound at the given index, e.g., after the object moved.
+	void SetBox(UINT index, const DirectX::BoundingBox& box);
+	void SetSphere(UINT index, const DirectX::BoundingSphere& sphere);
+
+	DirectX::BoundingBox GetBox(UINT index)const;
+
+	// Append count boxes: localBox placed by each of the world matrices, which are
+	// worldStride bytes apart (e.g., inside instance structs).  The boxes are
+	// transformed in one batch (see TransformKernels).  Returns the first index.
+	UINT AddBoxes(const DirectX::BoundingBox& localBox, const DirectX::XMFLOAT4X4* worlds, UINT worldStride, UINT count);
+
+	// Replace the count bounds from first on the same way, e.g., after instances moved.
+	void SetBoxes(UINT first, const DirectX::BoundingBox& localBox, const DirectX::XMFLOAT4X4* worlds, UINT worldStride, UINT count);
+
+	// Test every bound against the planes (inward facing, normalized) and write
+	// the indices of the bounds that are not completely outside to outVisible,
+	// which must have room for BoundsCount() indices.  Returns the visible count.
+	// Any number of planes may be given, e.g., extruded portal or cascade volumes.
+	UINT Cull(const std::array<DirectX::XMFLOAT4, 6>& planes, UINT* outVisible)const;
+	UINT Cull(const DirectX::XMFLOAT4* planes, UINT planeCount, UINT* outVisible)const;
+
+	// Test every bound against viewCount (at most MaxViews) frusta in one pass.  Bit v
+	// of outViewMasks[i] is set when bound i is not completely outside of view v;
+	// outViewMasks must have room for BoundsCount() masks.  If outViewLists is not
+	// null it must point to viewCount vectors, which are filled with the indices of
+	// the bounds visible from each view.  Returns the number of bounds visible from
+	// at least one view.
+	UINT CullViews(const std::array<DirectX::XMFLOAT4, 6>* viewPlanes, UINT viewCount,
+		UINT* outViewMasks, std::vector<UINT>* outViewLists = nullptr)const;
+
+	static const UINT MaxViews = 32;
+
+	// Returns true if the CPU and OS support AVX, in which case Cull() uses the
+	// eight wide path.
+	static bool AvxSupported();
+
+private:
+	UINT CullSse(const DirectX::XMFLOAT4* planes, UINT planeCount, UINT* outVisible)const;
+	UINT CullAvx(const DirectX::XMFLOAT4* planes, UINT planeCount, UINT* outVisible)const;
+
+	// A view plane refers to a unique plane, possibly with its normal flipped.
+	struct ViewPlane
+	{
+		BYTE Index;
+		BYTE Flipped;
+	};
+
+	struct ViewSetup
+	{
+		UINT UniqueCount = 0;
+		float Nx[MaxViews*6], Ny[MaxViews*6], Nz[MaxViews*6], Nd[MaxViews*6];
+		ViewPlane Planes[MaxViews][6];
+	};
+
+	static void SetupViews(const std::array<DirectX::XMFLOAT4, 6>* viewPlanes, UINT viewCount, ViewSetup& setup);
+	UINT CullViewsSse(const ViewSetup& setup, UINT viewCount, UINT* outViewMasks, std::vector<UINT>* outViewLists)const;
+	UINT CullViewsAvx(const ViewSetup& setup, UINT viewCount, UINT* outViewMasks, std::vector<UINT>* outViewLists)const;
+	UINT ScatterViewMasks(UINT first, UINT laneCount, const int* planeMasks, const ViewSetup& setup,
+		UINT viewCount, UINT* outViewMasks, std::vector<UINT>* outViewLists)const;
+
+private:
+
+	// Number of real bounds.  The arrays are padded to a multiple of 8 with
+	// boxes of negative extent that every plane rejects, so the SIMD loops
+	// never need a scalar tail.
+	UINT mCount = 0;
+
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+};
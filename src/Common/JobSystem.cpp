@@ -0,0 +1,299 @@
+//***************************************************************************************
+// JobSystem.cpp - Portable work-stealing job scheduler
+//***************************************************************************************
+
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <string>
+
+struct Job
+{
+	std::function<void()> Function;
+	JobCounter* Counter;
+};
+
+namespace
+{
+	// The system and deque of the calling thread, if it is a worker.
+	thread_local JobSystem* tSystem = nullptr;
+	thread_local std::uint32_t tWorker = 0;
+
+	// Where the calling thread starts looking for a job to steal.
+	thread_local std::uint32_t tVictim = 0;
+
+	// Failed searches before an idle worker goes to sleep.
+	const int SpinCount = 64;
+}
+
+bool JobCounter::IsDone()const
+{
+	return mPending.load() == 0;
+}
+
+//
+// WorkDeque, after "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Le, Pop, Cohen, Zappa Nardelli), without growing the array.
+//
+
+bool JobSystem::WorkDeque::Push(Job* job)
+{
+	std::int64_t b = mBottom.load(std::memory_order_relaxed);
+	std::int64_t t = mTop.load(std::memory_order_acquire);
+	if(b - t >= Capacity)
+		return false;
+
+	mJobs[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	mBottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* JobSystem::WorkDeque::Pop()
+{
+	std::int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+	mBottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t t = mTop.load(std::memory_order_relaxed);
+
+	if(t > b)
+	{
+		// Empty.
+		mBottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = mJobs[b & (Capacity - 1)].load(std::memory_order_relaxed);
+	if(t == b)
+	{
+		// The last job; race the thieves for it.
+		if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		mBottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* JobSystem::WorkDeque::Steal()
+{
+	std::int64_t t = mTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t b = mBottom.load(std::memory_order_acquire);
+	if(t >= b)
+		return nullptr;
+
+	Job* job = mJobs[t & (Capacity - 1)].load(std::memory_order_relaxed);
+	if(!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
+
+//
+// JobSystem
+//
+
+JobSystem::JobSystem(std::uint32_t workerCount)
+{
+	for(std::uint32_t i = 0; i < workerCount; ++i)
+		mDeques.push_back(std::make_unique<WorkDeque>());
+
+	for(std::uint32_t i = 0; i < workerCount; ++i)
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	mQuit = true;
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+	}
+	mWakeUp.notify_all();
+
+	for(auto& worker : mWorkers)
+		worker.join();
+
+	// Jobs nobody waited for.
+	for(auto& deque : mDeques)
+	{
+		while(Job* job = deque->Steal())
+			delete job;
+	}
+	for(Job* job : mSharedJobs)
+		delete job;
+}
+
+JobSystem& JobSystem::Default()
+{
+	static JobSystem system(std::thread::hardware_concurrency() > 1 ?
+		std::thread::hardware_concurrency() - 1 : 0);
+	return system;
+}
+
+std::uint32_t JobSystem::WorkerCount()const
+{
+	return (std::uint32_t)mWorkers.size();
+}
+
+void JobSystem::Run(std::function<void()> job, JobCounter* counter, JobCounter* dependency)
+{
+	Job* j = new Job{ std::move(job), counter };
+
+	if(counter != nullptr)
+		counter->mPending++;
+
+	if(dependency != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(dependency->mMutex);
+		if(dependency->mPending > 0)
+		{
+			dependency->mContinuations.push_back(j);
+			return;
+		}
+	}
+
+	Enqueue(j);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while(!counter.IsDone())
+	{
+		if(!RunOne())
+			std::this_thread::yield();
+	}
+
+	// The job that finished the counter may still hold its lock.
+	std::lock_guard<std::mutex> lock(counter.mMutex);
+}
+
+void JobSystem::Enqueue(Job* job)
+{
+	if(tSystem == this)
+	{
+		if(!mDeques[tWorker]->Push(job))
+		{
+			Execute(job);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(mSharedMutex);
+		mSharedJobs.push_back(job);
+		mSharedJobCount++;
+	}
+
+	// Wake a sleeping worker.  A worker that is about to sleep sees the new epoch.
+	mEpoch++;
+	if(mSleeperCount > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSleepMutex);
+		}
+		mWakeUp.notify_one();
+	}
+}
+
+void JobSystem::Execute(Job* job)
+{
+	{
+		PROFILE_SCOPE("Job");
+		job->Function();
+	}
+
+	JobCounter* counter = job->Counter;
+	delete job;
+
+	if(counter == nullptr)
+		return;
+
+	// Decrement under the lock, so a dependent job is either queued here or by
+	// Run(), and Wait() cannot return while the counter is still in use.
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter->mMutex);
+		if(--counter->mPending == 0)
+			ready.swap(counter->mContinuations);
+	}
+
+	for(Job* j : ready)
+		Enqueue(j);
+}
+
+bool JobSystem::RunOne()
+{
+	Job* job = FindJob();
+	if(job == nullptr)
+		return false;
+
+	Execute(job);
+	return true;
+}
+
+Job* JobSystem::FindJob()
+{
+	if(tSystem == this)
+	{
+		if(Job* job = mDeques[tWorker]->Pop())
+			return job;
+	}
+
+	if(mSharedJobCount > 0)
+	{
+		std::lock_guard<std::mutex> lock(mSharedMutex);
+		if(!mSharedJobs.empty())
+		{
+			Job* job = mSharedJobs.front();
+			mSharedJobs.pop_front();
+			mSharedJobCount--;
+			return job;
+		}
+	}
+
+	const std::uint32_t dequeCount = (std::uint32_t)mDeques.size();
+	for(std::uint32_t i = 0; i < dequeCount; ++i)
+	{
+		std::uint32_t victim = (tVictim + i) % dequeCount;
+		if(tSystem == this && victim == tWorker)
+			continue;
+
+		if(Job* job = mDeques[victim]->Steal())
+		{
+			// Come back to the same victim first; it likely has more.
+			tVictim = victim;
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::WorkerLoop(std::uint32_t worker)
+{
+	tSystem = this;
+	tWorker = worker;
+	tVictim = worker + 1;
+
+	PROFILE_THREAD_NAME("Job worker " + std::to_string(worker));
+
+	while(!mQuit)
+	{
+		std::uint64_t epoch = mEpoch;
+
+		bool found = false;
+		for(int i = 0; i < SpinCount && !found; ++i)
+		{
+			found = RunOne();
+			if(!found)
+				std::this_thread::yield();
+		}
+
+		if(found)
+			continue;
+
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		mSleeperCount++;
+		mWakeUp.wait(lock, [&]() { return mEpoch != epoch || mQuit; });
+		mSleeperCount--;
+	}
+}
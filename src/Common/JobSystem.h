@@ -0,0 +1,164 @@
+//***************************************************************************************
+// JobSystem.h - Portable work-stealing job scheduler
+//
+// One pool of worker threads for all CPU work of a demo (culling, skinning, sorting,
+// simulation, ...), built on the standard library only so it runs on Windows and Linux.
+//   -Every worker owns a Chase-Lev deque: it pushes and pops its own jobs at the
+//    bottom without locks, and idle workers steal from the top of the others.  Jobs
+//    started by any other thread (e.g., the main thread) go to a shared queue.
+//   -A JobCounter counts the unfinished jobs started with it.  A job can depend on
+//    a counter: it is only queued once that counter reaches zero.
+//   -Wait() runs queued jobs on the waiting thread until the counter is done, so
+//    the main thread works instead of blocking, and nested waits cannot deadlock.
+//   -ParallelFor() splits an index range into chunks of a grain size; a few jobs
+//    grab the chunks one at a time, so uneven chunks still balance.
+// Jobs must not throw.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+struct Job;
+
+// Number of unfinished jobs of a group.  Must outlive the jobs started with it.
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter& rhs) = delete;
+	JobCounter& operator=(const JobCounter& rhs) = delete;
+
+	bool IsDone()const;
+
+private:
+	friend class JobSystem;
+
+	std::atomic<std::uint32_t> mPending{ 0 };
+
+	// Jobs waiting for the counter to reach zero.
+	std::mutex mMutex;
+	std::vector<Job*> mContinuations;
+};
+
+class JobSystem
+{
+public:
+	// workerCount threads besides the threads that wait; 0 runs every job on the
+	// waiting thread.
+	explicit JobSystem(std::uint32_t workerCount);
+	JobSystem(const JobSystem& rhs) = delete;
+	JobSystem& operator=(const JobSystem& rhs) = delete;
+	~JobSystem();
+
+	// The pool shared by the demos, one worker per core besides the main thread.
+	static JobSystem& Default();
+
+	std::uint32_t WorkerCount()const;
+
+	// Queue job.  counter (optional) counts it until it has run; if dependency is
+	// given, the job is only queued once the dependency is done.
+	void Run(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Run queued jobs on the calling thread until counter is done.
+	void Wait(JobCounter& counter);
+
+	// Call body(i) for every i in [first, last) and return when all calls are done.
+	// The range is split into chunks of grainSize indices (0 picks about four
+	// chunks per thread); the calling thread runs chunks too.
+	template<typename Index, typename Body>
+	void ParallelFor(Index first, Index last, const Body& body, Index grainSize = 0);
+
+private:
+	// Fixed size Chase-Lev deque of job pointers.  Push() and Pop() are only called
+	// by the owning worker, Steal() by any thread.
+	class WorkDeque
+	{
+	public:
+		static const std::int64_t Capacity = 4096;
+
+		// False if full; the caller then runs the job itself.
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		alignas(64) std::atomic<std::int64_t> mTop{ 0 };
+		alignas(64) std::atomic<std::int64_t> mBottom{ 0 };
+		std::atomic<Job*> mJobs[Capacity];
+	};
+
+	void Enqueue(Job* job);
+	void Execute(Job* job);
+
+	// Run one queued job; false if none was found.
+	bool RunOne();
+	Job* FindJob();
+
+	void WorkerLoop(std::uint32_t worker);
+
+	std::vector<std::unique_ptr<WorkDeque>> mDeques;
+	std::vector<std::thread> mWorkers;
+
+	// Jobs queued by threads without a deque.
+	std::mutex mSharedMutex;
+	std::deque<Job*> mSharedJobs;
+	std::atomic<std::uint32_t> mSharedJobCount{ 0 };
+
+	// Idle workers sleep until the epoch changes, i.e., until a job is queued.
+	std::mutex mSleepMutex;
+	std::condition_variable mWakeUp;
+	std::atomic<std::uint64_t> mEpoch{ 0 };
+	std::atomic<std::uint32_t> mSleeperCount{ 0 };
+	std::atomic<bool> mQuit{ false };
+};
+
+template<typename Index, typename Body>
+void JobSystem::ParallelFor(Index first, Index last, const Body& body, Index grainSize)
+{
+	if(!(first < last))
+		return;
+
+	const std::uint64_t count = (std::uint64_t)(last - first);
+	const std::uint64_t grain = grainSize > 0 ? (std::uint64_t)grainSize :
+		(count + 4*(mWorkers.size() + 1) - 1) / (4*(mWorkers.size() + 1));
+	const std::uint32_t chunkCount = (std::uint32_t)((count + grain - 1) / grain);
+
+	if(chunkCount == 1 || mWorkers.empty())
+	{
+		for(Index i = first; i < last; ++i)
+			body(i);
+		return;
+	}
+
+	std::atomic<std::uint32_t> nextChunk{ 0 };
+	auto runChunks = [&]()
+	{
+		for(std::uint32_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+		{
+			const std::uint64_t begin = chunk*grain;
+			const std::uint64_t end = begin + grain < count ? begin + grain : count;
+			for(std::uint64_t k = begin; k < end; ++k)
+				body((Index)(first + k));
+		}
+	};
+
+	// One helper per worker at most; the calling thread is the last helper.
+	JobCounter counter;
+	const std::uint32_t helperCount = chunkCount - 1 < (std::uint32_t)mWorkers.size() ?
+		chunkCount - 1 : (std::uint32_t)mWorkers.size();
+	for(std::uint32_t h = 0; h < helperCount; ++h)
+		Run(runChunks, &counter);
+
+	runChunks();
+	Wait(counter);
+}
@@ -0,0 +1,22 @@
+//***************************************************************************************
+// Light.h - Light constants as the shaders read them
+//
+// Split out of d3dUtil.h (which includes it) so pass constants can be built
+// without D3D12, e.g., by the headless benchmarks.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+
+struct Light
+{
+    DirectX::XMFLOAT3 Strength = { 0.5f, 0.5f, 0.5f };
+    float FalloffStart = 1.0f;                          // point/spot light only
+    DirectX::XMFLOAT3 Direction = { 0.0f, -1.0f, 0.0f };// directional/spot light only
+    float FalloffEnd = 10.0f;                           // point/spot light only
+    DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };  // point/spot light only
+    float SpotPower = 64.0f;                            // spot light only
+};
+
+#define MaxLights 16
@@ -0,0 +1,381 @@
+//***************************************************************************************
+// LightClusters.cpp - CPU clustered light culling
+//***************************************************************************************
+
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <intrin.h>
+#include <emmintrin.h>
+#include <cassert>
+#include <chrono>
+
+using namespace DirectX;
+
+namespace
+{
+	// Bit i is set if the distance to plane i is at least -radius.  count planes,
+	// padded to a multiple of four.
+	std::uint64_t PlaneMask(const float* a, const float* b, UINT count, float p, float z, float radius)
+	{
+		const __m128 P = _mm_set1_ps(p);
+		const __m128 Z = _mm_set1_ps(z);
+		const __m128 R = _mm_set1_ps(-radius);
+
+		std::uint64_t mask = 0;
+		for(UINT i = 0; i < count; i += 4)
+		{
+			__m128 d = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), P), _mm_mul_ps(_mm_loadu_ps(b + i), Z));
+			mask |= (std::uint64_t)_mm_movemask_ps(_mm_cmpge_ps(d, R)) << i;
+		}
+
+		return mask;
+	}
+
+	// Tiles a sphere can touch: tile i lies between planes i and i + 1, so the
+	// sphere must not be fully behind plane i (distance >= -r) nor fully in front
+	// of plane i + 1 (not distance >= r).
+	UINT TileMask(const float* a, const float* b, UINT tileCount, float p, float z, float radius)
+	{
+		const UINT planeCount = (tileCount + 1 + 3) & ~3u;
+
+		std::uint64_t notBehind = PlaneMask(a, b, planeCount, p, z, radius);
+		std::uint64_t notInFront = ~PlaneMask(a, b, planeCount, p, z, -radius);
+
+		std::uint64_t mask = notBehind & (notInFront >> 1);
+		return (UINT)(mask & ((1ull << tileCount) - 1));
+	}
+
+	// Lanes of four cluster boxes [xLo, xHi] x [yLo, yHi] x [z0, z1] that a cone may
+	// touch, tested against the bounding spheres of the boxes: the distance from
+	// the sphere center to the cone's side, its far cap and the plane through the
+	// apex must all be within the sphere radius.
+	int ConeMask(const XMFLOAT3& apex, const XMFLOAT3& dir, float cosAngle, float sinAngle, float range,
+		__m128 xLo, __m128 xHi, float yLo, float yHi, float z0, float z1)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+
+		const float hy = 0.5f*(yHi - yLo);
+		const float hz = 0.5f*(z1 - z0);
+		const float vy = yLo + hy - apex.y;
+		const float vz = z0 + hz - apex.z;
+
+		__m128 hx = _mm_mul_ps(half, _mm_sub_ps(xHi, xLo));
+		__m128 vx = _mm_sub_ps(_mm_add_ps(xLo, hx), _mm_set1_ps(apex.x));
+		__m128 radius = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(hx, hx), _mm_set1_ps(hy*hy + hz*hz)));
+
+		__m128 along = _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(dir.x)), _mm_set1_ps(vy*dir.y + vz*dir.z));
+		__m128 lengthSq = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_set1_ps(vy*vy + vz*vz));
+		__m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(along, along)), _mm_setzero_ps()));
+
+		__m128 side = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(cosAngle), across), _mm_mul_ps(_mm_set1_ps(sinAngle), along));
+		__m128 inside = _mm_and_ps(_mm_cmple_ps(side, radius),
+			_mm_and_ps(_mm_cmple_ps(along, _mm_add_ps(_mm_set1_ps(range), radius)),
+				_mm_cmpge_ps(along, _mm_sub_ps(_mm_setzero_ps(), radius))));
+
+		return _mm_movemask_ps(inside);
+	}
+
+	float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<float, std::milli>(end - start).count();
+	}
+}
+
+void LightClusters::SetGrid(UINT tilesX, UINT tilesY, UINT slices, UINT maxIndexCount)
+{
+	assert(tilesX > 0 && tilesX <= MaxTiles);
+	assert(tilesY > 0 && tilesY <= MaxTiles);
+	assert(slices > 0);
+
+	mTilesX = tilesX;
+	mTilesY = tilesY;
+	mSlices = slices;
+	mMaxIndexCount = maxIndexCount;
+
+	mClusterRanges.assign(ClusterCount(), XMUINT2(0, 0));
+	mClusterCursors.assign(ClusterCount(), 0);
+	mLightIndices.assign(maxIndexCount, 0);
+}
+
+void LightClusters::SetProjection(float fovY, float aspect, float nearZ, float farZ)
+{
+	mNearZ = nearZ;
+	mFarZ = farZ;
+
+	const float tanHalfY = tanf(0.5f*fovY);
+	BuildPlanes(tanHalfY*aspect, mTilesX, 1.0f, mColumnA, mColumnB, mColumnSlopes);
+	BuildPlanes(tanHalfY, mTilesY, -1.0f, mRowA, mRowB, mRowSlopes);
+
+	mSliceScale = mSlices / logf(farZ / nearZ);
+	mSliceBias = -logf(nearZ)*mSliceScale;
+
+	mSliceDepths.resize(mSlices + 1);
+	for(UINT k = 0; k <= mSlices; ++k)
+		mSliceDepths[k] = nearZ*powf(farZ / nearZ, (float)k / mSlices);
+}
+
+void LightClusters::BuildPlanes(float tanHalf, UINT count, float sign, float* a, float* b, float* slopes)
+{
+	// Plane i passes through the eye and the edge of tile i at slope (x/z or y/z)
+	// s; its signed distance is sign*(p - s*z)/sqrt(1 + s^2).  Columns run left
+	// to right (sign 1), rows top to bottom (sign -1).
+	for(UINT i = 0; i <= count; ++i)
+	{
+		float s = sign*(-1.0f + 2.0f*i / count)*tanHalf;
+		float invLength = 1.0f / sqrtf(1.0f + s*s);
+
+		slopes[i] = s;
+		a[i] = sign*invLength;
+		b[i] = -sign*s*invLength;
+	}
+
+	for(UINT i = count + 1; i < MaxTiles + 4; ++i)
+	{
+		slopes[i] = 0.0f;
+		a[i] = 0.0f;
+		b[i] = 0.0f;
+	}
+}
+
+void LightClusters::Build(FXMMATRIX view, const LightBounds* lights, UINT lightCount)
+{
+	PROFILE_SCOPE("LightClusters::Build");
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	mStats = Stats();
+	mStats.LightCount = lightCount;
+
+	// The lights are assigned in chunks on the worker threads; every chunk
+	// collects its own (cluster, light) pairs.
+	const UINT chunkCount = (lightCount + ChunkLightCount - 1) / ChunkLightCount;
+	if(mChunks.size() < chunkCount)
+		mChunks.resize(chunkCount);
+
+	JobSystem::Default().ParallelFor(0u, chunkCount, [&](UINT chunkIndex)
+	{
+		PairList& chunk = mChunks[chunkIndex];
+		chunk.Clusters.clear();
+		chunk.Lights.clear();
+		chunk.VisibleLightCount = 0;
+
+		const UINT first = chunkIndex*ChunkLightCount;
+		const UINT last = MathHelper::Min(first + ChunkLightCount, lightCount);
+		for(UINT i = first; i < last; ++i)
+		{
+			const LightBounds& light = lights[i];
+
+			XMVECTOR apex = XMVector3TransformCoord(XMLoadFloat3(&light.Position), view);
+			XMVECTOR dir = XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&light.Direction), view));
+
+			ViewLight viewLight;
+			XMStoreFloat3(&viewLight.Apex, apex);
+			XMStoreFloat3(&viewLight.Direction, dir);
+			viewLight.Range = light.Range;
+			viewLight.CosAngle = light.SpotCosAngle;
+
+			// Bounding sphere of the cone: for wide cones the sphere through the
+			// rim, for narrow cones the sphere through the rim and the apex.
+			XMVECTOR center = apex;
+			viewLight.Radius = light.Range;
+			if(light.SpotCosAngle > 0.0f)
+			{
+				float cosAngle = light.SpotCosAngle;
+				float sinAngle = sqrtf(MathHelper::Max(0.0f, 1.0f - cosAngle*cosAngle));
+
+				if(cosAngle < 0.70710678f)
+				{
+					center = apex + (cosAngle*light.Range)*dir;
+					viewLight.Radius = sinAngle*light.Range;
+				}
+				else
+				{
+					viewLight.Radius = light.Range / (2.0f*cosAngle);
+					center = apex + viewLight.Radius*dir;
+				}
+			}
+			XMStoreFloat3(&viewLight.Center, center);
+
+			const std::size_t pairCount = chunk.Lights.size();
+			AssignLight(i, viewLight, chunk);
+
+			if(chunk.Lights.size() > pairCount)
+				++chunk.VisibleLightCount;
+		}
+	});
+
+	// Counting sort of the pairs by cluster.  The chunks are in light order, so
+	// the lights of every cluster stay sorted.
+	const UINT clusterCount = ClusterCount();
+	for(UINT c = 0; c < clusterCount; ++c)
+		mClusterRanges[c] = XMUINT2(0, 0);
+
+	for(UINT chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+	{
+		mStats.VisibleLightCount += mChunks[chunkIndex].VisibleLightCount;
+		for(UINT cluster : mChunks[chunkIndex].Clusters)
+			++mClusterRanges[cluster].y;
+	}
+
+	UINT offset = 0;
+	for(UINT c = 0; c < clusterCount; ++c)
+	{
+		XMUINT2& range = mClusterRanges[c];
+		mStats.MaxClusterLightCount = MathHelper::Max(mStats.MaxClusterLightCount, range.y);
+
+		UINT count = MathHelper::Min(range.y, mMaxIndexCount - offset);
+		mStats.DroppedIndexCount += range.y - count;
+
+		range = XMUINT2(offset, count);
+		mClusterCursors[c] = offset;
+		offset += count;
+	}
+
+	for(UINT chunkIndex = 0; chunkIndex < chunkCount; ++chunkIndex)
+	{
+		const PairList& chunk = mChunks[chunkIndex];
+		for(std::size_t p = 0; p < chunk.Clusters.size(); ++p)
+		{
+			const UINT cluster = chunk.Clusters[p];
+			const XMUINT2& range = mClusterRanges[cluster];
+			if(mClusterCursors[cluster] < range.x + range.y)
+				mLightIndices[mClusterCursors[cluster]++] = chunk.Lights[p];
+		}
+	}
+
+	mStats.IndexCount = offset;
+	mStats.BuildMs = ElapsedMs(start);
+}
+
+void LightClusters::AssignLight(UINT light, const ViewLight& l, PairList& out)const
+{
+	const XMFLOAT3& c = l.Center;
+	const float radius = l.Radius;
+
+	if(c.z + radius < mNearZ || c.z - radius > mFarZ)
+		return;
+
+	const UINT columns = TileMask(mColumnA, mColumnB, mTilesX, c.x, c.z, radius);
+	const UINT rows = TileMask(mRowA, mRowB, mTilesY, c.y, c.z, radius);
+	if(columns == 0 || rows == 0)
+		return;
+
+	auto slice = [this](float z)
+	{
+		float s = logf(MathHelper::Clamp(z, mNearZ, mFarZ))*mSliceScale + mSliceBias;
+		return (UINT)MathHelper::Clamp((int)s, 0, (int)mSlices - 1);
+	};
+
+	const UINT firstSlice = slice(c.z - radius);
+	const UINT lastSlice = slice(c.z + radius);
+
+	unsigned long firstColumn, lastColumn;
+	_BitScanForward(&firstColumn, (unsigned long)columns);
+	_BitScanReverse(&lastColumn, (unsigned long)columns);
+
+	// Cones of 90 degrees or more are tested as their sphere.
+	const bool spot = l.CosAngle > 0.0f;
+	const float sinAngle = sqrtf(MathHelper::Max(0.0f, 1.0f - l.CosAngle*l.CosAngle));
+
+	// Squared distance from the sphere center to [lo, hi] along one axis.
+	auto axisDistSq = [](float p, float lo, float hi)
+	{
+		float d = p < lo ? lo - p : (p > hi ? p - hi : 0.0f);
+		return d*d;
+	};
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 centerX = _mm_set1_ps(c.x);
+
+	for(UINT k = firstSlice; k <= lastSlice; ++k)
+	{
+		const float z0 = mSliceDepths[k];
+		const float z1 = mSliceDepths[k + 1];
+		const float dzSq = axisDistSq(c.z, z0, z1);
+		const __m128 Z0 = _mm_set1_ps(z0);
+		const __m128 Z1 = _mm_set1_ps(z1);
+
+		unsigned long j;
+		for(UINT rowBits = rows; _BitScanForward(&j, (unsigned long)rowBits); rowBits &= rowBits - 1)
+		{
+			// Row j is between the top plane j and bottom plane j + 1.
+			const float yLo = MathHelper::Min(mRowSlopes[j + 1]*z0, mRowSlopes[j + 1]*z1);
+			const float yHi = MathHelper::Max(mRowSlopes[j]*z0, mRowSlopes[j]*z1);
+			const float dyzSq = dzSq + axisDistSq(c.y, yLo, yHi);
+			if(dyzSq > radius*radius)
+				continue;
+
+			// Sphere (and cone) against the boxes of four columns at a time; only
+			// the x extents differ between them.
+			const __m128 remainingSq = _mm_set1_ps(radius*radius - dyzSq);
+			for(UINT first = firstColumn; first <= lastColumn; first += 4)
+			{
+				__m128 left = _mm_loadu_ps(mColumnSlopes + first);
+				__m128 right = _mm_loadu_ps(mColumnSlopes + first + 1);
+				__m128 xLo = _mm_min_ps(_mm_mul_ps(left, Z0), _mm_mul_ps(left, Z1));
+				__m128 xHi = _mm_max_ps(_mm_mul_ps(right, Z0), _mm_mul_ps(right, Z1));
+
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(xLo, centerX), _mm_sub_ps(centerX, xHi)), zero);
+				UINT hits = (UINT)_mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), remainingSq));
+				hits &= columns >> first;
+
+				if(spot && hits != 0)
+					hits &= ConeMask(l.Apex, l.Direction, l.CosAngle, sinAngle, l.Range, xLo, xHi, yLo, yHi, z0, z1);
+
+				unsigned long bit;
+				for(; _BitScanForward(&bit, (unsigned long)hits); hits &= hits - 1)
+				{
+					out.Clusters.push_back(ClusterIndex(first + bit, j, k));
+					out.Lights.push_back(light);
+				}
+			}
+		}
+	}
+}
+
+UINT LightClusters::TilesX()const
+{
+	return mTilesX;
+}
+
+UINT LightClusters::TilesY()const
+{
+	return mTilesY;
+}
+
+UINT LightClusters::SliceCount()const
+{
+	return mSlices;
+}
+
+UINT LightClusters::ClusterCount()const
+{
+	return mTilesX*mTilesY*mSlices;
+}
+
+UINT LightClusters::ClusterIndex(UINT tileX, UINT tileY, UINT slice)const
+{
+	return (slice*mTilesY + tileY)*mTilesX + tileX;
+}
+
+XMFLOAT2 LightClusters::SliceScaleBias()const
+{
+	return XMFLOAT2(mSliceScale, mSliceBias);
+}
+
+const std::vector<XMUINT2>& LightClusters::ClusterRanges()const
+{
+	return mClusterRanges;
+}
+
+const std::vector<UINT>& LightClusters::LightIndices()const
+{
+	return mLightIndices;
+}
+
+const LightClusters::Stats& LightClusters::GetStats()const
+{
+	return mStats;
+}
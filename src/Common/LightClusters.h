@@ -0,0 +1,141 @@
+//***************************************************************************************
+// LightClusters.h - CPU clustered light culling
+//
+// Splits the view frustum into a grid of clusters (screen tiles times depth slices)
+// and lists the point and spot lights that reach each cluster, so a pixel shader
+// only loops over the lights of its own cluster instead of a fixed light array.
+//   -Depth slices are exponential: slice k ends at nearZ*(farZ/nearZ)^((k+1)/slices),
+//    so clusters stay roughly cube shaped at every distance.
+//   -A light is first bounded by the tile planes: the signed distances of its
+//    bounding sphere to every column (row) plane are computed four planes per SSE
+//    instruction, giving the columns (rows) it can touch as a bit mask.  Only the
+//    clusters left are tested exactly, spheres against the cluster box and cones
+//    against the cluster bounding sphere.
+//   -Lights are assigned in chunks on the worker threads; a counting sort then
+//    merges the chunks without changing the light order inside a cluster.
+//   -The result is one (offset, count) range per cluster into a single light index
+//    list, both ready to be copied into structured buffers.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <vector>
+
+class LightClusters
+{
+public:
+	// Tile counts are limited by the width of the plane masks.
+	static const UINT MaxTiles = 32;
+
+	// The culling shape of a light in world space: a cone with its apex at
+	// Position, opening SpotCosAngle around Direction and ending at Range.  A
+	// point light is the cone with SpotCosAngle = -1, i.e., the full sphere.
+	struct LightBounds
+	{
+		DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		float Range = 1.0f;
+		DirectX::XMFLOAT3 Direction = { 0.0f, 0.0f, 1.0f };
+		float SpotCosAngle = -1.0f;
+	};
+
+	struct Stats
+	{
+		UINT LightCount = 0;
+		UINT VisibleLightCount = 0;     // Lights in at least one cluster.
+		UINT IndexCount = 0;
+		UINT DroppedIndexCount = 0;     // Lost because the index list was full.
+		UINT MaxClusterLightCount = 0;
+		float BuildMs = 0.0f;
+	};
+
+	// Size the grid.  maxIndexCount is the capacity of the light index list (the
+	// size of the index buffer); if the lights need more, the clusters at the end
+	// of the list get only part of their lights.
+	void SetGrid(UINT tilesX, UINT tilesY, UINT slices, UINT maxIndexCount);
+
+	// Set the perspective projection of the view, as Camera::SetLens takes it.
+	// Call again after SetGrid().
+	void SetProjection(float fovY, float aspect, float nearZ, float farZ);
+
+	// Assign lightCount lights to the clusters of the view.
+	void Build(DirectX::FXMMATRIX view, const LightBounds* lights, UINT lightCount);
+
+	UINT TilesX()const;
+	UINT TilesY()const;
+	UINT SliceCount()const;
+	UINT ClusterCount()const;
+
+	// The cluster of a tile and slice is (slice*TilesY() + tileY)*TilesX() + tileX;
+	// tile (0, 0) is at the top left of the screen.
+	UINT ClusterIndex(UINT tileX, UINT tileY, UINT slice)const;
+
+	// The slice of view depth z is floor(log(z)*scale + bias), clamped to the
+	// slices; returns (scale, bias) for the shader.
+	DirectX::XMFLOAT2 SliceScaleBias()const;
+
+	// Per cluster (offset, count) into LightIndices(); ClusterCount() elements.
+	const std::vector<DirectX::XMUINT2>& ClusterRanges()const;
+
+	// Light indices of all clusters; only the first GetStats().IndexCount are used.
+	const std::vector<UINT>& LightIndices()const;
+
+	const Stats& GetStats()const;
+
+private:
+	// A light in view space with its bounding sphere.
+	struct ViewLight
+	{
+		DirectX::XMFLOAT3 Center;
+		float Radius;
+		DirectX::XMFLOAT3 Apex;
+		float Range;
+		DirectX::XMFLOAT3 Direction;
+		float CosAngle;
+	};
+
+	// (cluster, light) pairs of a chunk of lights, in light order.
+	struct PairList
+	{
+		std::vector<UINT> Clusters;
+		std::vector<UINT> Lights;
+		UINT VisibleLightCount = 0;
+	};
+
+	// Lights assigned by one task.
+	static const UINT ChunkLightCount = 64;
+
+	void AssignLight(UINT light, const ViewLight& l, PairList& out)const;
+	void BuildPlanes(float tanHalf, UINT count, float sign, float* a, float* b, float* slopes);
+
+	UINT mTilesX = 16;
+	UINT mTilesY = 9;
+	UINT mSlices = 24;
+	UINT mMaxIndexCount = 0;
+
+	float mNearZ = 1.0f;
+	float mFarZ = 1000.0f;
+	float mSliceScale = 0.0f;
+	float mSliceBias = 0.0f;
+
+	// Tile plane i is a*p.x + b*p.z = 0 for columns (a*p.y + b*p.z for rows),
+	// normalized and facing into tile i, padded to a multiple of four with zeros.
+	// The slopes are the x/z (y/z) of the planes, for the cluster bounds.
+	float mColumnA[MaxTiles + 4];
+	float mColumnB[MaxTiles + 4];
+	float mRowA[MaxTiles + 4];
+	float mRowB[MaxTiles + 4];
+	float mColumnSlopes[MaxTiles + 4];
+	float mRowSlopes[MaxTiles + 4];
+
+	// Start depth of every slice, plus farZ.
+	std::vector<float> mSliceDepths;
+
+	std::vector<PairList> mChunks;
+
+	std::vector<DirectX::XMUINT2> mClusterRanges;
+	std::vector<UINT> mClusterCursors;
+	std::vector<UINT> mLightIndices;
+
+	Stats mStats;
+};
@@ -0,0 +1,231 @@
+//***************************************************************************************
+// LodGroup.cpp - Screen space size driven level of detail selection
+//***************************************************************************************
+
+#include "LodGroup.h"
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace DirectX;
+
+void LodGroup::AddLevel(UINT indexCount, UINT startIndexLocation, int baseVertexLocation, float minScreenSize)
+{
+	assert(mLevelCount < MaxLevels);
+	assert(mLevelCount == 0 || minScreenSize <= mLevels[mLevelCount - 1].MinScreenSize);
+
+	Level& level = mLevels[mLevelCount++];
+	level.IndexCount = indexCount;
+	level.StartIndexLocation = startIndexLocation;
+	level.BaseVertexLocation = baseVertexLocation;
+	level.MinScreenSize = minScreenSize;
+}
+
+void LodGroup::Clear()
+{
+	mLevelCount = 0;
+}
+
+UINT LodGroup::LevelCount()const
+{
+	return mLevelCount;
+}
+
+const LodGroup::Level& LodGroup::GetLevel(UINT level)const
+{
+	assert(level < mLevelCount);
+
+	return mLevels[level];
+}
+
+void LodGroup::SetHysteresis(float hysteresis)
+{
+	mHysteresis = hysteresis;
+}
+
+UINT LodGroup::SelectLevel(float screenSize, UINT currentLevel)const
+{
+	UINT level = MathHelper::Min(currentLevel, mLevelCount - 1);
+
+	// Move to a finer level once clearly above its threshold...
+	while(level > 0 && screenSize > mLevels[level - 1].MinScreenSize*(1.0f + mHysteresis))
+		--level;
+
+	// ...or to a coarser one once clearly below the current threshold.
+	while(level + 1 < mLevelCount && screenSize < mLevels[level].MinScreenSize*(1.0f - mHysteresis))
+		++level;
+
+	return level;
+}
+
+void LodGroup::Select(const UINT* ids, UINT count, const BoundingSphere* worldSpheres,
+	FXMVECTOR eyePosW, float pixelScale, BYTE* currentLevels,
+	UINT* outSortedIds, UINT* outLevelCounts)const
+{
+	assert(mLevelCount > 0);
+
+	std::fill(outLevelCounts, outLevelCounts + mLevelCount, 0);
+
+	for(UINT v = 0; v < count; ++v)
+	{
+		UINT i = ids[v];
+
+		float screenSize = ScreenSize(worldSpheres[i], eyePosW, pixelScale);
+		currentLevels[i] = (BYTE)SelectLevel(screenSize, currentLevels[i]);
+		outLevelCounts[currentLevels[i]]++;
+	}
+
+	// Counting sort by level.
+	UINT levelOffsets[MaxLevels];
+	UINT offset = 0;
+	for(UINT l = 0; l < mLevelCount; ++l)
+	{
+		levelOffsets[l] = offset;
+		offset += outLevelCounts[l];
+	}
+
+	for(UINT v = 0; v < count; ++v)
+	{
+		UINT i = ids[v];
+		outSortedIds[levelOffsets[currentLevels[i]]++] = i;
+	}
+}
+
+float LodGroup::PixelScale(CXMMATRIX proj, float viewportHeight)
+{
+	// proj(1,1) = 1/tan(fovY/2) maps view space y/z to [-1,1], which covers
+	// viewportHeight pixels.
+	XMFLOAT4X4 P;
+	XMStoreFloat4x4(&P, proj);
+
+	return 0.5f*P(1, 1)*viewportHeight;
+}
+
+float LodGroup::ScreenSize(const BoundingSphere& worldSphere, FXMVECTOR eyePosW, float pixelScale)
+{
+	XMVECTOR center = XMLoadFloat3(&worldSphere.Center);
+	float dist = XMVectorGetX(XMVector3Length(center - eyePosW));
+
+	// Inside the sphere it covers the whole screen.
+	if(dist <= worldSphere.Radius)
+		return MathHelper::Infinity;
+
+	return 2.0f*worldSphere.Radius*pixelScale / dist;
+}
+
+std::vector<std::int32_t> LodGroup::SimplifyByClustering(const void* positions, UINT positionStride, UINT vertexCount,
+	const std::int32_t* indices, UINT indexCount, float cellSize)
+{
+	assert(cellSize > 0.0f);
+	assert(vertexCount < (1u << 21));
+
+	auto position = [&](UINT i)
+	{
+		return *reinterpret_cast<const XMFLOAT3*>(static_cast<const BYTE*>(positions) + i*positionStride);
+	};
+
+	XMFLOAT3 vMin(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		XMFLOAT3 p = position(i);
+		vMin.x = MathHelper::Min(vMin.x, p.x);
+		vMin.y = MathHelper::Min(vMin.y, p.y);
+		vMin.z = MathHelper::Min(vMin.z, p.z);
+	}
+
+	//
+	// Assign the vertices to grid cells and average the vertices of each cell.
+	//
+
+	struct Cell
+	{
+		XMFLOAT3 Sum = { 0.0f, 0.0f, 0.0f };
+		UINT Count = 0;
+		UINT Representative = 0;
+		float BestDistSq = MathHelper::Infinity;
+	};
+
+	std::unordered_map<std::uint64_t, UINT> cellLookup;
+	std::vector<Cell> cells;
+	std::vector<UINT> vertexCell(vertexCount);
+
+	const float invCellSize = 1.0f / cellSize;
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		XMFLOAT3 p = position(i);
+		std::uint64_t cx = (std::uint64_t)((p.x - vMin.x)*invCellSize);
+		std::uint64_t cy = (std::uint64_t)((p.y - vMin.y)*invCellSize);
+		std::uint64_t cz = (std::uint64_t)((p.z - vMin.z)*invCellSize);
+		std::uint64_t key = ((cx & 0x1fffff) << 42) | ((cy & 0x1fffff) << 21) | (cz & 0x1fffff);
+
+		auto it = cellLookup.find(key);
+		if(it == cellLookup.end())
+		{
+			it = cellLookup.emplace(key, (UINT)cells.size()).first;
+			cells.push_back(Cell());
+		}
+
+		Cell& cell = cells[it->second];
+		cell.Sum.x += p.x;
+		cell.Sum.y += p.y;
+		cell.Sum.z += p.z;
+		cell.Count++;
+
+		vertexCell[i] = it->second;
+	}
+
+	// Keep the vertex nearest to the average of its cell, so the representative
+	// brings along a sensible normal and texture coordinate.
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		Cell& cell = cells[vertexCell[i]];
+		XMFLOAT3 p = position(i);
+
+		float dx = p.x - cell.Sum.x / cell.Count;
+		float dy = p.y - cell.Sum.y / cell.Count;
+		float dz = p.z - cell.Sum.z / cell.Count;
+		float distSq = dx*dx + dy*dy + dz*dz;
+
+		if(distSq < cell.BestDistSq)
+		{
+			cell.BestDistSq = distSq;
+			cell.Representative = i;
+		}
+	}
+
+	//
+	// Remap the triangles, dropping the ones that collapsed and duplicates.
+	//
+
+	std::vector<std::int32_t> simplified;
+	std::unordered_set<std::uint64_t> emitted;
+	for(UINT t = 0; t + 2 < indexCount; t += 3)
+	{
+		std::int32_t a = (std::int32_t)cells[vertexCell[indices[t + 0]]].Representative;
+		std::int32_t b = (std::int32_t)cells[vertexCell[indices[t + 1]]].Representative;
+		std::int32_t c = (std::int32_t)cells[vertexCell[indices[t + 2]]].Representative;
+
+		if(a == b || b == c || a == c)
+			continue;
+
+		// Rotate the smallest index first, keeping the winding, to detect duplicates.
+		while(a > b || a > c)
+		{
+			std::int32_t tmp = a;
+			a = b;
+			b = c;
+			c = tmp;
+		}
+
+		std::uint64_t key = ((std::uint64_t)a << 42) | ((std::uint64_t)b << 21) | (std::uint64_t)c;
+		if(!emitted.insert(key).second)
+			continue;
+
+		simplified.push_back(a);
+		simplified.push_back(b);
+		simplified.push_back(c);
+	}
+
+	return simplified;
+}
@@ -0,0 +1,86 @@
+//***************************************************************************************
+// LodGroup.h - Screen space size driven level of detail selection
+//
+// A LodGroup holds the submesh ranges of the detail levels of a mesh, finest
+// first, each with the smallest projected size (bounding sphere diameter in
+// pixels) at which it is still used.
+//   -Selection is done for a whole list of visible instances at once and sorts
+//    them by level, so that each level can be drawn as its own instanced draw
+//    from a contiguous range of the instance buffer.
+//   -Each instance remembers its current level, and only switches to another
+//    level once its size is past the threshold by the hysteresis fraction, so
+//    instances hovering around a threshold do not flicker between levels.
+//   -SimplifyByClustering() builds coarser index lists on the existing vertex
+//    buffer by vertex clustering, so all levels share one vertex buffer.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <vector>
+
+class LodGroup
+{
+public:
+	static const UINT MaxLevels = 8;
+
+	struct Level
+	{
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+		int BaseVertexLocation = 0;
+
+		// Smallest projected diameter, in pixels, at which this level is used.
+		float MinScreenSize = 0.0f;
+	};
+
+	LodGroup() = default;
+	LodGroup(const LodGroup& rhs) = default;
+	LodGroup& operator=(const LodGroup& rhs) = default;
+	~LodGroup() = default;
+
+	// Levels must be added finest first, with decreasing MinScreenSize.  The
+	// last level is used below its MinScreenSize as well.
+	void AddLevel(UINT indexCount, UINT startIndexLocation, int baseVertexLocation, float minScreenSize);
+	void Clear();
+
+	UINT LevelCount()const;
+	const Level& GetLevel(UINT level)const;
+
+	// Fraction a projected size must exceed a threshold by before the level
+	// changes.  Defaults to 0.1.
+	void SetHysteresis(float hysteresis);
+
+	// Returns the level to use for an object of the given projected size that
+	// currently uses currentLevel.
+	UINT SelectLevel(float screenSize, UINT currentLevel)const;
+
+	// Select the level of each of the count objects in ids (indices into
+	// worldSpheres and currentLevels) seen from eyePosW.  currentLevels is
+	// updated, and the ids are written to outSortedIds grouped by level, finest
+	// first, with outLevelCounts[l] (room for LevelCount()) objects per level.
+	void Select(const UINT* ids, UINT count, const DirectX::BoundingSphere* worldSpheres,
+		DirectX::FXMVECTOR eyePosW, float pixelScale, BYTE* currentLevels,
+		UINT* outSortedIds, UINT* outLevelCounts)const;
+
+	// Projected diameter in pixels of a sphere at distance dist is
+	// 2 * radius * pixelScale / dist with pixelScale computed from the projection
+	// matrix and the viewport height.
+	static float PixelScale(DirectX::CXMMATRIX proj, float viewportHeight);
+	static float ScreenSize(const DirectX::BoundingSphere& worldSphere, DirectX::FXMVECTOR eyePosW, float pixelScale);
+
+	// Simplify a triangle list by snapping its vertices to a grid of the given cell
+	// size: each cell keeps the vertex nearest to the cell's vertex average and the
+	// triangles that collapse are dropped.  The returned indices refer to the
+	// original vertices.  positions points to the first position and consecutive
+	// positions are positionStride bytes apart.
+	static std::vector<std::int32_t> SimplifyByClustering(const void* positions, UINT positionStride, UINT vertexCount,
+		const std::int32_t* indices, UINT indexCount, float cellSize);
+
+private:
+	UINT mLevelCount = 0;
+	Level mLevels[MaxLevels];
+
+	float mHysteresis = 0.1f;
+};
@@ -5,12 +5,49 @@
 #include "MathHelper.h"
 #include <float.h>
 #include <cmath>
+#include <atomic>
+#include <cassert>
 
 using namespace DirectX;
 
 const float MathHelper::Infinity = FLT_MAX;
 const float MathHelper::Pi       = 3.1415926535f;
 
+namespace
+{
+	std::uint32_t ReverseBits(std::uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+		x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+		x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+		x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+		return x;
+	}
+
+	std::uint64_t SplitMix64(std::uint64_t& x)
+	{
+		std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27))*0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// Tangents t and s completing the unit vector n to an orthonormal basis, from
+	// Duff et al., "Building an Orthonormal Basis, Revisited".
+	void OrthonormalBasis(FXMVECTOR n, XMVECTOR& t, XMVECTOR& s)
+	{
+		XMFLOAT3 v;
+		XMStoreFloat3(&v, n);
+
+		float sign = v.z >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (sign + v.z);
+		float b = v.x*v.y*a;
+		t = XMVectorSet(1.0f + sign*v.x*v.x*a, sign*b, -sign*v.x, 0.0f);
+		s = XMVectorSet(b, sign + v.y*v.y*a, -v.y, 0.0f);
+	}
+}
+
 float MathHelper::AngleFromXY(float x, float y)
 {
 	float theta = 0.0f;
@@ -33,50 +70,345 @@ float MathHelper::AngleFromXY(float x, float y)
 	return theta;
 }
 
+void MathHelper::ExtractFrustumPlanes(CXMMATRIX viewProj, XMFLOAT4 outPlanes[6])
+{
+	// Gribb/Hartmann plane extraction.  With row vectors, a point p is inside
+	// the clip volume when -w <= x <= w, -w <= y <= w and 0 <= z <= w, where
+	// (x, y, z, w) = p*M.  Each inequality is a dot product of p with a 
+	// combination of the columns of M, so we work on the transpose.
+	XMMATRIX M = XMMatrixTranspose(viewProj);
+
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(M.r[3], M.r[0]),      // left
+		XMVectorSubtract(M.r[3], M.r[0]), // right
+		XMVectorAdd(M.r[3], M.r[1]),      // bottom
+		XMVectorSubtract(M.r[3], M.r[1]), // top
+		M.r[2],                           // near
+		XMVectorSubtract(M.r[3], M.r[2])  // far
+	};
+
+	for(int i = 0; i < 6; ++i)
+		XMStoreFloat4(&outPlanes[i], XMPlaneNormalize(planes[i]));
+}
+
 XMVECTOR MathHelper::RandUnitVec3()
 {
-	XMVECTOR One  = XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f);
-	XMVECTOR Zero = XMVectorZero();
+	return ThreadRandom().NextUnitVec3();
+}
+
+XMVECTOR MathHelper::RandHemisphereUnitVec3(XMVECTOR n)
+{
+	return ThreadRandom().NextHemisphereUnitVec3(n);
+}
+
+RandomGenerator& MathHelper::ThreadRandom()
+{
+	static std::atomic<std::uint64_t> nextStream(0);
+
+	thread_local RandomGenerator generator(0, nextStream++);
+
+	return generator;
+}
+
+void MathHelper::SeedRandom(std::uint64_t seed, std::uint64_t stream)
+{
+	ThreadRandom().Seed(seed, stream);
+}
+
+float MathHelper::Halton(std::uint32_t index, std::uint32_t base)
+{
+	assert(base >= 2);
+
+	if(base == 2)
+		return ReverseBits(index) * (1.0f / 4294967296.0f);
 
-	// Keep trying until we get a point on/in the hemisphere.
-	while(true)
+	const float invBase = 1.0f / base;
+
+	float result = 0.0f;
+	float f = invBase;
+	for(std::uint32_t i = index; i > 0; i /= base)
 	{
-		// Generate random point in the cube [-1,1]^3.
-		XMVECTOR v = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+		result += f*(i % base);
+		f *= invBase;
+	}
 
-		// Ignore points outside the unit sphere in order to get an even distribution 
-		// over the unit sphere.  Otherwise points will clump more on the sphere near 
-		// the corners of the cube.
+	return result;
+}
+
+void MathHelper::HaltonSequence(XMFLOAT2* out, std::uint32_t count, std::uint32_t index)
+{
+	for(std::uint32_t i = 0; i < count; ++i)
+	{
+		out[i].x = Halton(index + i, 2);
+		out[i].y = Halton(index + i, 3);
+	}
+}
 
-		if( XMVector3Greater( XMVector3LengthSq(v), One) )
-			continue;
+XMFLOAT2 MathHelper::Sobol2D(std::uint32_t index, std::uint32_t scramble)
+{
+	// The first dimension is the van der Corput sequence.  The second has the
+	// direction numbers of the polynomial x + 1, which double as a running XOR.
+	std::uint32_t x = ReverseBits(index);
 
-		return XMVector3Normalize(v);
+	std::uint32_t y = 0;
+	for(std::uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+	{
+		if(index & 1)
+			y ^= v;
 	}
+
+	x ^= scramble;
+	y ^= scramble*0x9e3779b9u;
+
+	return XMFLOAT2((x >> 8)*(1.0f / 16777216.0f), (y >> 8)*(1.0f / 16777216.0f));
 }
 
-XMVECTOR MathHelper::RandHemisphereUnitVec3(XMVECTOR n)
+void MathHelper::SobolSequence(XMFLOAT2* out, std::uint32_t count, std::uint32_t index, std::uint32_t scramble)
+{
+	for(std::uint32_t i = 0; i < count; ++i)
+		out[i] = Sobol2D(index + i, scramble);
+}
+
+XMVECTOR MathHelper::CosineHemisphereUnitVec3(FXMVECTOR n, float u1, float u2)
+{
+	// Uniform on the unit disk, then projected up onto the hemisphere (Malley).
+	float r = sqrtf(u1);
+	float phi = 2.0f*Pi*u2;
+
+	XMVECTOR t, s;
+	OrthonormalBasis(n, t, s);
+
+	return r*cosf(phi)*t + r*sinf(phi)*s + sqrtf(Max(0.0f, 1.0f - u1))*n;
+}
+
+RandomGenerator::RandomGenerator(std::uint64_t seed, std::uint64_t stream)
+{
+	Seed(seed, stream);
+}
+
+void RandomGenerator::Seed(std::uint64_t seed, std::uint64_t stream)
 {
-	XMVECTOR One  = XMVectorSet(1.0f, 1.0f, 1.0f, 1.0f);
-	XMVECTOR Zero = XMVectorZero();
+	// PCG32 seeding as in the reference implementation.
+	mState = 0;
+	mIncrement = (stream << 1) | 1;
+	NextUInt();
+	mState += seed;
+	NextUInt();
 
-	// Keep trying until we get a point on/in the hemisphere.
-	while(true)
+	// The SIMD generators get their state from SplitMix64, which never gives
+	// the all zero state xoshiro cannot leave in practice.
+	std::uint64_t x = seed ^ (stream*0xda942042e4dd58b5ull);
+
+	alignas(16) std::uint32_t words[4][4];
+	for(int lane = 0; lane < 4; ++lane)
 	{
-		// Generate random point in the cube [-1,1]^3.
-		XMVECTOR v = XMVectorSet(MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f), 0.0f);
+		for(int k = 0; k < 4; k += 2)
+		{
+			std::uint64_t z = SplitMix64(x);
+			words[k][lane] = (std::uint32_t)z;
+			words[k + 1][lane] = (std::uint32_t)(z >> 32);
+		}
+	}
 
-		// Ignore points outside the unit sphere in order to get an even distribution 
-		// over the unit sphere.  Otherwise points will clump more on the sphere near 
-		// the corners of the cube.
-		
-		if( XMVector3Greater( XMVector3LengthSq(v), One) )
-			continue;
+	for(int k = 0; k < 4; ++k)
+		mSimdState[k] = _mm_load_si128(reinterpret_cast<const __m128i*>(words[k]));
+}
+
+std::uint32_t RandomGenerator::NextUInt()
+{
+	std::uint64_t old = mState;
+	mState = old*6364136223846793005ull + mIncrement;
 
-		// Ignore points in the bottom hemisphere.
-		if( XMVector3Less( XMVector3Dot(n, v), Zero ) )
-			continue;
+	std::uint32_t xorShifted = (std::uint32_t)(((old >> 18) ^ old) >> 27);
+	std::uint32_t rot = (std::uint32_t)(old >> 59);
+	return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+}
 
-		return XMVector3Normalize(v);
+std::uint32_t RandomGenerator::NextUInt(std::uint32_t bound)
+{
+	assert(bound > 0);
+
+	// Lemire's multiply and reject: the high word of x*bound is uniform in
+	// [0, bound) once the low words that wrap unevenly are rejected.
+	std::uint64_t m = std::uint64_t(NextUInt())*bound;
+	std::uint32_t low = (std::uint32_t)m;
+	if(low < bound)
+	{
+		const std::uint32_t threshold = (0u - bound) % bound;
+		while(low < threshold)
+		{
+			m = std::uint64_t(NextUInt())*bound;
+			low = (std::uint32_t)m;
+		}
 	}
-}
\ No newline at end of file
+
+	return (std::uint32_t)(m >> 32);
+}
+
+float RandomGenerator::NextFloat()
+{
+	return (NextUInt() >> 8)*(1.0f / 16777216.0f);
+}
+
+float RandomGenerator::NextFloat(float a, float b)
+{
+	return a + NextFloat()*(b - a);
+}
+
+int RandomGenerator::NextInt(int a, int b)
+{
+	assert(a <= b);
+
+	return a + (int)NextUInt((std::uint32_t)(b - a) + 1);
+}
+
+XMVECTOR RandomGenerator::NextUnitVec3()
+{
+	// z is uniform in [-1, 1] on the unit sphere (Archimedes), so no rejection.
+	float z = 1.0f - 2.0f*NextFloat();
+	float phi = 2.0f*MathHelper::Pi*NextFloat();
+	float r = sqrtf(MathHelper::Max(0.0f, 1.0f - z*z));
+
+	return XMVectorSet(r*cosf(phi), r*sinf(phi), z, 0.0f);
+}
+
+XMVECTOR RandomGenerator::NextHemisphereUnitVec3(FXMVECTOR n)
+{
+	XMVECTOR v = NextUnitVec3();
+
+	// Mirroring the bottom half onto the top keeps the distribution uniform.
+	return XMVectorGetX(XMVector3Dot(n, v)) < 0.0f ? -v : v;
+}
+
+XMVECTOR RandomGenerator::NextCosineHemisphereUnitVec3(FXMVECTOR n)
+{
+	float u1 = NextFloat();
+	float u2 = NextFloat();
+
+	return MathHelper::CosineHemisphereUnitVec3(n, u1, u2);
+}
+
+XMVECTOR RandomGenerator::NextFloat4()
+{
+	__m128i s0 = mSimdState[0];
+	__m128i s1 = mSimdState[1];
+	__m128i s2 = mSimdState[2];
+	__m128i s3 = mSimdState[3];
+
+	__m128i result = _mm_add_epi32(s0, s3);
+
+	__m128i t = _mm_slli_epi32(s1, 9);
+	s2 = _mm_xor_si128(s2, s0);
+	s3 = _mm_xor_si128(s3, s1);
+	s1 = _mm_xor_si128(s1, s2);
+	s0 = _mm_xor_si128(s0, s3);
+	s2 = _mm_xor_si128(s2, t);
+	s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+	mSimdState[0] = s0;
+	mSimdState[1] = s1;
+	mSimdState[2] = s2;
+	mSimdState[3] = s3;
+
+	// The top 23 bits as the mantissa of a float in [1, 2).  The low bits of
+	// xoshiro128+ are its weak ones, so they are the ones dropped.
+	__m128i mantissa = _mm_or_si128(_mm_srli_epi32(result, 9), _mm_set1_epi32(0x3f800000));
+	return XMVectorSubtract(_mm_castsi128_ps(mantissa), g_XMOne);
+}
+
+void RandomGenerator::FillFloats(float* out, std::uint32_t count, float a, float b)
+{
+	const XMVECTOR scale = XMVectorReplicate(b - a);
+	const XMVECTOR offset = XMVectorReplicate(a);
+
+	for(std::uint32_t i = 0; i < count; i += 4)
+	{
+		XMVECTOR v = XMVectorMultiplyAdd(NextFloat4(), scale, offset);
+
+		if(count - i >= 4)
+		{
+			_mm_storeu_ps(out + i, v);
+		}
+		else
+		{
+			alignas(16) float tail[4];
+			_mm_store_ps(tail, v);
+			for(std::uint32_t j = 0; j < count - i; ++j)
+				out[i + j] = tail[j];
+		}
+	}
+}
+
+template<typename Sample>
+void RandomGenerator::FillVec3(XMFLOAT3* out, std::uint32_t count, const XMFLOAT3& n, Sample sample)
+{
+	XMVECTOR axis = XMLoadFloat3(&n);
+	XMVECTOR t, s;
+	OrthonormalBasis(axis, t, s);
+
+	XMFLOAT3 tf, sf;
+	XMStoreFloat3(&tf, t);
+	XMStoreFloat3(&sf, s);
+
+	for(std::uint32_t i = 0; i < count; i += 4)
+	{
+		XMVECTOR u1 = NextFloat4();
+		XMVECTOR u2 = NextFloat4();
+
+		XMVECTOR x, y, z;
+		sample(u1, u2, x, y, z);
+
+		// Rotate out of the frame, four vectors at a time.
+		alignas(16) float wx[4], wy[4], wz[4];
+		_mm_store_ps(wx, x*tf.x + y*sf.x + z*n.x);
+		_mm_store_ps(wy, x*tf.y + y*sf.y + z*n.y);
+		_mm_store_ps(wz, x*tf.z + y*sf.z + z*n.z);
+
+		const std::uint32_t last = MathHelper::Min(count - i, 4u);
+		for(std::uint32_t j = 0; j < last; ++j)
+			out[i + j] = XMFLOAT3(wx[j], wy[j], wz[j]);
+	}
+}
+
+void RandomGenerator::FillUnitVec3(XMFLOAT3* out, std::uint32_t count)
+{
+	FillVec3(out, count, XMFLOAT3(0.0f, 0.0f, 1.0f),
+		[](FXMVECTOR u1, FXMVECTOR u2, XMVECTOR& x, XMVECTOR& y, XMVECTOR& z)
+	{
+		z = XMVectorNegativeMultiplySubtract(u1, XMVectorReplicate(2.0f), g_XMOne);
+		XMVECTOR r = XMVectorSqrt(XMVectorMax(XMVectorZero(), XMVectorNegativeMultiplySubtract(z, z, g_XMOne)));
+		XMVECTOR sinPhi, cosPhi;
+		XMVectorSinCos(&sinPhi, &cosPhi, u2*XM_2PI);
+		x = r*cosPhi;
+		y = r*sinPhi;
+	});
+}
+
+void RandomGenerator::FillHemisphereUnitVec3(XMFLOAT3* out, std::uint32_t count, const XMFLOAT3& n)
+{
+	FillVec3(out, count, n,
+		[](FXMVECTOR u1, FXMVECTOR u2, XMVECTOR& x, XMVECTOR& y, XMVECTOR& z)
+	{
+		z = u1;
+		XMVECTOR r = XMVectorSqrt(XMVectorMax(XMVectorZero(), XMVectorNegativeMultiplySubtract(z, z, g_XMOne)));
+		XMVECTOR sinPhi, cosPhi;
+		XMVectorSinCos(&sinPhi, &cosPhi, u2*XM_2PI);
+		x = r*cosPhi;
+		y = r*sinPhi;
+	});
+}
+
+void RandomGenerator::FillCosineHemisphereUnitVec3(XMFLOAT3* out, std::uint32_t count, const XMFLOAT3& n)
+{
+	FillVec3(out, count, n,
+		[](FXMVECTOR u1, FXMVECTOR u2, XMVECTOR& x, XMVECTOR& y, XMVECTOR& z)
+	{
+		z = XMVectorSqrt(XMVectorMax(XMVectorZero(), XMVectorSubtract(g_XMOne, u1)));
+		XMVECTOR r = XMVectorSqrt(u1);
+		XMVECTOR sinPhi, cosPhi;
+		XMVectorSinCos(&sinPhi, &cosPhi, u2*XM_2PI);
+		x = r*cosPhi;
+		y = r*sinPhi;
+	});
+}
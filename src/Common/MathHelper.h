@@ -6,17 +6,77 @@
 
 #pragma once
 
+#if defined(_WIN32)
 #include <Windows.h>
+#endif
 #include <DirectXMath.h>
 #include <cstdint>
+#include <emmintrin.h>
+
+// Small, fast random number generator with explicit seeding, for use by one thread
+// at a time (give every thread or task its own).  The same seed and stream always
+// give the same numbers, on any thread.
+//   -Single values come from PCG32 (O'Neill), a 64-bit LCG with a permuted output.
+//   -The Fill*() batch functions run four xoshiro128+ (Blackman, Vigna) generators
+//    in the SSE lanes and make four samples per step.  They are seeded from the
+//    same seed, so a batch is as reproducible as single values.
+class RandomGenerator
+{
+public:
+	explicit RandomGenerator(std::uint64_t seed = 0, std::uint64_t stream = 0);
+
+	// Restart the generator.  Generators with different streams give independent
+	// sequences for the same seed, e.g., seed = frame or asset, stream = thread.
+	void Seed(std::uint64_t seed, std::uint64_t stream = 0);
+
+	std::uint32_t NextUInt();
+
+	// Returns an integer in [0, bound), without modulo bias.
+	std::uint32_t NextUInt(std::uint32_t bound);
+
+	// Returns a float in [0, 1).
+	float NextFloat();
+
+	// Returns a float in [a, b).
+	float NextFloat(float a, float b);
+
+	// Returns an integer in [a, b].
+	int NextInt(int a, int b);
+
+	DirectX::XMVECTOR NextUnitVec3();
+	DirectX::XMVECTOR NextHemisphereUnitVec3(DirectX::FXMVECTOR n);
+	DirectX::XMVECTOR NextCosineHemisphereUnitVec3(DirectX::FXMVECTOR n);
+
+	// Batch generators.  n is the unit length hemisphere axis.
+	void FillFloats(float* out, std::uint32_t count, float a = 0.0f, float b = 1.0f);
+	void FillUnitVec3(DirectX::XMFLOAT3* out, std::uint32_t count);
+	void FillHemisphereUnitVec3(DirectX::XMFLOAT3* out, std::uint32_t count, const DirectX::XMFLOAT3& n);
+	void FillCosineHemisphereUnitVec3(DirectX::XMFLOAT3* out, std::uint32_t count, const DirectX::XMFLOAT3& n);
+
+private:
+	// Four uniform floats in [0, 1) from the SIMD generators.
+	DirectX::XMVECTOR NextFloat4();
+
+	// Writes the direction of a batch that is (x, y, z) in the frame of n.
+	template<typename Sample>
+	void FillVec3(DirectX::XMFLOAT3* out, std::uint32_t count, const DirectX::XMFLOAT3& n, Sample sample);
+
+private:
+	std::uint64_t mState = 0;
+	std::uint64_t mIncrement = 1;
+
+	// xoshiro128+ state: lane i of mSimdState[k] is word k of generator i.
+	__m128i mSimdState[4];
+};
 
 class MathHelper
 {
 public:
-	// Returns random float in [0, 1).
+	// Returns random float in [0, 1).  Uses the generator of the calling thread
+	// (see ThreadRandom()), so unlike rand() it takes no lock.
 	static float RandF()
 	{
-		return (float)(rand()) / (float)RAND_MAX;
+		return ThreadRandom().NextFloat();
 	}
 
 	// Returns random float in [a, b).
@@ -25,11 +85,36 @@ public:
 		return a + RandF()*(b-a);
 	}
 
+	// Returns random integer in [a, b].
     static int Rand(int a, int b)
     {
-        return a + rand() % ((b - a) + 1);
+        return ThreadRandom().NextInt(a, b);
     }
 
+	// The generator behind RandF() and friends, one per thread.  The first thread
+	// to use it (the main thread in the demos) gets stream 0, the next one stream 1
+	// and so on, all with seed 0.  Call SeedRandom() for reproducible sequences on
+	// worker threads.
+	static RandomGenerator& ThreadRandom();
+	static void SeedRandom(std::uint64_t seed, std::uint64_t stream = 0);
+
+	// Radical inverse of index in base (the Halton sequence for prime bases).
+	static float Halton(std::uint32_t index, std::uint32_t base);
+
+	// Points index, ..., index + count - 1 of the 2D Halton sequence (bases 2 and 3).
+	static void HaltonSequence(DirectX::XMFLOAT2* out, std::uint32_t count, std::uint32_t index = 1);
+
+	// Point index of the first two dimensions of the Sobol sequence.  A nonzero
+	// scramble XORs the coordinates with bits derived from it (random digit
+	// scrambling), which keeps the stratification and decorrelates sequences,
+	// e.g., between pixels or vertices.
+	static DirectX::XMFLOAT2 Sobol2D(std::uint32_t index, std::uint32_t scramble = 0);
+	static void SobolSequence(DirectX::XMFLOAT2* out, std::uint32_t count, std::uint32_t index = 0, std::uint32_t scramble = 0);
+
+	// Maps a point of [0, 1)^2 to a cosine weighted direction in the hemisphere
+	// around the unit length axis n.
+	static DirectX::XMVECTOR CosineHemisphereUnitVec3(DirectX::FXMVECTOR n, float u1, float u2);
+
 	template<typename T>
 	static T Min(const T& a, const T& b)
 	{
@@ -89,6 +174,11 @@ public:
         return I;
     }
 
+	// Extracts the normalized world space planes (normals pointing inward) of the
+	// frustum of a view-projection matrix in the order left, right, bottom, top,
+	// near, far.
+	static void ExtractFrustumPlanes(DirectX::CXMMATRIX viewProj, DirectX::XMFLOAT4 outPlanes[6]);
+
     static DirectX::XMVECTOR RandUnitVec3();
     static DirectX::XMVECTOR RandHemisphereUnitVec3(DirectX::XMVECTOR n);
 
@@ -0,0 +1,230 @@
+//***************************************************************************************
+// NullRenderDevice.cpp - Null (recording) backend of the rendering interface
+//***************************************************************************************
+
+#include "NullRenderDevice.h"
+#include <cassert>
+#include <cstring>
+
+class NullBuffer : public RenderBuffer
+{
+public:
+	NullBuffer(NullRenderDevice* device, std::uint64_t byteSize, RenderHeap heap, GpuAddress address) :
+		mDevice(device),
+		mData((size_t)byteSize),
+		mHeap(heap),
+		mAddress(address)
+	{
+	}
+
+	std::uint64_t Size()const override
+	{
+		return mData.size();
+	}
+
+	GpuAddress GetGpuAddress()const override
+	{
+		return mAddress;
+	}
+
+	void Write(std::uint64_t offset, const void* data, std::uint64_t byteSize) override
+	{
+		assert(mHeap == RenderHeap::Upload);
+		assert(offset + byteSize <= mData.size());
+
+		memcpy(mData.data() + offset, data, (size_t)byteSize);
+		mDevice->mUploadedBytes.fetch_add(byteSize, std::memory_order_relaxed);
+	}
+
+	std::uint8_t* MappedData()const override
+	{
+		// Writes through the pointer are not counted in UploadedBytes.
+		return mHeap == RenderHeap::Upload ? const_cast<std::uint8_t*>(mData.data()) : nullptr;
+	}
+
+private:
+	NullRenderDevice* mDevice;
+	std::vector<std::uint8_t> mData;
+	RenderHeap mHeap;
+	GpuAddress mAddress;
+};
+
+//
+// NullRenderDevice
+//
+
+std::unique_ptr<RenderBuffer> NullRenderDevice::CreateBuffer(std::uint64_t byteSize, RenderHeap heap)
+{
+	// Leave a gap after every buffer, so overruns do not land in the next one.
+	GpuAddress address = mNextAddress.fetch_add((byteSize + 0x1ff) & ~std::uint64_t(0xff));
+
+	mBufferCount++;
+	mBufferBytes += byteSize;
+
+	return std::make_unique<NullBuffer>(this, byteSize, heap, address);
+}
+
+NullRenderDevice::Stats NullRenderDevice::GetStats()const
+{
+	Stats stats;
+	stats.BufferCount = mBufferCount;
+	stats.BufferBytes = mBufferBytes;
+	stats.UploadedBytes = mUploadedBytes;
+	return stats;
+}
+
+void NullRenderDevice::ResetUploadStats()
+{
+	mUploadedBytes = 0;
+}
+
+//
+// NullCommandList
+//
+
+void NullCommandList::Reset()
+{
+	mStream.clear();
+	mObjectIds.clear();
+	mStats = Stats();
+}
+
+void NullCommandList::SetPipelineState(RenderPipeline* pso)
+{
+	Emit(Op::SetPipelineState, { ObjectId(pso) });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetGraphicsRootSignature(RenderRootSignature* rootSignature)
+{
+	Emit(Op::SetGraphicsRootSignature, { ObjectId(rootSignature) });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetVertexBuffer(const VertexBufferView& vbv)
+{
+	Emit(Op::SetVertexBuffer, { Lo(vbv.Address), Hi(vbv.Address), vbv.SizeInBytes, vbv.StrideInBytes });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetIndexBuffer(const IndexBufferView& ibv)
+{
+	Emit(Op::SetIndexBuffer, { Lo(ibv.Address), Hi(ibv.Address), ibv.SizeInBytes, (std::uint32_t)ibv.Format });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetPrimitiveTopology(PrimitiveTopology topology)
+{
+	Emit(Op::SetPrimitiveTopology, { (std::uint32_t)topology });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address)
+{
+	Emit(Op::SetGraphicsRootConstantBufferView, { rootParameterIndex, Lo(address), Hi(address) });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address)
+{
+	Emit(Op::SetGraphicsRootShaderResourceView, { rootParameterIndex, Lo(address), Hi(address) });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor)
+{
+	Emit(Op::SetGraphicsRootDescriptorTable, { rootParameterIndex, Lo(baseDescriptor), Hi(baseDescriptor) });
+	mStats.StateChangeCount++;
+}
+
+void NullCommandList::DrawInstanced(std::uint32_t vertexCountPerInstance, std::uint32_t instanceCount,
+	std::uint32_t startVertexLocation, std::uint32_t startInstanceLocation)
+{
+	Emit(Op::DrawInstanced, { vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation });
+
+	mStats.DrawCount++;
+	mStats.InstanceCount += instanceCount;
+	mStats.VertexCount += (std::uint64_t)vertexCountPerInstance*instanceCount;
+}
+
+void NullCommandList::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+	std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+{
+	Emit(Op::DrawIndexedInstanced, { indexCountPerInstance, instanceCount, startIndexLocation,
+		(std::uint32_t)baseVertexLocation, startInstanceLocation });
+
+	mStats.DrawCount++;
+	mStats.InstanceCount += instanceCount;
+	mStats.VertexCount += (std::uint64_t)indexCountPerInstance*instanceCount;
+}
+
+void NullCommandList::ResourceBarrier(RenderResource* resource, ResourceState before, ResourceState after)
+{
+	Emit(Op::ResourceBarrier, { ObjectId(resource), (std::uint32_t)before, (std::uint32_t)after });
+	mStats.BarrierCount++;
+}
+
+void NullCommandList::CopyBufferRegion(RenderBuffer* dst, std::uint64_t dstOffset,
+	RenderBuffer* src, std::uint64_t srcOffset, std::uint64_t byteSize)
+{
+	assert(dstOffset + byteSize <= dst->Size());
+	assert(srcOffset + byteSize <= src->Size());
+
+	Emit(Op::CopyBufferRegion, { ObjectId(dst), Lo(dstOffset), Hi(dstOffset),
+		ObjectId(src), Lo(srcOffset), Hi(srcOffset), Lo(byteSize), Hi(byteSize) });
+
+	mStats.CopyCount++;
+	mStats.CopiedBytes += byteSize;
+}
+
+const std::vector<std::uint32_t>& NullCommandList::Stream()const
+{
+	return mStream;
+}
+
+std::uint64_t NullCommandList::Hash()const
+{
+	std::uint64_t h = 14695981039346656037ull;
+	for(std::uint32_t word : mStream)
+	{
+		for(int i = 0; i < 4; ++i)
+		{
+			h ^= (word >> (8*i)) & 0xff;
+			h *= 1099511628211ull;
+		}
+	}
+	return h;
+}
+
+const NullCommandList::Stats& NullCommandList::GetStats()const
+{
+	return mStats;
+}
+
+void NullCommandList::Emit(Op op, std::initializer_list<std::uint32_t> payload)
+{
+	mStream.push_back((std::uint32_t)op | ((std::uint32_t)payload.size() << 8));
+	mStream.insert(mStream.end(), payload.begin(), payload.end());
+
+	mStats.CommandCount++;
+}
+
+std::uint32_t NullCommandList::ObjectId(const void* object)
+{
+	if(object == nullptr)
+		return 0;
+
+	// Ids start at 1; 0 is null.
+	auto it = mObjectIds.emplace(object, (std::uint32_t)mObjectIds.size() + 1).first;
+	return it->second;
+}
+
+std::uint32_t NullCommandList::Lo(std::uint64_t x)
+{
+	return (std::uint32_t)x;
+}
+
+std::uint32_t NullCommandList::Hi(std::uint64_t x)
+{
+	return (std::uint32_t)(x >> 32);
+}
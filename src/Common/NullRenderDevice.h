@@ -0,0 +1,133 @@
+//***************************************************************************************
+// NullRenderDevice.h - Null (recording) backend of the rendering interface
+//
+// Runs a frame's CPU work without a GPU, e.g., for headless benchmarks and
+// regression tests.
+//   -Buffers live in CPU memory.  Their GPU addresses are made up, deterministic in
+//    the order the buffers are created, and 256-byte aligned like real ones.
+//   -NullCommandList appends every command to a stream of 32-bit words: a header
+//    (opcode in the low byte, payload word count above it) and the arguments.
+//    Pipelines, root signatures and resources are numbered in the order the list
+//    first sees them, so the stream, and its Hash(), only depend on the commands
+//    recorded, not on where objects happen to live in memory.
+//   -The device counts buffers and bytes written to upload buffers; the command
+//    list counts draws, barriers, state changes and copies.
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderDevice.h"
+#include <atomic>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+class NullRenderDevice : public RenderDevice
+{
+public:
+	struct Stats
+	{
+		std::uint64_t BufferCount = 0;
+		std::uint64_t BufferBytes = 0;
+		std::uint64_t UploadedBytes = 0;
+	};
+
+	NullRenderDevice() = default;
+	NullRenderDevice(const NullRenderDevice& rhs) = delete;
+	NullRenderDevice& operator=(const NullRenderDevice& rhs) = delete;
+	~NullRenderDevice() = default;
+
+	// Buffers must not outlive the device.
+	std::unique_ptr<RenderBuffer> CreateBuffer(std::uint64_t byteSize, RenderHeap heap) override;
+
+	Stats GetStats()const;
+
+	// Zero UploadedBytes, e.g., at the start of a frame.
+	void ResetUploadStats();
+
+private:
+	friend class NullBuffer;
+
+	std::atomic<std::uint64_t> mNextAddress{ 0x10000 };
+	std::atomic<std::uint64_t> mBufferCount{ 0 };
+	std::atomic<std::uint64_t> mBufferBytes{ 0 };
+
+	// Written to by any thread that fills upload buffers.
+	std::atomic<std::uint64_t> mUploadedBytes{ 0 };
+};
+
+class NullCommandList : public RenderCommandList
+{
+public:
+	enum class Op : std::uint8_t
+	{
+		SetPipelineState,
+		SetGraphicsRootSignature,
+		SetVertexBuffer,
+		SetIndexBuffer,
+		SetPrimitiveTopology,
+		SetGraphicsRootConstantBufferView,
+		SetGraphicsRootShaderResourceView,
+		SetGraphicsRootDescriptorTable,
+		DrawInstanced,
+		DrawIndexedInstanced,
+		ResourceBarrier,
+		CopyBufferRegion
+	};
+
+	struct Stats
+	{
+		std::uint32_t CommandCount = 0;
+		std::uint32_t DrawCount = 0;
+		std::uint64_t InstanceCount = 0;
+		std::uint64_t VertexCount = 0;      // Indices for indexed draws, times instances.
+		std::uint32_t StateChangeCount = 0;
+		std::uint32_t BarrierCount = 0;
+		std::uint32_t CopyCount = 0;
+		std::uint64_t CopiedBytes = 0;
+	};
+
+	NullCommandList() = default;
+	NullCommandList(const NullCommandList& rhs) = delete;
+	NullCommandList& operator=(const NullCommandList& rhs) = delete;
+	~NullCommandList() = default;
+
+	// Empty the stream and zero the stats and object numbers, like resetting a
+	// command list for the next frame.
+	void Reset();
+
+	void SetPipelineState(RenderPipeline* pso) override;
+	void SetGraphicsRootSignature(RenderRootSignature* rootSignature) override;
+	void SetVertexBuffer(const VertexBufferView& vbv) override;
+	void SetIndexBuffer(const IndexBufferView& ibv) override;
+	void SetPrimitiveTopology(PrimitiveTopology topology) override;
+	void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address) override;
+	void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address) override;
+	void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor) override;
+	void DrawInstanced(std::uint32_t vertexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startVertexLocation, std::uint32_t startInstanceLocation) override;
+	void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) override;
+	void ResourceBarrier(RenderResource* resource, ResourceState before, ResourceState after) override;
+	void CopyBufferRegion(RenderBuffer* dst, std::uint64_t dstOffset,
+		RenderBuffer* src, std::uint64_t srcOffset, std::uint64_t byteSize) override;
+
+	const std::vector<std::uint32_t>& Stream()const;
+
+	// FNV-1a of the stream; equal command sequences give equal hashes.
+	std::uint64_t Hash()const;
+
+	const Stats& GetStats()const;
+
+private:
+	void Emit(Op op, std::initializer_list<std::uint32_t> payload);
+	std::uint32_t ObjectId(const void* object);
+
+	static std::uint32_t Lo(std::uint64_t x);
+	static std::uint32_t Hi(std::uint64_t x);
+
+private:
+	std::vector<std::uint32_t> mStream;
+	std::unordered_map<const void*, std::uint32_t> mObjectIds;
+	Stats mStats;
+};
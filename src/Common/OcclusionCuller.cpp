@@ -0,0 +1,425 @@
+//***************************************************************************************
+// OcclusionCuller.cpp - CPU software occlusion culling
+//***************************************************************************************
+
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+
+using namespace DirectX;
+
+namespace
+{
+	float ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<float, std::milli>(end - start).count();
+	}
+}
+
+OcclusionCuller::OcclusionCuller(UINT width, UINT height)
+{
+	Resize(width, height);
+}
+
+UINT OcclusionCuller::Width()const
+{
+	return mWidth;
+}
+
+UINT OcclusionCuller::Height()const
+{
+	return mHeight;
+}
+
+void OcclusionCuller::Resize(UINT width, UINT height)
+{
+	mTilesX = MathHelper::Max(1u, (width + TileWidth - 1) / TileWidth);
+	mTilesY = MathHelper::Max(1u, (height + TileHeight - 1) / TileHeight);
+	mWidth = mTilesX*TileWidth;
+	mHeight = mTilesY*TileHeight;
+
+	mDepth.assign(mWidth*mHeight, 1.0f);
+	mTileMaxDepth.assign(mTilesX*mTilesY, 1.0f);
+	mTileBins.resize(mTilesX*mTilesY);
+}
+
+UINT OcclusionCuller::AddOccluderMesh(const void* positions, UINT positionStride, UINT vertexCount,
+	const UINT* indices, UINT indexCount)
+{
+	assert(indexCount % 3 == 0);
+
+	OccluderMesh mesh;
+	mesh.Positions.resize(vertexCount);
+	for(UINT i = 0; i < vertexCount; ++i)
+	{
+		const BYTE* p = reinterpret_cast<const BYTE*>(positions) + i*positionStride;
+		mesh.Positions[i] = *reinterpret_cast<const XMFLOAT3*>(p);
+	}
+	mesh.Indices.assign(indices, indices + indexCount);
+
+	mMeshes.push_back(std::move(mesh));
+
+	return (UINT)mMeshes.size() - 1;
+}
+
+void OcclusionCuller::BeginFrame(CXMMATRIX viewProj)
+{
+	XMStoreFloat4x4(&mViewProj, viewProj);
+
+	mSubmissions.clear();
+	mStats = Stats();
+}
+
+void OcclusionCuller::SubmitOccluder(UINT meshIndex, CXMMATRIX world)
+{
+	assert(meshIndex < mMeshes.size());
+
+	Submission s;
+	s.MeshIndex = meshIndex;
+	XMStoreFloat4x4(&s.WorldViewProj, XMMatrixMultiply(world, XMLoadFloat4x4(&mViewProj)));
+
+	mSubmissions.push_back(s);
+}
+
+void OcclusionCuller::RenderOccluders()
+{
+	PROFILE_SCOPE("OcclusionCuller::RenderOccluders");
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//
+	// Transform the occluders to clip space, clip them against the near plane
+	// and set up the screen space triangles.
+	//
+
+	mTriangles.clear();
+	for(const auto& s : mSubmissions)
+	{
+		const OccluderMesh& mesh = mMeshes[s.MeshIndex];
+		XMMATRIX worldViewProj = XMLoadFloat4x4(&s.WorldViewProj);
+
+		for(size_t i = 0; i < mesh.Indices.size(); i += 3)
+		{
+			XMFLOAT4 clip[3];
+			for(int k = 0; k < 3; ++k)
+			{
+				XMVECTOR p = XMLoadFloat3(&mesh.Positions[mesh.Indices[i + k]]);
+				XMStoreFloat4(&clip[k], XMVector3Transform(p, worldViewProj));
+			}
+
+			ClipAndSetup(clip);
+		}
+
+		mStats.OccluderTriangles += (UINT)mesh.Indices.size() / 3;
+	}
+
+	mStats.RasterizedTriangles = (UINT)mTriangles.size();
+
+	//
+	// Bin the triangles to the tiles their bounding rectangles overlap.
+	//
+
+	for(auto& bin : mTileBins)
+		bin.clear();
+
+	for(UINT t = 0; t < (UINT)mTriangles.size(); ++t)
+	{
+		const Triangle& tri = mTriangles[t];
+
+		for(int ty = tri.MinY / (int)TileHeight; ty <= tri.MaxY / (int)TileHeight; ++ty)
+		{
+			for(int tx = tri.MinX / (int)TileWidth; tx <= tri.MaxX / (int)TileWidth; ++tx)
+				mTileBins[ty*mTilesX + tx].push_back(t);
+		}
+	}
+
+	//
+	// The tiles do not share any memory, so they are rasterized in parallel.
+	//
+
+	JobSystem::Default().ParallelFor(0u, mTilesX*mTilesY, [this](UINT tileIndex)
+	{
+		RasterizeTile(tileIndex);
+	});
+
+	mStats.RasterMs = ElapsedMs(start);
+}
+
+void OcclusionCuller::ClipAndSetup(const XMFLOAT4 clip[3])
+{
+	// Clip the triangle against the near plane (z >= 0 in Direct3D clip space).
+	// This also guarantees w > 0 for the perspective divide.  A triangle clipped
+	// by one plane becomes a polygon with at most four vertices.
+	XMFLOAT4 poly[4];
+	int polyCount = 0;
+	for(int i = 0; i < 3; ++i)
+	{
+		const XMFLOAT4& a = clip[i];
+		const XMFLOAT4& b = clip[(i + 1) % 3];
+
+		if(a.z >= 0.0f)
+			poly[polyCount++] = a;
+
+		if((a.z >= 0.0f) != (b.z >= 0.0f))
+		{
+			float t = a.z / (a.z - b.z);
+			poly[polyCount++] = XMFLOAT4(
+				a.x + t*(b.x - a.x),
+				a.y + t*(b.y - a.y),
+				0.0f,
+				a.w + t*(b.w - a.w));
+		}
+	}
+
+	if(polyCount < 3)
+		return;
+
+	// Perspective divide and viewport transform.
+	XMFLOAT3 screen[4];
+	for(int i = 0; i < polyCount; ++i)
+	{
+		float invW = 1.0f / poly[i].w;
+		screen[i].x = (0.5f + 0.5f*poly[i].x*invW)*mWidth;
+		screen[i].y = (0.5f - 0.5f*poly[i].y*invW)*mHeight;
+		screen[i].z = poly[i].z*invW;
+	}
+
+	SetupTriangle(screen[0], screen[1], screen[2]);
+	if(polyCount == 4)
+		SetupTriangle(screen[0], screen[2], screen[3]);
+}
+
+void OcclusionCuller::SetupTriangle(const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2)
+{
+	// Twice the signed area.  With y pointing down, clockwise (front facing)
+	// triangles have positive area.
+	float area = (v1.x - v0.x)*(v2.y - v0.y) - (v2.x - v0.x)*(v1.y - v0.y);
+	if(area <= 0.0f)
+		return;
+
+	Triangle tri;
+
+	tri.MinX = MathHelper::Max(0, (int)floorf(MathHelper::Min(v0.x, MathHelper::Min(v1.x, v2.x))));
+	tri.MinY = MathHelper::Max(0, (int)floorf(MathHelper::Min(v0.y, MathHelper::Min(v1.y, v2.y))));
+	tri.MaxX = MathHelper::Min((int)mWidth - 1, (int)ceilf(MathHelper::Max(v0.x, MathHelper::Max(v1.x, v2.x))));
+	tri.MaxY = MathHelper::Min((int)mHeight - 1, (int)ceilf(MathHelper::Max(v0.y, MathHelper::Max(v1.y, v2.y))));
+	if(tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+		return;
+
+	// Edge k is opposite to vertex k, so E_k(p) is the (unnormalized)
+	// barycentric weight of vertex k.
+	const XMFLOAT3* v[3] = { &v0, &v1, &v2 };
+	for(int k = 0; k < 3; ++k)
+	{
+		const XMFLOAT3& a = *v[(k + 1) % 3];
+		const XMFLOAT3& b = *v[(k + 2) % 3];
+
+		tri.A[k] = a.y - b.y;
+		tri.B[k] = b.x - a.x;
+		tri.C[k] = -(tri.A[k]*a.x + tri.B[k]*a.y);
+	}
+
+	// Depth is linear in screen space after the perspective divide.
+	float invArea = 1.0f / area;
+	tri.ZA = (tri.A[0]*v0.z + tri.A[1]*v1.z + tri.A[2]*v2.z)*invArea;
+	tri.ZB = (tri.B[0]*v0.z + tri.B[1]*v1.z + tri.B[2]*v2.z)*invArea;
+	tri.ZC = (tri.C[0]*v0.z + tri.C[1]*v1.z + tri.C[2]*v2.z)*invArea;
+
+	mTriangles.push_back(tri);
+}
+
+float* OcclusionCuller::TileDepth(UINT tileIndex)
+{
+	return &mDepth[tileIndex*TileWidth*TileHeight];
+}
+
+const float* OcclusionCuller::TileDepth(UINT tileIndex)const
+{
+	return &mDepth[tileIndex*TileWidth*TileHeight];
+}
+
+void OcclusionCuller::RasterizeTile(UINT tileIndex)
+{
+	const int tileX = (int)((tileIndex % mTilesX)*TileWidth);
+	const int tileY = (int)((tileIndex / mTilesX)*TileHeight);
+
+	float* depth = TileDepth(tileIndex);
+	std::fill(depth, depth + TileWidth*TileHeight, 1.0f);
+
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for(UINT t : mTileBins[tileIndex])
+	{
+		const Triangle& tri = mTriangles[t];
+
+		// Overlap of the triangle's rectangle and the tile, with x aligned to whole
+		// groups of four pixels.
+		const int x0 = MathHelper::Max(tri.MinX, tileX) & ~3;
+		const int x1 = MathHelper::Min(tri.MaxX, tileX + (int)TileWidth - 1);
+		const int y0 = MathHelper::Max(tri.MinY, tileY);
+		const int y1 = MathHelper::Min(tri.MaxY, tileY + (int)TileHeight - 1);
+
+		const __m128 a0 = _mm_set1_ps(tri.A[0]);
+		const __m128 a1 = _mm_set1_ps(tri.A[1]);
+		const __m128 a2 = _mm_set1_ps(tri.A[2]);
+		const __m128 za = _mm_set1_ps(tri.ZA);
+
+		for(int y = y0; y <= y1; ++y)
+		{
+			const float py = y + 0.5f;
+			const __m128 row0 = _mm_set1_ps(tri.B[0]*py + tri.C[0]);
+			const __m128 row1 = _mm_set1_ps(tri.B[1]*py + tri.C[1]);
+			const __m128 row2 = _mm_set1_ps(tri.B[2]*py + tri.C[2]);
+			const __m128 rowZ = _mm_set1_ps(tri.ZB*py + tri.ZC);
+
+			float* depthRow = depth + (y - tileY)*TileWidth - tileX;
+
+			for(int x = x0; x <= x1; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), row0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), row1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), row2);
+
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+					_mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+				if(_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 z = _mm_add_ps(_mm_mul_ps(za, px), rowZ);
+				__m128 oldZ = _mm_loadu_ps(depthRow + x);
+				__m128 newZ = _mm_min_ps(oldZ, z);
+
+				_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, newZ), _mm_andnot_ps(inside, oldZ)));
+			}
+		}
+	}
+
+	// Furthest depth in the tile.
+	__m128 maxZ = zero;
+	for(UINT i = 0; i < TileWidth*TileHeight; i += 4)
+		maxZ = _mm_max_ps(maxZ, _mm_loadu_ps(depth + i));
+
+	maxZ = _mm_max_ps(maxZ, _mm_shuffle_ps(maxZ, maxZ, _MM_SHUFFLE(1, 0, 3, 2)));
+	maxZ = _mm_max_ps(maxZ, _mm_shuffle_ps(maxZ, maxZ, _MM_SHUFFLE(2, 3, 0, 1)));
+	mTileMaxDepth[tileIndex] = _mm_cvtss_f32(maxZ);
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& worldBox)const
+{
+	XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	worldBox.GetCorners(corners);
+
+	//
+	// Project the box to a screen rectangle and its nearest depth.
+	//
+
+	float minX = +MathHelper::Infinity, minY = +MathHelper::Infinity;
+	float maxX = -MathHelper::Infinity, maxY = -MathHelper::Infinity;
+	float minZ = +MathHelper::Infinity;
+	for(size_t i = 0; i < BoundingBox::CORNER_COUNT; ++i)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corners[i]), viewProj));
+
+		// The box crosses the near plane, so it contains the eye or is right in front of it.
+		if(clip.z < 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float x = (0.5f + 0.5f*clip.x*invW)*mWidth;
+		float y = (0.5f - 0.5f*clip.y*invW)*mHeight;
+
+		minX = MathHelper::Min(minX, x);
+		maxX = MathHelper::Max(maxX, x);
+		minY = MathHelper::Min(minY, y);
+		maxY = MathHelper::Max(maxY, y);
+		minZ = MathHelper::Min(minZ, clip.z*invW);
+	}
+
+	const int x0 = MathHelper::Max(0, (int)floorf(minX));
+	const int y0 = MathHelper::Max(0, (int)floorf(minY));
+	const int x1 = MathHelper::Min((int)mWidth - 1, (int)ceilf(maxX));
+	const int y1 = MathHelper::Min((int)mHeight - 1, (int)ceilf(maxY));
+
+	// Off screen; that is the frustum culler's business, so be conservative.
+	if(x0 > x1 || y0 > y1)
+		return true;
+
+	//
+	// Coarse test against the furthest depth of each tile, then fine test
+	// against the pixels of the tiles the coarse test could not reject.
+	//
+
+	for(int ty = y0 / (int)TileHeight; ty <= y1 / (int)TileHeight; ++ty)
+	{
+		for(int tx = x0 / (int)TileWidth; tx <= x1 / (int)TileWidth; ++tx)
+		{
+			const UINT tileIndex = ty*mTilesX + tx;
+			if(minZ > mTileMaxDepth[tileIndex])
+				continue;
+
+			const int tileX = tx*TileWidth;
+			const int tileY = ty*TileHeight;
+			const float* depth = TileDepth(tileIndex);
+
+			for(int y = MathHelper::Max(y0, tileY); y <= MathHelper::Min(y1, tileY + (int)TileHeight - 1); ++y)
+			{
+				for(int x = MathHelper::Max(x0, tileX); x <= MathHelper::Min(x1, tileX + (int)TileWidth - 1); ++x)
+				{
+					if(minZ <= depth[(y - tileY)*TileWidth + (x - tileX)])
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+UINT OcclusionCuller::CullBoxes(const BoundingBox* boxes, UINT* ids, UINT count)
+{
+	PROFILE_SCOPE("OcclusionCuller::CullBoxes");
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Nothing was rasterized, so nothing can be hidden.
+	if(mStats.RasterizedTriangles == 0)
+	{
+		mStats.TestedCount += count;
+		return count;
+	}
+
+	mVisibleFlags.resize(count);
+	JobSystem::Default().ParallelFor(0u, count, [&](UINT i)
+	{
+		mVisibleFlags[i] = IsVisible(boxes[ids[i]]) ? 1 : 0;
+	});
+
+	UINT visibleCount = 0;
+	for(UINT i = 0; i < count; ++i)
+	{
+		if(mVisibleFlags[i])
+			ids[visibleCount++] = ids[i];
+	}
+
+	mStats.TestedCount += count;
+	mStats.CulledCount += count - visibleCount;
+	mStats.TestMs += ElapsedMs(start);
+
+	return visibleCount;
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::GetStats()const
+{
+	return mStats;
+}
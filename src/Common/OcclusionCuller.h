@@ -0,0 +1,125 @@
+//***************************************************************************************
+// OcclusionCuller.h - CPU software occlusion culling
+//
+// Rasterizes a handful of low-poly occluder proxies into a small depth buffer and
+// tests world space boxes against it.
+//   -The depth buffer is split into 16x8 pixel tiles stored contiguously.  Occluder
+//    triangles are binned to the tiles they overlap, and the tiles are then
+//    rasterized independently on worker threads, four pixels per SSE instruction.
+//   -Every tile keeps the furthest occluder depth it contains, forming a two level
+//    hierarchy: a box is rejected per tile when it is behind that depth, and only
+//    tiles that could not reject it are tested per pixel.
+//   -Occluder proxies must lie inside the geometry they stand for (otherwise
+//    visible objects get culled) and use the Direct3D clockwise front face winding.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <vector>
+
+class OcclusionCuller
+{
+public:
+	struct Stats
+	{
+		UINT OccluderTriangles = 0;   // Triangles submitted.
+		UINT RasterizedTriangles = 0; // Front facing triangles that reached the tiles.
+		UINT TestedCount = 0;
+		UINT CulledCount = 0;
+		float RasterMs = 0.0f;
+		float TestMs = 0.0f;
+	};
+
+	OcclusionCuller(UINT width = 320, UINT height = 192);
+	OcclusionCuller(const OcclusionCuller& rhs) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller& rhs) = delete;
+	~OcclusionCuller() = default;
+
+	UINT Width()const;
+	UINT Height()const;
+
+	// Resolution of the depth buffer; rounded up to whole tiles.  A quarter of
+	// the back buffer resolution or less is usually plenty.
+	void Resize(UINT width, UINT height);
+
+	// Register an occluder proxy mesh and return its index.  positions points to
+	// the first position and consecutive positions are positionStride bytes apart,
+	// so vertex arrays with other attributes can be passed directly.
+	UINT AddOccluderMesh(const void* positions, UINT positionStride, UINT vertexCount,
+		const UINT* indices, UINT indexCount);
+
+	// Start a new frame: clears the submitted occluders and the statistics.
+	void BeginFrame(DirectX::CXMMATRIX viewProj);
+
+	// Draw an instance of an occluder mesh this frame.
+	void SubmitOccluder(UINT meshIndex, DirectX::CXMMATRIX world);
+
+	// Transform, clip, bin and rasterize the submitted occluders.
+	void RenderOccluders();
+
+	// Returns false if the world space box is certainly hidden by the occluders.
+	bool IsVisible(const DirectX::BoundingBox& worldBox)const;
+
+	// Remove the ids whose boxes are hidden, keeping the order of the others.
+	// boxes is indexed by id.  Returns the new count.
+	UINT CullBoxes(const DirectX::BoundingBox* boxes, UINT* ids, UINT count);
+
+	const Stats& GetStats()const;
+
+private:
+	struct OccluderMesh
+	{
+		std::vector<DirectX::XMFLOAT3> Positions;
+		std::vector<UINT> Indices;
+	};
+
+	struct Submission
+	{
+		UINT MeshIndex;
+		DirectX::XMFLOAT4X4 WorldViewProj;
+	};
+
+	// Edge equations E(x,y) = A*x + B*y + C (positive inside), the depth plane
+	// z(x,y) = ZA*x + ZB*y + ZC and the pixel bounding rectangle.
+	struct Triangle
+	{
+		float A[3], B[3], C[3];
+		float ZA, ZB, ZC;
+		int MinX, MinY, MaxX, MaxY;
+	};
+
+	void ClipAndSetup(const DirectX::XMFLOAT4 clip[3]);
+	void SetupTriangle(const DirectX::XMFLOAT3& v0, const DirectX::XMFLOAT3& v1, const DirectX::XMFLOAT3& v2);
+	void RasterizeTile(UINT tileIndex);
+
+	float* TileDepth(UINT tileIndex);
+	const float* TileDepth(UINT tileIndex)const;
+
+private:
+	static const UINT TileWidth = 16;
+	static const UINT TileHeight = 8;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+	UINT mTilesX = 0;
+	UINT mTilesY = 0;
+
+	DirectX::XMFLOAT4X4 mViewProj = MathHelper::Identity4x4();
+
+	// Tile-major depth buffer (0 = near plane, 1 = far plane) and the furthest
+	// depth within each tile.
+	std::vector<float> mDepth;
+	std::vector<float> mTileMaxDepth;
+
+	std::vector<OccluderMesh> mMeshes;
+	std::vector<Submission> mSubmissions;
+
+	std::vector<Triangle> mTriangles;
+	std::vector<std::vector<UINT>> mTileBins;
+
+	std::vector<BYTE> mVisibleFlags;
+
+	Stats mStats;
+};
@@ -0,0 +1,203 @@
+//***************************************************************************************
+// PortalFrustum.cpp - Reduced view frustum through a portal or mirror opening
+//***************************************************************************************
+
+#include "PortalFrustum.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+bool PortalFrustum::Build(const XMFLOAT3* portal, UINT vertexCount, CXMMATRIX viewProj, FXMVECTOR eyePosW)
+{
+	assert(vertexCount >= 3 && vertexCount <= MaxPortalVertices);
+
+	mVisible = false;
+	mPlaneCount = 0;
+
+	//
+	// Back facing portals cannot be looked through.  With the clockwise winding
+	// the normal cross(v1 - v0, v2 - v0) points to the front.
+	//
+
+	XMVECTOR v0 = XMLoadFloat3(&portal[0]);
+	XMVECTOR v1 = XMLoadFloat3(&portal[1]);
+	XMVECTOR v2 = XMLoadFloat3(&portal[2]);
+	XMVECTOR portalNormal = XMVector3Normalize(XMVector3Cross(v1 - v0, v2 - v0));
+
+	if(XMVectorGetX(XMVector3Dot(portalNormal, eyePosW - v0)) <= 0.0f)
+		return false;
+
+	//
+	// Clip the portal against the camera frustum.
+	//
+
+	XMFLOAT4 cameraPlanes[6];
+	MathHelper::ExtractFrustumPlanes(viewProj, cameraPlanes);
+
+	XMFLOAT3 polygon[2][MaxClippedVertices];
+	std::copy(portal, portal + vertexCount, polygon[0]);
+
+	UINT count = vertexCount;
+	UINT curr = 0;
+	for(int p = 0; p < 6 && count >= 3; ++p)
+	{
+		count = ClipPolygon(polygon[curr], count, cameraPlanes[p], polygon[1 - curr]);
+		curr = 1 - curr;
+	}
+
+	if(count < 3)
+		return false;
+
+	const XMFLOAT3* visible = polygon[curr];
+
+	//
+	// One plane through the eye per edge, facing the inside of the polygon.
+	//
+
+	XMVECTOR centroid = XMVectorZero();
+	for(UINT i = 0; i < count; ++i)
+		centroid += XMLoadFloat3(&visible[i]);
+	centroid /= (float)count;
+
+	for(UINT i = 0; i < count; ++i)
+	{
+		XMVECTOR a = XMLoadFloat3(&visible[i]);
+		XMVECTOR b = XMLoadFloat3(&visible[(i + 1) % count]);
+
+		XMVECTOR n = XMVector3Cross(a - eyePosW, b - eyePosW);
+
+		// Clipping can produce (nearly) coincident vertices; their edge adds nothing.
+		if(XMVectorGetX(XMVector3LengthSq(n)) < 1e-12f)
+			continue;
+
+		n = XMVector3Normalize(n);
+		if(XMVectorGetX(XMVector3Dot(n, centroid - eyePosW)) < 0.0f)
+			n = -n;
+
+		XMVECTOR plane = XMVectorSetW(n, -XMVectorGetX(XMVector3Dot(n, eyePosW)));
+		XMStoreFloat4(&mPlanes[mPlaneCount++], plane);
+	}
+
+	// Only what is behind the portal can be seen through it...
+	XMVECTOR nearNormal = -portalNormal;
+	XMVECTOR nearPlane = XMVectorSetW(nearNormal, -XMVectorGetX(XMVector3Dot(nearNormal, v0)));
+	XMStoreFloat4(&mPlanes[mPlaneCount++], nearPlane);
+
+	// ...and within the camera range.
+	mPlanes[mPlaneCount++] = cameraPlanes[5];
+
+	//
+	// Screen bounds.  The clipped vertices are in front of the camera near plane,
+	// so w > 0.
+	//
+
+	mNdcMin = XMFLOAT2(+1.0f, +1.0f);
+	mNdcMax = XMFLOAT2(-1.0f, -1.0f);
+	for(UINT i = 0; i < count; ++i)
+	{
+		XMFLOAT3 ndc;
+		XMStoreFloat3(&ndc, XMVector3TransformCoord(XMLoadFloat3(&visible[i]), viewProj));
+
+		mNdcMin.x = MathHelper::Min(mNdcMin.x, ndc.x);
+		mNdcMin.y = MathHelper::Min(mNdcMin.y, ndc.y);
+		mNdcMax.x = MathHelper::Max(mNdcMax.x, ndc.x);
+		mNdcMax.y = MathHelper::Max(mNdcMax.y, ndc.y);
+	}
+
+	mNdcMin.x = MathHelper::Clamp(mNdcMin.x, -1.0f, 1.0f);
+	mNdcMin.y = MathHelper::Clamp(mNdcMin.y, -1.0f, 1.0f);
+	mNdcMax.x = MathHelper::Clamp(mNdcMax.x, -1.0f, 1.0f);
+	mNdcMax.y = MathHelper::Clamp(mNdcMax.y, -1.0f, 1.0f);
+
+	mVisible = true;
+
+	return true;
+}
+
+bool PortalFrustum::IsVisible()const
+{
+	return mVisible;
+}
+
+UINT PortalFrustum::PlaneCount()const
+{
+	return mPlaneCount;
+}
+
+const XMFLOAT4* PortalFrustum::Planes()const
+{
+	return mPlanes;
+}
+
+bool PortalFrustum::Intersects(const BoundingBox& box)const
+{
+	if(!mVisible)
+		return false;
+
+	for(UINT p = 0; p < mPlaneCount; ++p)
+	{
+		const XMFLOAT4& n = mPlanes[p];
+
+		float d = n.x*box.Center.x + n.y*box.Center.y + n.z*box.Center.z + n.w;
+		float r = fabsf(n.x)*box.Extents.x + fabsf(n.y)*box.Extents.y + fabsf(n.z)*box.Extents.z;
+
+		if(d + r < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+RECT PortalFrustum::ScreenRect(UINT width, UINT height)const
+{
+	RECT rect = { 0, 0, 0, 0 };
+	if(!mVisible)
+		return rect;
+
+	// NDC y points up, pixel rows go down.
+	rect.left   = (LONG)floorf((0.5f*mNdcMin.x + 0.5f)*width);
+	rect.right  = (LONG)ceilf((0.5f*mNdcMax.x + 0.5f)*width);
+	rect.top    = (LONG)floorf((0.5f - 0.5f*mNdcMax.y)*height);
+	rect.bottom = (LONG)ceilf((0.5f - 0.5f*mNdcMin.y)*height);
+
+	return rect;
+}
+
+float PortalFrustum::ScreenCoverage()const
+{
+	if(!mVisible)
+		return 0.0f;
+
+	return 0.25f*(mNdcMax.x - mNdcMin.x)*(mNdcMax.y - mNdcMin.y);
+}
+
+// Sutherland-Hodgman clipping of a convex polygon, keeping the part in front
+// of the plane.  Returns the number of output vertices.
+UINT PortalFrustum::ClipPolygon(const XMFLOAT3* in, UINT inCount, const XMFLOAT4& plane, XMFLOAT3* out)
+{
+	XMVECTOR P = XMLoadFloat4(&plane);
+
+	UINT outCount = 0;
+	for(UINT i = 0; i < inCount; ++i)
+	{
+		XMVECTOR a = XMLoadFloat3(&in[i]);
+		XMVECTOR b = XMLoadFloat3(&in[(i + 1) % inCount]);
+
+		float da = XMVectorGetX(XMPlaneDotCoord(P, a));
+		float db = XMVectorGetX(XMPlaneDotCoord(P, b));
+
+		if(da >= 0.0f)
+			out[outCount++] = in[i];
+
+		if((da >= 0.0f) != (db >= 0.0f))
+		{
+			float t = da / (da - db);
+			XMStoreFloat3(&out[outCount++], XMVectorLerp(a, b, t));
+		}
+	}
+
+	assert(outCount <= MaxClippedVertices);
+
+	return outCount;
+}
@@ -0,0 +1,70 @@
+//***************************************************************************************
+// PortalFrustum.h - Reduced view frustum through a portal or mirror opening
+//
+// Given a convex portal polygon and the camera, builds the frustum of everything
+// that can be seen through the visible part of the portal.
+//   -The polygon is first clipped against the camera frustum.  If nothing is left
+//    (or the camera looks at the back of the portal) the portal is not visible and
+//    whatever is behind it need not be drawn at all.
+//   -Otherwise the frustum consists of one plane through the eye for each edge of
+//    the clipped polygon, the portal plane as near plane and the camera far plane.
+//    It is returned as world space planes usable with FrustumCuller::Cull().
+//   -The screen rectangle covered by the visible part of the portal can be used as
+//    scissor rectangle for the pass drawn through the portal.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+
+class PortalFrustum
+{
+public:
+	static const UINT MaxPortalVertices = 8;
+
+	// Clipping a convex polygon against the six camera planes adds at most one
+	// vertex per plane.
+	static const UINT MaxClippedVertices = MaxPortalVertices + 6;
+	static const UINT MaxPlanes = MaxClippedVertices + 2;
+
+	PortalFrustum() = default;
+	PortalFrustum(const PortalFrustum& rhs) = default;
+	PortalFrustum& operator=(const PortalFrustum& rhs) = default;
+	~PortalFrustum() = default;
+
+	// Build the frustum through the convex world space portal polygon.  The vertices
+	// are in clockwise order seen from the front (the Direct3D front face winding);
+	// the portal can only be looked through from the front.  Returns IsVisible().
+	bool Build(const DirectX::XMFLOAT3* portal, UINT vertexCount,
+		DirectX::CXMMATRIX viewProj, DirectX::FXMVECTOR eyePosW);
+
+	bool IsVisible()const;
+
+	// Inward facing, normalized world space planes.  Empty if not visible.
+	UINT PlaneCount()const;
+	const DirectX::XMFLOAT4* Planes()const;
+
+	// Returns false if the world space box is certainly not visible through the portal.
+	bool Intersects(const DirectX::BoundingBox& box)const;
+
+	// Pixel rectangle covered by the visible part of the portal on a render target
+	// of the given size.
+	RECT ScreenRect(UINT width, UINT height)const;
+
+	// Fraction of the screen covered by ScreenRect().
+	float ScreenCoverage()const;
+
+private:
+	static UINT ClipPolygon(const DirectX::XMFLOAT3* in, UINT inCount, const DirectX::XMFLOAT4& plane, DirectX::XMFLOAT3* out);
+
+private:
+	bool mVisible = false;
+
+	UINT mPlaneCount = 0;
+	DirectX::XMFLOAT4 mPlanes[MaxPlanes];
+
+	// Normalized device coordinate bounds of the visible part of the portal.
+	DirectX::XMFLOAT2 mNdcMin = { 0.0f, 0.0f };
+	DirectX::XMFLOAT2 mNdcMax = { 0.0f, 0.0f };
+};
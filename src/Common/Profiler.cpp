@@ -0,0 +1,403 @@
+//***************************************************************************************
+// Profiler.cpp - Hierarchical CPU scope profiler with Chrome trace export
+//***************************************************************************************
+
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PROFILER_USE_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define PROFILER_USE_TSC 0
+#endif
+
+namespace
+{
+	thread_local Profiler* tBufferOwner = nullptr;
+	thread_local void* tBuffer = nullptr;
+
+	// Call path of the innermost open scope of the thread; 0 outside of any.
+	thread_local std::uint64_t tPath = 0;
+
+	double SteadySeconds()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	std::uint64_t PathId(std::uint64_t parentPath, const char* name)
+	{
+		// splitmix64 of the parent path and the name address.
+		std::uint64_t x = parentPath ^ ((std::uint64_t)(std::uintptr_t)name*0x9E3779B97F4A7C15ull);
+		x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27))*0x94D049BB133111EBull;
+		x = x ^ (x >> 31);
+		return x != 0 ? x : 1;
+	}
+
+	void WriteJsonString(std::ofstream& out, const char* s)
+	{
+		out << '"';
+		for(; *s != 0; ++s)
+		{
+			if(*s == '"' || *s == '\\')
+				out << '\\';
+			out << *s;
+		}
+		out << '"';
+	}
+}
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+std::uint64_t Profiler::Now()
+{
+#if PROFILER_USE_TSC
+	return __rdtsc();
+#else
+	return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+Profiler::Profiler()
+{
+	mStartTicks = Now();
+	mStartSeconds = SteadySeconds();
+
+	mFrameNode.Name = "Frame";
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+	ThreadBuffer* buffer = ThisThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+	buffer->Name = name;
+}
+
+bool Profiler::NextFrame(float deltaTime)
+{
+	const std::uint64_t now = Now();
+
+#if PROFILER_USE_TSC
+	if(mCalibrationSeconds < 0.25)
+	{
+		double seconds = SteadySeconds() - mStartSeconds;
+		if(seconds > 1e-3)
+			mTicksPerSecond = (now - mStartTicks) / seconds;
+	}
+
+	// The GameTimer measures the same frames with the performance counter; once
+	// enough frames are in, their ratio replaces the steady_clock estimate.  A
+	// frame the timer was stopped (or paused) in is left out.
+	if(mFrameStart != 0 && deltaTime > 0.0f)
+	{
+		double seconds = (now - mFrameStart) / mTicksPerSecond;
+		if(seconds < 2.0*deltaTime && deltaTime < 2.0*seconds)
+		{
+			mCalibrationTicks += now - mFrameStart;
+			mCalibrationSeconds += deltaTime;
+		}
+	}
+
+	if(mCalibrationSeconds >= 0.25)
+		mTicksPerSecond = mCalibrationTicks / mCalibrationSeconds;
+#endif
+
+	const bool capturing = mCaptureFramesLeft > 0;
+
+	// Drain the events of every thread.
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for(auto& buffer : mThreads)
+		{
+			std::uint32_t tail = buffer->Tail.load(std::memory_order_relaxed);
+			const std::uint32_t head = buffer->Head.load(std::memory_order_acquire);
+			for(; tail != head; ++tail)
+			{
+				const Event& e = buffer->Events[tail & (ThreadBuffer::Capacity - 1)];
+
+				Node& node = GetNode(e.Name, e.Path, e.ParentPath);
+				node.FrameTicks += e.End - e.Begin;
+				node.FrameCalls++;
+
+				if(capturing && e.Begin >= mCaptureStart)
+					mCapturedEvents.push_back({ e.Name, e.Begin, e.End, buffer->Index });
+			}
+			buffer->Tail.store(head, std::memory_order_release);
+		}
+	}
+
+	// Close the frame.
+	const double msPerTick = 1000.0 / mTicksPerSecond;
+	if(mFrameStart != 0)
+	{
+		PushHistory(mFrameNode, (float)((now - mFrameStart)*msPerTick), 1);
+
+		if(capturing && mFrameStart >= mCaptureStart)
+			mCapturedEvents.push_back({ mFrameNode.Name, mFrameStart, now, ThisThreadBuffer()->Index });
+	}
+
+	for(Node& node : mNodes)
+	{
+		if(node.FrameCalls > 0)
+			PushHistory(node, (float)(node.FrameTicks*msPerTick), node.FrameCalls);
+
+		node.FrameTicks = 0;
+		node.FrameCalls = 0;
+	}
+
+	mFrameStart = now;
+
+	if(capturing && --mCaptureFramesLeft == 0)
+	{
+		WriteCapture();
+		mCapturedEvents.clear();
+		return true;
+	}
+
+	return false;
+}
+
+void Profiler::CaptureFrames(std::uint32_t frameCount, const std::string& path)
+{
+	mCaptureFramesLeft = frameCount;
+	mCaptureStart = Now();
+	mCapturePath = path;
+	mCapturedEvents.clear();
+}
+
+bool Profiler::IsCapturing()const
+{
+	return mCaptureFramesLeft > 0;
+}
+
+double Profiler::TicksPerSecond()const
+{
+	return mTicksPerSecond;
+}
+
+std::vector<Profiler::ScopeStats> Profiler::GetStats()const
+{
+	auto stats = [](const Node& node, const char* name, std::uint32_t depth)
+	{
+		ScopeStats s;
+		s.Name = name;
+		s.Depth = depth;
+		s.FrameCount = node.HistoryCount;
+		if(node.HistoryCount == 0)
+			return s;
+
+		float history[HistoryFrames];
+		std::copy(node.HistoryMs, node.HistoryMs + node.HistoryCount, history);
+		std::sort(history, history + node.HistoryCount);
+
+		float sum = 0.0f;
+		std::uint32_t calls = 0;
+		for(std::uint32_t i = 0; i < node.HistoryCount; ++i)
+		{
+			sum += history[i];
+			calls += node.HistoryCalls[i];
+		}
+
+		std::uint32_t p99 = (99*node.HistoryCount + 99) / 100 - 1;
+
+		s.MinMs = history[0];
+		s.AvgMs = sum / node.HistoryCount;
+		s.P99Ms = history[p99];
+		s.CallsPerFrame = (float)calls / node.HistoryCount;
+		return s;
+	};
+
+	std::vector<ScopeStats> result;
+	result.push_back(stats(mFrameNode, mFrameNode.Name, 0));
+
+	// Children of every path, in the order they were first seen.
+	std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> children;
+	for(std::uint32_t i = 0; i < (std::uint32_t)mNodes.size(); ++i)
+		children[mNodes[i].ParentPath].push_back(i);
+
+	// Depth first from the outermost scopes (parent path 0).
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> stack;
+	auto pushChildren = [&](std::uint64_t path, std::uint32_t depth)
+	{
+		auto it = children.find(path);
+		if(it == children.end())
+			return;
+
+		for(auto c = it->second.rbegin(); c != it->second.rend(); ++c)
+			stack.push_back({ *c, depth });
+	};
+
+	pushChildren(0, 1);
+	while(!stack.empty())
+	{
+		auto top = stack.back();
+		stack.pop_back();
+
+		const Node& node = mNodes[top.first];
+		result.push_back(stats(node, node.Name, top.second));
+		pushChildren(node.Path, top.second + 1);
+	}
+
+	return result;
+}
+
+std::string Profiler::FormatStats()const
+{
+	std::string text;
+	char line[256];
+
+	std::uint64_t droppedCount = 0;
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for(auto& buffer : mThreads)
+			droppedCount += buffer->DroppedCount;
+	}
+
+	snprintf(line, sizeof(line), "%-48s %9s %9s %9s %9s\n", "Scope (ms per frame)", "min", "avg", "p99", "calls");
+	text += line;
+
+	for(const ScopeStats& s : GetStats())
+	{
+		std::string name = std::string(2*s.Depth, ' ') + s.Name;
+		snprintf(line, sizeof(line), "%-48s %9.3f %9.3f %9.3f %9.1f\n",
+			name.c_str(), s.MinMs, s.AvgMs, s.P99Ms, s.CallsPerFrame);
+		text += line;
+	}
+
+	if(droppedCount > 0)
+	{
+		snprintf(line, sizeof(line), "%llu events dropped (full thread buffers)\n", (unsigned long long)droppedCount);
+		text += line;
+	}
+
+	return text;
+}
+
+Profiler::ThreadBuffer* Profiler::ThisThreadBuffer()
+{
+	if(tBufferOwner == this)
+		return (ThreadBuffer*)tBuffer;
+
+	std::lock_guard<std::mutex> lock(mThreadsMutex);
+
+	auto buffer = std::make_unique<ThreadBuffer>();
+	buffer->Index = (std::uint32_t)mThreads.size();
+	buffer->Name = "Thread " + std::to_string(buffer->Index);
+
+	tBufferOwner = this;
+	tBuffer = buffer.get();
+
+	mThreads.push_back(std::move(buffer));
+	return (ThreadBuffer*)tBuffer;
+}
+
+void Profiler::Record(const Event& e)
+{
+	ThreadBuffer* buffer = ThisThreadBuffer();
+
+	const std::uint32_t head = buffer->Head.load(std::memory_order_relaxed);
+	const std::uint32_t tail = buffer->Tail.load(std::memory_order_acquire);
+	if(head - tail >= ThreadBuffer::Capacity)
+	{
+		buffer->DroppedCount++;
+		return;
+	}
+
+	buffer->Events[head & (ThreadBuffer::Capacity - 1)] = e;
+	buffer->Head.store(head + 1, std::memory_order_release);
+}
+
+Profiler::Node& Profiler::GetNode(const char* name, std::uint64_t path, std::uint64_t parentPath)
+{
+	auto it = mNodeIndices.find(path);
+	if(it != mNodeIndices.end())
+		return mNodes[it->second];
+
+	mNodeIndices[path] = (std::uint32_t)mNodes.size();
+	mNodes.emplace_back();
+
+	Node& node = mNodes.back();
+	node.Name = name;
+	node.Path = path;
+	node.ParentPath = parentPath;
+	return node;
+}
+
+void Profiler::PushHistory(Node& node, float ms, std::uint32_t calls)
+{
+	node.HistoryMs[node.HistoryNext] = ms;
+	node.HistoryCalls[node.HistoryNext] = calls;
+	node.HistoryNext = (node.HistoryNext + 1) % HistoryFrames;
+	node.HistoryCount = std::min<std::uint32_t>(node.HistoryCount + 1, HistoryFrames);
+}
+
+void Profiler::WriteCapture()const
+{
+	std::ofstream out(mCapturePath);
+	if(!out)
+		return;
+
+	const double usPerTick = 1e6 / mTicksPerSecond;
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+	{
+		std::lock_guard<std::mutex> lock(mThreadsMutex);
+		for(auto& buffer : mThreads)
+		{
+			out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->Index
+				<< ",\"args\":{\"name\":";
+			WriteJsonString(out, buffer->Name.c_str());
+			out << "}}";
+			first = false;
+		}
+	}
+
+	char number[64];
+	for(const CapturedEvent& e : mCapturedEvents)
+	{
+		out << (first ? "" : ",\n") << "{\"name\":";
+		WriteJsonString(out, e.Name);
+
+		snprintf(number, sizeof(number), "%.3f", (e.Begin - mCaptureStart)*usPerTick);
+		out << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.Thread << ",\"ts\":" << number;
+		snprintf(number, sizeof(number), "%.3f", (e.End - e.Begin)*usPerTick);
+		out << ",\"dur\":" << number << "}";
+		first = false;
+	}
+
+	out << "\n]}\n";
+}
+
+ProfileScope::ProfileScope(const char* name)
+{
+	mName = name;
+	mParentPath = tPath;
+	mPath = PathId(mParentPath, name);
+	tPath = mPath;
+
+	mBegin = Profiler::Now();
+}
+
+ProfileScope::~ProfileScope()
+{
+	std::uint64_t end = Profiler::Now();
+	tPath = mParentPath;
+
+	Profiler::Get().Record({ mName, mBegin, end, mPath, mParentPath });
+}
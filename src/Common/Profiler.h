@@ -0,0 +1,191 @@
+//***************************************************************************************
+// Profiler.h - Hierarchical CPU scope profiler with Chrome trace export
+//
+// PROFILE_SCOPE("Name") times the rest of the enclosing block on any thread.
+//   -A scope is stored as one event (name, begin, end, call path) in a lock-free
+//    ring buffer owned by its thread; only the first scope of a thread takes a lock,
+//    to register the buffer.  A full buffer drops events instead of blocking.
+//   -Timestamps are rdtsc where available (steady_clock otherwise); the tick rate is
+//    calibrated against the frame times of the GameTimer passed to NextFrame().
+//   -NextFrame() (main thread, once per frame) drains all buffers and adds the time
+//    of every call path (e.g., Draw/DrawSceneToShadowMap) to its frame total; the
+//    totals of the last HistoryFrames frames give min/avg/p99 per path.
+//   -CaptureFrames() additionally keeps the events of the next frames and writes
+//    them as Chrome trace JSON (chrome://tracing, Perfetto), one track per thread.
+// The markers compile out unless PROFILER_ENABLED is nonzero, which is the default in
+// debug builds only.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if !defined(PROFILER_ENABLED)
+#if defined(DEBUG) || defined(_DEBUG)
+#define PROFILER_ENABLED 1
+#else
+#define PROFILER_ENABLED 0
+#endif
+#endif
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) Profiler::Get().SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+class Profiler
+{
+public:
+	// Frames the min/avg/p99 are taken over.
+	static const std::uint32_t HistoryFrames = 128;
+
+	struct ScopeStats
+	{
+		std::string Name;
+		std::uint32_t Depth = 0;        // 0 for the frame, 1 for outermost scopes.
+		float MinMs = 0.0f;             // Per frame totals.
+		float AvgMs = 0.0f;
+		float P99Ms = 0.0f;
+		float CallsPerFrame = 0.0f;
+		std::uint32_t FrameCount = 0;   // Frames of the history the scope ran in.
+	};
+
+	static Profiler& Get();
+
+	// Current timestamp in ticks.
+	static std::uint64_t Now();
+
+	Profiler(const Profiler& rhs) = delete;
+	Profiler& operator=(const Profiler& rhs) = delete;
+
+	// Name of the calling thread in the trace.
+	void SetThreadName(const std::string& name);
+
+	// Call once per frame on the main thread, right after GameTimer::Tick(), with
+	// GameTimer::DeltaTime().  Returns true when a capture was just written.  The
+	// other functions below are for the main thread too.
+	bool NextFrame(float deltaTime);
+
+	// Record the next frameCount frames and write them to path.
+	void CaptureFrames(std::uint32_t frameCount, const std::string& path);
+	bool IsCapturing()const;
+
+	double TicksPerSecond()const;
+
+	// The call paths depth first, children after their parent; the first entry is
+	// the whole frame.
+	std::vector<ScopeStats> GetStats()const;
+
+	// GetStats() as an indented text table.
+	std::string FormatStats()const;
+
+private:
+	friend class ProfileScope;
+
+	Profiler();
+
+	struct Event
+	{
+		const char* Name;
+		std::uint64_t Begin;
+		std::uint64_t End;
+		std::uint64_t Path;
+		std::uint64_t ParentPath;
+	};
+
+	// Single producer (the owning thread), single consumer (NextFrame()) ring.
+	struct ThreadBuffer
+	{
+		static const std::uint32_t Capacity = 1 << 14;
+
+		Event Events[Capacity];
+		std::atomic<std::uint32_t> Head{ 0 };
+		std::atomic<std::uint32_t> Tail{ 0 };
+		std::atomic<std::uint64_t> DroppedCount{ 0 };
+
+		std::uint32_t Index = 0;
+		std::string Name;
+	};
+
+	// Frame totals of one call path.
+	struct Node
+	{
+		const char* Name = nullptr;
+		std::uint64_t Path = 0;
+		std::uint64_t ParentPath = 0;
+
+		std::uint64_t FrameTicks = 0;
+		std::uint32_t FrameCalls = 0;
+
+		float HistoryMs[HistoryFrames];
+		std::uint32_t HistoryCalls[HistoryFrames];
+		std::uint32_t HistoryCount = 0;
+		std::uint32_t HistoryNext = 0;
+	};
+
+	struct CapturedEvent
+	{
+		const char* Name;
+		std::uint64_t Begin;
+		std::uint64_t End;
+		std::uint32_t Thread;
+	};
+
+	ThreadBuffer* ThisThreadBuffer();
+	void Record(const Event& e);
+
+	Node& GetNode(const char* name, std::uint64_t path, std::uint64_t parentPath);
+	static void PushHistory(Node& node, float ms, std::uint32_t calls);
+	void WriteCapture()const;
+
+	// All thread buffers; a buffer lives as long as the profiler.
+	mutable std::mutex mThreadsMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> mThreads;
+
+	// Tick rate, first from steady_clock, then from the GameTimer.
+	std::uint64_t mStartTicks = 0;
+	double mStartSeconds = 0.0;
+	double mTicksPerSecond = 1e9;
+	std::uint64_t mCalibrationTicks = 0;
+	double mCalibrationSeconds = 0.0;
+
+	std::uint64_t mFrameStart = 0;
+	Node mFrameNode;
+	std::vector<Node> mNodes;
+	std::unordered_map<std::uint64_t, std::uint32_t> mNodeIndices;
+
+	std::uint32_t mCaptureFramesLeft = 0;
+	std::uint64_t mCaptureStart = 0;
+	std::string mCapturePath;
+	std::vector<CapturedEvent> mCapturedEvents;
+};
+
+// Times its lifetime; use through PROFILE_SCOPE.  name must be a string literal (or
+// otherwise outlive the profiler).
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name);
+	ProfileScope(const ProfileScope& rhs) = delete;
+	ProfileScope& operator=(const ProfileScope& rhs) = delete;
+	~ProfileScope();
+
+private:
+	const char* mName;
+	std::uint64_t mPath;
+	std::uint64_t mParentPath;
+	std::uint64_t mBegin;
+};
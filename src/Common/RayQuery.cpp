@@ -0,0 +1,253 @@
+//***************************************************************************************
+// RayQuery.cpp - Batched ray queries against a scene of triangle meshes
+//***************************************************************************************
+
+#include "RayQuery.h"
+#include "TransformKernels.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include <cassert>
+
+using namespace DirectX;
+
+namespace
+{
+	float SafeReciprocal(float d)
+	{
+		const float tiny = 1e-20f;
+		if(fabsf(d) < tiny)
+			d = d < 0.0f ? -tiny : tiny;
+
+		return 1.0f / d;
+	}
+
+	// Slab test of one ray against a Bvh node box.
+	bool RayEntersBox(const Bvh::Node& node, const XMFLOAT3& origin, const XMFLOAT3& invDir, float maxDist)
+	{
+		float tNear = 0.0f;
+		float tFar = maxDist;
+		for(UINT axis = 0; axis < 3; ++axis)
+		{
+			const float c = (&node.Center.x)[axis];
+			const float e = (&node.Extents.x)[axis];
+			const float o = (&origin.x)[axis];
+			const float inv = (&invDir.x)[axis];
+
+			float t0 = (c - e - o)*inv;
+			float t1 = (c + e - o)*inv;
+			if(inv < 0.0f)
+				std::swap(t0, t1);
+
+			tNear = MathHelper::Max(tNear, t0);
+			tFar = MathHelper::Min(tFar, t1);
+		}
+
+		return tNear <= tFar;
+	}
+}
+
+UINT RayQuery::AddInstance(const TriangleBvh* mesh, FXMMATRIX world)
+{
+	assert(mesh != nullptr);
+
+	mInstances.emplace_back();
+	mInstances.back().Mesh = mesh;
+
+	const UINT index = (UINT)mInstances.size() - 1;
+	SetInstanceWorld(index, world);
+
+	return index;
+}
+
+void RayQuery::SetInstanceWorld(UINT instance, FXMMATRIX world)
+{
+	assert(instance < mInstances.size());
+
+	// The inverse is computed in Build(), together with those of all instances.
+	XMStoreFloat4x4(&mInstances[instance].World, world);
+}
+
+void RayQuery::Build()
+{
+	if(!mInstances.empty())
+	{
+		TransformKernels::InverseAffine(&mInstances[0].World, sizeof(Instance), (UINT)mInstances.size(),
+			&mInstances[0].InvWorld, nullptr);
+	}
+
+	std::vector<BoundingBox> bounds(mInstances.size());
+	for(size_t i = 0; i < mInstances.size(); ++i)
+	{
+		const Instance& instance = mInstances[i];
+		instance.Mesh->Bounds().Transform(bounds[i], XMLoadFloat4x4(&instance.World));
+	}
+
+	mInstanceBvh.Build(bounds.data(), nullptr, (UINT)bounds.size(), 1);
+}
+
+void RayQuery::Clear()
+{
+	mInstances.clear();
+	mInstanceBvh.Clear();
+}
+
+UINT RayQuery::InstanceCount()const
+{
+	return (UINT)mInstances.size();
+}
+
+UINT RayQuery::Octant(const XMFLOAT3& dir)
+{
+	return (dir.x < 0.0f ? 1u : 0u) | (dir.y < 0.0f ? 2u : 0u) | (dir.z < 0.0f ? 4u : 0u);
+}
+
+UINT RayQuery::Trace(const Ray* rays, UINT count, Mode mode, Result* outResults, bool multithreaded)const
+{
+	PROFILE_SCOPE("RayQuery::Trace");
+
+	if(count == 0)
+		return 0;
+
+	// Counting sort of the rays by octant, keeping the order within an octant so
+	// neighbouring rays of a coherent batch (e.g., adjacent pixels) stay together.
+	UINT octantStart[9] = {};
+	for(UINT i = 0; i < count; ++i)
+		octantStart[Octant(rays[i].Direction) + 1]++;
+	for(UINT o = 1; o < 9; ++o)
+		octantStart[o] += octantStart[o - 1];
+
+	std::vector<UINT> order(count);
+	UINT octantNext[8];
+	std::copy(octantStart, octantStart + 8, octantNext);
+	for(UINT i = 0; i < count; ++i)
+		order[octantNext[Octant(rays[i].Direction)]++] = i;
+
+	// Packets of four rays, never mixing octants.
+	std::vector<Packet> packets;
+	packets.reserve(count / 4 + 8);
+	for(UINT o = 0; o < 8; ++o)
+	{
+		for(UINT first = octantStart[o]; first < octantStart[o + 1]; first += 4)
+			packets.push_back({ first, MathHelper::Min(4u, octantStart[o + 1] - first) });
+	}
+
+	const UINT packetCount = (UINT)packets.size();
+	const UINT taskCount = (packetCount + PacketsPerTask - 1) / PacketsPerTask;
+
+	auto traceTask = [&](UINT task)
+	{
+		const UINT first = task*PacketsPerTask;
+		const UINT last = MathHelper::Min(first + PacketsPerTask, packetCount);
+		for(UINT p = first; p < last; ++p)
+			TracePacket(rays, &order[packets[p].First], packets[p].Count, mode, outResults);
+	};
+
+	if(multithreaded && taskCount > 1)
+	{
+		JobSystem::Default().ParallelFor(0u, taskCount, traceTask);
+	}
+	else
+	{
+		for(UINT task = 0; task < taskCount; ++task)
+			traceTask(task);
+	}
+
+	UINT hitCount = 0;
+	for(UINT i = 0; i < count; ++i)
+	{
+		if(outResults[i].Instance != NoHit)
+			++hitCount;
+	}
+
+	return hitCount;
+}
+
+void RayQuery::TracePacket(const Ray* rays, const UINT* rayIndices, UINT rayCount, Mode mode, Result* outResults)const
+{
+	assert(rayCount >= 1 && rayCount <= 4);
+
+	// Unused lanes repeat the first ray but are inactive (negative distance).
+	XMFLOAT3 origins[4];
+	XMFLOAT3 dirs[4];
+	XMFLOAT3 invDirs[4];
+	float tMax[4];
+	for(UINT lane = 0; lane < 4; ++lane)
+	{
+		const bool used = lane < rayCount;
+		const Ray& ray = rays[rayIndices[used ? lane : 0]];
+
+		origins[lane] = ray.Origin;
+		dirs[lane] = ray.Direction;
+		invDirs[lane] = XMFLOAT3(
+			SafeReciprocal(ray.Direction.x),
+			SafeReciprocal(ray.Direction.y),
+			SafeReciprocal(ray.Direction.z));
+		tMax[lane] = used ? ray.MaxDist : -1.0f;
+
+		if(used)
+			outResults[rayIndices[lane]] = Result();
+	}
+
+	const bool anyHit = mode == Mode::AnyHit;
+	const auto& nodes = mInstanceBvh.Nodes();
+	const auto& items = mInstanceBvh.Items();
+
+	UINT nodeIndex = 0;
+	while(nodeIndex < nodes.size())
+	{
+		const Bvh::Node& node = nodes[nodeIndex];
+
+		bool entered = false;
+		for(UINT lane = 0; lane < 4 && !entered; ++lane)
+			entered = tMax[lane] >= 0.0f && RayEntersBox(node, origins[lane], invDirs[lane], tMax[lane]);
+
+		if(!entered)
+		{
+			nodeIndex = node.Skip;
+			continue;
+		}
+
+		if(node.Skip == nodeIndex + 1)
+		{
+			for(UINT i = node.First; i < node.First + node.Count; ++i)
+			{
+				const UINT instanceIndex = items[i];
+				const Instance& instance = mInstances[instanceIndex];
+
+				// The rays in the mesh's local space.  The directions are not
+				// renormalized, so the distances stay in units of the world rays.
+				XMMATRIX invWorld = XMLoadFloat4x4(&instance.InvWorld);
+				XMFLOAT3 localOrigins[4];
+				XMFLOAT3 localDirs[4];
+				for(UINT lane = 0; lane < 4; ++lane)
+				{
+					XMStoreFloat3(&localOrigins[lane], XMVector3TransformCoord(XMLoadFloat3(&origins[lane]), invWorld));
+					XMStoreFloat3(&localDirs[lane], XMVector3TransformNormal(XMLoadFloat3(&dirs[lane]), invWorld));
+				}
+
+				TriangleBvh::Hit hits[4];
+				int mask = instance.Mesh->RayCast4(localOrigins, localDirs, tMax, anyHit, hits);
+
+				for(UINT lane = 0; lane < rayCount; ++lane)
+				{
+					if((mask & (1 << lane)) == 0)
+						continue;
+
+					Result& result = outResults[rayIndices[lane]];
+					result.Distance = hits[lane].Distance;
+					result.Instance = instanceIndex;
+					result.Triangle = hits[lane].Triangle;
+					result.U = hits[lane].U;
+					result.V = hits[lane].V;
+
+					tMax[lane] = anyHit ? -1.0f : hits[lane].Distance;
+				}
+			}
+
+			if(tMax[0] < 0.0f && tMax[1] < 0.0f && tMax[2] < 0.0f && tMax[3] < 0.0f)
+				break;
+		}
+
+		nodeIndex = nodeIndex + 1;
+	}
+}
@@ -0,0 +1,98 @@
+//***************************************************************************************
+// RayQuery.h - Batched ray queries against a scene of triangle meshes
+//
+// Traces arrays of rays against instances of TriangleBvh meshes and writes one
+// result per ray to a caller supplied array.
+//   -The instances are kept in a Bvh over their world space boxes; each mesh is
+//    traversed in its local space with the rays transformed by the inverse world.
+//   -The rays are sorted by the signs of their directions (octant) and grouped
+//    into packets of four, which traverse the trees together (TriangleBvh::RayCast4).
+//   -The packets are split into tasks run on the worker threads.
+//   -ClosestHit finds the nearest hit of each ray; AnyHit stops at the first hit
+//    found, which is all occlusion (shadow, ambient occlusion) rays need.
+//***************************************************************************************
+
+#pragma once
+
+#include "Bvh.h"
+#include "TriangleBvh.h"
+
+class RayQuery
+{
+public:
+	static const UINT NoHit = 0xffffffff;
+
+	enum class Mode
+	{
+		ClosestHit,
+		AnyHit
+	};
+
+	struct Ray
+	{
+		DirectX::XMFLOAT3 Origin;
+		DirectX::XMFLOAT3 Direction;  // Need not be normalized.
+		float MaxDist = MathHelper::Infinity;
+	};
+
+	struct Result
+	{
+		// Distance along the ray in units of |Direction|.
+		float Distance = 0.0f;
+
+		// Instance and triangle hit; Instance is NoHit on a miss.
+		UINT Instance = NoHit;
+		UINT Triangle = 0;
+
+		// Barycentric coordinates of the hit point (see TriangleBvh::Hit).
+		float U = 0.0f;
+		float V = 0.0f;
+	};
+
+	RayQuery() = default;
+	RayQuery(const RayQuery& rhs) = delete;
+	RayQuery& operator=(const RayQuery& rhs) = delete;
+	~RayQuery() = default;
+
+	// Add an instance of mesh placed by world (an affine matrix).  The mesh is
+	// referenced, not copied, and must outlive the queries.  Returns the instance
+	// index reported in the results.  Call Build() after adding or moving instances;
+	// it also inverts the world matrices, all in one batch.
+	UINT AddInstance(const TriangleBvh* mesh, DirectX::FXMMATRIX world);
+	void SetInstanceWorld(UINT instance, DirectX::FXMMATRIX world);
+	void Build();
+	void Clear();
+
+	UINT InstanceCount()const;
+
+	// Trace rays[0..count) and write outResults[i] for rays[i].  With multithreaded
+	// the packets are spread over the worker threads.  Returns the number of hits.
+	UINT Trace(const Ray* rays, UINT count, Mode mode, Result* outResults, bool multithreaded = true)const;
+
+	// Direction octant of a ray: bit 0/1/2 set for a negative x/y/z direction.
+	static UINT Octant(const DirectX::XMFLOAT3& dir);
+
+private:
+	struct Instance
+	{
+		const TriangleBvh* Mesh = nullptr;
+		DirectX::XMFLOAT4X4 World;
+		DirectX::XMFLOAT4X4 InvWorld;
+	};
+
+	// Up to four rays (indices into the sorted ray order) traced together.
+	struct Packet
+	{
+		UINT First;
+		UINT Count;
+	};
+
+	void TracePacket(const Ray* rays, const UINT* rayIndices, UINT rayCount, Mode mode, Result* outResults)const;
+
+	// Packets per task given to a worker thread.
+	static const UINT PacketsPerTask = 64;
+
+private:
+	std::vector<Instance> mInstances;
+	Bvh mInstanceBvh;
+};
@@ -0,0 +1,138 @@
+//***************************************************************************************
+// RenderDevice.h - Thin rendering interface over D3D12 and a null backend
+//
+// Buffers and command recording go through RenderDevice and RenderCommandList
+// instead of ID3D12Device and ID3D12GraphicsCommandList, so the CPU side of a frame
+// can run and be measured without a GPU.
+//   -D3D12RenderDevice/D3D12CommandList (D3D12RenderDevice.h) forward every call to
+//    D3D12 and behave as before.
+//   -NullRenderDevice/NullCommandList (NullRenderDevice.h) keep buffers in CPU
+//    memory, record commands into a compact stream, and count draws, barriers and
+//    uploaded bytes.
+// Only standard types are used here, so the interface and the null backend build
+// on any platform.  Pipeline states and root signatures are opaque pointers that the
+// D3D12 backend casts back to its objects.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+typedef std::uint64_t GpuAddress;       // D3D12_GPU_VIRTUAL_ADDRESS
+typedef std::uint64_t GpuDescriptor;    // D3D12_GPU_DESCRIPTOR_HANDLE::ptr
+
+struct RenderPipeline;                  // ID3D12PipelineState
+struct RenderRootSignature;             // ID3D12RootSignature
+
+enum class RenderHeap
+{
+	Default,
+	Upload
+};
+
+enum class ResourceState
+{
+	Common,
+	VertexAndConstantBuffer,
+	IndexBuffer,
+	RenderTarget,
+	UnorderedAccess,
+	DepthWrite,
+	DepthRead,
+	NonPixelShaderResource,
+	PixelShaderResource,
+	CopyDest,
+	CopySource,
+	GenericRead,
+	Present
+};
+
+enum class PrimitiveTopology
+{
+	Undefined,
+	PointList,
+	LineList,
+	LineStrip,
+	TriangleList,
+	TriangleStrip
+};
+
+enum class IndexFormat
+{
+	UInt16,
+	UInt32
+};
+
+struct VertexBufferView
+{
+	GpuAddress Address = 0;
+	std::uint32_t SizeInBytes = 0;
+	std::uint32_t StrideInBytes = 0;
+};
+
+struct IndexBufferView
+{
+	GpuAddress Address = 0;
+	std::uint32_t SizeInBytes = 0;
+	IndexFormat Format = IndexFormat::UInt16;
+};
+
+class RenderResource
+{
+public:
+	virtual ~RenderResource() = default;
+};
+
+class RenderBuffer : public RenderResource
+{
+public:
+	virtual std::uint64_t Size()const = 0;
+	virtual GpuAddress GetGpuAddress()const = 0;
+
+	// Copy byteSize bytes to offset.  Upload heap buffers only; the range must not
+	// be in use by the GPU.
+	virtual void Write(std::uint64_t offset, const void* data, std::uint64_t byteSize) = 0;
+
+	// The CPU address of an upload heap buffer, which stays mapped until it is
+	// destroyed; nullptr for default heap buffers.
+	virtual std::uint8_t* MappedData()const = 0;
+};
+
+// The subset of ID3D12GraphicsCommandList the demos draw with.
+class RenderCommandList
+{
+public:
+	virtual ~RenderCommandList() = default;
+
+	virtual void SetPipelineState(RenderPipeline* pso) = 0;
+	virtual void SetGraphicsRootSignature(RenderRootSignature* rootSignature) = 0;
+
+	// Slot 0 only.
+	virtual void SetVertexBuffer(const VertexBufferView& vbv) = 0;
+	virtual void SetIndexBuffer(const IndexBufferView& ibv) = 0;
+	virtual void SetPrimitiveTopology(PrimitiveTopology topology) = 0;
+
+	virtual void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress address) = 0;
+	virtual void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress address) = 0;
+	virtual void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, GpuDescriptor baseDescriptor) = 0;
+
+	virtual void DrawInstanced(std::uint32_t vertexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startVertexLocation, std::uint32_t startInstanceLocation) = 0;
+	virtual void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+		std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) = 0;
+
+	virtual void ResourceBarrier(RenderResource* resource, ResourceState before, ResourceState after) = 0;
+	virtual void CopyBufferRegion(RenderBuffer* dst, std::uint64_t dstOffset,
+		RenderBuffer* src, std::uint64_t srcOffset, std::uint64_t byteSize) = 0;
+};
+
+class RenderDevice
+{
+public:
+	virtual ~RenderDevice() = default;
+
+	// Upload heap buffers start in ResourceState::GenericRead, default heap buffers
+	// in ResourceState::Common.
+	virtual std::unique_ptr<RenderBuffer> CreateBuffer(std::uint64_t byteSize, RenderHeap heap) = 0;
+};
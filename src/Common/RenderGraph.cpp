@@ -0,0 +1,517 @@
+//***************************************************************************************
+// RenderGraph.cpp - Frame render graph with batched split barriers and aliased transients
+//***************************************************************************************
+
+#include "RenderGraph.h"
+#include "Profiler.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	const D3D12_RESOURCE_STATES ReadOnlyStates = D3D12_RESOURCE_STATE_GENERIC_READ | D3D12_RESOURCE_STATE_DEPTH_READ;
+
+	bool IsReadOnly(D3D12_RESOURCE_STATES state)
+	{
+		return state != D3D12_RESOURCE_STATE_COMMON && (state & ~ReadOnlyStates) == 0;
+	}
+
+	// True if a texture in state 'current' can be used in state 'wanted' as it is.
+	bool Satisfies(D3D12_RESOURCE_STATES current, D3D12_RESOURCE_STATES wanted)
+	{
+		if(current == wanted)
+			return true;
+
+		return IsReadOnly(current) && IsReadOnly(wanted) && (current & wanted) == wanted;
+	}
+
+	UINT64 AlignUp(UINT64 x, UINT64 alignment)
+	{
+		return (x + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+//
+// PassBuilder
+//
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph* graph, int pass) :
+	mGraph(graph),
+	mPass(pass)
+{
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(Texture texture, D3D12_RESOURCE_STATES state)
+{
+	assert(texture.IsValid());
+	assert(IsReadOnly(state));
+
+	mGraph->mPasses[mPass].Accesses.push_back({ texture.Index, state, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(Texture texture, D3D12_RESOURCE_STATES state)
+{
+	assert(texture.IsValid());
+	assert(!IsReadOnly(state));
+
+	mGraph->mPasses[mPass].Accesses.push_back({ texture.Index, state, true });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SideEffect()
+{
+	mGraph->mPasses[mPass].SideEffect = true;
+	return *this;
+}
+
+//
+// RenderGraph
+//
+
+RenderGraph::RenderGraph(ID3D12Device* device, ID3D12Fence* fence) :
+	md3dDevice(device),
+	mFence(fence)
+{
+}
+
+void RenderGraph::Reset()
+{
+	// clear() keeps the capacity, so a steady frame does not allocate here.
+	mPasses.clear();
+	mTextures.clear();
+	mSchedule.clear();
+	for(auto& batch : mBatches)
+		batch.clear();
+
+	UINT reallocationCount = mStats.ReallocationCount;
+	mStats = Stats();
+	mStats.ReallocationCount = reallocationCount;
+}
+
+RenderGraph::Texture RenderGraph::Import(ID3D12Resource* resource,
+	D3D12_RESOURCE_STATES initial, D3D12_RESOURCE_STATES final)
+{
+	assert(resource != nullptr);
+
+	TextureEntry entry;
+	entry.Resource = resource;
+	entry.Initial = initial;
+	entry.Final = final;
+	mTextures.push_back(entry);
+
+	Texture texture;
+	texture.Index = (int)mTextures.size() - 1;
+	return texture;
+}
+
+RenderGraph::Texture RenderGraph::Import(ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+	return Import(resource, state, state);
+}
+
+RenderGraph::Texture RenderGraph::Create(const char* name, const TextureDesc& desc)
+{
+	// Only render targets and depth buffers can share a heap on every resource heap tier.
+	assert(desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL));
+
+	TextureEntry entry;
+	entry.Name = name;
+	entry.Transient = true;
+	entry.Desc = desc;
+	mTextures.push_back(entry);
+
+	Texture texture;
+	texture.Index = (int)mTextures.size() - 1;
+	return texture;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name, PassFunction execute)
+{
+	Pass pass;
+	pass.Name = name;
+	pass.Execute = std::move(execute);
+	mPasses.push_back(std::move(pass));
+
+	return PassBuilder(this, (int)mPasses.size() - 1);
+}
+
+void RenderGraph::Compile(UINT64 fenceValue)
+{
+	PROFILE_SCOPE("RenderGraph::Compile");
+
+	CullPasses();
+	PlaceTransients();
+	BuildBarriers();
+
+	mFenceValue = fenceValue;
+}
+
+void RenderGraph::Execute(ID3D12GraphicsCommandList* cmdList)
+{
+	for(size_t i = 0; i < mSchedule.size(); ++i)
+	{
+		const auto& batch = mBatches[i];
+		if(!batch.empty())
+			cmdList->ResourceBarrier((UINT)batch.size(), batch.data());
+
+		mPasses[mSchedule[i]].Execute(cmdList);
+	}
+
+	const auto& last = mBatches[mSchedule.size()];
+	if(!last.empty())
+		cmdList->ResourceBarrier((UINT)last.size(), last.data());
+}
+
+ID3D12Resource* RenderGraph::Resource(Texture texture)const
+{
+	const TextureEntry& entry = mTextures[texture.Index];
+	if(!entry.Transient)
+		return entry.Resource;
+
+	return entry.Physical >= 0 ? mPhysicals[entry.Physical].Resource.Get() : nullptr;
+}
+
+const RenderGraph::Stats& RenderGraph::GetStats()const
+{
+	return mStats;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walk backwards, so every pass is decided after all the passes that could use
+	// its results.
+	std::vector<bool> used(mTextures.size(), false);
+
+	for(int i = (int)mPasses.size() - 1; i >= 0; --i)
+	{
+		Pass& pass = mPasses[i];
+
+		bool keep = pass.SideEffect;
+		for(const Access& access : pass.Accesses)
+		{
+			if(access.Write && (!mTextures[access.TextureIndex].Transient || used[access.TextureIndex]))
+				keep = true;
+		}
+
+		pass.Culled = !keep;
+		if(pass.Culled)
+		{
+			mStats.CulledPassCount++;
+			continue;
+		}
+
+		for(const Access& access : pass.Accesses)
+			used[access.TextureIndex] = true;
+	}
+
+	for(int i = 0; i < (int)mPasses.size(); ++i)
+	{
+		if(!mPasses[i].Culled)
+			mSchedule.push_back(i);
+	}
+
+	mStats.PassCount = (UINT)mSchedule.size();
+}
+
+void RenderGraph::PlaceTransients()
+{
+	struct Placement
+	{
+		int TextureIndex;
+		int First;
+		int Last;
+		D3D12_RESOURCE_STATES FirstState;
+		UINT64 Offset;
+		UINT64 Size;
+	};
+
+	// Lifetimes of the transients the kept passes use, in order of first use.
+	std::vector<Placement> placements;
+	std::vector<int> placementOf(mTextures.size(), -1);
+
+	for(int k = 0; k < (int)mSchedule.size(); ++k)
+	{
+		for(const Access& access : mPasses[mSchedule[k]].Accesses)
+		{
+			if(!mTextures[access.TextureIndex].Transient)
+				continue;
+
+			int& p = placementOf[access.TextureIndex];
+			if(p < 0)
+			{
+				p = (int)placements.size();
+				placements.push_back({ access.TextureIndex, k, k, access.State, 0, 0 });
+			}
+			placements[p].Last = k;
+		}
+	}
+
+	// First fit: the lowest offset that does not overlap the memory of a texture
+	// already placed whose lifetime overlaps.
+	UINT64 heapSize = 0;
+	for(size_t i = 0; i < placements.size(); ++i)
+	{
+		Placement& p = placements[i];
+
+		D3D12_RESOURCE_DESC rd = ResourceDesc(mTextures[p.TextureIndex].Desc);
+		D3D12_RESOURCE_ALLOCATION_INFO info = md3dDevice->GetResourceAllocationInfo(0, 1, &rd);
+		p.Size = info.SizeInBytes;
+
+		UINT64 offset = 0;
+		for(bool moved = true; moved; )
+		{
+			moved = false;
+			for(size_t j = 0; j < i; ++j)
+			{
+				const Placement& q = placements[j];
+
+				bool liveTogether = p.First <= q.Last && q.First <= p.Last;
+				bool overlap = offset < q.Offset + q.Size && q.Offset < offset + p.Size;
+				if(liveTogether && overlap)
+				{
+					offset = AlignUp(q.Offset + q.Size, info.Alignment);
+					moved = true;
+				}
+			}
+		}
+
+		p.Offset = offset;
+		heapSize = std::max<UINT64>(heapSize, offset + p.Size);
+
+		mStats.TransientBytes += p.Size;
+	}
+
+	mStats.TransientCount = (UINT)placements.size();
+	mStats.HeapBytes = heapSize;
+
+	// Keep last frame's resources if the layout did not change.
+	bool same = placements.size() == mPhysicals.size();
+	for(size_t i = 0; same && i < placements.size(); ++i)
+	{
+		const Physical& physical = mPhysicals[i];
+		const Placement& p = placements[i];
+
+		same = SameDesc(physical.Desc, mTextures[p.TextureIndex].Desc) && physical.Offset == p.Offset;
+	}
+
+	if(!same)
+	{
+		// The GPU may still be using the old resources and views.
+		WaitForLastFrame();
+
+		mPhysicals.clear();
+		mHeap = nullptr;
+
+		if(heapSize > 0)
+		{
+			D3D12_HEAP_DESC heapDesc = {};
+			heapDesc.SizeInBytes = AlignUp(heapSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+			heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+			heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+			ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+		}
+
+		for(const Placement& p : placements)
+		{
+			Physical physical;
+			physical.Desc = mTextures[p.TextureIndex].Desc;
+			physical.Offset = p.Offset;
+			physical.Size = p.Size;
+			physical.State = p.FirstState;
+
+			D3D12_RESOURCE_DESC rd = ResourceDesc(physical.Desc);
+			bool hasClearValue = physical.Desc.ClearValue.Format != DXGI_FORMAT_UNKNOWN;
+			ThrowIfFailed(md3dDevice->CreatePlacedResource(
+				mHeap.Get(),
+				p.Offset,
+				&rd,
+				p.FirstState,
+				hasClearValue ? &physical.Desc.ClearValue : nullptr,
+				IID_PPV_ARGS(&physical.Resource)));
+			physical.Resource->SetName(AnsiToWString(mTextures[p.TextureIndex].Name).c_str());
+
+			CreateViews(physical);
+			mPhysicals.push_back(std::move(physical));
+		}
+
+		for(size_t i = 0; i < placements.size(); ++i)
+		{
+			Physical& a = mPhysicals[i];
+			for(size_t j = i + 1; j < placements.size(); ++j)
+			{
+				Physical& b = mPhysicals[j];
+				if(a.Offset < b.Offset + b.Size && b.Offset < a.Offset + a.Size)
+					a.Aliased = b.Aliased = true;
+			}
+		}
+
+		mStats.ReallocationCount++;
+	}
+
+	for(size_t i = 0; i < placements.size(); ++i)
+		mTextures[placements[i].TextureIndex].Physical = (int)i;
+}
+
+void RenderGraph::BuildBarriers()
+{
+	int passCount = (int)mSchedule.size();
+	mBatches.resize(passCount + 1);
+
+	// The uses of every texture by the kept passes; a pass using a texture twice
+	// counts once, in the combined state.
+	struct Use
+	{
+		int Pass;
+		D3D12_RESOURCE_STATES State;
+	};
+	std::vector<std::vector<Use>> uses(mTextures.size());
+
+	for(int k = 0; k < passCount; ++k)
+	{
+		for(const Access& access : mPasses[mSchedule[k]].Accesses)
+		{
+			auto& u = uses[access.TextureIndex];
+			if(!u.empty() && u.back().Pass == k)
+			{
+				assert(IsReadOnly(u.back().State) == IsReadOnly(access.State) || u.back().State == access.State);
+				if(IsReadOnly(access.State))
+					u.back().State |= access.State;
+			}
+			else
+			{
+				u.push_back({ k, access.State });
+			}
+		}
+	}
+
+	auto transition = [&](ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after,
+		int lastUse, int nextUse, bool canSplit)
+	{
+		// Split when a pass that does not use the texture lies in between.
+		if(canSplit && nextUse > lastUse + 1)
+		{
+			mBatches[lastUse + 1].push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, before, after,
+				D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+			mBatches[nextUse].push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, before, after,
+				D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY));
+
+			mStats.BarrierCount += 2;
+			mStats.SplitBarrierCount++;
+		}
+		else
+		{
+			mBatches[nextUse].push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, before, after));
+			mStats.BarrierCount++;
+		}
+	};
+
+	for(size_t t = 0; t < mTextures.size(); ++t)
+	{
+		const TextureEntry& entry = mTextures[t];
+		if(uses[t].empty())
+			continue;
+
+		ID3D12Resource* resource = Resource(Texture{ (int)t });
+		Physical* physical = entry.Transient ? &mPhysicals[entry.Physical] : nullptr;
+
+		D3D12_RESOURCE_STATES state = physical != nullptr ? physical->State : entry.Initial;
+		int lastUse = -1;
+
+		for(const Use& use : uses[t])
+		{
+			bool firstUse = lastUse < 0;
+
+			// Another texture may have used the memory since; activate this one.
+			// Transitions cannot begin before that.
+			if(firstUse && physical != nullptr && physical->Aliased)
+			{
+				mBatches[use.Pass].push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resource));
+				mStats.BarrierCount++;
+			}
+
+			if(Satisfies(state, use.State))
+			{
+				// Successive unordered access writes still have to wait for each other.
+				if(use.State == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && !firstUse)
+				{
+					mBatches[use.Pass].push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource));
+					mStats.BarrierCount++;
+				}
+			}
+			else
+			{
+				transition(resource, state, use.State, lastUse, use.Pass, physical == nullptr || !firstUse);
+				state = use.State;
+			}
+
+			lastUse = use.Pass;
+		}
+
+		if(physical != nullptr)
+			physical->State = state;
+		else if(state != entry.Final)
+			transition(resource, state, entry.Final, lastUse, passCount, true);
+	}
+
+	for(const auto& batch : mBatches)
+	{
+		if(!batch.empty())
+			mStats.BarrierBatchCount++;
+	}
+}
+
+void RenderGraph::WaitForLastFrame()
+{
+	if(mFence->GetCompletedValue() < mFenceValue)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		ThrowIfFailed(mFence->SetEventOnCompletion(mFenceValue, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+}
+
+void RenderGraph::CreateViews(const Physical& physical)
+{
+	const TextureDesc& desc = physical.Desc;
+	ID3D12Resource* resource = physical.Resource.Get();
+
+	if(desc.Srv.ptr != 0)
+	{
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Format = desc.SrvFormat != DXGI_FORMAT_UNKNOWN ? desc.SrvFormat : desc.Format;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = 1;
+		md3dDevice->CreateShaderResourceView(resource, &srvDesc, desc.Srv);
+	}
+
+	if(desc.Rtv.ptr != 0)
+		md3dDevice->CreateRenderTargetView(resource, nullptr, desc.Rtv);
+
+	if(desc.Dsv.ptr != 0)
+	{
+		D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+		dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+		dsvDesc.Format = desc.DsvFormat != DXGI_FORMAT_UNKNOWN ? desc.DsvFormat : desc.Format;
+		dsvDesc.Texture2D.MipSlice = 0;
+		md3dDevice->CreateDepthStencilView(resource, &dsvDesc, desc.Dsv);
+	}
+}
+
+bool RenderGraph::SameDesc(const TextureDesc& a, const TextureDesc& b)
+{
+	return a.Width == b.Width && a.Height == b.Height && a.Format == b.Format && a.Flags == b.Flags &&
+		memcmp(&a.ClearValue, &b.ClearValue, sizeof(D3D12_CLEAR_VALUE)) == 0 &&
+		a.Srv.ptr == b.Srv.ptr && a.Rtv.ptr == b.Rtv.ptr && a.Dsv.ptr == b.Dsv.ptr &&
+		a.SrvFormat == b.SrvFormat && a.DsvFormat == b.DsvFormat;
+}
+
+D3D12_RESOURCE_DESC RenderGraph::ResourceDesc(const TextureDesc& desc)
+{
+	return CD3DX12_RESOURCE_DESC::Tex2D(desc.Format, desc.Width, desc.Height, 1, 1, 1, 0, desc.Flags);
+}
@@ -0,0 +1,185 @@
+//***************************************************************************************
+// RenderGraph.h - Frame render graph with batched split barriers and aliased transients
+//
+// Each frame the passes are declared again, in execution order, together with the
+// textures they read and write and the state they need them in.  Compile() then:
+//   -Culls the passes whose results nobody uses.  Writing an imported texture (or
+//    calling SideEffect()) keeps a pass; so does writing a texture a kept pass reads
+//    or writes (a write may only cover part of the texture).
+//   -Places the transient textures in one heap.  Textures whose lifetimes (first to
+//    last kept pass using them) do not overlap share memory, first fit.  The placed
+//    resources are kept while the declarations do not change; when they do, the graph
+//    waits for the GPU to finish the last frame and creates new ones.
+//   -Works out every state transition.  All barriers in front of a pass go into one
+//    ResourceBarrier() call, and a transition over passes that do not use the texture
+//    is split: it begins right after the last use and ends right before the next one.
+// Execute() records the barriers and the passes.  Pass code never transitions graph
+// textures itself.
+//
+// Transient textures must be render targets or depth buffers; their contents are
+// undefined at the first use of a frame, so the first pass writing one clears it (or
+// copies over all of it).
+// Their views are written to descriptors the caller reserves in its own heaps.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <functional>
+
+class RenderGraph
+{
+public:
+	struct Texture
+	{
+		int Index = -1;
+
+		bool IsValid()const { return Index >= 0; }
+	};
+
+	struct TextureDesc
+	{
+		UINT Width = 0;
+		UINT Height = 0;
+		DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+		D3D12_RESOURCE_FLAGS Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+		D3D12_CLEAR_VALUE ClearValue = {};
+
+		// Descriptors the views are written to; ptr 0 for none.  The view formats
+		// default to Format, which must then not be typeless.
+		D3D12_CPU_DESCRIPTOR_HANDLE Srv = {};
+		D3D12_CPU_DESCRIPTOR_HANDLE Rtv = {};
+		D3D12_CPU_DESCRIPTOR_HANDLE Dsv = {};
+		DXGI_FORMAT SrvFormat = DXGI_FORMAT_UNKNOWN;
+		DXGI_FORMAT DsvFormat = DXGI_FORMAT_UNKNOWN;
+	};
+
+	class PassBuilder
+	{
+	public:
+		PassBuilder(RenderGraph* graph, int pass);
+
+		// A pass may read a texture in several states at once (they are combined),
+		// but must not both read and write it.
+		PassBuilder& Read(Texture texture, D3D12_RESOURCE_STATES state);
+		PassBuilder& Write(Texture texture, D3D12_RESOURCE_STATES state);
+
+		// Never cull the pass.
+		PassBuilder& SideEffect();
+
+	private:
+		RenderGraph* mGraph;
+		int mPass;
+	};
+
+	using PassFunction = std::function<void(ID3D12GraphicsCommandList*)>;
+
+	struct Stats
+	{
+		UINT PassCount = 0;
+		UINT CulledPassCount = 0;
+		UINT BarrierCount = 0;          // Including both halves of split barriers.
+		UINT SplitBarrierCount = 0;
+		UINT BarrierBatchCount = 0;     // ResourceBarrier() calls.
+		UINT TransientCount = 0;
+		UINT64 TransientBytes = 0;      // Sum of the transient texture sizes.
+		UINT64 HeapBytes = 0;           // Memory they actually take.
+		UINT ReallocationCount = 0;     // Frames the placed resources were recreated.
+	};
+
+	// The fence is the one frames signal; see Compile().
+	RenderGraph(ID3D12Device* device, ID3D12Fence* fence);
+	RenderGraph(const RenderGraph& rhs) = delete;
+	RenderGraph& operator=(const RenderGraph& rhs) = delete;
+	~RenderGraph() = default;
+
+	// Start declaring a new frame.
+	void Reset();
+
+	// A texture that lives outside the graph.  It is in state 'initial' when the frame
+	// starts and is left in state 'final'.
+	Texture Import(ID3D12Resource* resource, D3D12_RESOURCE_STATES initial, D3D12_RESOURCE_STATES final);
+	Texture Import(ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+
+	// A texture that only lives during this frame.
+	Texture Create(const char* name, const TextureDesc& desc);
+
+	// Passes run in the order they are added.
+	PassBuilder AddPass(const char* name, PassFunction execute);
+
+	// fenceValue is the value the fence is signaled with after this frame.
+	void Compile(UINT64 fenceValue);
+	void Execute(ID3D12GraphicsCommandList* cmdList);
+
+	// Valid after Compile(); null for a texture only culled passes use.
+	ID3D12Resource* Resource(Texture texture)const;
+
+	const Stats& GetStats()const;
+
+private:
+	struct Access
+	{
+		int TextureIndex;
+		D3D12_RESOURCE_STATES State;
+		bool Write;
+	};
+
+	struct Pass
+	{
+		const char* Name;
+		PassFunction Execute;
+		std::vector<Access> Accesses;
+		bool SideEffect = false;
+		bool Culled = false;
+	};
+
+	struct TextureEntry
+	{
+		const char* Name = nullptr;
+		ID3D12Resource* Resource = nullptr;    // Imported only, until Compile().
+		D3D12_RESOURCE_STATES Initial = D3D12_RESOURCE_STATE_COMMON;
+		D3D12_RESOURCE_STATES Final = D3D12_RESOURCE_STATE_COMMON;
+		bool Transient = false;
+		TextureDesc Desc;
+		int Physical = -1;
+	};
+
+	// A placed resource, kept across frames.
+	struct Physical
+	{
+		TextureDesc Desc;
+		UINT64 Offset = 0;
+		UINT64 Size = 0;
+		bool Aliased = false;
+		D3D12_RESOURCE_STATES State = D3D12_RESOURCE_STATE_COMMON;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+	};
+
+	void CullPasses();
+	void PlaceTransients();
+	void BuildBarriers();
+
+	void WaitForLastFrame();
+	void CreateViews(const Physical& physical);
+
+	static bool SameDesc(const TextureDesc& a, const TextureDesc& b);
+	static D3D12_RESOURCE_DESC ResourceDesc(const TextureDesc& desc);
+
+private:
+	ID3D12Device* md3dDevice;
+	ID3D12Fence* mFence;
+
+	std::vector<Pass> mPasses;
+	std::vector<TextureEntry> mTextures;
+
+	// Kept passes in order, and the barriers in front of each of them; the last
+	// batch follows the last pass.
+	std::vector<int> mSchedule;
+	std::vector<std::vector<D3D12_RESOURCE_BARRIER>> mBatches;
+
+	Microsoft::WRL::ComPtr<ID3D12Heap> mHeap;
+	std::vector<Physical> mPhysicals;
+
+	UINT64 mFenceValue = 0;
+	Stats mStats;
+};
@@ -0,0 +1,171 @@
+//***************************************************************************************
+// ShadowCache.cpp - Bookkeeping for a cached static shadow map
+//***************************************************************************************
+
+#include "ShadowCache.h"
+#include <cstring>
+
+using namespace DirectX;
+
+void ShadowCache::SetSize(UINT width, UINT height)
+{
+	mWidth = width;
+	mHeight = height;
+
+	InvalidateAll();
+}
+
+void ShadowCache::SetLightViewProj(FXMMATRIX viewProj)
+{
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, viewProj);
+
+	mLightMoved = !mHasViewProj || memcmp(&m, &mViewProj, sizeof(m)) != 0;
+	if(mLightMoved)
+	{
+		mViewProj = m;
+		mHasViewProj = true;
+		InvalidateAll();
+	}
+}
+
+void ShadowCache::Invalidate(const BoundingBox& worldBounds)
+{
+	RECT r;
+	if(!TexelRect(worldBounds, r))
+		return;
+
+	if(!IsDirty())
+	{
+		mDirtyRect = r;
+		return;
+	}
+
+	mDirtyRect.left = MathHelper::Min(mDirtyRect.left, r.left);
+	mDirtyRect.top = MathHelper::Min(mDirtyRect.top, r.top);
+	mDirtyRect.right = MathHelper::Max(mDirtyRect.right, r.right);
+	mDirtyRect.bottom = MathHelper::Max(mDirtyRect.bottom, r.bottom);
+}
+
+void ShadowCache::InvalidateAll()
+{
+	mDirtyRect = { 0, 0, (LONG)mWidth, (LONG)mHeight };
+}
+
+bool ShadowCache::IsDirty()const
+{
+	return mDirtyRect.right > mDirtyRect.left && mDirtyRect.bottom > mDirtyRect.top;
+}
+
+bool ShadowCache::IsFullyDirty()const
+{
+	return mDirtyRect.left == 0 && mDirtyRect.top == 0 &&
+		mDirtyRect.right == (LONG)mWidth && mDirtyRect.bottom == (LONG)mHeight;
+}
+
+const RECT& ShadowCache::DirtyRect()const
+{
+	return mDirtyRect;
+}
+
+bool ShadowCache::BypassCache()const
+{
+	return mLightMoved;
+}
+
+void ShadowCache::MarkBypassed()
+{
+	mStats.BypassCount++;
+
+	// The static map stays dirty, and the shadow map no longer matches it, so the
+	// first cached frame redraws the static map and restores.
+	mDynamicDrawn = true;
+}
+
+bool ShadowCache::OverlapsDirtyRect(const BoundingBox& worldBounds)const
+{
+	if(!IsDirty())
+		return false;
+
+	RECT r;
+	if(!TexelRect(worldBounds, r))
+		return false;
+
+	return r.left < mDirtyRect.right && mDirtyRect.left < r.right &&
+		r.top < mDirtyRect.bottom && mDirtyRect.top < r.bottom;
+}
+
+void ShadowCache::MarkClean()
+{
+	if(IsDirty())
+	{
+		mStats.StaticRedrawCount++;
+		if(IsFullyDirty())
+			mStats.FullRedrawCount++;
+		mStats.RedrawnTexelCount += (UINT64)(mDirtyRect.right - mDirtyRect.left)*(mDirtyRect.bottom - mDirtyRect.top);
+
+		mStaticChanged = true;
+	}
+
+	mDirtyRect = { 0, 0, 0, 0 };
+}
+
+bool ShadowCache::BeginFrame(bool drawDynamicCasters)
+{
+	bool restore = mStaticChanged || mDynamicDrawn || drawDynamicCasters;
+
+	mStaticChanged = false;
+	mDynamicDrawn = drawDynamicCasters;
+
+	if(restore)
+		mStats.RestoreCount++;
+
+	return restore;
+}
+
+const ShadowCache::Stats& ShadowCache::GetStats()const
+{
+	return mStats;
+}
+
+bool ShadowCache::TexelRect(const BoundingBox& worldBounds, RECT& outRect)const
+{
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	worldBounds.GetCorners(corners);
+
+	XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+	float minX = +MathHelper::Infinity;
+	float minY = +MathHelper::Infinity;
+	float maxX = -MathHelper::Infinity;
+	float maxY = -MathHelper::Infinity;
+	for(UINT i = 0; i < BoundingBox::CORNER_COUNT; ++i)
+	{
+		XMFLOAT4 p;
+		XMStoreFloat4(&p, XMVector3Transform(XMLoadFloat3(&corners[i]), viewProj));
+
+		// Behind a perspective light; no finite rectangle covers the bound.
+		if(p.w <= 1e-6f)
+		{
+			outRect = { 0, 0, (LONG)mWidth, (LONG)mHeight };
+			return true;
+		}
+
+		// NDC to texels; y points down in the texture.
+		float x = (0.5f*p.x / p.w + 0.5f)*mWidth;
+		float y = (0.5f - 0.5f*p.y / p.w)*mHeight;
+
+		minX = MathHelper::Min(minX, x);
+		minY = MathHelper::Min(minY, y);
+		maxX = MathHelper::Max(maxX, x);
+		maxY = MathHelper::Max(maxY, y);
+	}
+
+	// Pad by a texel for the rasterization of edges.
+	outRect.left = (LONG)MathHelper::Max(floorf(minX) - 1.0f, 0.0f);
+	outRect.top = (LONG)MathHelper::Max(floorf(minY) - 1.0f, 0.0f);
+	outRect.right = (LONG)MathHelper::Min(ceilf(maxX) + 1.0f, (float)mWidth);
+	outRect.bottom = (LONG)MathHelper::Min(ceilf(maxY) + 1.0f, (float)mHeight);
+
+	return outRect.right > outRect.left && outRect.bottom > outRect.top;
+}
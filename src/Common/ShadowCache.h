@@ -0,0 +1,91 @@
+//***************************************************************************************
+// ShadowCache.h - Bookkeeping for a cached static shadow map
+//
+// The static casters are rendered into their own depth map, which is kept from frame
+// to frame; each frame the shadow map is restored from it and only the dynamic casters
+// are drawn on top.  This class decides what has to be redrawn.
+//   -A change of the light view-projection invalidates the whole static map.
+//   -A static caster that changes invalidates only the texels its light space bounds
+//    cover (call Invalidate() with its old and its new bounds); the dirty texels are
+//    kept as one rectangle, to be cleared and redrawn with a scissor rectangle.
+//   -The restore copy is skipped while the shadow map already holds exactly the
+//    static map, i.e., when no dynamic casters were drawn and nothing changed.
+//   -While the light moves the static map would be thrown away every frame, so the
+//    cache is bypassed: all casters go straight into the shadow map (see BypassCache()).
+//    The static map is redrawn once the light stops.
+// Intended for orthographic light projections; a bound behind a perspective light
+// invalidates everything.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+
+class ShadowCache
+{
+public:
+	struct Stats
+	{
+		UINT StaticRedrawCount = 0;     // Frames the static map was (partly) redrawn.
+		UINT FullRedrawCount = 0;       // Of those, frames it was redrawn completely.
+		UINT64 RedrawnTexelCount = 0;
+		UINT RestoreCount = 0;          // Frames the shadow map was restored.
+		UINT BypassCount = 0;           // Frames all casters were drawn directly.
+	};
+
+	// Size of the shadow map in texels.  Invalidates the whole static map.
+	void SetSize(UINT width, UINT height);
+
+	// Set the light view-projection of this frame; the static map is invalidated
+	// if it differs from the one it was rendered with.
+	void SetLightViewProj(DirectX::FXMMATRIX viewProj);
+
+	// Invalidate the texels covered by a world space bound.
+	void Invalidate(const DirectX::BoundingBox& worldBounds);
+	void InvalidateAll();
+
+	bool IsDirty()const;
+	bool IsFullyDirty()const;
+
+	// The texels of the static map to clear and redraw; empty if not dirty.
+	const RECT& DirtyRect()const;
+
+	// True if the light view-projection changed this frame.  Then draw all casters
+	// straight into the shadow map and call MarkBypassed() instead of redrawing the
+	// static map and calling MarkClean() and BeginFrame().
+	bool BypassCache()const;
+	void MarkBypassed();
+
+	// True if a world space bound covers texels of DirtyRect(), i.e., the static
+	// caster must be drawn in the redraw.
+	bool OverlapsDirtyRect(const DirectX::BoundingBox& worldBounds)const;
+
+	// Call after the static casters in DirtyRect() have been drawn.
+	void MarkClean();
+
+	// Call once per frame before drawing the dynamic casters.  Returns true if the
+	// shadow map must be restored from the static map: the static map changed, or
+	// dynamic casters were drawn over the shadow map last frame or will be now.
+	bool BeginFrame(bool drawDynamicCasters);
+
+	const Stats& GetStats()const;
+
+private:
+	// The texels a bound covers, padded by a texel, clipped to the map; returns
+	// false if it covers none or cannot be bounded.
+	bool TexelRect(const DirectX::BoundingBox& worldBounds, RECT& outRect)const;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+
+	DirectX::XMFLOAT4X4 mViewProj = MathHelper::Identity4x4();
+	bool mHasViewProj = false;
+	bool mLightMoved = false;
+
+	RECT mDirtyRect = { 0, 0, 0, 0 };
+	bool mStaticChanged = false;
+	bool mDynamicDrawn = false;
+
+	Stats mStats;
+};
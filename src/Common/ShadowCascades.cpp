@@ -0,0 +1,224 @@
+//***************************************************************************************
+// ShadowCascades.cpp - Cascaded shadow map fitting for a directional light
+//***************************************************************************************
+
+#include "ShadowCascades.h"
+#include <cassert>
+
+using namespace DirectX;
+
+namespace
+{
+	// Bounds of points transformed by M.
+	void TransformedBounds(const XMFLOAT3* points, UINT count, FXMMATRIX M, XMVECTOR& outMin, XMVECTOR& outMax)
+	{
+		outMin = XMVectorReplicate(+MathHelper::Infinity);
+		outMax = XMVectorReplicate(-MathHelper::Infinity);
+		for(UINT i = 0; i < count; ++i)
+		{
+			XMVECTOR p = XMVector3TransformCoord(XMLoadFloat3(&points[i]), M);
+			outMin = XMVectorMin(outMin, p);
+			outMax = XMVectorMax(outMax, p);
+		}
+	}
+
+	// Frustum planes of viewProj without the ones a caster moving along lightDir
+	// would cross inward: a box outside of such a plane can still throw its shadow
+	// into the volume, while a box outside of any other plane only moves away
+	// from the volume as it is extruded.
+	void ExtrudedPlanes(FXMMATRIX viewProj, FXMVECTOR lightDir, std::array<XMFLOAT4, 6>& outPlanes)
+	{
+		MathHelper::ExtractFrustumPlanes(viewProj, outPlanes.data());
+
+		for(XMFLOAT4& plane : outPlanes)
+		{
+			if(XMVectorGetX(XMVector3Dot(XMLoadFloat4(&plane), lightDir)) > 1e-4f)
+				plane = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+}
+
+void ShadowCascades::SetSettings(const Settings& settings)
+{
+	assert(settings.CascadeCount >= 1 && settings.CascadeCount <= MaxCascades);
+	assert(settings.Resolution >= 2 && settings.ExtentSteps >= 1);
+
+	mSettings = settings;
+}
+
+const ShadowCascades::Settings& ShadowCascades::GetSettings()const
+{
+	return mSettings;
+}
+
+UINT ShadowCascades::CascadeCount()const
+{
+	return mSettings.CascadeCount;
+}
+
+const ShadowCascades::Cascade& ShadowCascades::GetCascade(UINT i)const
+{
+	assert(i < mSettings.CascadeCount);
+	return mCascades[i];
+}
+
+XMMATRIX ShadowCascades::LightView()const
+{
+	return XMLoadFloat4x4(&mLightView);
+}
+
+float ShadowCascades::PracticalSplit(UINT i, UINT count, float nearZ, float farZ, float lambda)
+{
+	float t = (float)i / count;
+
+	float logSplit = nearZ*powf(farZ / nearZ, t);
+	float uniformSplit = nearZ + (farZ - nearZ)*t;
+
+	return lambda*logSplit + (1.0f - lambda)*uniformSplit;
+}
+
+void ShadowCascades::Update(FXMMATRIX cameraView, float fovY, float aspect, float nearZ, float farZ,
+	FXMVECTOR lightDir, const BoundingBox& casters, const BoundingBox& receivers)
+{
+	const UINT cascadeCount = mSettings.CascadeCount;
+	const float res = (float)mSettings.Resolution;
+
+	XMFLOAT3 casterCorners[BoundingBox::CORNER_COUNT];
+	XMFLOAT3 receiverCorners[BoundingBox::CORNER_COUNT];
+	casters.GetCorners(casterCorners);
+	receivers.GetCorners(receiverCorners);
+
+	// Only shade the depths the receivers are at.
+	XMVECTOR viewMin, viewMax;
+	TransformedBounds(receiverCorners, BoundingBox::CORNER_COUNT, cameraView, viewMin, viewMax);
+
+	float shadowFar = mSettings.MaxDistance > 0.0f ? MathHelper::Min(mSettings.MaxDistance, farZ) : farZ;
+	float splitNear = MathHelper::Max(nearZ, XMVectorGetZ(viewMin));
+	float splitFar = MathHelper::Min(shadowFar, XMVectorGetZ(viewMax));
+
+	// Round the range out to steps of a quarter octave, so the splits (and with
+	// them the cascade sizes) stay put while the camera moves a little.
+	if(splitFar > splitNear)
+	{
+		splitNear = MathHelper::Max(nearZ, nearZ*exp2f(floorf(4.0f*log2f(splitNear / nearZ)) / 4.0f));
+		splitFar = MathHelper::Min(shadowFar, nearZ*exp2f(ceilf(4.0f*log2f(splitFar / nearZ)) / 4.0f));
+	}
+
+	// The light view only depends on the light direction, not on the camera, so
+	// the shadow texel grid stays fixed in the world.
+	XMVECTOR dir = XMVector3Normalize(lightDir);
+	XMVECTOR up = fabsf(XMVectorGetY(dir)) > 0.99f ? XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	XMMATRIX lightView = XMMatrixLookToLH(XMVectorZero(), dir, up);
+	XMStoreFloat4x4(&mLightView, lightView);
+
+	if(splitFar <= splitNear)
+	{
+		// No receivers in front of the camera; a zero range disables every cascade
+		// and no caster is needed.
+		for(UINT i = 0; i < cascadeCount; ++i)
+		{
+			mCascades[i] = Cascade();
+			mCascades[i].LightPlanes.fill(XMFLOAT4(0.0f, 0.0f, 0.0f, -1.0f));
+			mCascades[i].SlicePlanes.fill(XMFLOAT4(0.0f, 0.0f, 0.0f, -1.0f));
+		}
+		return;
+	}
+
+	XMVECTOR casterMin, casterMax;
+	XMVECTOR receiverMin, receiverMax;
+	TransformedBounds(casterCorners, BoundingBox::CORNER_COUNT, lightView, casterMin, casterMax);
+	TransformedBounds(receiverCorners, BoundingBox::CORNER_COUNT, lightView, receiverMin, receiverMax);
+
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(cameraView), cameraView);
+	XMMATRIX viewToLight = XMMatrixMultiply(invView, lightView);
+
+	float tanHalfY = tanf(0.5f*fovY);
+	float tanHalfX = tanHalfY*aspect;
+
+	// Transform NDC space [-1,+1]^2 to texture space [0,1]^2.
+	XMMATRIX T(
+		0.5f, 0.0f, 0.0f, 0.0f,
+		0.0f, -0.5f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.5f, 0.5f, 0.0f, 1.0f);
+
+	for(UINT i = 0; i < cascadeCount; ++i)
+	{
+		Cascade& c = mCascades[i];
+		c.SplitNear = PracticalSplit(i, cascadeCount, splitNear, splitFar, mSettings.SplitLambda);
+		c.SplitFar = PracticalSplit(i + 1, cascadeCount, splitNear, splitFar, mSettings.SplitLambda);
+
+		// Corners of the frustum slice in camera view space.
+		XMFLOAT3 corners[8];
+		float depths[2] = { c.SplitNear, c.SplitFar };
+		for(UINT k = 0; k < 8; ++k)
+		{
+			float z = depths[k >> 2];
+			corners[k].x = (k & 1 ? +1.0f : -1.0f)*z*tanHalfX;
+			corners[k].y = (k & 2 ? +1.0f : -1.0f)*z*tanHalfY;
+			corners[k].z = z;
+		}
+
+		// The slice bounding sphere only depends on the lens and the splits, so its
+		// diameter gives extent steps that do not change as the camera turns.
+		XMVECTOR center = XMVectorZero();
+		for(UINT k = 0; k < 8; ++k)
+			center = XMVectorAdd(center, XMLoadFloat3(&corners[k]));
+		center = XMVectorScale(center, 1.0f / 8.0f);
+
+		float radius = 0.0f;
+		for(UINT k = 0; k < 8; ++k)
+			radius = MathHelper::Max(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&corners[k]), center))));
+
+		XMVECTOR sliceMin, sliceMax;
+		TransformedBounds(corners, 8, viewToLight, sliceMin, sliceMax);
+
+		// Cover only the part of the slice with receivers in it.
+		XMVECTOR lo = XMVectorMax(sliceMin, receiverMin);
+		XMVECTOR hi = XMVectorMin(sliceMax, receiverMax);
+		if(!XMVector3LessOrEqual(lo, hi))
+		{
+			lo = sliceMin;
+			hi = sliceMax;
+		}
+
+		// Round the extents up to whole steps, with a texel to spare for snapping,
+		// then move the window in whole texels.
+		float step = 2.0f*radius / mSettings.ExtentSteps;
+
+		XMFLOAT2 loXY, sizeXY;
+		XMStoreFloat2(&loXY, lo);
+		XMStoreFloat2(&sizeXY, XMVectorSubtract(hi, lo));
+
+		sizeXY.x = step*ceilf(MathHelper::Max(sizeXY.x, step)*res / (res - 1.0f) / step);
+		sizeXY.y = step*ceilf(MathHelper::Max(sizeXY.y, step)*res / (res - 1.0f) / step);
+
+		c.TexelSize = XMFLOAT2(sizeXY.x / res, sizeXY.y / res);
+		loXY.x = floorf(loXY.x / c.TexelSize.x)*c.TexelSize.x;
+		loXY.y = floorf(loXY.y / c.TexelSize.y)*c.TexelSize.y;
+
+		// Reach back to the nearest caster so geometry between the light and the
+		// slice still casts into it; nothing behind the slice or the receivers can
+		// be shadowed.
+		float sliceNearZ = XMVectorGetZ(lo);
+		float sliceFarZ = XMVectorGetZ(hi);
+		c.NearZ = MathHelper::Min(XMVectorGetZ(casterMin), sliceNearZ);
+		c.FarZ = MathHelper::Min(sliceFarZ, XMVectorGetZ(receiverMax));
+		c.FarZ = MathHelper::Max(c.FarZ, c.NearZ + 0.01f);
+
+		XMMATRIX P = XMMatrixOrthographicOffCenterLH(
+			loXY.x, loXY.x + sizeXY.x, loXY.y, loXY.y + sizeXY.y, c.NearZ, c.FarZ);
+		XMMATRIX VP = lightView*P;
+
+		XMStoreFloat4x4(&c.Proj, P);
+		XMStoreFloat4x4(&c.ViewProj, VP);
+		XMStoreFloat4x4(&c.ShadowTransform, VP*T);
+
+		XMMATRIX sliceProj = XMMatrixPerspectiveFovLH(fovY, aspect, c.SplitNear, c.SplitFar);
+		ExtrudedPlanes(VP, dir, c.LightPlanes);
+		ExtrudedPlanes(cameraView*sliceProj, dir, c.SlicePlanes);
+	}
+
+	for(UINT i = cascadeCount; i < MaxCascades; ++i)
+		mCascades[i] = Cascade();
+}
@@ -0,0 +1,102 @@
+//***************************************************************************************
+// ShadowCascades.h - Cascaded shadow map fitting for a directional light
+//
+// Splits the camera frustum into depth slices and fits one orthographic shadow
+// projection to each, so near geometry gets many shadow texels per world unit and
+// far geometry fewer.  Only math; the application renders one shadow map (or
+// array slice) per cascade with the results.
+//   -The depth range is first clipped to the receivers (rounded out to quarter
+//    octaves so it does not change every frame), then split with the practical
+//    scheme: a blend of logarithmic and uniform split distances.
+//   -Each cascade covers the part of its frustum slice that overlaps the
+//    receivers, and reaches back toward the light to the nearest caster.
+//   -The light view only depends on the light direction, and the extents are
+//    rounded up to steps of the slice's bounding sphere and moved in whole texels,
+//    so the shadow texels do not crawl (shimmer) as the camera moves.
+//   -Every cascade also gets shadow caster culling planes for FrustumCuller: its
+//    own volume and the camera frustum slice, both extruded toward the light.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <array>
+
+class ShadowCascades
+{
+public:
+	static const UINT MaxCascades = 4;
+
+	struct Settings
+	{
+		UINT CascadeCount = 4;
+
+		// Shadow map texels per side of every cascade.
+		UINT Resolution = 1024;
+
+		// Blend between uniform (0) and logarithmic (1) split distances.
+		float SplitLambda = 0.75f;
+
+		// Shadows end at this view depth; 0 uses the camera far plane.
+		float MaxDistance = 0.0f;
+
+		// The extents of a cascade are rounded up to multiples of its slice
+		// diameter divided by this; higher fits tighter but resizes more often.
+		UINT ExtentSteps = 16;
+	};
+
+	struct Cascade
+	{
+		// Orthographic projection from the light view space, and the light
+		// view-projection and world to shadow map texture space transforms.
+		DirectX::XMFLOAT4X4 Proj = MathHelper::Identity4x4();
+		DirectX::XMFLOAT4X4 ViewProj = MathHelper::Identity4x4();
+		DirectX::XMFLOAT4X4 ShadowTransform = MathHelper::Identity4x4();
+
+		// Camera view depth range the cascade is used for.
+		float SplitNear = 0.0f;
+		float SplitFar = 0.0f;
+
+		// Depth range in the light view space.
+		float NearZ = 0.0f;
+		float FarZ = 0.0f;
+
+		// World units per shadow texel along the light view x and y axes.
+		DirectX::XMFLOAT2 TexelSize = { 0.0f, 0.0f };
+
+		// Inward facing world space planes of the cascade volume (LightPlanes) and
+		// of the camera frustum slice (SlicePlanes), with the planes facing the
+		// light opened up, so a caster anywhere between the light and the volume is
+		// inside.  A caster outside of either set cannot shadow a visible receiver
+		// of the cascade.
+		std::array<DirectX::XMFLOAT4, 6> LightPlanes;
+		std::array<DirectX::XMFLOAT4, 6> SlicePlanes;
+	};
+
+	void SetSettings(const Settings& settings);
+	const Settings& GetSettings()const;
+
+	// Fit the cascades to the camera (its view matrix and lens, as Camera::SetLens
+	// takes it) for a directional light shining along lightDir.  casters bound the
+	// geometry drawn into the shadow maps, receivers the geometry that is shadowed;
+	// both are in world space.
+	void Update(DirectX::FXMMATRIX cameraView, float fovY, float aspect, float nearZ, float farZ,
+		DirectX::FXMVECTOR lightDir, const DirectX::BoundingBox& casters, const DirectX::BoundingBox& receivers);
+
+	UINT CascadeCount()const;
+	const Cascade& GetCascade(UINT i)const;
+
+	// The light view matrix shared by all cascades.
+	DirectX::XMMATRIX LightView()const;
+
+	// Split distance i of count slices of [nearZ, farZ]; i = 0 gives nearZ and
+	// i = count gives farZ.
+	static float PracticalSplit(UINT i, UINT count, float nearZ, float farZ, float lambda);
+
+private:
+	Settings mSettings;
+
+	DirectX::XMFLOAT4X4 mLightView = MathHelper::Identity4x4();
+	Cascade mCascades[MaxCascades];
+};
@@ -0,0 +1,582 @@
+//***************************************************************************************
+// TransformKernels.cpp - Batched SIMD transforms of points, vectors, bounds and matrices
+//***************************************************************************************
+
+#include "TransformKernels.h"
+#include <intrin.h>
+#include <immintrin.h>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	//
+	// The kernels are written once against these wrappers and instantiated for
+	// AVX2 (eight lanes), SSE (four lanes) and plain floats (one lane, for the
+	// elements left over after the last whole register).
+	//
+
+	struct ScalarOps
+	{
+		typedef float V;
+		static const UINT Width = 1;
+
+		static V Load(const float* p) { return *p; }
+		static void Store(float* p, V v) { *p = v; }
+		static V Set1(float x) { return x; }
+		static V Add(V a, V b) { return a + b; }
+		static V Sub(V a, V b) { return a - b; }
+		static V Mul(V a, V b) { return a*b; }
+		static V MulAdd(V a, V b, V c) { return a*b + c; }
+		static V Div(V a, V b) { return a / b; }
+		static V Max(V a, V b) { return a > b ? a : b; }
+		static V Abs(V a) { return fabsf(a); }
+		static V Sqrt(V a) { return sqrtf(a); }
+		static void Finish() {}
+	};
+
+	struct SseOps
+	{
+		typedef __m128 V;
+		static const UINT Width = 4;
+
+		static V Load(const float* p) { return _mm_loadu_ps(p); }
+		static void Store(float* p, V v) { _mm_storeu_ps(p, v); }
+		static V Set1(float x) { return _mm_set1_ps(x); }
+		static V Add(V a, V b) { return _mm_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V MulAdd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+		static V Div(V a, V b) { return _mm_div_ps(a, b); }
+		static V Max(V a, V b) { return _mm_max_ps(a, b); }
+		static V Abs(V a) { return _mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))); }
+		static V Sqrt(V a) { return _mm_sqrt_ps(a); }
+		static void Finish() {}
+	};
+
+	struct Avx2Ops
+	{
+		typedef __m256 V;
+		static const UINT Width = 8;
+
+		static V Load(const float* p) { return _mm256_loadu_ps(p); }
+		static void Store(float* p, V v) { _mm256_storeu_ps(p, v); }
+		static V Set1(float x) { return _mm256_set1_ps(x); }
+		static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+		static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		static V MulAdd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+		static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+		static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+		static V Abs(V a) { return _mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))); }
+		static V Sqrt(V a) { return _mm256_sqrt_ps(a); }
+
+		// Avoid the AVX to SSE transition penalty in the code that follows.
+		static void Finish() { _mm256_zeroupper(); }
+	};
+
+	const XMFLOAT4X4& MatrixAt(const XMFLOAT4X4* matrices, UINT stride, UINT i)
+	{
+		return *reinterpret_cast<const XMFLOAT4X4*>(reinterpret_cast<const char*>(matrices) + std::size_t(i)*stride);
+	}
+
+	XMFLOAT4X4& MatrixAt(XMFLOAT4X4* matrices, UINT stride, UINT i)
+	{
+		return *reinterpret_cast<XMFLOAT4X4*>(reinterpret_cast<char*>(matrices) + std::size_t(i)*stride);
+	}
+
+	//
+	// Matrix sources give the upper 4x3 part of the matrices of Width elements in
+	// structure-of-arrays form: m[r][c] holds entry (r, c) of every lane's matrix.
+	//
+
+	// The same matrix for every element, broadcast once.
+	template<class Ops>
+	struct OneMatrix
+	{
+		typename Ops::V M[4][3];
+
+		explicit OneMatrix(const XMFLOAT4X4& m)
+		{
+			for(UINT r = 0; r < 4; ++r)
+				for(UINT c = 0; c < 3; ++c)
+					M[r][c] = Ops::Set1(m.m[r][c]);
+		}
+
+		void Load(UINT, typename Ops::V m[4][3])const
+		{
+			for(UINT r = 0; r < 4; ++r)
+				for(UINT c = 0; c < 3; ++c)
+					m[r][c] = M[r][c];
+		}
+	};
+
+	// Matrix i for element i, gathered into the lanes.
+	template<class Ops>
+	struct MatrixArray
+	{
+		const XMFLOAT4X4* Matrices;
+		UINT Stride;
+
+		MatrixArray(const XMFLOAT4X4* matrices, UINT stride) : Matrices(matrices), Stride(stride) {}
+
+		void Load(UINT first, typename Ops::V m[4][3])const
+		{
+			alignas(32) float lanes[4][3][Ops::Width];
+			for(UINT lane = 0; lane < Ops::Width; ++lane)
+			{
+				const XMFLOAT4X4& matrix = MatrixAt(Matrices, Stride, first + lane);
+				for(UINT r = 0; r < 4; ++r)
+					for(UINT c = 0; c < 3; ++c)
+						lanes[r][c][lane] = matrix.m[r][c];
+			}
+
+			for(UINT r = 0; r < 4; ++r)
+				for(UINT c = 0; c < 3; ++c)
+					m[r][c] = Ops::Load(lanes[r][c]);
+		}
+	};
+
+	template<class Ops>
+	void LoadMatrices(const XMFLOAT4X4* matrices, UINT stride, UINT first, typename Ops::V m[4][4])
+	{
+		alignas(32) float lanes[4][4][Ops::Width];
+		for(UINT lane = 0; lane < Ops::Width; ++lane)
+		{
+			const XMFLOAT4X4& matrix = MatrixAt(matrices, stride, first + lane);
+			for(UINT r = 0; r < 4; ++r)
+				for(UINT c = 0; c < 4; ++c)
+					lanes[r][c][lane] = matrix.m[r][c];
+		}
+
+		for(UINT r = 0; r < 4; ++r)
+			for(UINT c = 0; c < 4; ++c)
+				m[r][c] = Ops::Load(lanes[r][c]);
+	}
+
+	template<class Ops>
+	void StoreMatrices(XMFLOAT4X4* matrices, UINT stride, UINT first, const typename Ops::V m[4][4])
+	{
+		alignas(32) float lanes[4][4][Ops::Width];
+		for(UINT r = 0; r < 4; ++r)
+			for(UINT c = 0; c < 4; ++c)
+				Ops::Store(lanes[r][c], m[r][c]);
+
+		for(UINT lane = 0; lane < Ops::Width; ++lane)
+		{
+			XMFLOAT4X4& matrix = MatrixAt(matrices, stride, first + lane);
+			for(UINT r = 0; r < 4; ++r)
+				for(UINT c = 0; c < 4; ++c)
+					matrix.m[r][c] = lanes[r][c][lane];
+		}
+	}
+
+	//
+	// Kernels.  Each processes whole groups of Ops::Width elements from first on and
+	// returns the index of the first element it left for a narrower pass.
+	//
+
+	template<class Ops, class Source>
+	UINT Float3Kernel(const TransformKernels::Float3Arrays& in, UINT first, UINT count,
+		const Source& source, bool points, const TransformKernels::Float3Arrays& out)
+	{
+		typedef typename Ops::V V;
+
+		for(; first + Ops::Width <= count; first += Ops::Width)
+		{
+			V m[4][3];
+			source.Load(first, m);
+
+			V x = Ops::Load(in.X + first);
+			V y = Ops::Load(in.Y + first);
+			V z = Ops::Load(in.Z + first);
+
+			V t[3];
+			for(UINT c = 0; c < 3; ++c)
+				t[c] = points ? m[3][c] : Ops::Set1(0.0f);
+
+			Ops::Store(out.X + first, Ops::MulAdd(x, m[0][0], Ops::MulAdd(y, m[1][0], Ops::MulAdd(z, m[2][0], t[0]))));
+			Ops::Store(out.Y + first, Ops::MulAdd(x, m[0][1], Ops::MulAdd(y, m[1][1], Ops::MulAdd(z, m[2][1], t[1]))));
+			Ops::Store(out.Z + first, Ops::MulAdd(x, m[0][2], Ops::MulAdd(y, m[1][2], Ops::MulAdd(z, m[2][2], t[2]))));
+		}
+
+		Ops::Finish();
+		return first;
+	}
+
+	//
+	// For a box with center c and extents e, the transformed box has center c*M and,
+	// along axis j, extent |M[0][j]|*e.x + |M[1][j]|*e.y + |M[2][j]|*e.z (Arvo).
+	//
+
+	template<class Ops>
+	void TransformBoxLanes(const typename Ops::V m[4][3], const typename Ops::V c[3], const typename Ops::V e[3],
+		typename Ops::V outC[3], typename Ops::V outE[3])
+	{
+		for(UINT j = 0; j < 3; ++j)
+		{
+			outC[j] = Ops::MulAdd(c[0], m[0][j], Ops::MulAdd(c[1], m[1][j], Ops::MulAdd(c[2], m[2][j], m[3][j])));
+			outE[j] = Ops::MulAdd(e[0], Ops::Abs(m[0][j]), Ops::MulAdd(e[1], Ops::Abs(m[1][j]), Ops::Mul(e[2], Ops::Abs(m[2][j]))));
+		}
+	}
+
+	template<class Ops, class Source>
+	UINT BoxKernel(const TransformKernels::BoxArrays& in, UINT first, UINT count,
+		const Source& source, const TransformKernels::BoxArrays& out)
+	{
+		typedef typename Ops::V V;
+
+		for(; first + Ops::Width <= count; first += Ops::Width)
+		{
+			V m[4][3];
+			source.Load(first, m);
+
+			V c[3] = { Ops::Load(in.CenterX + first), Ops::Load(in.CenterY + first), Ops::Load(in.CenterZ + first) };
+			V e[3] = { Ops::Load(in.ExtentX + first), Ops::Load(in.ExtentY + first), Ops::Load(in.ExtentZ + first) };
+
+			V outC[3], outE[3];
+			TransformBoxLanes<Ops>(m, c, e, outC, outE);
+
+			Ops::Store(out.CenterX + first, outC[0]);
+			Ops::Store(out.CenterY + first, outC[1]);
+			Ops::Store(out.CenterZ + first, outC[2]);
+			Ops::Store(out.ExtentX + first, outE[0]);
+			Ops::Store(out.ExtentY + first, outE[1]);
+			Ops::Store(out.ExtentZ + first, outE[2]);
+		}
+
+		Ops::Finish();
+		return first;
+	}
+
+	template<class Ops, class Source>
+	UINT OneBoxKernel(const BoundingBox& box, UINT first, UINT count,
+		const Source& source, const TransformKernels::BoxArrays& out)
+	{
+		typedef typename Ops::V V;
+
+		const V c[3] = { Ops::Set1(box.Center.x), Ops::Set1(box.Center.y), Ops::Set1(box.Center.z) };
+		const V e[3] = { Ops::Set1(box.Extents.x), Ops::Set1(box.Extents.y), Ops::Set1(box.Extents.z) };
+
+		for(; first + Ops::Width <= count; first += Ops::Width)
+		{
+			V m[4][3];
+			source.Load(first, m);
+
+			V outC[3], outE[3];
+			TransformBoxLanes<Ops>(m, c, e, outC, outE);
+
+			Ops::Store(out.CenterX + first, outC[0]);
+			Ops::Store(out.CenterY + first, outC[1]);
+			Ops::Store(out.CenterZ + first, outC[2]);
+			Ops::Store(out.ExtentX + first, outE[0]);
+			Ops::Store(out.ExtentY + first, outE[1]);
+			Ops::Store(out.ExtentZ + first, outE[2]);
+		}
+
+		Ops::Finish();
+		return first;
+	}
+
+	// The radius scales by the length of the longest of the first three rows, as in
+	// BoundingSphere::Transform.
+	template<class Ops, class Source>
+	UINT SphereKernel(const TransformKernels::SphereArrays& in, UINT first, UINT count,
+		const Source& source, const TransformKernels::SphereArrays& out)
+	{
+		typedef typename Ops::V V;
+
+		for(; first + Ops::Width <= count; first += Ops::Width)
+		{
+			V m[4][3];
+			source.Load(first, m);
+
+			V x = Ops::Load(in.CenterX + first);
+			V y = Ops::Load(in.CenterY + first);
+			V z = Ops::Load(in.CenterZ + first);
+
+			V scaleSq = Ops::Set1(0.0f);
+			for(UINT r = 0; r < 3; ++r)
+				scaleSq = Ops::Max(scaleSq, Ops::MulAdd(m[r][0], m[r][0], Ops::MulAdd(m[r][1], m[r][1], Ops::Mul(m[r][2], m[r][2]))));
+
+			Ops::Store(out.CenterX + first, Ops::MulAdd(x, m[0][0], Ops::MulAdd(y, m[1][0], Ops::MulAdd(z, m[2][0], m[3][0]))));
+			Ops::Store(out.CenterY + first, Ops::MulAdd(x, m[0][1], Ops::MulAdd(y, m[1][1], Ops::MulAdd(z, m[2][1], m[3][1]))));
+			Ops::Store(out.CenterZ + first, Ops::MulAdd(x, m[0][2], Ops::MulAdd(y, m[1][2], Ops::MulAdd(z, m[2][2], m[3][2]))));
+			Ops::Store(out.Radius + first, Ops::Mul(Ops::Load(in.Radius + first), Ops::Sqrt(scaleSq)));
+		}
+
+		Ops::Finish();
+		return first;
+	}
+
+	//
+	// The inverse of the 3x3 part with rows a0, a1, a2 has the columns
+	// (a1 x a2, a2 x a0, a0 x a1) / det, with det = a0 . (a1 x a2), so its transpose
+	// has them as rows.  The translation t of the inverse is -t*A^-1.
+	//
+
+	template<class Ops>
+	UINT InverseKernel(const XMFLOAT4X4* matrices, UINT stride, UINT first, UINT count,
+		XMFLOAT4X4* outInverse, XMFLOAT4X4* outInverseTranspose)
+	{
+		typedef typename Ops::V V;
+
+		const MatrixArray<Ops> source(matrices, stride);
+		const V zero = Ops::Set1(0.0f);
+		const V one = Ops::Set1(1.0f);
+
+		for(; first + Ops::Width <= count; first += Ops::Width)
+		{
+			V m[4][3];
+			source.Load(first, m);
+
+			V cofactors[3][3];
+			for(UINT j = 0; j < 3; ++j)
+			{
+				const V* a = m[(j + 1) % 3];
+				const V* b = m[(j + 2) % 3];
+				cofactors[j][0] = Ops::Sub(Ops::Mul(a[1], b[2]), Ops::Mul(a[2], b[1]));
+				cofactors[j][1] = Ops::Sub(Ops::Mul(a[2], b[0]), Ops::Mul(a[0], b[2]));
+				cofactors[j][2] = Ops::Sub(Ops::Mul(a[0], b[1]), Ops::Mul(a[1], b[0]));
+			}
+
+			V det = Ops::MulAdd(m[0][0], cofactors[0][0], Ops::MulAdd(m[0][1], cofactors[0][1], Ops::Mul(m[0][2], cofactors[0][2])));
+			V invDet = Ops::Div(one, det);
+
+			for(UINT j = 0; j < 3; ++j)
+				for(UINT i = 0; i < 3; ++i)
+					cofactors[j][i] = Ops::Mul(cofactors[j][i], invDet);
+
+			if(outInverse != nullptr)
+			{
+				V inv[4][4];
+				for(UINT i = 0; i < 3; ++i)
+				{
+					for(UINT j = 0; j < 3; ++j)
+						inv[i][j] = cofactors[j][i];
+					inv[i][3] = zero;
+				}
+
+				for(UINT j = 0; j < 3; ++j)
+				{
+					V dot = Ops::MulAdd(m[3][0], cofactors[j][0], Ops::MulAdd(m[3][1], cofactors[j][1], Ops::Mul(m[3][2], cofactors[j][2])));
+					inv[3][j] = Ops::Sub(zero, dot);
+				}
+				inv[3][3] = one;
+
+				StoreMatrices<Ops>(outInverse, stride, first, inv);
+			}
+
+			if(outInverseTranspose != nullptr)
+			{
+				V invT[4][4];
+				for(UINT i = 0; i < 3; ++i)
+				{
+					for(UINT j = 0; j < 3; ++j)
+						invT[i][j] = cofactors[i][j];
+					invT[i][3] = zero;
+				}
+				invT[3][0] = zero;
+				invT[3][1] = zero;
+				invT[3][2] = zero;
+				invT[3][3] = one;
+
+				StoreMatrices<Ops>(outInverseTranspose, stride, first, invT);
+			}
+		}
+
+		Ops::Finish();
+		return first;
+	}
+
+	template<class Ops>
+	UINT MultiplyKernel(const XMFLOAT4X4* matrices, UINT stride, UINT first, UINT count,
+		const XMFLOAT4X4& b, XMFLOAT4X4* outMatrices)
+	{
+		typedef typename Ops::V V;
+
+		V bm[4][4];
+		for(UINT r = 0; r < 4; ++r)
+			for(UINT c = 0; c < 4; ++c)
+				bm[r][c] = Ops::Set1(b.m[r][c]);
+
+		for(; first + Ops::Width <= count; first += Ops::Width)
+		{
+			V a[4][4];
+			LoadMatrices<Ops>(matrices, stride, first, a);
+
+			V product[4][4];
+			for(UINT r = 0; r < 4; ++r)
+			{
+				for(UINT c = 0; c < 4; ++c)
+				{
+					product[r][c] = Ops::MulAdd(a[r][0], bm[0][c], Ops::MulAdd(a[r][1], bm[1][c],
+						Ops::MulAdd(a[r][2], bm[2][c], Ops::Mul(a[r][3], bm[3][c]))));
+				}
+			}
+
+			StoreMatrices<Ops>(outMatrices, stride, first, product);
+		}
+
+		Ops::Finish();
+		return first;
+	}
+}
+
+void TransformKernels::TransformPoints(const Float3Arrays& in, UINT count, const XMFLOAT4X4& m, const Float3Arrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = Float3Kernel<Avx2Ops>(in, first, count, OneMatrix<Avx2Ops>(m), true, out);
+	else
+		first = Float3Kernel<SseOps>(in, first, count, OneMatrix<SseOps>(m), true, out);
+
+	Float3Kernel<ScalarOps>(in, first, count, OneMatrix<ScalarOps>(m), true, out);
+}
+
+void TransformKernels::TransformVectors(const Float3Arrays& in, UINT count, const XMFLOAT4X4& m, const Float3Arrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = Float3Kernel<Avx2Ops>(in, first, count, OneMatrix<Avx2Ops>(m), false, out);
+	else
+		first = Float3Kernel<SseOps>(in, first, count, OneMatrix<SseOps>(m), false, out);
+
+	Float3Kernel<ScalarOps>(in, first, count, OneMatrix<ScalarOps>(m), false, out);
+}
+
+void TransformKernels::TransformPoints(const Float3Arrays& in, UINT count,
+	const XMFLOAT4X4* matrices, UINT matrixStride, const Float3Arrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = Float3Kernel<Avx2Ops>(in, first, count, MatrixArray<Avx2Ops>(matrices, matrixStride), true, out);
+	else
+		first = Float3Kernel<SseOps>(in, first, count, MatrixArray<SseOps>(matrices, matrixStride), true, out);
+
+	Float3Kernel<ScalarOps>(in, first, count, MatrixArray<ScalarOps>(matrices, matrixStride), true, out);
+}
+
+void TransformKernels::TransformVectors(const Float3Arrays& in, UINT count,
+	const XMFLOAT4X4* matrices, UINT matrixStride, const Float3Arrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = Float3Kernel<Avx2Ops>(in, first, count, MatrixArray<Avx2Ops>(matrices, matrixStride), false, out);
+	else
+		first = Float3Kernel<SseOps>(in, first, count, MatrixArray<SseOps>(matrices, matrixStride), false, out);
+
+	Float3Kernel<ScalarOps>(in, first, count, MatrixArray<ScalarOps>(matrices, matrixStride), false, out);
+}
+
+void TransformKernels::TransformBoxes(const BoxArrays& in, UINT count, const XMFLOAT4X4& m, const BoxArrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = BoxKernel<Avx2Ops>(in, first, count, OneMatrix<Avx2Ops>(m), out);
+	else
+		first = BoxKernel<SseOps>(in, first, count, OneMatrix<SseOps>(m), out);
+
+	BoxKernel<ScalarOps>(in, first, count, OneMatrix<ScalarOps>(m), out);
+}
+
+void TransformKernels::TransformSpheres(const SphereArrays& in, UINT count, const XMFLOAT4X4& m, const SphereArrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = SphereKernel<Avx2Ops>(in, first, count, OneMatrix<Avx2Ops>(m), out);
+	else
+		first = SphereKernel<SseOps>(in, first, count, OneMatrix<SseOps>(m), out);
+
+	SphereKernel<ScalarOps>(in, first, count, OneMatrix<ScalarOps>(m), out);
+}
+
+void TransformKernels::TransformBoxes(const BoxArrays& in, UINT count,
+	const XMFLOAT4X4* matrices, UINT matrixStride, const BoxArrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = BoxKernel<Avx2Ops>(in, first, count, MatrixArray<Avx2Ops>(matrices, matrixStride), out);
+	else
+		first = BoxKernel<SseOps>(in, first, count, MatrixArray<SseOps>(matrices, matrixStride), out);
+
+	BoxKernel<ScalarOps>(in, first, count, MatrixArray<ScalarOps>(matrices, matrixStride), out);
+}
+
+void TransformKernels::TransformSpheres(const SphereArrays& in, UINT count,
+	const XMFLOAT4X4* matrices, UINT matrixStride, const SphereArrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = SphereKernel<Avx2Ops>(in, first, count, MatrixArray<Avx2Ops>(matrices, matrixStride), out);
+	else
+		first = SphereKernel<SseOps>(in, first, count, MatrixArray<SseOps>(matrices, matrixStride), out);
+
+	SphereKernel<ScalarOps>(in, first, count, MatrixArray<ScalarOps>(matrices, matrixStride), out);
+}
+
+void TransformKernels::TransformBox(const BoundingBox& box, UINT count,
+	const XMFLOAT4X4* matrices, UINT matrixStride, const BoxArrays& out)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = OneBoxKernel<Avx2Ops>(box, first, count, MatrixArray<Avx2Ops>(matrices, matrixStride), out);
+	else
+		first = OneBoxKernel<SseOps>(box, first, count, MatrixArray<SseOps>(matrices, matrixStride), out);
+
+	OneBoxKernel<ScalarOps>(box, first, count, MatrixArray<ScalarOps>(matrices, matrixStride), out);
+}
+
+void TransformKernels::InverseAffine(const XMFLOAT4X4* matrices, UINT matrixStride, UINT count,
+	XMFLOAT4X4* outInverse, XMFLOAT4X4* outInverseTranspose)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = InverseKernel<Avx2Ops>(matrices, matrixStride, first, count, outInverse, outInverseTranspose);
+	else
+		first = InverseKernel<SseOps>(matrices, matrixStride, first, count, outInverse, outInverseTranspose);
+
+	InverseKernel<ScalarOps>(matrices, matrixStride, first, count, outInverse, outInverseTranspose);
+}
+
+void TransformKernels::Multiply(const XMFLOAT4X4* matrices, UINT matrixStride, UINT count,
+	const XMFLOAT4X4& m, XMFLOAT4X4* outMatrices)
+{
+	UINT first = 0;
+	if(Avx2Supported())
+		first = MultiplyKernel<Avx2Ops>(matrices, matrixStride, first, count, m, outMatrices);
+	else
+		first = MultiplyKernel<SseOps>(matrices, matrixStride, first, count, m, outMatrices);
+
+	MultiplyKernel<ScalarOps>(matrices, matrixStride, first, count, m, outMatrices);
+}
+
+bool TransformKernels::Avx2Supported()
+{
+	static const bool supported = []()
+	{
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7)
+			return false;
+
+		// The CPU must support AVX and FMA and the OS must use XSAVE/XRSTOR...
+		__cpuid(info, 1);
+		const bool fma     = (info[2] & (1 << 12)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+		if(!fma || !osxsave || !avx)
+			return false;
+
+		// ...and preserve the YMM registers across context switches...
+		if((_xgetbv(0) & 0x6) != 0x6)
+			return false;
+
+		// ...and the CPU must support AVX2.
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}();
+
+	return supported;
+}
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// TransformKernels.h - Batched SIMD transforms of points, vectors, bounds and matrices
+//
+// Transforms whole arrays at once instead of one XMVECTOR at a time.
+//   -Points, vectors and bounds are in structure-of-arrays form (one array per
+//    component), so one instruction works on eight elements (AVX2) or four (SSE).
+//    The path is picked at run time; the elements that do not fill a whole SIMD
+//    register go through the same code with scalar floats.
+//   -The matrices are affine world matrices (row vectors, translation in the
+//    last row).  The last column is ignored and taken to be (0, 0, 0, 1).
+//   -Functions taking a matrix array transform element i by matrix i.  The
+//    matrices are matrixStride bytes apart, so they can stay inside render items
+//    or instance structs.
+//   -Outputs may be the same arrays as the inputs.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+
+class TransformKernels
+{
+public:
+	struct Float3Arrays
+	{
+		float* X = nullptr;
+		float* Y = nullptr;
+		float* Z = nullptr;
+	};
+
+	struct BoxArrays
+	{
+		float* CenterX = nullptr;
+		float* CenterY = nullptr;
+		float* CenterZ = nullptr;
+		float* ExtentX = nullptr;
+		float* ExtentY = nullptr;
+		float* ExtentZ = nullptr;
+	};
+
+	struct SphereArrays
+	{
+		float* CenterX = nullptr;
+		float* CenterY = nullptr;
+		float* CenterZ = nullptr;
+		float* Radius = nullptr;
+	};
+
+	// Points get the translation, vectors do not.  Transform normals as vectors by
+	// the inverse-transpose (see InverseAffine()) and renormalize them.
+	static void TransformPoints(const Float3Arrays& in, UINT count, const DirectX::XMFLOAT4X4& m, const Float3Arrays& out);
+	static void TransformVectors(const Float3Arrays& in, UINT count, const DirectX::XMFLOAT4X4& m, const Float3Arrays& out);
+
+	static void TransformPoints(const Float3Arrays& in, UINT count,
+		const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, const Float3Arrays& out);
+	static void TransformVectors(const Float3Arrays& in, UINT count,
+		const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, const Float3Arrays& out);
+
+	// Axis-aligned boxes of the transformed boxes (the same result as
+	// BoundingBox::Transform).  Spheres scale by the largest axis scale.
+	static void TransformBoxes(const BoxArrays& in, UINT count, const DirectX::XMFLOAT4X4& m, const BoxArrays& out);
+	static void TransformSpheres(const SphereArrays& in, UINT count, const DirectX::XMFLOAT4X4& m, const SphereArrays& out);
+
+	static void TransformBoxes(const BoxArrays& in, UINT count,
+		const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, const BoxArrays& out);
+	static void TransformSpheres(const SphereArrays& in, UINT count,
+		const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, const SphereArrays& out);
+
+	// One local box placed by count matrices, e.g., the world bounds of the
+	// instances of a mesh.
+	static void TransformBox(const DirectX::BoundingBox& box, UINT count,
+		const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, const BoxArrays& out);
+
+	// Inverse and inverse-transpose of count affine matrices.  The inverse-transpose
+	// has no translation, like MathHelper::InverseTranspose().  Either output may
+	// be null; both have the same stride as the input.  A singular matrix gives
+	// infinities, as XMMatrixInverse does.
+	static void InverseAffine(const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, UINT count,
+		DirectX::XMFLOAT4X4* outInverse, DirectX::XMFLOAT4X4* outInverseTranspose);
+
+	// outMatrices[i] = matrices[i]*m with full 4x4 matrices, e.g., world*viewProj
+	// for every object.  The output has the same stride as the input.
+	static void Multiply(const DirectX::XMFLOAT4X4* matrices, UINT matrixStride, UINT count,
+		const DirectX::XMFLOAT4X4& m, DirectX::XMFLOAT4X4* outMatrices);
+
+	// Returns true if the CPU and OS support AVX2 and FMA, in which case the
+	// kernels use the eight wide path.
+	static bool Avx2Supported();
+};
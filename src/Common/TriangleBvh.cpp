@@ -0,0 +1,739 @@
+//***************************************************************************************
+// TriangleBvh.cpp - Triangle bounding volume hierarchy for ray casts against a mesh
+//***************************************************************************************
+
+#include "TriangleBvh.h"
+#include "Bvh.h"
+#include "Profiler.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+namespace
+{
+	bool IsLeaf(const std::vector<Bvh::Node>& nodes, UINT node)
+	{
+		return nodes[node].Skip == node + 1;
+	}
+
+	float SurfaceArea(const Bvh::Node& node)
+	{
+		const XMFLOAT3& e = node.Extents;
+
+		return 8.0f*(e.x*e.y + e.y*e.z + e.z*e.x);
+	}
+
+	__m128 Cross(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz, __m128& outY, __m128& outZ)
+	{
+		outY = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+		outZ = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+
+		return _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+	}
+
+	__m128 Dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+	}
+
+	// 1/d with zero components replaced by a tiny value of the same sign, so the
+	// slab test never computes 0*inf.
+	float SafeReciprocal(float d)
+	{
+		const float tiny = 1e-20f;
+		if(fabsf(d) < tiny)
+			d = d < 0.0f ? -tiny : tiny;
+
+		return 1.0f / d;
+	}
+}
+
+void TriangleBvh::Build(const void* positions, UINT positionStride,
+	const std::uint32_t* indices, UINT triangleCount, int baseVertex)
+{
+	Clear();
+
+	mTriangleCount = triangleCount;
+	if(triangleCount == 0)
+		return;
+
+	mIndices.assign(indices, indices + 3 * triangleCount);
+	mBaseVertex = baseVertex;
+
+	// Gather the triangle corners and boxes.
+	std::vector<XMFLOAT3> corners(3 * triangleCount);
+	std::vector<BoundingBox> bounds(triangleCount);
+	for(UINT t = 0; t < triangleCount; ++t)
+	{
+		for(UINT k = 0; k < 3; ++k)
+		{
+			const BYTE* p = (const BYTE*)positions + (size_t)(indices[3*t + k] + baseVertex)*positionStride;
+			corners[3*t + k] = *(const XMFLOAT3*)p;
+		}
+
+		BoundingBox::CreateFromPoints(bounds[t], 3, &corners[3*t], sizeof(XMFLOAT3));
+	}
+
+	// Build a binary tree with leaves of up to 4 triangles (16 if splitting does
+	// not pay) and collapse it to the four wide tree.
+	Bvh tree;
+	tree.Build(bounds.data(), nullptr, triangleCount, 4);
+
+	mNodes.reserve(tree.NodeCount() / 2 + 1);
+	mPackets.reserve(triangleCount / 2 + 1);
+
+	if(IsLeaf(tree.Nodes(), 0))
+	{
+		// The whole mesh fits into one leaf.
+		mNodes.emplace_back();
+		Node& root = mNodes[0];
+		for(UINT k = 0; k < 4; ++k)
+		{
+			root.MinX[k] = root.MinY[k] = root.MinZ[k] = +MathHelper::Infinity;
+			root.MaxX[k] = root.MaxY[k] = root.MaxZ[k] = -MathHelper::Infinity;
+			root.Child[k] = 0;
+		}
+
+		const Bvh::Node& leaf = tree.Nodes()[0];
+		root.MinX[0] = leaf.Center.x - leaf.Extents.x;
+		root.MinY[0] = leaf.Center.y - leaf.Extents.y;
+		root.MinZ[0] = leaf.Center.z - leaf.Extents.z;
+		root.MaxX[0] = leaf.Center.x + leaf.Extents.x;
+		root.MaxY[0] = leaf.Center.y + leaf.Extents.y;
+		root.MaxZ[0] = leaf.Center.z + leaf.Extents.z;
+
+		UINT child = BuildLeaf(tree, 0, corners);
+		mNodes[0].Child[0] = child;
+		mStackSize = 4;
+	}
+	else
+	{
+		BuildNode(tree, 0, 0, corners);
+	}
+}
+
+void TriangleBvh::Clear()
+{
+	mNodes.clear();
+	mPackets.clear();
+	mTriangleCount = 0;
+	mStackSize = 0;
+	mIndices.clear();
+	mBaseVertex = 0;
+}
+
+void TriangleBvh::Refit(const void* positions, UINT positionStride)
+{
+	PROFILE_SCOPE("TriangleBvh::Refit");
+
+	auto corner = [&](UINT t, UINT k) -> const XMFLOAT3&
+	{
+		const BYTE* p = (const BYTE*)positions + (size_t)(mIndices[3*t + k] + mBaseVertex)*positionStride;
+		return *(const XMFLOAT3*)p;
+	};
+
+	for(TrianglePacket& packet : mPackets)
+	{
+		for(UINT lane = 0; lane < 4; ++lane)
+		{
+			const UINT t = packet.Triangle[lane];
+			if(t == UnusedLane)
+				continue;
+
+			const XMFLOAT3& v0 = corner(t, 0);
+			const XMFLOAT3& v1 = corner(t, 1);
+			const XMFLOAT3& v2 = corner(t, 2);
+
+			packet.V0X[lane] = v0.x;
+			packet.V0Y[lane] = v0.y;
+			packet.V0Z[lane] = v0.z;
+			packet.E1X[lane] = v1.x - v0.x;
+			packet.E1Y[lane] = v1.y - v0.y;
+			packet.E1Z[lane] = v1.z - v0.z;
+			packet.E2X[lane] = v2.x - v0.x;
+			packet.E2Y[lane] = v2.y - v0.y;
+			packet.E2Z[lane] = v2.z - v0.z;
+		}
+	}
+
+	// Children always come after their parent, so walking the nodes backwards
+	// refits every child node before the node that holds its box.
+	for(UINT n = (UINT)mNodes.size(); n-- > 0; )
+	{
+		Node& node = mNodes[n];
+		for(UINT k = 0; k < 4; ++k)
+		{
+			// Unused children keep their empty boxes.
+			if(node.MinX[k] > node.MaxX[k])
+				continue;
+
+			float boxMin[3] = { +MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity };
+			float boxMax[3] = { -MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity };
+
+			const UINT child = node.Child[k];
+			if(child & LeafFlag)
+			{
+				const UINT first = child & LeafFirstMask;
+				const UINT count = ((child & ~LeafFlag) >> LeafCountShift) + 1;
+				for(UINT p = first; p < first + count; ++p)
+				{
+					const TrianglePacket& packet = mPackets[p];
+					for(UINT lane = 0; lane < 4; ++lane)
+					{
+						if(packet.Triangle[lane] == UnusedLane)
+							continue;
+
+						for(UINT c = 0; c < 3; ++c)
+						{
+							const XMFLOAT3& v = corner(packet.Triangle[lane], c);
+							boxMin[0] = MathHelper::Min(boxMin[0], v.x);
+							boxMin[1] = MathHelper::Min(boxMin[1], v.y);
+							boxMin[2] = MathHelper::Min(boxMin[2], v.z);
+							boxMax[0] = MathHelper::Max(boxMax[0], v.x);
+							boxMax[1] = MathHelper::Max(boxMax[1], v.y);
+							boxMax[2] = MathHelper::Max(boxMax[2], v.z);
+						}
+					}
+				}
+			}
+			else
+			{
+				const Node& c = mNodes[child];
+				for(UINT j = 0; j < 4; ++j)
+				{
+					if(c.MinX[j] > c.MaxX[j])
+						continue;
+
+					boxMin[0] = MathHelper::Min(boxMin[0], c.MinX[j]);
+					boxMin[1] = MathHelper::Min(boxMin[1], c.MinY[j]);
+					boxMin[2] = MathHelper::Min(boxMin[2], c.MinZ[j]);
+					boxMax[0] = MathHelper::Max(boxMax[0], c.MaxX[j]);
+					boxMax[1] = MathHelper::Max(boxMax[1], c.MaxY[j]);
+					boxMax[2] = MathHelper::Max(boxMax[2], c.MaxZ[j]);
+				}
+			}
+
+			node.MinX[k] = boxMin[0];
+			node.MinY[k] = boxMin[1];
+			node.MinZ[k] = boxMin[2];
+			node.MaxX[k] = boxMax[0];
+			node.MaxY[k] = boxMax[1];
+			node.MaxZ[k] = boxMax[2];
+		}
+	}
+}
+
+UINT TriangleBvh::TriangleCount()const
+{
+	return mTriangleCount;
+}
+
+UINT TriangleBvh::NodeCount()const
+{
+	return (UINT)mNodes.size();
+}
+
+BoundingBox TriangleBvh::Bounds()const
+{
+	if(mNodes.empty())
+		return BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+
+	const Node& root = mNodes[0];
+
+	XMFLOAT3 boxMin(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+	XMFLOAT3 boxMax(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+	for(UINT k = 0; k < 4; ++k)
+	{
+		if(root.MinX[k] > root.MaxX[k])
+			continue;
+
+		boxMin.x = MathHelper::Min(boxMin.x, root.MinX[k]);
+		boxMin.y = MathHelper::Min(boxMin.y, root.MinY[k]);
+		boxMin.z = MathHelper::Min(boxMin.z, root.MinZ[k]);
+		boxMax.x = MathHelper::Max(boxMax.x, root.MaxX[k]);
+		boxMax.y = MathHelper::Max(boxMax.y, root.MaxY[k]);
+		boxMax.z = MathHelper::Max(boxMax.z, root.MaxZ[k]);
+	}
+
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, XMLoadFloat3(&boxMin), XMLoadFloat3(&boxMax));
+
+	return box;
+}
+
+UINT TriangleBvh::LastVisitedNodeCount()const
+{
+	return mLastVisitedNodeCount;
+}
+
+UINT TriangleBvh::BuildNode(const Bvh& tree, UINT treeNode, UINT depth, const std::vector<XMFLOAT3>& corners)
+{
+	const auto& treeNodes = tree.Nodes();
+	mStackSize = MathHelper::Max(mStackSize, 3*depth + 4);
+
+	// Pull the grandchildren up: replace the interior child with the largest
+	// surface area by its two children until there are four.
+	UINT children[4] = { treeNode + 1, treeNodes[treeNode + 1].Skip, 0, 0 };
+	UINT childCount = 2;
+	while(childCount < 4)
+	{
+		int best = -1;
+		float bestArea = -1.0f;
+		for(UINT k = 0; k < childCount; ++k)
+		{
+			if(!IsLeaf(treeNodes, children[k]) && SurfaceArea(treeNodes[children[k]]) > bestArea)
+			{
+				best = (int)k;
+				bestArea = SurfaceArea(treeNodes[children[k]]);
+			}
+		}
+
+		if(best < 0)
+			break;
+
+		UINT opened = children[best];
+		children[best] = opened + 1;
+		children[childCount++] = treeNodes[opened + 1].Skip;
+	}
+
+	const UINT nodeIndex = (UINT)mNodes.size();
+	mNodes.emplace_back();
+
+	for(UINT k = 0; k < 4; ++k)
+	{
+		// Note: mNodes may be reallocated by the recursion.
+		UINT child = 0;
+		if(k < childCount)
+			child = IsLeaf(treeNodes, children[k]) ? BuildLeaf(tree, children[k], corners) : BuildNode(tree, children[k], depth + 1, corners);
+
+		Node& node = mNodes[nodeIndex];
+		node.Child[k] = child;
+
+		if(k < childCount)
+		{
+			const Bvh::Node& c = treeNodes[children[k]];
+			node.MinX[k] = c.Center.x - c.Extents.x;
+			node.MinY[k] = c.Center.y - c.Extents.y;
+			node.MinZ[k] = c.Center.z - c.Extents.z;
+			node.MaxX[k] = c.Center.x + c.Extents.x;
+			node.MaxY[k] = c.Center.y + c.Extents.y;
+			node.MaxZ[k] = c.Center.z + c.Extents.z;
+		}
+		else
+		{
+			node.MinX[k] = node.MinY[k] = node.MinZ[k] = +MathHelper::Infinity;
+			node.MaxX[k] = node.MaxY[k] = node.MaxZ[k] = -MathHelper::Infinity;
+		}
+	}
+
+	return nodeIndex;
+}
+
+UINT TriangleBvh::BuildLeaf(const Bvh& tree, UINT treeNode, const std::vector<XMFLOAT3>& corners)
+{
+	const Bvh::Node& leaf = tree.Nodes()[treeNode];
+	assert(leaf.Count <= MaxLeafTriangles);
+
+	const UINT firstPacket = (UINT)mPackets.size();
+	const UINT packetCount = (leaf.Count + 3) / 4;
+	assert(firstPacket <= LeafFirstMask);
+
+	for(UINT p = 0; p < packetCount; ++p)
+	{
+		TrianglePacket packet = {};
+		for(UINT lane = 0; lane < 4; ++lane)
+		{
+			UINT item = 4*p + lane;
+			if(item >= leaf.Count)
+			{
+				packet.Triangle[lane] = UnusedLane;
+				continue;
+			}
+
+			UINT t = tree.Items()[leaf.First + item];
+			const XMFLOAT3& v0 = corners[3*t + 0];
+			const XMFLOAT3& v1 = corners[3*t + 1];
+			const XMFLOAT3& v2 = corners[3*t + 2];
+
+			packet.V0X[lane] = v0.x;
+			packet.V0Y[lane] = v0.y;
+			packet.V0Z[lane] = v0.z;
+			packet.E1X[lane] = v1.x - v0.x;
+			packet.E1Y[lane] = v1.y - v0.y;
+			packet.E1Z[lane] = v1.z - v0.z;
+			packet.E2X[lane] = v2.x - v0.x;
+			packet.E2Y[lane] = v2.y - v0.y;
+			packet.E2Z[lane] = v2.z - v0.z;
+			packet.Triangle[lane] = t;
+		}
+
+		mPackets.push_back(packet);
+	}
+
+	return LeafFlag | ((packetCount - 1) << LeafCountShift) | firstPacket;
+}
+
+bool TriangleBvh::RayCast(FXMVECTOR origin, FXMVECTOR dir, float maxDist, Hit& outHit)const
+{
+	mLastVisitedNodeCount = 0;
+
+	if(mNodes.empty())
+		return false;
+
+	XMFLOAT3 o, d;
+	XMStoreFloat3(&o, origin);
+	XMStoreFloat3(&d, dir);
+
+	const __m128 ox = _mm_set1_ps(o.x);
+	const __m128 oy = _mm_set1_ps(o.y);
+	const __m128 oz = _mm_set1_ps(o.z);
+	const __m128 dx = _mm_set1_ps(d.x);
+	const __m128 dy = _mm_set1_ps(d.y);
+	const __m128 dz = _mm_set1_ps(d.z);
+	const __m128 invX = _mm_set1_ps(SafeReciprocal(d.x));
+	const __m128 invY = _mm_set1_ps(SafeReciprocal(d.y));
+	const __m128 invZ = _mm_set1_ps(SafeReciprocal(d.z));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// Per axis, the slab the ray enters first: the min plane if the ray goes
+	// toward +axis.  Empty child boxes (min > max) then give tNear > tFar.
+	const bool posX = d.x >= 0.0f;
+	const bool posY = d.y >= 0.0f;
+	const bool posZ = d.z >= 0.0f;
+
+	float nearest = maxDist;
+	bool hit = false;
+	UINT visited = 0;
+
+	struct StackEntry
+	{
+		UINT Child;
+		float Dist;
+	};
+
+	// A degenerate tree can be deeper than the fixed stack allows; see mStackSize.
+	StackEntry fixedStack[StackSize];
+	std::vector<StackEntry> deepStack;
+	StackEntry* stack = fixedStack;
+	if(mStackSize > StackSize)
+	{
+		deepStack.resize(mStackSize);
+		stack = deepStack.data();
+	}
+
+	UINT stackSize = 0;
+	stack[stackSize++] = { 0, 0.0f };
+
+	while(stackSize > 0)
+	{
+		const StackEntry entry = stack[--stackSize];
+		if(entry.Dist > nearest)
+			continue;
+
+		if(entry.Child & LeafFlag)
+		{
+			const UINT first = entry.Child & LeafFirstMask;
+			const UINT count = ((entry.Child & ~LeafFlag) >> LeafCountShift) + 1;
+
+			for(UINT p = first; p < first + count; ++p)
+			{
+				const TrianglePacket& packet = mPackets[p];
+
+				const __m128 e1x = _mm_loadu_ps(packet.E1X);
+				const __m128 e1y = _mm_loadu_ps(packet.E1Y);
+				const __m128 e1z = _mm_loadu_ps(packet.E1Z);
+				const __m128 e2x = _mm_loadu_ps(packet.E2X);
+				const __m128 e2y = _mm_loadu_ps(packet.E2Y);
+				const __m128 e2z = _mm_loadu_ps(packet.E2Z);
+
+				// Moller-Trumbore for four triangles at once.
+				__m128 py, pz;
+				__m128 px = Cross(dx, dy, dz, e2x, e2y, e2z, py, pz);
+				__m128 det = Dot(e1x, e1y, e1z, px, py, pz);
+				__m128 invDet = _mm_div_ps(one, det);
+
+				__m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(packet.V0X));
+				__m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(packet.V0Y));
+				__m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(packet.V0Z));
+				__m128 u = _mm_mul_ps(Dot(sx, sy, sz, px, py, pz), invDet);
+
+				__m128 qy, qz;
+				__m128 qx = Cross(sx, sy, sz, e1x, e1y, e1z, qy, qz);
+				__m128 v = _mm_mul_ps(Dot(dx, dy, dz, qx, qy, qz), invDet);
+				__m128 t = _mm_mul_ps(Dot(e2x, e2y, e2z, qx, qy, qz), invDet);
+
+				// Degenerate triangles (and unused lanes) have det = 0 and fail here,
+				// as do the NaNs that produces.
+				__m128 valid = _mm_cmpneq_ps(det, zero);
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+				valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(nearest)));
+
+				int mask = _mm_movemask_ps(valid);
+				if(mask == 0)
+					continue;
+
+				alignas(16) float ts[4], us[4], vs[4];
+				_mm_store_ps(ts, t);
+				_mm_store_ps(us, u);
+				_mm_store_ps(vs, v);
+				for(UINT lane = 0; lane < 4; ++lane)
+				{
+					if((mask & (1 << lane)) && ts[lane] < nearest)
+					{
+						nearest = ts[lane];
+						outHit.Distance = ts[lane];
+						outHit.Triangle = packet.Triangle[lane];
+						outHit.U = us[lane];
+						outHit.V = vs[lane];
+						hit = true;
+					}
+				}
+			}
+
+			continue;
+		}
+
+		const Node& node = mNodes[entry.Child];
+		++visited;
+
+		// Slab test against the four child boxes.
+		__m128 tNearX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(posX ? node.MinX : node.MaxX), ox), invX);
+		__m128 tNearY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(posY ? node.MinY : node.MaxY), oy), invY);
+		__m128 tNearZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(posZ ? node.MinZ : node.MaxZ), oz), invZ);
+		__m128 tFarX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(posX ? node.MaxX : node.MinX), ox), invX);
+		__m128 tFarY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(posY ? node.MaxY : node.MinY), oy), invY);
+		__m128 tFarZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(posZ ? node.MaxZ : node.MinZ), oz), invZ);
+
+		__m128 tNear = _mm_max_ps(_mm_max_ps(tNearX, tNearY), _mm_max_ps(tNearZ, zero));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(tFarX, tFarY), _mm_min_ps(tFarZ, _mm_set1_ps(nearest)));
+
+		int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+		if(mask == 0)
+			continue;
+
+		alignas(16) float dists[4];
+		_mm_store_ps(dists, tNear);
+
+		// Push the children hit, furthest first, so the nearest is visited next.
+		StackEntry hits[4];
+		UINT hitCount = 0;
+		for(UINT k = 0; k < 4; ++k)
+		{
+			if(mask & (1 << k))
+				hits[hitCount++] = { node.Child[k], dists[k] };
+		}
+
+		std::sort(hits, hits + hitCount, [](const StackEntry& a, const StackEntry& b) { return a.Dist > b.Dist; });
+
+		assert(stackSize + hitCount <= mStackSize);
+		for(UINT k = 0; k < hitCount; ++k)
+			stack[stackSize++] = hits[k];
+	}
+
+	mLastVisitedNodeCount = visited;
+
+	return hit;
+}
+
+int TriangleBvh::RayCast4(const XMFLOAT3 origins[4], const XMFLOAT3 dirs[4],
+	const float maxDists[4], bool anyHit, Hit outHits[4])const
+{
+	if(mNodes.empty())
+		return 0;
+
+	const __m128 ox = _mm_setr_ps(origins[0].x, origins[1].x, origins[2].x, origins[3].x);
+	const __m128 oy = _mm_setr_ps(origins[0].y, origins[1].y, origins[2].y, origins[3].y);
+	const __m128 oz = _mm_setr_ps(origins[0].z, origins[1].z, origins[2].z, origins[3].z);
+	const __m128 dx = _mm_setr_ps(dirs[0].x, dirs[1].x, dirs[2].x, dirs[3].x);
+	const __m128 dy = _mm_setr_ps(dirs[0].y, dirs[1].y, dirs[2].y, dirs[3].y);
+	const __m128 dz = _mm_setr_ps(dirs[0].z, dirs[1].z, dirs[2].z, dirs[3].z);
+	const __m128 invX = _mm_setr_ps(SafeReciprocal(dirs[0].x), SafeReciprocal(dirs[1].x), SafeReciprocal(dirs[2].x), SafeReciprocal(dirs[3].x));
+	const __m128 invY = _mm_setr_ps(SafeReciprocal(dirs[0].y), SafeReciprocal(dirs[1].y), SafeReciprocal(dirs[2].y), SafeReciprocal(dirs[3].y));
+	const __m128 invZ = _mm_setr_ps(SafeReciprocal(dirs[0].z), SafeReciprocal(dirs[1].z), SafeReciprocal(dirs[2].z), SafeReciprocal(dirs[3].z));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 inactive = _mm_set1_ps(-1.0f);
+
+	// Per lane, whether the ray enters the slabs at the max planes.  The rays of
+	// a packet need not agree, so the near/far planes are selected per lane.
+	const __m128 negX = _mm_cmplt_ps(invX, zero);
+	const __m128 negY = _mm_cmplt_ps(invY, zero);
+	const __m128 negZ = _mm_cmplt_ps(invZ, zero);
+
+	// tMax is the search distance of each ray; a ray that is done (or inactive)
+	// has tMax < 0 so that no box or triangle passes for it.
+	__m128 tMax = _mm_loadu_ps(maxDists);
+	__m128 bestT = zero;
+	__m128 bestU = zero;
+	__m128 bestV = zero;
+	__m128i bestTriangle = _mm_setzero_si128();
+	int hitMask = 0;
+
+	struct StackEntry
+	{
+		UINT Child;
+		float Dist;
+	};
+
+	// A degenerate tree can be deeper than the fixed stack allows; see mStackSize.
+	StackEntry fixedStack[StackSize];
+	std::vector<StackEntry> deepStack;
+	StackEntry* stack = fixedStack;
+	if(mStackSize > StackSize)
+	{
+		deepStack.resize(mStackSize);
+		stack = deepStack.data();
+	}
+
+	UINT stackSize = 0;
+	stack[stackSize++] = { 0, 0.0f };
+
+	while(stackSize > 0)
+	{
+		// Furthest distance any ray still searches to.
+		__m128 tMaxAll = _mm_max_ps(tMax, _mm_shuffle_ps(tMax, tMax, _MM_SHUFFLE(2, 3, 0, 1)));
+		tMaxAll = _mm_max_ps(tMaxAll, _mm_shuffle_ps(tMaxAll, tMaxAll, _MM_SHUFFLE(1, 0, 3, 2)));
+		const float searchDist = _mm_cvtss_f32(tMaxAll);
+		if(searchDist < 0.0f)
+			break;
+
+		const StackEntry entry = stack[--stackSize];
+		if(entry.Dist > searchDist)
+			continue;
+
+		if(entry.Child & LeafFlag)
+		{
+			const UINT first = entry.Child & LeafFirstMask;
+			const UINT count = ((entry.Child & ~LeafFlag) >> LeafCountShift) + 1;
+
+			for(UINT p = first; p < first + count; ++p)
+			{
+				const TrianglePacket& packet = mPackets[p];
+
+				// One triangle against the four rays at a time.
+				for(UINT lane = 0; lane < 4; ++lane)
+				{
+					if(packet.Triangle[lane] == UnusedLane)
+						break;
+
+					const __m128 e1x = _mm_set1_ps(packet.E1X[lane]);
+					const __m128 e1y = _mm_set1_ps(packet.E1Y[lane]);
+					const __m128 e1z = _mm_set1_ps(packet.E1Z[lane]);
+					const __m128 e2x = _mm_set1_ps(packet.E2X[lane]);
+					const __m128 e2y = _mm_set1_ps(packet.E2Y[lane]);
+					const __m128 e2z = _mm_set1_ps(packet.E2Z[lane]);
+
+					__m128 py, pz;
+					__m128 px = Cross(dx, dy, dz, e2x, e2y, e2z, py, pz);
+					__m128 det = Dot(e1x, e1y, e1z, px, py, pz);
+					__m128 invDet = _mm_div_ps(one, det);
+
+					__m128 sx = _mm_sub_ps(ox, _mm_set1_ps(packet.V0X[lane]));
+					__m128 sy = _mm_sub_ps(oy, _mm_set1_ps(packet.V0Y[lane]));
+					__m128 sz = _mm_sub_ps(oz, _mm_set1_ps(packet.V0Z[lane]));
+					__m128 u = _mm_mul_ps(Dot(sx, sy, sz, px, py, pz), invDet);
+
+					__m128 qy, qz;
+					__m128 qx = Cross(sx, sy, sz, e1x, e1y, e1z, qy, qz);
+					__m128 v = _mm_mul_ps(Dot(dx, dy, dz, qx, qy, qz), invDet);
+					__m128 t = _mm_mul_ps(Dot(e2x, e2y, e2z, qx, qy, qz), invDet);
+
+					__m128 valid = _mm_cmpneq_ps(det, zero);
+					valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+					valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+					valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+					valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+					valid = _mm_and_ps(valid, _mm_cmplt_ps(t, tMax));
+
+					int mask = _mm_movemask_ps(valid);
+					if(mask == 0)
+						continue;
+
+					hitMask |= mask;
+					bestT = _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, bestT));
+					bestU = _mm_or_ps(_mm_and_ps(valid, u), _mm_andnot_ps(valid, bestU));
+					bestV = _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, bestV));
+
+					__m128i validI = _mm_castps_si128(valid);
+					bestTriangle = _mm_or_si128(
+						_mm_and_si128(validI, _mm_set1_epi32((int)packet.Triangle[lane])),
+						_mm_andnot_si128(validI, bestTriangle));
+
+					tMax = _mm_or_ps(_mm_and_ps(valid, anyHit ? inactive : t), _mm_andnot_ps(valid, tMax));
+				}
+			}
+
+			continue;
+		}
+
+		const Node& node = mNodes[entry.Child];
+
+		// Each child box against the four rays.
+		StackEntry hits[4];
+		UINT hitCount = 0;
+		for(UINT k = 0; k < 4; ++k)
+		{
+			const __m128 minX = _mm_set1_ps(node.MinX[k]);
+			const __m128 minY = _mm_set1_ps(node.MinY[k]);
+			const __m128 minZ = _mm_set1_ps(node.MinZ[k]);
+			const __m128 maxX = _mm_set1_ps(node.MaxX[k]);
+			const __m128 maxY = _mm_set1_ps(node.MaxY[k]);
+			const __m128 maxZ = _mm_set1_ps(node.MaxZ[k]);
+
+			__m128 tNearX = _mm_mul_ps(_mm_sub_ps(_mm_or_ps(_mm_and_ps(negX, maxX), _mm_andnot_ps(negX, minX)), ox), invX);
+			__m128 tNearY = _mm_mul_ps(_mm_sub_ps(_mm_or_ps(_mm_and_ps(negY, maxY), _mm_andnot_ps(negY, minY)), oy), invY);
+			__m128 tNearZ = _mm_mul_ps(_mm_sub_ps(_mm_or_ps(_mm_and_ps(negZ, maxZ), _mm_andnot_ps(negZ, minZ)), oz), invZ);
+			__m128 tFarX = _mm_mul_ps(_mm_sub_ps(_mm_or_ps(_mm_and_ps(negX, minX), _mm_andnot_ps(negX, maxX)), ox), invX);
+			__m128 tFarY = _mm_mul_ps(_mm_sub_ps(_mm_or_ps(_mm_and_ps(negY, minY), _mm_andnot_ps(negY, maxY)), oy), invY);
+			__m128 tFarZ = _mm_mul_ps(_mm_sub_ps(_mm_or_ps(_mm_and_ps(negZ, minZ), _mm_andnot_ps(negZ, maxZ)), oz), invZ);
+
+			__m128 tNear = _mm_max_ps(_mm_max_ps(tNearX, tNearY), _mm_max_ps(tNearZ, zero));
+			__m128 tFar = _mm_min_ps(_mm_min_ps(tFarX, tFarY), _mm_min_ps(tFarZ, tMax));
+
+			__m128 enter = _mm_cmple_ps(tNear, tFar);
+			if(_mm_movemask_ps(enter) == 0)
+				continue;
+
+			// Order the children by the nearest entry of any ray.
+			__m128 dist = _mm_or_ps(_mm_and_ps(enter, tNear), _mm_andnot_ps(enter, _mm_set1_ps(MathHelper::Infinity)));
+			dist = _mm_min_ps(dist, _mm_shuffle_ps(dist, dist, _MM_SHUFFLE(2, 3, 0, 1)));
+			dist = _mm_min_ps(dist, _mm_shuffle_ps(dist, dist, _MM_SHUFFLE(1, 0, 3, 2)));
+
+			hits[hitCount++] = { node.Child[k], _mm_cvtss_f32(dist) };
+		}
+
+		std::sort(hits, hits + hitCount, [](const StackEntry& a, const StackEntry& b) { return a.Dist > b.Dist; });
+
+		assert(stackSize + hitCount <= mStackSize);
+		for(UINT k = 0; k < hitCount; ++k)
+			stack[stackSize++] = hits[k];
+	}
+
+	if(hitMask == 0)
+		return 0;
+
+	alignas(16) float ts[4], us[4], vs[4];
+	alignas(16) UINT triangles[4];
+	_mm_store_ps(ts, bestT);
+	_mm_store_ps(us, bestU);
+	_mm_store_ps(vs, bestV);
+	_mm_store_si128((__m128i*)triangles, bestTriangle);
+	for(UINT lane = 0; lane < 4; ++lane)
+	{
+		if(hitMask & (1 << lane))
+		{
+			outHits[lane].Distance = ts[lane];
+			outHits[lane].Triangle = triangles[lane];
+			outHits[lane].U = us[lane];
+			outHits[lane].V = vs[lane];
+		}
+	}
+
+	return hitMask;
+}
@@ -0,0 +1,140 @@
+//***************************************************************************************
+// TriangleBvh.h - Triangle bounding volume hierarchy for ray casts against a mesh
+//
+// Accelerates ray/triangle queries (picking, ray casts against a mesh) so that they
+// visit a few dozen triangles instead of all of them.
+//   -The tree is built with the binned SAH builder of Bvh over the triangle boxes
+//    and then collapsed to a four wide tree: every node holds the boxes of up to
+//    four children in structure-of-arrays form, so one SSE test handles all four.
+//   -Leaf triangles are stored in packets of four, as one vertex and two edges in
+//    structure-of-arrays form, for a four wide Moller-Trumbore intersection test.
+//   -Children are visited nearest first and the search distance shrinks with
+//    every hit, so the nearest hit prunes everything behind it.
+//   -RayCast4() traverses packets of four rays, with the rays in the SIMD lanes.
+//   -Refit() updates the tree for deformed vertices (skinning) without a rebuild.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <vector>
+
+class Bvh;
+
+class TriangleBvh
+{
+public:
+	struct Hit
+	{
+		// Distance along the ray in units of |dir|.
+		float Distance = 0.0f;
+
+		// Index of the triangle in the index list the tree was built from.
+		UINT Triangle = 0;
+
+		// Barycentric coordinates of the hit point: weights of the second and third
+		// vertex; the first vertex has weight 1 - U - V.
+		float U = 0.0f;
+		float V = 0.0f;
+	};
+
+	TriangleBvh() = default;
+	TriangleBvh(const TriangleBvh& rhs) = delete;
+	TriangleBvh& operator=(const TriangleBvh& rhs) = delete;
+	~TriangleBvh() = default;
+
+	// Build over the triangle list given by triangleCount*3 indices (offset by
+	// baseVertex) into the positions.  positions points to the first position and
+	// consecutive positions are positionStride bytes apart.  Any previous tree is
+	// discarded.
+	void Build(const void* positions, UINT positionStride,
+		const std::uint32_t* indices, UINT triangleCount, int baseVertex = 0);
+
+	// Move the triangles to new vertex positions (same layout as in Build, e.g.,
+	// a skinned pose) and refit the node boxes bottom up instead of rebuilding.
+	// The tree structure is kept, so queries slow down as the positions drift
+	// far from the ones the tree was built for; Build again then.
+	void Refit(const void* positions, UINT positionStride);
+
+	void Clear();
+
+	UINT TriangleCount()const;
+	UINT NodeCount()const;
+	DirectX::BoundingBox Bounds()const;
+
+	// Find the nearest triangle the ray hits within [0, maxDist].  dir need not be
+	// normalized.  Both sides of the triangles are hit.  Returns false on a miss.
+	bool RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist, Hit& outHit)const;
+
+	// Cast a packet of four rays through the tree together: a node is visited
+	// once for all rays that enter it, and each box and triangle is tested against
+	// the four rays in one go.  Works best for coherent rays, e.g., with the same
+	// direction signs (see RayQuery).  Lanes with maxDists[i] < 0 are inactive.
+	// With anyHit a ray stops at the first hit found instead of the nearest.
+	// Returns a bitmask of the rays that hit; outHits is written for those.
+	// Unlike RayCast() it keeps no state, so threads may call it concurrently.
+	int RayCast4(const DirectX::XMFLOAT3 origins[4], const DirectX::XMFLOAT3 dirs[4],
+		const float maxDists[4], bool anyHit, Hit outHits[4])const;
+
+	// Number of nodes visited by the last query; handy for profiling.
+	UINT LastVisitedNodeCount()const;
+
+private:
+	// Four child boxes in structure-of-arrays form.  A child is either another
+	// node or a range of triangle packets (LeafFlag set); unused children have
+	// empty boxes (min > max) which no ray hits.
+	struct Node
+	{
+		float MinX[4];
+		float MinY[4];
+		float MinZ[4];
+		float MaxX[4];
+		float MaxY[4];
+		float MaxZ[4];
+		UINT Child[4];
+	};
+
+	// Four triangles as first vertex and two edges; unused lanes are degenerate
+	// and have Triangle = UnusedLane.
+	struct TrianglePacket
+	{
+		float V0X[4];
+		float V0Y[4];
+		float V0Z[4];
+		float E1X[4];
+		float E1Y[4];
+		float E1Z[4];
+		float E2X[4];
+		float E2Y[4];
+		float E2Z[4];
+		UINT Triangle[4];
+	};
+
+	static const UINT LeafFlag = 0x80000000;
+	static const UINT LeafCountShift = 27;
+	static const UINT LeafFirstMask = (1u << LeafCountShift) - 1;
+	static const UINT MaxLeafTriangles = 16;
+	static const UINT StackSize = 128;
+	static const UINT UnusedLane = 0xffffffff;
+
+	UINT BuildNode(const Bvh& tree, UINT treeNode, UINT depth, const std::vector<DirectX::XMFLOAT3>& corners);
+	UINT BuildLeaf(const Bvh& tree, UINT treeNode, const std::vector<DirectX::XMFLOAT3>& corners);
+
+private:
+	std::vector<Node> mNodes;
+	std::vector<TrianglePacket> mPackets;
+	UINT mTriangleCount = 0;
+
+	// Traversal stack entries the tree needs: a node at depth d is visited with at
+	// most 3 pending siblings per level above it, and pushes up to 4 children, so
+	// 3*d + 4 for the deepest node.  Queries use a fixed array of StackSize entries
+	// and fall back to the heap for trees deeper than that.
+	UINT mStackSize = 0;
+
+	// Index list the tree was built from, kept for Refit().
+	std::vector<std::uint32_t> mIndices;
+	int mBaseVertex = 0;
+
+	mutable UINT mLastVisitedNodeCount = 0;
+};
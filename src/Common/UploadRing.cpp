@@ -0,0 +1,110 @@
+//***************************************************************************************
+// UploadRing.cpp - Per frame linear allocator over one persistently mapped upload buffer
+//***************************************************************************************
+
+#include "UploadRing.h"
+#include <algorithm>
+#include <cassert>
+
+UploadRing::UploadRing(RenderDevice* device, std::uint64_t capacity) :
+	mDevice(device)
+{
+	assert(capacity > 0);
+
+	mCapacity = (capacity + ConstantBufferAlignment - 1) & ~(ConstantBufferAlignment - 1);
+	mBuffer = mDevice->CreateBuffer(mCapacity, RenderHeap::Upload);
+	mMappedData = mBuffer->MappedData();
+	assert(mMappedData != nullptr);
+
+	mStats.Capacity = mCapacity;
+}
+
+void UploadRing::BeginFrame(std::uint64_t completedFence)
+{
+	while(!mFrames.empty() && mFrames.front().Fence <= completedFence)
+	{
+		mTail = mFrames.front().End;
+		mFrames.pop_front();
+	}
+
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+		[completedFence](const RetiredBuffer& r) { return r.Fence != 0 && r.Fence <= completedFence; }),
+		mRetired.end());
+
+	mFrameStart = mHead;
+	mStats.FrameBytes = 0;
+	mStats.InFlightBytes = mHead - mTail;
+}
+
+void UploadRing::EndFrame(std::uint64_t fence)
+{
+	assert(fence != 0);
+
+	mFrames.push_back({ fence, mHead });
+
+	for(auto& r : mRetired)
+	{
+		if(r.Fence == 0)
+			r.Fence = fence;
+	}
+}
+
+UploadRing::Allocation UploadRing::Allocate(std::uint64_t byteSize, std::uint64_t alignment)
+{
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	assert(alignment <= ConstantBufferAlignment);
+
+	byteSize = std::max<std::uint64_t>(byteSize, 1);
+
+	std::uint64_t offset = mHead % mCapacity;
+	std::uint64_t start = (offset + alignment - 1) & ~(alignment - 1);
+
+	// An allocation never wraps; skip the end of the buffer instead.
+	if(start + byteSize > mCapacity)
+		start = mCapacity;
+
+	std::uint64_t newHead = mHead + (start - offset) + byteSize;
+	if(newHead - mTail > mCapacity)
+	{
+		Grow(byteSize);
+		return Allocate(byteSize, alignment);
+	}
+
+	mStats.FrameBytes += newHead - mHead;
+	mStats.InFlightBytes += newHead - mHead;
+	mHead = newHead;
+
+	Allocation a;
+	a.Buffer = mBuffer.get();
+	a.Offset = start % mCapacity;
+	a.Size = byteSize;
+	a.Address = mBuffer->GetGpuAddress() + a.Offset;
+	a.CpuAddress = mMappedData + a.Offset;
+	return a;
+}
+
+void UploadRing::Grow(std::uint64_t minCapacity)
+{
+	// The frames in flight still read the old buffer; free it with the last of them.
+	// So does this frame, if it allocated from it; then the fence is set in EndFrame().
+	mRetired.push_back({ std::move(mBuffer), 0 });
+	if(!mFrames.empty() && mHead == mFrameStart)
+		mRetired.back().Fence = mFrames.back().Fence;
+
+	std::uint64_t capacity = std::max<std::uint64_t>(2*mCapacity, minCapacity);
+	mCapacity = (capacity + ConstantBufferAlignment - 1) & ~(ConstantBufferAlignment - 1);
+	mBuffer = mDevice->CreateBuffer(mCapacity, RenderHeap::Upload);
+	mMappedData = mBuffer->MappedData();
+
+	mFrames.clear();
+	mHead = mTail = mFrameStart = 0;
+
+	mStats.Capacity = mCapacity;
+	mStats.InFlightBytes = 0;
+	mStats.GrowCount++;
+}
+
+const UploadRing::Stats& UploadRing::GetStats()const
+{
+	return mStats;
+}
@@ -0,0 +1,108 @@
+//***************************************************************************************
+// UploadRing.h - Per frame linear allocator over one persistently mapped upload buffer
+//
+// Replaces the fixed UploadBuffer arrays of a FrameResource, sized up front for the
+// most objects a frame could have, with suballocations from a single ring that all
+// frames share:
+//   -Allocate() bumps a pointer; any size and power of two alignment.  It returns
+//    the GPU virtual address and the CPU address to write to.
+//   -EndFrame() records where the frame ended and the fence value it is signaled
+//    with; BeginFrame() frees the frames whose fence the GPU has passed.
+//   -If the frames in flight do not fit, a buffer twice as large is created and the
+//    old one is released once its last frame completes.
+// A frame only takes the bytes it writes, so the object count can change freely.
+// Constant buffer views must start at a multiple of 256 bytes; use PushConstants().
+//***************************************************************************************
+
+#pragma once
+
+#include "RenderDevice.h"
+#include <cstring>
+#include <deque>
+#include <vector>
+
+class UploadRing
+{
+public:
+	struct Allocation
+	{
+		RenderBuffer* Buffer = nullptr;
+		std::uint64_t Offset = 0;
+		std::uint64_t Size = 0;
+		GpuAddress Address = 0;
+		std::uint8_t* CpuAddress = nullptr;
+	};
+
+	struct Stats
+	{
+		std::uint64_t Capacity = 0;
+		std::uint64_t FrameBytes = 0;       // Allocated since BeginFrame(), with padding.
+		std::uint64_t InFlightBytes = 0;    // Not yet freed in the current buffer.
+		std::uint32_t GrowCount = 0;
+	};
+
+	static const std::uint64_t ConstantBufferAlignment = 256;
+
+	UploadRing(RenderDevice* device, std::uint64_t capacity);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing() = default;
+
+	// completedFence is the fence's completed value.
+	void BeginFrame(std::uint64_t completedFence);
+	void EndFrame(std::uint64_t fence);
+
+	Allocation Allocate(std::uint64_t byteSize, std::uint64_t alignment);
+
+	// Copies data to a new allocation and returns its GPU address.
+	template<typename T>
+	GpuAddress Push(const T& data)
+	{
+		Allocation a = Allocate(sizeof(T), alignof(T));
+		memcpy(a.CpuAddress, &data, sizeof(T));
+		return a.Address;
+	}
+
+	template<typename T>
+	GpuAddress PushConstants(const T& data)
+	{
+		Allocation a = Allocate(sizeof(T), ConstantBufferAlignment);
+		memcpy(a.CpuAddress, &data, sizeof(T));
+		return a.Address;
+	}
+
+	const Stats& GetStats()const;
+
+private:
+	void Grow(std::uint64_t minCapacity);
+
+private:
+	struct Frame
+	{
+		std::uint64_t Fence;
+		std::uint64_t End;      // mHead when the frame ended.
+	};
+
+	struct RetiredBuffer
+	{
+		std::unique_ptr<RenderBuffer> Buffer;
+		std::uint64_t Fence;    // 0 until the frame that retired it ends.
+	};
+
+	RenderDevice* mDevice;
+
+	std::unique_ptr<RenderBuffer> mBuffer;
+	std::uint8_t* mMappedData = nullptr;
+	std::uint64_t mCapacity = 0;
+
+	// Byte positions that only grow; the offset in the buffer is modulo mCapacity.
+	// [mTail, mHead) is in use.
+	std::uint64_t mHead = 0;
+	std::uint64_t mTail = 0;
+	std::uint64_t mFrameStart = 0;
+
+	std::deque<Frame> mFrames;
+	std::vector<RetiredBuffer> mRetired;
+
+	Stats mStats;
+};
@@ -0,0 +1,191 @@
+//***************************************************************************************
+// VisibilityCache.cpp - Temporal-coherence visibility caching for frustum culling
+//***************************************************************************************
+
+#include "VisibilityCache.h"
+#include <cassert>
+
+using namespace DirectX;
+
+void VisibilityCache::Resize(UINT objectCount)
+{
+	mCenterX.assign(objectCount, 0.0f);
+	mCenterY.assign(objectCount, 0.0f);
+	mCenterZ.assign(objectCount, 0.0f);
+	mRadius.assign(objectCount, 0.0f);
+
+	mState.assign(objectCount, Untested);
+	mMargin.assign(objectCount, 0.0f);
+	mEyeDist.assign(objectCount, 0.0f);
+	mTestedFrame.assign(objectCount, 0);
+}
+
+UINT VisibilityCache::ObjectCount()const
+{
+	return (UINT)mState.size();
+}
+
+void VisibilityCache::SetBounds(UINT index, const BoundingSphere& worldSphere)
+{
+	assert(index < ObjectCount());
+
+	mCenterX[index] = worldSphere.Center.x;
+	mCenterY[index] = worldSphere.Center.y;
+	mCenterZ[index] = worldSphere.Center.z;
+	mRadius[index] = worldSphere.Radius;
+
+	mState[index] = Untested;
+}
+
+void VisibilityCache::Invalidate(UINT index)
+{
+	assert(index < ObjectCount());
+
+	mState[index] = Untested;
+}
+
+void VisibilityCache::InvalidateAll()
+{
+	std::fill(mState.begin(), mState.end(), (BYTE)Untested);
+}
+
+void VisibilityCache::SetMaxReuseFrames(UINT maxFrames)
+{
+	// We need the pose of every frame a reusable result may come from.
+	mMaxReuseFrames = MathHelper::Min(maxFrames, PoseHistorySize - 1);
+}
+
+void VisibilityCache::SetSafetyMargin(float margin)
+{
+	mSafetyMargin = margin;
+}
+
+const VisibilityCache::Stats& VisibilityCache::GetStats()const
+{
+	return mStats;
+}
+
+UINT VisibilityCache::Cull(const std::array<XMFLOAT4, 6>& planes, FXMVECTOR eyePosW, UINT* outVisible)
+{
+	++mFrame;
+
+	Pose& pose = mPoseHistory[mFrame % PoseHistorySize];
+	pose.Planes = planes;
+	XMStoreFloat3(&pose.EyePosW, eyePosW);
+	for(int p = 0; p < 6; ++p)
+	{
+		const XMFLOAT4& n = planes[p];
+		pose.Offsets[p] = n.w + n.x*pose.EyePosW.x + n.y*pose.EyePosW.y + n.z*pose.EyePosW.z;
+	}
+
+	//
+	// Bound how much the camera moved since each of the frames a cached result
+	// can come from.  This is per frame work, independent of the object count.
+	//
+
+	const UINT maxAge = MathHelper::Min(mMaxReuseFrames, mFrame - 1);
+
+	float normalDelta[PoseHistorySize];
+	float offsetDelta[PoseHistorySize];
+	for(UINT age = 0; age <= maxAge; ++age)
+	{
+		const Pose& old = mPoseHistory[(mFrame - age) % PoseHistorySize];
+
+		float dn = 0.0f;
+		float dk = 0.0f;
+		for(int p = 0; p < 6; ++p)
+		{
+			XMVECTOR n0 = XMLoadFloat4(&old.Planes[p]);
+			XMVECTOR n1 = XMLoadFloat4(&pose.Planes[p]);
+			dn = MathHelper::Max(dn, XMVectorGetX(XMVector3Length(n1 - n0)));
+			dk = MathHelper::Max(dk, fabsf(pose.Offsets[p] - old.Offsets[p]));
+		}
+
+		XMVECTOR e0 = XMLoadFloat3(&old.EyePosW);
+		XMVECTOR e1 = XMLoadFloat3(&pose.EyePosW);
+
+		normalDelta[age] = dn;
+		offsetDelta[age] = dk + XMVectorGetX(XMVector3Length(e1 - e0)) + mSafetyMargin;
+	}
+
+	//
+	// Reuse what we can, retest the rest.
+	//
+
+	mStats = Stats();
+	mStats.ObjectCount = ObjectCount();
+
+	UINT visibleCount = 0;
+	for(UINT i = 0; i < ObjectCount(); ++i)
+	{
+		const UINT age = mFrame - mTestedFrame[i];
+
+		bool retest = mState[i] == Untested || mState[i] == Intersecting || age > maxAge;
+		if(!retest)
+			retest = normalDelta[age]*mEyeDist[i] + offsetDelta[age] >= mMargin[i];
+
+		if(retest)
+		{
+			Test(i, pose);
+			mStats.RetestedCount++;
+		}
+		else
+		{
+			mStats.ReusedCount++;
+		}
+
+		if(mState[i] != Outside)
+			outVisible[visibleCount++] = i;
+	}
+
+	mStats.VisibleCount = visibleCount;
+
+	return visibleCount;
+}
+
+void VisibilityCache::Test(UINT index, const Pose& pose)
+{
+	const float cx = mCenterX[index];
+	const float cy = mCenterY[index];
+	const float cz = mCenterZ[index];
+	const float r = mRadius[index];
+
+	float insideMargin = MathHelper::Infinity;
+	float outsideMargin = -MathHelper::Infinity;
+	bool intersecting = false;
+	for(int p = 0; p < 6; ++p)
+	{
+		const XMFLOAT4& n = pose.Planes[p];
+		float d = n.x*cx + n.y*cy + n.z*cz + n.w;
+
+		if(d + r < 0.0f)
+			outsideMargin = MathHelper::Max(outsideMargin, -(d + r));
+		else if(d - r < 0.0f)
+			intersecting = true;
+		else
+			insideMargin = MathHelper::Min(insideMargin, d - r);
+	}
+
+	if(outsideMargin >= 0.0f)
+	{
+		// Stays outside as long as the most rejecting plane still rejects it.
+		mState[index] = Outside;
+		mMargin[index] = outsideMargin;
+	}
+	else if(intersecting)
+	{
+		mState[index] = Intersecting;
+		mMargin[index] = 0.0f;
+	}
+	else
+	{
+		mState[index] = Inside;
+		mMargin[index] = insideMargin;
+	}
+
+	float dx = cx - pose.EyePosW.x;
+	float dy = cy - pose.EyePosW.y;
+	float dz = cz - pose.EyePosW.z;
+	mEyeDist[index] = sqrtf(dx*dx + dy*dy + dz*dz) + r;
+	mTestedFrame[index] = mFrame;
+}
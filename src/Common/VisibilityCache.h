@@ -0,0 +1,105 @@
+//***************************************************************************************
+// VisibilityCache.h - Temporal-coherence visibility caching for frustum culling
+//
+// Remembers, per object, the result of its last frustum test together with how
+// far the bounding sphere was from changing classification (its margin) and the
+// camera pose the test used.  While the camera has moved too little to close
+// that margin the result is reused instead of retesting.
+//   -For a plane n.p + w with eye e, the distance of a point p changes by at most
+//    |n' - n| * |p - e| + |e' - e| + |k' - k| when the camera moves to the pose
+//    n', w', e', where k = w + n.e is the plane offset relative to the eye (0 for
+//    the side planes).  The cache evaluates this bound per object in a few flops.
+//   -Objects straddling a plane have no margin and are retested every frame, as
+//    are objects whose bounds changed and results older than MaxReuseFrames.
+//***************************************************************************************
+
+#pragma once
+
+#include "MathHelper.h"
+#include <DirectXCollision.h>
+#include <array>
+#include <vector>
+
+class VisibilityCache
+{
+public:
+	struct Stats
+	{
+		UINT ObjectCount = 0;
+		UINT RetestedCount = 0;
+		UINT ReusedCount = 0;
+		UINT VisibleCount = 0;
+	};
+
+	VisibilityCache() = default;
+	VisibilityCache(const VisibilityCache& rhs) = delete;
+	VisibilityCache& operator=(const VisibilityCache& rhs) = delete;
+	~VisibilityCache() = default;
+
+	// Set the number of objects.  Every object starts out untested.
+	void Resize(UINT objectCount);
+	UINT ObjectCount()const;
+
+	// Set the world space bounds of an object.  Call whenever it moves; this
+	// invalidates its cached result.
+	void SetBounds(UINT index, const DirectX::BoundingSphere& worldSphere);
+	void Invalidate(UINT index);
+	void InvalidateAll();
+
+	// Cached results are retested at least every maxFrames frames.
+	void SetMaxReuseFrames(UINT maxFrames);
+
+	// Extra distance, in world units, an object must keep from a plane for its
+	// result to be reused.
+	void SetSafetyMargin(float margin);
+
+	// Cull against the world space planes of the camera at eyePosW and write the
+	// indices of the visible objects to outVisible (room for ObjectCount() indices).
+	// Call once per frame.  Returns the number of visible objects.
+	UINT Cull(const std::array<DirectX::XMFLOAT4, 6>& planes, DirectX::FXMVECTOR eyePosW, UINT* outVisible);
+
+	const Stats& GetStats()const;
+
+private:
+	enum State : BYTE
+	{
+		Untested = 0,
+		Inside,
+		Outside,
+		Intersecting
+	};
+
+	struct Pose
+	{
+		std::array<DirectX::XMFLOAT4, 6> Planes;
+		std::array<float, 6> Offsets; // k = w + n.e per plane.
+		DirectX::XMFLOAT3 EyePosW;
+	};
+
+	void Test(UINT index, const Pose& pose);
+
+private:
+	static const UINT PoseHistorySize = 64;
+
+	UINT mMaxReuseFrames = 16;
+	float mSafetyMargin = 0.1f;
+
+	UINT mFrame = 0;
+	std::array<Pose, PoseHistorySize> mPoseHistory;
+
+	// Bounds, in structure-of-arrays form.
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mRadius;
+
+	// Cached results: state, margin to the nearest classification change,
+	// furthest distance of the sphere from the eye it was tested from, and
+	// the frame of the test.
+	std::vector<BYTE> mState;
+	std::vector<float> mMargin;
+	std::vector<float> mEyeDist;
+	std::vector<UINT> mTestedFrame;
+
+	Stats mStats;
+};
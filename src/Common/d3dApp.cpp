@@ -3,6 +3,7 @@
 //***************************************************************************************
 
 #include "d3dApp.h"
+#include "Profiler.h"
 #include <WindowsX.h>
 
 using Microsoft::WRL::ComPtr;
@@ -75,6 +76,8 @@ int D3DApp::Run()
  
 	mTimer.Reset();
 
+	PROFILE_THREAD_NAME("Main");
+
 	while(msg.message != WM_QUIT)
 	{
 		// If there are Window messages then process them.
@@ -90,9 +93,21 @@ int D3DApp::Run()
 
 			if( !mAppPaused )
 			{
+#if PROFILER_ENABLED
+				// A finished capture also dumps the per scope stats.
+				if(Profiler::Get().NextFrame(mTimer.DeltaTime()))
+					OutputDebugStringA(Profiler::Get().FormatStats().c_str());
+#endif
+
 				CalculateFrameStats();
-				Update(mTimer);	
-                Draw(mTimer);
+				{
+					PROFILE_SCOPE("Update");
+					Update(mTimer);
+				}
+				{
+					PROFILE_SCOPE("Draw");
+					Draw(mTimer);
+				}
 			}
 			else
 			{
@@ -365,6 +380,11 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         }
         else if((int)wParam == VK_F2)
             Set4xMsaaState(!m4xMsaaState);
+#if PROFILER_ENABLED
+        // Write the next 120 frames as a Chrome trace.
+        else if((int)wParam == VK_F3)
+            Profiler::Get().CaptureFrames(120, "profile.json");
+#endif
 
         return 0;
 	}
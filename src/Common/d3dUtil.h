@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <vector>
 #include <array>
+#include <tuple>
 #include <unordered_map>
 #include <cstdint>
 #include <fstream>
@@ -28,6 +29,7 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "Light.h"
 
 extern const int gNumFrameResources;
 
@@ -126,6 +128,21 @@ public:
 		const D3D_SHADER_MACRO* defines,
 		const std::string& entrypoint,
 		const std::string& target);
+
+    // Keys for DrawQueue::SortRuns() and ForEachRun(): render items with equal keys
+    // draw the same mesh (and material) and can be drawn as one instanced draw.
+    template<typename RenderItem>
+    static std::tuple<std::uintptr_t, UINT, int, UINT, UINT> MeshKey(const RenderItem* ri)
+    {
+        return std::make_tuple((std::uintptr_t)ri->Geo, ri->StartIndexLocation,
+            ri->BaseVertexLocation, ri->IndexCount, (UINT)ri->PrimitiveType);
+    }
+
+    template<typename RenderItem>
+    static std::tuple<std::uintptr_t, UINT, int, UINT, UINT, std::uintptr_t> MeshMaterialKey(const RenderItem* ri)
+    {
+        return std::tuple_cat(MeshKey(ri), std::make_tuple((std::uintptr_t)ri->Mat));
+    }
 };
 
 class DxException
@@ -212,18 +229,6 @@ struct MeshGeometry
 	}
 };
 
-struct Light
-{
-    DirectX::XMFLOAT3 Strength = { 0.5f, 0.5f, 0.5f };
-    float FalloffStart = 1.0f;                          // point/spot light only
-    DirectX::XMFLOAT3 Direction = { 0.0f, -1.0f, 0.0f };// directional/spot light only
-    float FalloffEnd = 10.0f;                           // point/spot light only
-    DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };  // point/spot light only
-    float SpotPower = 64.0f;                            // spot light only
-};
-
-#define MaxLights 16
-
 struct MaterialConstants
 {
 	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };